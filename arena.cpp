@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include "arena.hpp"
+
+namespace cshanty{
+
+static const size_t FIRST_CHUNK_SIZE = 64 * 1024;
+static const size_t MAX_CHUNK_SIZE = 4 * 1024 * 1024;
+
+/*
+Kind ids are handed out once per type for the whole process, so the
+table of names is shared (and guarded) while each arena only keeps
+a vector of counters indexed by kind.
+*/
+static std::mutex kindsLock;
+static std::vector<std::string> & kindNames(){
+	static std::vector<std::string> names;
+	return names;
+}
+
+static std::string prettyKindName(const char * mangledName){
+	int status = 0;
+	char * demangled = abi::__cxa_demangle(mangledName,
+		nullptr, nullptr, &status);
+	std::string name = (status == 0) ? demangled : mangledName;
+	std::free(demangled);
+
+	for (const std::string ns : {"cshanty::", "__cxx11::"}){
+		for (size_t at = name.find(ns); at != std::string::npos;
+		  at = name.find(ns, at)){
+			name.erase(at, ns.length());
+		}
+	}
+	return name;
+}
+
+size_t Arena::registerKind(const char * mangledName){
+	std::lock_guard<std::mutex> guard(kindsLock);
+	kindNames().push_back(prettyKindName(mangledName));
+	return kindNames().size() - 1;
+}
+
+Arena::Arena()
+: myCur(0), myEnd(0), myNextChunkSize(FIRST_CHUNK_SIZE),
+  myCleanups(nullptr){
+}
+
+Arena::~Arena(){
+	for (Cleanup * c = myCleanups; c != nullptr; c = c->next){
+		c->fn(c->obj);
+	}
+	for (auto chunk : myChunks){
+		::operator delete(chunk.first);
+	}
+}
+
+void * Arena::allocateSlow(size_t size, size_t align){
+	size_t needed = size + align;
+	size_t chunkSize = myNextChunkSize;
+	if (needed > chunkSize / 4){
+		//Oversized requests get a chunk of their own so that
+		// the current chunk keeps serving small nodes
+		char * own = static_cast<char *>(::operator new(needed));
+		myChunks.push_back(std::make_pair(own, needed));
+		uintptr_t raw = reinterpret_cast<uintptr_t>(own);
+		uintptr_t start = (raw + align - 1) & ~(align - 1);
+		return reinterpret_cast<void *>(start);
+	}
+
+	char * chunk = static_cast<char *>(::operator new(chunkSize));
+	myChunks.push_back(std::make_pair(chunk, chunkSize));
+	if (myNextChunkSize < MAX_CHUNK_SIZE){ myNextChunkSize *= 2; }
+
+	myCur = reinterpret_cast<uintptr_t>(chunk);
+	myEnd = myCur + chunkSize;
+	uintptr_t start = (myCur + align - 1) & ~(align - 1);
+	myCur = start + size;
+	return reinterpret_cast<void *>(start);
+}
+
+void Arena::addCleanup(void * obj, void (*fn)(void *)){
+	Cleanup * c = static_cast<Cleanup *>(allocate(sizeof(Cleanup),
+		alignof(Cleanup), kindOf<Cleanup>()));
+	c->obj = obj;
+	c->fn = fn;
+	c->next = myCleanups;
+	myCleanups = c;
+}
+
+size_t Arena::bytesUsed() const{
+	size_t total = 0;
+	for (auto usage : myUsage){ total += usage.bytes; }
+	return total;
+}
+
+size_t Arena::bytesReserved() const{
+	size_t total = 0;
+	for (auto chunk : myChunks){ total += chunk.second; }
+	return total;
+}
+
+void Arena::reportUsage(std::ostream& out) const{
+	std::vector<std::pair<std::string, Usage>> rows;
+	{
+		std::lock_guard<std::mutex> guard(kindsLock);
+		for (size_t k = 0; k < myUsage.size(); k++){
+			if (myUsage[k].objects == 0){ continue; }
+			rows.push_back(std::make_pair(kindNames()[k], myUsage[k]));
+		}
+	}
+	std::sort(rows.begin(), rows.end(),
+		[](const std::pair<std::string, Usage>& a,
+		   const std::pair<std::string, Usage>& b){
+			return a.second.bytes > b.second.bytes;
+		});
+
+	out << "Arena: " << bytesUsed() << " bytes used, "
+	<< bytesReserved() << " reserved in "
+	<< myChunks.size() << " chunks\n";
+	for (auto row : rows){
+		out << "  " << std::left << std::setw(40) << row.first
+		<< std::right << std::setw(10) << row.second.objects
+		<< " objects" << std::setw(12) << row.second.bytes
+		<< " bytes\n";
+	}
+}
+
+}
@@ -0,0 +1,141 @@
+#ifndef CSHANTY_ARENA_H
+#define CSHANTY_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace cshanty{
+
+/**
+* \class Arena
+* Bump allocator that owns every object built by one compilation:
+* positions, tokens, AST nodes and the lists that hold them. Nothing
+* allocated here is freed individually; destroying the arena runs the
+* destructors that matter (e.g. for std::string members) and then
+* releases all of its chunks at once.
+**/
+class Arena{
+public:
+	Arena();
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	/** Construct a T in the arena, charging its size to T's kind **/
+	template <typename T, typename... Args>
+	T * make(Args&&... args){
+		void * mem = allocate(sizeof(T), alignof(T), kindOf<T>());
+		T * obj = new (mem) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value){
+			addCleanup(obj, &destroy<T>);
+		}
+		return obj;
+	}
+
+	/** Copy len characters of text into the arena **/
+	const char * copy(const char * text, size_t len){
+		char * mem = static_cast<char *>(
+			allocate(len, 1, kindOf<char>()));
+		std::memcpy(mem, text, len);
+		return mem;
+	}
+
+	/** Raw storage, charged to the given kind (see kindOf) **/
+	void * allocate(size_t size, size_t align, size_t kind){
+		if (kind >= myUsage.size()){ myUsage.resize(kind + 1); }
+		myUsage[kind].objects++;
+		myUsage[kind].bytes += size;
+
+		uintptr_t start = (myCur + align - 1) & ~(align - 1);
+		if (start + size > myEnd){ return allocateSlow(size, align); }
+		myCur = start + size;
+		return reinterpret_cast<void *>(start);
+	}
+
+	/** Small dense id for T, used to index the usage table **/
+	template <typename T>
+	static size_t kindOf(){
+		static const size_t kind = registerKind(typeid(T).name());
+		return kind;
+	}
+
+	size_t bytesUsed() const;
+	size_t bytesReserved() const;
+
+	/** Write a per-kind breakdown of the bytes handed out **/
+	void reportUsage(std::ostream& out) const;
+
+private:
+	struct Usage{
+		size_t objects = 0;
+		size_t bytes = 0;
+	};
+	struct Cleanup{
+		void * obj;
+		void (*fn)(void *);
+		Cleanup * next;
+	};
+
+	template <typename T>
+	static void destroy(void * obj){ static_cast<T *>(obj)->~T(); }
+
+	static size_t registerKind(const char * mangledName);
+	void * allocateSlow(size_t size, size_t align);
+	void addCleanup(void * obj, void (*fn)(void *));
+
+	uintptr_t myCur;
+	uintptr_t myEnd;
+	size_t myNextChunkSize;
+	std::vector<std::pair<char *, size_t>> myChunks;
+	std::vector<Usage> myUsage;
+	Cleanup * myCleanups;
+};
+
+/**
+* \class ArenaAllocator
+* Standard allocator adapter so that containers built during parsing
+* (e.g. the std::lists of declarations and statements) draw their
+* cells from the arena. deallocate is a no-op; the arena reclaims
+* everything in bulk.
+**/
+template <typename T>
+class ArenaAllocator{
+public:
+	typedef T value_type;
+
+	ArenaAllocator(Arena& arena) : myArena(&arena){ }
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other)
+	: myArena(other.arena()){ }
+
+	T * allocate(size_t n){
+		return static_cast<T *>(myArena->allocate(
+			n * sizeof(T), alignof(T), Arena::kindOf<T>()));
+	}
+	void deallocate(T *, size_t){ }
+
+	Arena * arena() const { return myArena; }
+private:
+	Arena * myArena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b){
+	return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b){
+	return !(a == b);
+}
+
+}
+
+#endif
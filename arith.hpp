@@ -0,0 +1,47 @@
+#ifndef CSHANTY_ARITH_H
+#define CSHANTY_ARITH_H
+
+#include <climits>
+#include <cstdint>
+
+namespace cshanty{
+
+/*
+The integer arithmetic of C-Shanty programs, shared by everything that
+runs or folds them. A result too big or too small for an int
+saturates at INT_MAX or INT_MIN, just as the scanner clamps a literal
+too large for an int to INT_MAX, so overflow never wraps a large
+positive count round to a negative one. Division by zero has no
+result: whoever divides checks for it first and reports it.
+*/
+
+inline int32_t saturate(int64_t value){
+	if (value > INT_MAX){ return INT_MAX; }
+	if (value < INT_MIN){ return INT_MIN; }
+	return static_cast<int32_t>(value);
+}
+
+inline int32_t satAdd(int32_t a, int32_t b){
+	return saturate(static_cast<int64_t>(a) + b);
+}
+
+inline int32_t satSub(int32_t a, int32_t b){
+	return saturate(static_cast<int64_t>(a) - b);
+}
+
+inline int32_t satMul(int32_t a, int32_t b){
+	return saturate(static_cast<int64_t>(a) * b);
+}
+
+/** b must not be 0; INT_MIN / -1 saturates to INT_MAX **/
+inline int32_t satDiv(int32_t a, int32_t b){
+	return saturate(static_cast<int64_t>(a) / b);
+}
+
+inline int32_t satNeg(int32_t a){
+	return saturate(-static_cast<int64_t>(a));
+}
+
+}
+
+#endif
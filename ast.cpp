@@ -1,11 +1,16 @@
 #include "ast.hpp"
 
-cshanty::ProgramNode::ProgramNode(std::list<DeclNode *> * globalsIn)
-: ASTNode(new Position(0,0,0,0)), myGlobals(globalsIn){
-	if (!globalsIn->empty()){
-		myPos->expand(
-			myGlobals->front()->pos(),
-			myGlobals->back()->pos()
+cshanty::ProgramNode::ProgramNode(const Position& p, NodeSpan<DeclNode> globalsIn)
+: ASTNode(p), myGlobals(globalsIn){
+	if (!globalsIn.empty()){
+		myPos.expand(
+			myGlobals.front()->pos(),
+			myGlobals.back()->pos()
 		);
 	}
 }
+
+cshanty::FnDeclNode * cshanty::CallExpNode::callee() const{
+	//Name analysis only lets a call's name resolve to a function
+	return static_cast<FnDeclNode *>(nameFunc->decl());
+}
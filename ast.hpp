@@ -1,9 +1,14 @@
 #ifndef CSHANTYC_AST_HPP
 #define CSHANTYC_AST_HPP
 
+#include <algorithm>
 #include <ostream>
-#include <list>
+#include <vector>
+#include "arena.hpp"
+#include "flatast.hpp"
+#include "ir.hpp"
 #include "tokens.hpp"
+#include "types.hpp"
 
 // **********************************************************************
 // ASTnode class (base class for all other kinds of nodes)
@@ -18,15 +23,86 @@ class DeclNode;
 class TypeNode;
 class StmtNode;
 class IDNode;
+class VarDeclNode;
+class SymbolTable;
+class TypeAnalysis;
+class Interpreter;
+class FnCompiler;
+class IRBuilder;
+class Folder;
+class DeadCode;
+class Inliner;
+class FrameLayout;
+struct Value;
+
+/**
+* \class NodeSpan
+* The children of a node: a fixed-size array of pointers in the
+* compilation's arena. Spans are small values stored inline in their
+* parent and are never modified once built, so walking a block of
+* statements touches one contiguous run of memory.
+**/
+template <typename T>
+class NodeSpan{
+public:
+	typedef T * const * iterator;
+	NodeSpan() : myData(nullptr), mySize(0){ }
+	NodeSpan(T * const * data, size_t size)
+	: myData(data), mySize(size){ }
+	iterator begin() const { return myData; }
+	iterator end() const { return myData + mySize; }
+	size_t size() const { return mySize; }
+	bool empty() const { return mySize == 0; }
+	T * operator[](size_t index) const { return myData[index]; }
+	T * front() const { return myData[0]; }
+	T * back() const { return myData[mySize - 1]; }
+private:
+	T * const * myData;
+	size_t mySize;
+};
+
+/**
+* \class NodeList
+* Collects the children of a list nonterminal while it is being
+* reduced. The rule that consumes the finished list calls freeze(),
+* which copies the children into an exactly-sized NodeSpan in the
+* arena and releases the builder's own storage.
+**/
+template <typename T>
+class NodeList{
+public:
+	NodeList(Arena& arena) : myArena(arena){ }
+	void push_back(T * node){ myNodes.push_back(node); }
+	bool empty() const { return myNodes.empty(); }
+	NodeSpan<T> freeze(){
+		size_t size = myNodes.size();
+		T ** data = nullptr;
+		if (size != 0){
+			data = ArenaAllocator<T *>(myArena).allocate(size);
+			std::copy(myNodes.begin(), myNodes.end(), data);
+		}
+		std::vector<T *>().swap(myNodes);
+		return NodeSpan<T>(data, size);
+	}
+private:
+	Arena& myArena;
+	std::vector<T *> myNodes;
+};
 
 class ASTNode{
 public:
-	ASTNode(Position * p) : myPos(p){ }
+	ASTNode(const Position& p) : myPos(p){ }
 	virtual void unparse(std::ostream& out, int indent) = 0;
-	Position * pos() { return myPos; }
-	std::string posStr() { return pos()->span(); }
+	/** Append this subtree to a FlatAST (see flatten.cpp) **/
+	virtual FlatAST::NodeId flatten(FlatBuilder& b) = 0;
+	/** Bind the names this subtree declares and resolve the ones it
+	    uses (see nameanalysis.cpp). Errors are reported as they are
+	    found; returns false if there were any **/
+	virtual bool nameAnalysis(SymbolTable& table) = 0;
+	const Position& pos() const { return myPos; }
+	std::string posStr() const { return pos().span(); }
 protected:
-	Position * myPos;
+	Position myPos;
 };
 
 /**
@@ -38,16 +114,53 @@ protected:
 **/
 class ProgramNode : public ASTNode{
 public:
-	ProgramNode(std::list<DeclNode *> * globalsIn) ;
-	void unparse(std::ostream& out, int indent) override;
+	ProgramNode(const Position& p, NodeSpan<DeclNode> globalsIn);
+	NodeSpan<DeclNode> globals() const { return myGlobals; }
+	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	/** Check the types of everything in the program (see
+	    typeanalysis.cpp), reporting each error to ta **/
+	void typeAnalysis(TypeAnalysis& ta);
+	/** After type analysis, fold the constant parts of every
+	    expression in the program (see fold.cpp) **/
+	void fold(Folder& f);
+	/** After type analysis, drop the statements that can't run and
+	    the locals nothing uses (see deadcode.cpp) **/
+	void prune(DeadCode& d);
+	/** After type analysis, put the bodies of small functions in
+	    place of calls to them (see inline.cpp) **/
+	void inlineCalls(Inliner& in);
 private:
-	std::list<DeclNode * > * myGlobals;
+	NodeSpan<DeclNode> myGlobals;
 };
 
 class StmtNode : public ASTNode{
 public:
-	StmtNode(Position * p) : ASTNode(p){ }
+	StmtNode(const Position& p) : ASTNode(p){ }
 	void unparse(std::ostream& out, int indent) override = 0;
+	virtual void typeAnalysis(TypeAnalysis& ta) = 0;
+	/** Run this statement (see interp.cpp). Returns true if it
+	    returned from the function it is in **/
+	virtual bool exec(Interpreter& in) = 0;
+	/** Give the variables this statement declares their slots in
+	    frame; most declare none **/
+	virtual void allocate(FrameLayout&){ }
+	/** Emit this statement's bytecode (see bytecode.cpp) **/
+	virtual void compile(FnCompiler& fc) = 0;
+	/** Add this statement's IR at the end of b (see lower.cpp) **/
+	virtual void lower(IRBuilder& b) = 0;
+	/** Fold the constant parts of the expressions in this statement
+	    (see fold.cpp) **/
+	virtual void fold(Folder& f) = 0;
+	/** Append what is left of this statement once its dead code is
+	    dropped to live: itself, or nothing, or part of its body (see
+	    deadcode.cpp). Returns false if control can't go on past it **/
+	virtual bool prune(DeadCode& d, NodeList<StmtNode>& live) = 0;
+	/** Inline the calls in this statement (see inline.cpp). Returns
+	    what to put in its place: itself, or the inlined body of the
+	    function it calls **/
+	virtual StmtNode * inlineCalls(Inliner& in) = 0;
 };
 
 
@@ -57,8 +170,16 @@ public:
 **/
 class DeclNode : public StmtNode{
 public:
-	DeclNode(Position * p) : StmtNode(p) { }
+	DeclNode(const Position& p) : StmtNode(p) { }
 	void unparse(std::ostream& out, int indent) override = 0;
+	/** What a name bound to this declaration stands for, as the
+	    annotation that follows each resolved identifier in the
+	    unparse: {int} for a variable, {int,bool->void} for a
+	    function. Records are named by their own name, so nothing **/
+	virtual void annotate(std::ostream& out) = 0;
+	/** The type of a name bound to this declaration. Valid once type
+	    analysis has passed the declaration **/
+	virtual Type declType() const = 0;
 };
 
 /**  \class ExpNode
@@ -67,76 +188,194 @@ public:
 * should inherit from this abstract superclass.
 **/
 class ExpNode : public ASTNode{
+public:
+	/** Find the type of this expression, reporting any error in it
+	    to ta, and keep it (see type) **/
+	Type typeAnalysis(TypeAnalysis& ta){
+		ta.enterExp(pos());
+		myType = computeType(ta);
+		ta.leaveExp();
+		return myType;
+	}
+	/** The type found by typeAnalysis; Type::error() before, or if the
+	    expression was ill-typed **/
+	Type type() const { return myType; }
+	/** Evaluate this expression in the running program (see
+	    interp.cpp) **/
+	virtual Value eval(Interpreter& in) = 0;
+	/** Emit bytecode that leaves this expression's value in register
+	    dst (see bytecode.cpp) **/
+	virtual void compile(FnCompiler& fc, uint16_t dst) = 0;
+	/** Add IR computing this expression at the end of b (see
+	    lower.cpp). Returns its value **/
+	virtual ValueId lower(IRBuilder& b) = 0;
+	/** Fold the constant parts of this expression (see fold.cpp).
+	    Returns what to put in its place: itself, or what it folded
+	    to **/
+	virtual ExpNode * fold(Folder& f) = 0;
+	/** Note each declaration a name in this expression uses (see
+	    deadcode.cpp) **/
+	virtual void markUses(DeadCode& d) = 0;
+	/** Inline the calls in this expression (see inline.cpp). Returns
+	    what to put in its place **/
+	virtual ExpNode * inlineCalls(Inliner& in) = 0;
 protected:
-	ExpNode(Position * p) : ASTNode(p){ }
+	ExpNode(const Position& p) : ASTNode(p){ }
+	/** This expression's type, given its children's **/
+	virtual Type computeType(TypeAnalysis& ta) = 0;
+private:
+	Type myType;
 };
 
 class TrueNode : public ExpNode{
 public:
-	TrueNode(Position * p) : ExpNode(p){ }
+	TrueNode(const Position& p) : ExpNode(p){ }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
+	void markUses(DeadCode& d) override;
+	ExpNode * inlineCalls(Inliner& in) override;
 };
 
 class FalseNode : public ExpNode{
 public:
-	FalseNode(Position * p) : ExpNode(p){ }
+	FalseNode(const Position& p) : ExpNode(p){ }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
+	void markUses(DeadCode& d) override;
+	ExpNode * inlineCalls(Inliner& in) override;
 };
 
 class StrLitNode : public ExpNode{
 public:
-	StrLitNode(Position * p, std::string Val)
+	StrLitNode(const Position& p, Symbol Val)
 	: ExpNode(p), stringVal(Val){ }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
+	void markUses(DeadCode& d) override;
+	ExpNode * inlineCalls(Inliner& in) override;
+	/** The characters the literal stands for: its text without the
+	    quotes, escapes undone. Made the first time it is asked for **/
+	Symbol text();
 private:
-	std::string stringVal;
+	Symbol stringVal;
+	Symbol myText;
 };
 
 class IntLitNode : public ExpNode{
 public:
-	IntLitNode(Position * p, int Val)
+	IntLitNode(const Position& p, int Val)
 	: ExpNode(p), numval(Val){ }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
+	void markUses(DeadCode& d) override;
+	ExpNode * inlineCalls(Inliner& in) override;
+	int value() const { return numval; }
 private:
 	int numval;
 };
 
 class UnaryExpNode : public ExpNode{
 public:
-	UnaryExpNode(Position * p, ExpNode * Expression)
+	UnaryExpNode(const Position& p, ExpNode * Expression)
 	: ExpNode(p), expression(Expression){ }
 	void unparse(std::ostream& out, int indent) override = 0;
-private:
+	bool nameAnalysis(SymbolTable& table) override;
+	void markUses(DeadCode& d) override;
+	ExpNode * inlineCalls(Inliner& in) override;
+	ExpNode * operand() const { return expression; }
+protected:
+	FlatAST::NodeId flattenAs(FlatBuilder& b, NodeKind kind);
+	/** Put the folded operand in place of the operand **/
+	void foldOperand(Folder& f);
 	ExpNode * expression;
 };
 
 class NegNode : public UnaryExpNode{
 public:
-	NegNode(Position * p, ExpNode * Expression) : UnaryExpNode(p, Expression) { }
+	NegNode(const Position& p, ExpNode * Expression) : UnaryExpNode(p, Expression) { }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class NotNode  : public UnaryExpNode{
 public:
-	NotNode(Position * p, ExpNode * Expression) : UnaryExpNode(p, Expression) { }
+	NotNode(const Position& p, ExpNode * Expression) : UnaryExpNode(p, Expression) { }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class CallExpNode : public ExpNode{
 public:
-	CallExpNode(Position * p , IDNode * Name ) : ExpNode(p), nameFunc(Name) { }
-	CallExpNode(Position * p, IDNode * Name, std::list<ExpNode *> * Arguments) : ExpNode(p), nameFunc(Name), arguments(Arguments) { }
-	void unparse(std::ostream& out, int indent) override;
+	CallExpNode(const Position& p , IDNode * Name ) : ExpNode(p), nameFunc(Name) { }
+	CallExpNode(const Position& p, IDNode * Name, NodeSpan<ExpNode> Arguments) : ExpNode(p), nameFunc(Name), arguments(Arguments) { }
+	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
+	void markUses(DeadCode& d) override;
+	ExpNode * inlineCalls(Inliner& in) override;
+	/** Inline the calls in the arguments, but not this one **/
+	void inlineArgs(Inliner& in);
+	/** The function called, once names are resolved **/
+	FnDeclNode * callee() const;
+	NodeSpan<ExpNode> args() const { return arguments; }
 	private:
 	IDNode * nameFunc;
-	std::list<ExpNode * > * arguments;
+	NodeSpan<ExpNode> arguments;
 };
 
 class CallStmtNode : public StmtNode{
 public:
-	CallStmtNode(Position * p, CallExpNode * func)
+	CallStmtNode(const Position& p, CallExpNode * func)
 	: StmtNode(p), Function(func){ }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
 private:
 	CallExpNode * Function;
 };
@@ -148,90 +387,175 @@ private:
 **/
 class TypeNode : public ASTNode{
 protected:
-	TypeNode(Position * p) : ASTNode(p){
+	TypeNode(const Position& p) : ASTNode(p){
 	}
 public:
 	virtual void unparse(std::ostream& out, int indent) override = 0;
+	/** The type this node spells **/
+	virtual Type asType() const = 0;
 	//TODO: consider adding an isRef to use in unparse to
 	// indicate if this is a reference type
 };
 
 class LValNode : public ExpNode{
 public:
-	LValNode(Position * p) : ExpNode(p){}
+	LValNode(const Position& p) : ExpNode(p){}
 	void unparse(std::ostream& out, int indent) override = 0;
+	/** The slot this names in the running program **/
+	virtual Value * locate(Interpreter& in) = 0;
+	/** The variable this names, or whose field it names **/
+	virtual VarDeclNode * varDecl() const = 0;
+	/** Where in variable() this is: 0, or the field's offset **/
+	virtual uint32_t offset() const = 0;
 };
 
 class PostDecStmtNode : public StmtNode{
 public:
-	PostDecStmtNode(Position * p , LValNode * Variable) : StmtNode(p), variable(Variable) { }
-	void unparse(std::ostream& out, int indent) override;
+	PostDecStmtNode(const Position& p , LValNode * Variable) : StmtNode(p), variable(Variable) { }
+	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
 	private:
 	LValNode * variable;
 };
 
 class PostIncStmtNode : public StmtNode{
 public:
-	PostIncStmtNode(Position * p , LValNode * Variable) : StmtNode(p), variable(Variable) { }
-	void unparse(std::ostream& out, int indent) override;
+	PostIncStmtNode(const Position& p , LValNode * Variable) : StmtNode(p), variable(Variable) { }
+	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
 	private:
 	LValNode * variable;
 };
 
 class ReceiveStmtNode : public StmtNode{
 public:
-	ReceiveStmtNode(Position * p , LValNode * Variable) : StmtNode(p), variable(Variable) { }
-	void unparse(std::ostream& out, int indent) override;
+	ReceiveStmtNode(const Position& p , LValNode * Variable) : StmtNode(p), variable(Variable) { }
+	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
 	private:
 	LValNode * variable;
 };
 
 class ReportStmtNode : public StmtNode{
 public:
-	ReportStmtNode(Position * p , ExpNode * Expression) : StmtNode(p), expression(Expression) { }
-	void unparse(std::ostream& out, int indent) override;
+	ReportStmtNode(const Position& p , ExpNode * Expression) : StmtNode(p), expression(Expression) { }
+	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
 	private:
 	ExpNode * expression;
 };
 
 class ReturnStmtNode : public StmtNode{
 public:
-	ReturnStmtNode(Position * p , ExpNode * Expression) : StmtNode(p), expression(Expression) { }
-	ReturnStmtNode(Position * p) : StmtNode(p) {}
-	void unparse(std::ostream& out, int indent) override;
+	ReturnStmtNode(const Position& p , ExpNode * Expression) : StmtNode(p), expression(Expression) { }
+	ReturnStmtNode(const Position& p) : StmtNode(p), expression(nullptr) {}
+	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
+	/** The value returned, or null **/
+	ExpNode * value() const { return expression; }
 	private:
 	ExpNode * expression;
 };
 
 class WhileStmtNode : public StmtNode{
 public:
-	WhileStmtNode(Position * p , ExpNode * Condition, std::list<StmtNode *> * body ) 
+	WhileStmtNode(const Position& p , ExpNode * Condition, NodeSpan<StmtNode> body ) 
 	: StmtNode(p), condition(Condition), WhileBody(body) { }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
+	void allocate(FrameLayout& frame) override;
 	private:
 	ExpNode * condition;
-	std::list<StmtNode * > * WhileBody;
+	NodeSpan<StmtNode> WhileBody;
 };
 
 class IfStmtNode : public StmtNode{
 public:
-	IfStmtNode(Position * p , ExpNode * Condition , std::list<StmtNode *> * body) 
+	IfStmtNode(const Position& p , ExpNode * Condition , NodeSpan<StmtNode> body) 
 	: StmtNode(p), condition(Condition), IfBody(body) { }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
+	void allocate(FrameLayout& frame) override;
 	private:
 	ExpNode * condition;
-	std::list<StmtNode * > * IfBody;
+	NodeSpan<StmtNode> IfBody;
 };
 
 class IfElseStmtNode : public StmtNode{
 public:
-	IfElseStmtNode(Position * p , ExpNode * Condition, std::list<StmtNode *> * tbody, std::list<StmtNode *> * fbody ) 
+	IfElseStmtNode(const Position& p , ExpNode * Condition, NodeSpan<StmtNode> tbody, NodeSpan<StmtNode> fbody ) 
 	: StmtNode(p), condition(Condition), IfTrueBody(tbody) ,IfFalseBody(fbody) { }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
+	void allocate(FrameLayout& frame) override;
 	private:
 	ExpNode * condition;
-	std::list<StmtNode * > * IfTrueBody;
-	std::list<StmtNode * > * IfFalseBody;
+	NodeSpan<StmtNode> IfTrueBody;
+	NodeSpan<StmtNode> IfFalseBody;
 };
 
 /** An identifier. Note that IDNodes subclass
@@ -240,19 +564,52 @@ public:
 
 class IDNode : public LValNode{
 public:
-	IDNode(Position * p, std::string nameIn)
-	: LValNode(p), name(nameIn){ }
-	void unparse(std::ostream& out, int indent) override;
+	IDNode(const Position& p, Symbol nameIn)
+	: LValNode(p), name(nameIn), myDecl(nullptr){ }
+	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	Value * locate(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
+	void markUses(DeadCode& d) override;
+	ExpNode * inlineCalls(Inliner& in) override;
+	VarDeclNode * varDecl() const override;
+	uint32_t offset() const override;
+	Symbol getName() const { return name; }
+	/** The declaration this name resolved to in name analysis (the
+	    node itself, for the name a declaration introduces); null
+	    before, or if it didn't resolve. Once set, unparse follows
+	    the name with the declaration's annotation **/
+	DeclNode * decl() const { return myDecl; }
+	void attach(DeclNode * decl){ myDecl = decl; }
 private:
-	/** The name of the identifier **/
-	std::string name;
+	/** The name of the identifier, interned so that passes can
+	    compare names by handle **/
+	Symbol name;
+	DeclNode * myDecl;
 };
 
 class IndexNode : public LValNode{
 public:
-	IndexNode(Position * p, IDNode * id, IDNode * name)
+	IndexNode(const Position& p, IDNode * id, IDNode * name)
 	: LValNode(p), Id_being_accessed(id), field_Name_being_accessed(name){ }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	Value * locate(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
+	void markUses(DeadCode& d) override;
+	ExpNode * inlineCalls(Inliner& in) override;
+	VarDeclNode * varDecl() const override;
+	uint32_t offset() const override;
 private:
 	IDNode * Id_being_accessed;
 	IDNode * field_Name_being_accessed;
@@ -272,50 +629,130 @@ private:
 **/
 class VarDeclNode : public DeclNode{
 public:
-	VarDeclNode(Position * p, TypeNode * type, IDNode * id)
+	VarDeclNode(const Position& p, TypeNode * type, IDNode * id)
 	: DeclNode(p), myType(type), myId(id){
 	}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void annotate(std::ostream& out) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	Type declType() const override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
+	void allocate(FrameLayout& frame) override;
+	TypeNode * type() const { return myType; }
+	IDNode * id() const { return myId; }
+	/** Where allocate put the variable: a slot among the globals, in
+	    its function's frame, or (for a field) in its record. A
+	    record variable takes a slot per field, from this one on **/
+	uint32_t slot() const { return mySlot; }
+	bool global() const { return myGlobal; }
 protected:
 	TypeNode * myType;
 	IDNode * myId;
+	uint32_t mySlot = 0;
+	bool myGlobal = false;
 };
 
 class FormalDeclNode : public VarDeclNode{
 public:
-	FormalDeclNode(Position * p, TypeNode * type, IDNode * id)
+	FormalDeclNode(const Position& p, TypeNode * type, IDNode * id)
 	: VarDeclNode(p, type, id) { }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
 };
 
 class RecordTypeDeclNode : public DeclNode{
 public:
-	RecordTypeDeclNode(Position * p, IDNode * Id, std::list<VarDeclNode *> * Variables)
+	RecordTypeDeclNode(const Position& p, IDNode * Id, NodeSpan<VarDeclNode> Variables)
 	: DeclNode(p), myId(Id), variables(Variables) { }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void annotate(std::ostream& out) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	Type declType() const override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
+	void allocate(FrameLayout& frame) override;
+	IDNode * id() const { return myId; }
+	NodeSpan<VarDeclNode> fields() const { return variables; }
+	/** The field called name, or null **/
+	VarDeclNode * field(Symbol name) const;
+	/** The type of variables of this record type, made by type
+	    analysis **/
+	Type recordType() const { return myRecordType; }
+	/** Slots taken by a variable of this record type, once
+	    allocated **/
+	uint32_t size() const { return mySize; }
 private:
 	IDNode * myId;
-	std::list<VarDeclNode * > * variables;
+	NodeSpan<VarDeclNode> variables;
+	Type myRecordType;
+	uint32_t mySize = 0;
 };
 
 class FnDeclNode : public DeclNode{
 public:
-	FnDeclNode(Position * p, TypeNode * type, IDNode * id, std::list<StmtNode * > * funcBody)
-	: DeclNode(p), myType(type), myId(id), parameters(nullptr), functionBody(funcBody) { }
-	FnDeclNode(Position * p, TypeNode * type, IDNode * id, std::list<FormalDeclNode * > *  paramIn, std::list<StmtNode * > * funcBody)
+	FnDeclNode(const Position& p, TypeNode * type, IDNode * id, NodeSpan<StmtNode> funcBody)
+	: DeclNode(p), myType(type), myId(id), functionBody(funcBody) { }
+	FnDeclNode(const Position& p, TypeNode * type, IDNode * id, NodeSpan<FormalDeclNode> paramIn, NodeSpan<StmtNode> funcBody)
 	: DeclNode(p), myType(type), myId(id), parameters(paramIn), functionBody(funcBody) { }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void annotate(std::ostream& out) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	Type declType() const override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
+	void allocate(FrameLayout& frame) override;
+	TypeNode * retType() const { return myType; }
+	IDNode * id() const { return myId; }
+	NodeSpan<FormalDeclNode> formals() const { return parameters; }
+	NodeSpan<StmtNode> body() const { return functionBody; }
+	/** Slots a call needs for the formals and locals, once
+	    allocated **/
+	uint32_t frameSize() const { return myFrameSize; }
 private:
 	TypeNode * myType;
 	IDNode * myId;
-	std::list<FormalDeclNode * > * parameters;
-	std::list<StmtNode * > * functionBody;
+	NodeSpan<FormalDeclNode> parameters;
+	NodeSpan<StmtNode> functionBody;
+	Type myFnType;
+	uint32_t myFrameSize = 0;
 };
 
 class AssignExpNode : public ExpNode{
 public:
-	AssignExpNode(Position * p ,  LValNode * Variable, ExpNode * Expression) : ExpNode(p),  variable(Variable), expression(Expression) { }
-	void unparse(std::ostream& out, int indent) override;
+	AssignExpNode(const Position& p ,  LValNode * Variable, ExpNode * Expression) : ExpNode(p),  variable(Variable), expression(Expression) { }
+	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
+	void markUses(DeadCode& d) override;
+	ExpNode * inlineCalls(Inliner& in) override;
+	/** Write the assignment without the parentheses it needs as an
+	    operand, as an assignment statement does **/
+	void unparseAssign(std::ostream& out);
 private:
 	LValNode * variable;
 	ExpNode * expression;
@@ -324,124 +761,238 @@ private:
 
 class AssignStmtNode : public StmtNode{
 public:
-	AssignStmtNode(Position * p , AssignExpNode * Assignment) : StmtNode(p), assignment(Assignment) { }
-	void unparse(std::ostream& out, int indent) override;
+	AssignStmtNode(const Position& p , AssignExpNode * Assignment) : StmtNode(p), assignment(Assignment) { }
+	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	void typeAnalysis(TypeAnalysis& ta) override;
+	bool exec(Interpreter& in) override;
+	void compile(FnCompiler& fc) override;
+	void lower(IRBuilder& b) override;
+	void fold(Folder& f) override;
+	bool prune(DeadCode& d, NodeList<StmtNode>& live) override;
+	StmtNode * inlineCalls(Inliner& in) override;
 private:
 	AssignExpNode * assignment;
 };
 
 class IntTypeNode : public TypeNode{
 public:
-	IntTypeNode(Position * p) : TypeNode(p){ }
+	IntTypeNode(const Position& p) : TypeNode(p){ }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type asType() const override;
 };
 
 class BoolTypeNode : public TypeNode{
 public:
-	BoolTypeNode(Position * p) : TypeNode(p){ }
+	BoolTypeNode(const Position& p) : TypeNode(p){ }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type asType() const override;
 };
 
 class VoidTypeNode : public TypeNode{
 public:
-	VoidTypeNode(Position * p) : TypeNode(p){ }
+	VoidTypeNode(const Position& p) : TypeNode(p){ }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type asType() const override;
 };
 
 class StringTypeNode : public TypeNode{
 public:
-	StringTypeNode(Position * p) : TypeNode(p){ }
+	StringTypeNode(const Position& p) : TypeNode(p){ }
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	bool nameAnalysis(SymbolTable& table) override;
+	Type asType() const override;
 };
 
 class RecordTypeNode : public TypeNode{
 public:
-	RecordTypeNode(Position * p, IDNode * id)
+	RecordTypeNode(const Position& p, IDNode * id)
 	: TypeNode(p), myId(id){ }
 	void unparse(std::ostream& out, int indent)override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	/** Succeeds, without reporting anything, only if the name is
+	    that of a record; the declaration using the type reports **/
+	bool nameAnalysis(SymbolTable& table) override;
+	/** The record type its name resolved to; valid once type
+	    analysis has passed that record's declaration **/
+	Type asType() const override;
+	IDNode * id() const { return myId; }
 private:
 	IDNode * myId;
 };
 
 class BinaryExpNode : public ExpNode {
 public:
-	BinaryExpNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : ExpNode(p), leftNode(leftNode), rightNode(rightNode) {}
+	BinaryExpNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : ExpNode(p), leftNode(leftNode), rightNode(rightNode) {}
 	void unparse(std::ostream& out, int indent) override = 0;
+	bool nameAnalysis(SymbolTable& table) override;
+	void markUses(DeadCode& d) override;
+	ExpNode * inlineCalls(Inliner& in) override;
+	ExpNode * left() const { return leftNode; }
+	ExpNode * right() const { return rightNode; }
 protected:
+	FlatAST::NodeId flattenAs(FlatBuilder& b, NodeKind kind);
+	//The type rules shared by each kind of operator
+	Type arithmeticType(TypeAnalysis& ta);
+	Type relationalType(TypeAnalysis& ta);
+	Type logicalType(TypeAnalysis& ta);
+	Type equalityType(TypeAnalysis& ta);
+	/** Put the folded operands in place of the operands **/
+	void foldOperands(Folder& f);
 	ExpNode * leftNode;
 	ExpNode * rightNode;
 };
 
 class AndNode : public BinaryExpNode {
 public:
-	AndNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	AndNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class DivideNode : public BinaryExpNode {
 public:
-	DivideNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	DivideNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class EqualsNode : public BinaryExpNode {
 public:
-	EqualsNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	EqualsNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class GreaterEqNode : public BinaryExpNode {
 public:
-	GreaterEqNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	GreaterEqNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class GreaterNode : public BinaryExpNode {
 public:
-	GreaterNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	GreaterNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class LessEqNode : public BinaryExpNode {
 public:
-	LessEqNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	LessEqNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class LessNode : public BinaryExpNode {
 public:
-	LessNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	LessNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class MinusNode : public BinaryExpNode {
 public:
-	MinusNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	MinusNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class NotEqualsNode : public BinaryExpNode {
 public:
-	NotEqualsNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	NotEqualsNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class OrNode : public BinaryExpNode {
 public:
-	OrNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	OrNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class PlusNode : public BinaryExpNode {
 public:
-	PlusNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	PlusNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 class TimesNode : public BinaryExpNode {
 public:
-	TimesNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
+	TimesNode(const Position& p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
 	void unparse(std::ostream& out, int indent) override;
+	FlatAST::NodeId flatten(FlatBuilder& b) override;
+	Type computeType(TypeAnalysis& ta) override;
+	Value eval(Interpreter& in) override;
+	void compile(FnCompiler& fc, uint16_t dst) override;
+	ValueId lower(IRBuilder& b) override;
+	ExpNode * fold(Folder& f) override;
 };
 
 } //End namespace cshanty
@@ -0,0 +1,170 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "ast.hpp"
+#include "astcache.hpp"
+#include "bytes.hpp"
+#include "errors.hpp"
+#include "flatast.hpp"
+#include "source.hpp"
+
+namespace cshanty{
+
+static const char MAGIC[4] = {'C', 'S', 'A', 'C'};
+
+/* <dir>/stats: this magic, then the hits, misses and stale entries
+   counted by the runs that reported stats */
+static const char STATS_MAGIC[4] = {'C', 'S', 'S', 'T'};
+static const size_t STATS_SIZE = sizeof(STATS_MAGIC) + 3 * 8;
+
+ASTCache::ASTCache(const std::string& dir)
+: myDir(dir), myHits(0), myMisses(0), myStale(0){
+	if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST){
+		std::string msg = "Can't create cache directory " + dir;
+		throw new InternalError(msg.c_str());
+	}
+}
+
+std::string ASTCache::entryPath(uint64_t hash) const{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ast",
+		static_cast<unsigned long long>(hash));
+	return myDir + "/" + name;
+}
+
+ProgramNode * ASTCache::lookup(const SourceBuffer& source,
+	const std::string& name, Arena& arena){
+	uint64_t hash = hashBytes(source.data(), source.size());
+	std::string path = entryPath(hash);
+	std::ifstream probe(path, std::ios::binary);
+	if (!probe.good()){
+		myMisses++;
+		return nullptr;
+	}
+	probe.close();
+
+	uint32_t file = 0;
+	try {
+		std::unique_ptr<SourceBuffer> entry(
+			SourceBuffer::map(path.c_str()));
+		ByteReader in(entry->data(), entry->size(), "AST cache entry");
+		StrView magic = in.raw(sizeof(MAGIC));
+		in.check(magic == StrView(MAGIC, sizeof(MAGIC)));
+		in.check(in.u32() == VERSION);
+		in.check(in.u64() == hash);
+		in.check(in.u32() == source.size());
+		uint64_t checksum = in.u64();
+		in.check(hashBytes(in.at(), in.left()) == checksum);
+
+		file = SourceFile::add(name);
+		SourceFile& lines = SourceFile::get(file);
+		uint32_t lineCount = in.u32();
+		in.fits(lineCount, 4);
+		in.check(lineCount != 0 && in.u32() == 0);
+		for (uint32_t i = 1; i < lineCount; i++){
+			lines.addLine(in.u32());
+		}
+		std::unique_ptr<FlatAST> flat(FlatAST::read(in, file));
+		ProgramNode * program = flat->inflate(arena);
+		myHits++;
+		return program;
+	} catch (InternalError * e){
+		delete e;
+		//The entry passed its checksum but not the rest; the file
+		// registered for it has nothing that will use it
+		if (file != 0){ SourceFile::release(file); }
+		myMisses++;
+		myStale++;
+		return nullptr;
+	}
+}
+
+void ASTCache::store(const SourceBuffer& source, uint32_t file,
+	ProgramNode * program){
+	std::unique_ptr<FlatAST> flat(FlatAST::build(program));
+	const SourceFile& lines = SourceFile::get(file);
+	std::ostringstream body;
+	ByteWriter bodyOut(body);
+	bodyOut.u32(static_cast<uint32_t>(lines.lineCount()));
+	for (size_t i = 0; i < lines.lineCount(); i++){
+		bodyOut.u32(lines.lineStart(i));
+	}
+	flat->write(bodyOut);
+	std::string bytes = body.str();
+
+	uint64_t hash = hashBytes(source.data(), source.size());
+	std::string path = entryPath(hash);
+	//Write under a private name and rename into place, so that a
+	// concurrent lookup never sees a half-written entry. Threads of
+	// one batch share a pid, so the name also counts stores
+	static std::atomic<unsigned> stores(0);
+	std::string tmp = path + ".tmp" + std::to_string(getpid()) + "."
+		+ std::to_string(stores++);
+	{
+		std::ofstream out(tmp, std::ios::binary);
+		ByteWriter header(out);
+		header.raw(MAGIC, sizeof(MAGIC));
+		header.u32(VERSION);
+		header.u64(hash);
+		header.u32(static_cast<uint32_t>(source.size()));
+		header.u64(hashBytes(bytes.data(), bytes.size()));
+		header.raw(bytes.data(), bytes.size());
+		out.close();
+		if (out.fail()){
+			std::remove(tmp.c_str());
+			std::string msg = "Can't write cache entry " + path;
+			throw new InternalError(msg.c_str());
+		}
+	}
+	if (std::rename(tmp.c_str(), path.c_str()) != 0){
+		std::remove(tmp.c_str());
+		std::string msg = "Can't write cache entry " + path;
+		throw new InternalError(msg.c_str());
+	}
+}
+
+void ASTCache::reportStats(std::ostream& out){
+	uint64_t totals[3] = { 0, 0, 0 };
+	//Runs that share the directory take turns at the counters, and
+	// the lock goes with the descriptor
+	std::string path = myDir + "/stats";
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0666);
+	if (fd >= 0 && flock(fd, LOCK_EX) == 0){
+		char bytes[STATS_SIZE];
+		if (pread(fd, bytes, STATS_SIZE, 0)
+		  == static_cast<ssize_t>(STATS_SIZE)){
+			ByteReader in(bytes, STATS_SIZE, "AST cache stats");
+			if (in.raw(sizeof(STATS_MAGIC))
+			  == StrView(STATS_MAGIC, sizeof(STATS_MAGIC))){
+				for (uint64_t& total : totals){ total = in.u64(); }
+			}
+		}
+		totals[0] += myHits;
+		totals[1] += myMisses;
+		totals[2] += myStale;
+		std::ostringstream counts;
+		ByteWriter countsOut(counts);
+		countsOut.raw(STATS_MAGIC, sizeof(STATS_MAGIC));
+		for (uint64_t total : totals){ countsOut.u64(total); }
+		if (pwrite(fd, counts.str().data(), STATS_SIZE, 0)
+		    != static_cast<ssize_t>(STATS_SIZE)){
+			Report::report(Severity::Warning, DiagId::CacheWrite,
+				"Can't update " + path);
+		}
+	}
+	if (fd >= 0){ ::close(fd); }
+	out << "AST cache: " << myHits << " hits, " << myMisses
+		<< " misses (" << myStale << " stale) this run; "
+		<< totals[0] << " hits, " << totals[1] << " misses ("
+		<< totals[2] << " stale) in " << myDir << "\n";
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef CSHANTY_ASTCACHE_H
+#define CSHANTY_ASTCACHE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace cshanty{
+
+class Arena;
+class ProgramNode;
+class SourceBuffer;
+
+/**
+* \class ASTCache
+* On-disk cache of parsed programs, keyed by a hash of the source
+* text. Each entry is one file, <dir>/<hash>.ast, holding the
+* source's line table and the program as a FlatAST. An entry is only
+* used if its format version matches, it was made from a source with
+* the same hash and length, and its own checksum is intact; anything
+* else counts as stale and is replaced on the next store. Lookups
+* are only counted in memory; a run that reports them also adds its
+* counts to the fixed-size counters in <dir>/stats, so that they
+* survive across runs.
+**/
+class ASTCache{
+public:
+	static const uint32_t VERSION = 1;
+
+	/** Use (and if needed create) the cache directory dir; throws
+	    InternalError if it can't be created **/
+	ASTCache(const std::string& dir);
+
+	/** The cached program for source, rebuilt in arena, or nullptr
+	    on a miss. Spans refer to a new SourceFile called name **/
+	ProgramNode * lookup(const SourceBuffer& source,
+		const std::string& name, Arena& arena);
+	/** Save program, parsed from source (registered as file).
+	    Throws InternalError if the entry can't be written **/
+	void store(const SourceBuffer& source, uint32_t file,
+		ProgramNode * program);
+
+	size_t hits() const { return myHits; }
+	size_t misses() const { return myMisses; }
+	/** Add this run's hit and miss counts to the directory's, then
+	    write both **/
+	void reportStats(std::ostream& out);
+private:
+	std::string entryPath(uint64_t hash) const;
+
+	std::string myDir;
+	size_t myHits;
+	size_t myMisses;
+	size_t myStale;
+};
+
+}
+
+#endif
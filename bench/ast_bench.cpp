@@ -0,0 +1,170 @@
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <vector>
+#include "ast.hpp"
+
+/*
+Full-tree traversal over the three ways the AST has stored child
+lists: heap std::lists (the original layout), std::lists drawing
+their cells from the arena, and the frozen NodeSpans used now. The
+tree has the shape of a parsed program with long function bodies:
+each function is a block of statements, every eighth of which is a
+nested block (a loop or if body). Every leaf is followed by a token's
+worth of unrelated allocation, as in a real parse, so that children
+are never adjacent by accident.
+*/
+
+using cshanty::Arena;
+using cshanty::ArenaAllocator;
+using cshanty::NodeList;
+using cshanty::NodeSpan;
+
+static const size_t FUNCTIONS = 400;
+static const size_t BODY = 2000;
+static const size_t NESTED = 6;
+static const size_t TOKEN_BYTES = 40;
+
+struct Stmt{
+	virtual ~Stmt(){ }
+	virtual long walk() const = 0;
+};
+
+struct Leaf : public Stmt{
+	Leaf(long v) : value(v){ }
+	long walk() const override { return value; }
+	long value;
+};
+
+template <typename Children>
+struct Block : public Stmt{
+	Block(Children * kids) : children(kids){ }
+	long walk() const override {
+		long sum = 1;
+		for (const Stmt * child : *children){ sum += child->walk(); }
+		return sum;
+	}
+	Children * children;
+};
+
+/** The frozen layout keeps the span inline in the node **/
+struct SpanBlock : public Stmt{
+	SpanBlock(NodeSpan<Stmt> kids) : children(kids){ }
+	long walk() const override {
+		long sum = 1;
+		for (const Stmt * child : children){ sum += child->walk(); }
+		return sum;
+	}
+	NodeSpan<Stmt> children;
+};
+
+typedef std::list<Stmt *> HeapList;
+typedef std::list<Stmt *, ArenaAllocator<Stmt *>> ArenaList;
+
+static std::vector<Stmt *> buildHeap(){
+	std::vector<Stmt *> fns;
+	for (size_t f = 0; f < FUNCTIONS; f++){
+		HeapList * body = new HeapList();
+		for (size_t s = 0; s < BODY; s++){
+			if (s % 8 == 7){
+				HeapList * inner = new HeapList();
+				for (size_t n = 0; n < NESTED; n++){
+					inner->push_back(new Leaf(static_cast<long>(n)));
+					new char[TOKEN_BYTES];
+				}
+				body->push_back(new Block<HeapList>(inner));
+			} else {
+				body->push_back(new Leaf(static_cast<long>(s)));
+				new char[TOKEN_BYTES];
+			}
+		}
+		fns.push_back(new Block<HeapList>(body));
+	}
+	return fns;
+}
+
+static std::vector<Stmt *> buildArenaList(Arena& arena){
+	std::vector<Stmt *> fns;
+	for (size_t f = 0; f < FUNCTIONS; f++){
+		ArenaList * body = arena.make<ArenaList>(arena);
+		for (size_t s = 0; s < BODY; s++){
+			if (s % 8 == 7){
+				ArenaList * inner = arena.make<ArenaList>(arena);
+				for (size_t n = 0; n < NESTED; n++){
+					inner->push_back(arena.make<Leaf>(
+						static_cast<long>(n)));
+					arena.allocate(TOKEN_BYTES, 8, 0);
+				}
+				body->push_back(arena.make<Block<ArenaList>>(inner));
+			} else {
+				body->push_back(arena.make<Leaf>(static_cast<long>(s)));
+				arena.allocate(TOKEN_BYTES, 8, 0);
+			}
+		}
+		fns.push_back(arena.make<Block<ArenaList>>(body));
+	}
+	return fns;
+}
+
+static std::vector<Stmt *> buildSpans(Arena& arena){
+	std::vector<Stmt *> fns;
+	for (size_t f = 0; f < FUNCTIONS; f++){
+		NodeList<Stmt> * body = arena.make<NodeList<Stmt>>(arena);
+		for (size_t s = 0; s < BODY; s++){
+			if (s % 8 == 7){
+				NodeList<Stmt> * inner =
+					arena.make<NodeList<Stmt>>(arena);
+				for (size_t n = 0; n < NESTED; n++){
+					inner->push_back(arena.make<Leaf>(
+						static_cast<long>(n)));
+					arena.allocate(TOKEN_BYTES, 8, 0);
+				}
+				body->push_back(arena.make<SpanBlock>(inner->freeze()));
+			} else {
+				body->push_back(arena.make<Leaf>(static_cast<long>(s)));
+				arena.allocate(TOKEN_BYTES, 8, 0);
+			}
+		}
+		fns.push_back(arena.make<SpanBlock>(body->freeze()));
+	}
+	return fns;
+}
+
+static double timeWalks(const char * name,
+	const std::vector<Stmt *>& fns, long& checksum){
+	const int rounds = 20;
+	size_t nodes = FUNCTIONS * (1 + BODY + (BODY / 8) * NESTED);
+	long sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++){
+		for (const Stmt * fn : fns){ sum += fn->walk(); }
+	}
+	std::chrono::duration<double, std::nano> took =
+		std::chrono::steady_clock::now() - start;
+	double perNode = took.count() / static_cast<double>(nodes * rounds);
+	std::cout << "  " << name << ": " << perNode << " ns/node\n";
+	checksum = sum;
+	return perNode;
+}
+
+int main(){
+	std::cout << "AST traversal, " << FUNCTIONS << " functions of "
+		<< BODY << " statements:\n";
+	std::vector<Stmt *> heap = buildHeap();
+	Arena listArena;
+	std::vector<Stmt *> arenaLists = buildArenaList(listArena);
+	Arena spanArena;
+	std::vector<Stmt *> spans = buildSpans(spanArena);
+
+	long heapSum, listSum, spanSum;
+	double heapNs = timeWalks("heap std::list ", heap, heapSum);
+	double listNs = timeWalks("arena std::list", arenaLists, listSum);
+	double spanNs = timeWalks("arena NodeSpan ", spans, spanSum);
+	if (heapSum != listSum || listSum != spanSum){
+		std::cerr << "Traversals disagree\n";
+		return 1;
+	}
+	std::cout << "  speedup over heap lists: " << heapNs / spanNs
+		<< "x, over arena lists: " << listNs / spanNs << "x\n";
+	return 0;
+}
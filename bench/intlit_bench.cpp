@@ -0,0 +1,108 @@
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "intlit.hpp"
+
+/*
+Microbenchmark for integer literal conversion: the single-pass
+parseIntLit against the body of the {DIGIT}+ rule it replaced in
+cshanty.l (stod + atoi + substr for leading zeros + length check).
+Inputs are a mix of short, long, zero-padded and overflowing literals,
+the kind of thing generated programs are full of.
+*/
+
+static int oldRule(const char * yytext, bool& overflowOut){
+	double asDouble = std::stod(yytext);
+	int intVal = atoi(yytext);
+	bool overflow = false;
+	if (asDouble > INT_MAX){ overflow = true; }
+	if (asDouble < INT_MIN){ overflow = true; }
+	std::string str = yytext;
+	std::string suffix = "";
+	if (yytext[0] == '-'){
+		str = str.substr(1);
+	}
+	for (size_t i = 0 ; i < str.length(); i++){
+		if (str[i] != '0'){
+			suffix = str.substr(i, std::string::npos);
+			break;
+		}
+	}
+	if (suffix.length() > 10){ overflow = true; }
+	if (overflow){ intVal = INT_MAX; }
+	overflowOut = overflow;
+	return intVal;
+}
+
+static std::vector<std::string> makeInputs(size_t count){
+	std::mt19937 rng(665);
+	std::uniform_int_distribution<int> shape(0, 9);
+	std::uniform_int_distribution<int> digit(0, 9);
+	std::vector<std::string> inputs;
+	for (size_t i = 0; i < count; i++){
+		std::string lit;
+		int kind = shape(rng);
+		size_t len = kind < 6 ? 1 + static_cast<size_t>(kind)
+			: kind < 8 ? 10 : 14;
+		if (kind == 8){ lit = "0000"; }
+		for (size_t d = 0; d < len; d++){
+			lit += static_cast<char>('0' + digit(rng));
+		}
+		inputs.push_back(lit);
+	}
+	return inputs;
+}
+
+template <typename F>
+static double timeIt(const std::vector<std::string>& inputs, int rounds,
+	long long& checksum, F convert){
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++){
+		for (const std::string& lit : inputs){
+			checksum += convert(lit);
+		}
+	}
+	auto stop = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+	return ns / (static_cast<double>(inputs.size()) * rounds);
+}
+
+int main(){
+	const std::vector<std::string> inputs = makeInputs(100000);
+	const int rounds = 20;
+
+	//Both conversions must agree before their speed means anything
+	for (const std::string& lit : inputs){
+		bool oldOverflow;
+		int oldVal = oldRule(lit.c_str(), oldOverflow);
+		int newVal;
+		bool newOverflow = !cshanty::parseIntLit(lit.data(), lit.size(), newVal);
+		if (oldVal != newVal || oldOverflow != newOverflow){
+			std::cerr << "Mismatch on " << lit << "\n";
+			return 1;
+		}
+	}
+
+	long long oldSum = 0;
+	long long newSum = 0;
+	double oldNs = timeIt(inputs, rounds, oldSum, [](const std::string& lit){
+		bool overflow;
+		return oldRule(lit.c_str(), overflow);
+	});
+	double newNs = timeIt(inputs, rounds, newSum, [](const std::string& lit){
+		int val;
+		cshanty::parseIntLit(lit.data(), lit.size(), val);
+		return val;
+	});
+
+	std::cout << "int literal conversion (" << inputs.size()
+	<< " literals x " << rounds << ")\n"
+	<< "  old {DIGIT}+ rule: " << oldNs << " ns/literal\n"
+	<< "  parseIntLit:       " << newNs << " ns/literal\n"
+	<< "  speedup:           " << oldNs / newNs << "x\n";
+	return oldSum == newSum ? 0 : 1;
+}
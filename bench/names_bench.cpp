@@ -0,0 +1,189 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.hpp"
+#include "document.hpp"
+#include "errors.hpp"
+#include "symboltable.hpp"
+
+/*
+Name analysis on a program with thousands of globals and functions
+nested many blocks deep, each block reading globals from its
+innermost level. First the whole pass on the parsed tree; then the
+symbol table alone against a stack of per-scope hash maps, replaying
+the same scope entries, declarations and lookups on both.
+*/
+
+using cshanty::DeclNode;
+using cshanty::Diagnostics;
+using cshanty::Document;
+using cshanty::ProgramNode;
+using cshanty::Report;
+using cshanty::Symbol;
+using cshanty::SymbolTable;
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t GLOBALS = 5000;
+static const size_t FUNCTIONS = 200;
+static const size_t DEPTH = 40;
+static const size_t ROUNDS = 20;
+
+static std::string makeProgram(){
+	std::ostringstream text;
+	for (size_t g = 0; g < GLOBALS; g++){
+		text << "int g" << g << ";\n";
+	}
+	for (size_t f = 0; f < FUNCTIONS; f++){
+		text << "int f" << f << "(int a) {\n\tint x;\n";
+		for (size_t d = 0; d < DEPTH; d++){
+			text << "\tif (a > " << d << ") {\n"
+				<< "\t\tint y" << d << ";\n"
+				<< "\t\ty" << d << " = g" << (f * 31 + d * 7) % GLOBALS
+				<< " + x;\n";
+		}
+		text << "\t\tx = a;\n";
+		for (size_t d = 0; d < DEPTH; d++){ text << "\t}\n"; }
+		text << "\treturn x;\n}\n";
+	}
+	return text.str();
+}
+
+/** One step of a name analysis, as the table sees it **/
+struct Op{
+	enum Kind { ENTER, LEAVE, DECLARE, LOOKUP } kind;
+	Symbol name;
+};
+
+static Symbol sym(const std::string& name){
+	return Symbol::intern(cshanty::StrView(name.data(), name.size()));
+}
+
+/** The table operations the pass makes on the program above **/
+static std::vector<Op> makeTrace(){
+	std::vector<Op> ops;
+	Symbol none;
+	ops.push_back({Op::ENTER, none});
+	for (size_t g = 0; g < GLOBALS; g++){
+		ops.push_back({Op::DECLARE, sym("g" + std::to_string(g))});
+	}
+	for (size_t f = 0; f < FUNCTIONS; f++){
+		ops.push_back({Op::DECLARE, sym("f" + std::to_string(f))});
+		ops.push_back({Op::ENTER, none});
+		ops.push_back({Op::DECLARE, sym("a")});
+		ops.push_back({Op::DECLARE, sym("x")});
+		for (size_t d = 0; d < DEPTH; d++){
+			ops.push_back({Op::LOOKUP, sym("a")});
+			ops.push_back({Op::ENTER, none});
+			Symbol y = sym("y" + std::to_string(d));
+			ops.push_back({Op::DECLARE, y});
+			ops.push_back({Op::LOOKUP, y});
+			ops.push_back({Op::LOOKUP,
+				sym("g" + std::to_string((f * 31 + d * 7) % GLOBALS))});
+			ops.push_back({Op::LOOKUP, sym("x")});
+		}
+		ops.push_back({Op::LOOKUP, sym("x")});
+		ops.push_back({Op::LOOKUP, sym("a")});
+		for (size_t d = 0; d < DEPTH; d++){
+			ops.push_back({Op::LEAVE, none});
+		}
+		ops.push_back({Op::LOOKUP, sym("x")});
+		ops.push_back({Op::LEAVE, none});
+	}
+	ops.push_back({Op::LEAVE, none});
+	return ops;
+}
+
+/** The textbook table: one hash map per scope, searched innermost
+    first **/
+class ScopeStack{
+public:
+	void enterScope(){ myScopes.emplace_back(); }
+	void leaveScope(){ myScopes.pop_back(); }
+	bool declare(Symbol name, DeclNode * decl){
+		return myScopes.back().emplace(name, decl).second;
+	}
+	DeclNode * lookup(Symbol name) const{
+		for (auto scope = myScopes.rbegin(); scope != myScopes.rend();
+			++scope){
+			auto found = scope->find(name);
+			if (found != scope->end()){ return found->second; }
+		}
+		return nullptr;
+	}
+private:
+	std::vector<std::unordered_map<Symbol, DeclNode *>> myScopes;
+};
+
+template <typename Table>
+static double replay(const std::vector<Op>& ops, size_t& found){
+	//Any non-null pointer will do as a declaration
+	static int dummy;
+	DeclNode * decl = reinterpret_cast<DeclNode *>(&dummy);
+	Clock::time_point start = Clock::now();
+	for (size_t round = 0; round < ROUNDS; round++){
+		Table table;
+		for (const Op& op : ops){
+			switch (op.kind){
+			case Op::ENTER: table.enterScope(); break;
+			case Op::LEAVE: table.leaveScope(); break;
+			case Op::DECLARE: table.declare(op.name, decl); break;
+			case Op::LOOKUP:
+				found += table.lookup(op.name) != nullptr;
+				break;
+			}
+		}
+	}
+	std::chrono::duration<double, std::milli> took = Clock::now() - start;
+	return took.count() / ROUNDS;
+}
+
+int main(){
+	std::string program = makeProgram();
+	Diagnostics sink("bench");
+	Report::collect(&sink);
+	Document doc("bench", true);
+	doc.load(program);
+	ProgramNode * tree = doc.program();
+	if (tree == nullptr){
+		std::cerr << "Benchmark program doesn't parse\n";
+		return 1;
+	}
+
+	double best = 0;
+	for (size_t round = 0; round < ROUNDS; round++){
+		SymbolTable table;
+		Clock::time_point start = Clock::now();
+		bool ok = tree->nameAnalysis(table);
+		std::chrono::duration<double, std::milli> took =
+			Clock::now() - start;
+		if (!ok){
+			std::cerr << "Benchmark program fails name analysis\n";
+			return 1;
+		}
+		if (round == 0 || took.count() < best){ best = took.count(); }
+	}
+	Report::collect(nullptr);
+	std::cout << "Name analysis, " << GLOBALS << " globals, "
+		<< FUNCTIONS << " functions " << DEPTH << " blocks deep:\n"
+		<< "  whole pass: " << best << " ms\n";
+
+	std::vector<Op> ops = makeTrace();
+	size_t flat = 0;
+	size_t stacked = 0;
+	double flatTime = replay<SymbolTable>(ops, flat);
+	double stackTime = replay<ScopeStack>(ops, stacked);
+	if (flat != stacked || flat == 0){
+		std::cerr << "The tables disagree on " << ops.size()
+			<< " operations\n";
+		return 1;
+	}
+	std::cout << "  " << ops.size() << " table operations:\n"
+		<< "    SymbolTable: " << flatTime << " ms\n"
+		<< "    map per scope: " << stackTime << " ms\n";
+	return 0;
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "document.hpp"
+#include "errors.hpp"
+
+/*
+Edit latency of the incremental front end (Document) on a program of
+some 30,000 lines, against parsing it from scratch. The edits are the
+kind made while typing: a literal changed, a statement added and
+removed again, a semicolon deleted and put back (which leaves the
+program broken in between), a global declared between functions.
+After every few edits the tree is checked against a fresh parse of
+the same text: same unparse, same position for every declaration.
+*/
+
+using cshanty::Diagnostics;
+using cshanty::DeclNode;
+using cshanty::Document;
+using cshanty::ProgramNode;
+using cshanty::Report;
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t FUNCTIONS = 2500;
+static const size_t EDITS = 4000;
+static const size_t CHECK_EVERY = 50;
+
+static std::string makeProgram(){
+	std::ostringstream text;
+	text << "record Point {\n\tint x;\n\tint y;\n}\n";
+	for (size_t f = 0; f < FUNCTIONS; f++){
+		text << "int g" << f << ";\n"
+			<< "// function number " << f << "\n"
+			<< "int f" << f << "(int a, bool b) {\n"
+			<< "\tint x;\n"
+			<< "\tx = a + " << f << ";\n"
+			<< "\tif (x > 3) {\n"
+			<< "\t\tx = x - 1;\n"
+			<< "\t}\n"
+			<< "\twhile (b) {\n"
+			<< "\t\tx++;\n"
+			<< "\t}\n"
+			<< "\treturn x;\n"
+			<< "}\n";
+	}
+	return text.str();
+}
+
+static std::string unparse(ProgramNode * program){
+	if (program == nullptr){ return "(no program)"; }
+	std::ostringstream out;
+	program->unparse(out, 0);
+	for (DeclNode * decl : program->globals()){
+		out << decl->posStr() << "\n";
+	}
+	return out.str();
+}
+
+static size_t reparsed = 0;
+
+/** Make one edit, quietly, and return how long it took in us **/
+static double timedEdit(Document& doc, size_t begin, size_t end,
+	const std::string& text){
+	Diagnostics sink("bench");
+	Report::collect(&sink);
+	Clock::time_point start = Clock::now();
+	doc.edit(begin, end, text);
+	std::chrono::duration<double, std::micro> took = Clock::now() - start;
+	Report::collect(nullptr);
+	reparsed += doc.reparsed();
+	return took.count();
+}
+
+static bool check(Document& doc){
+	Diagnostics sink("bench");
+	Report::collect(&sink);
+	Document fresh("bench", true);
+	fresh.load(doc.text());
+	Report::collect(nullptr);
+	return unparse(doc.program()) == unparse(fresh.program());
+}
+
+int main(){
+	std::string program = makeProgram();
+	size_t lines = static_cast<size_t>(
+		std::count(program.begin(), program.end(), '\n'));
+	Document doc("bench", true);
+
+	Clock::time_point start = Clock::now();
+	doc.load(program);
+	std::chrono::duration<double, std::milli> full = Clock::now() - start;
+	std::cout << "Incremental reparse, " << lines << " lines, "
+		<< doc.reparsed() << " declarations:\n"
+		<< "  full parse: " << full.count() << " ms\n";
+
+	std::mt19937 rng(665);
+	std::uniform_int_distribution<size_t> pick(0, FUNCTIONS - 1);
+	std::uniform_int_distribution<int> kind(0, 3);
+	std::vector<double> times;
+	size_t rounds = 0;
+	while (times.size() < EDITS){
+		const std::string& text = doc.text();
+		std::string name = "int f" + std::to_string(pick(rng)) + "(";
+		size_t fn = text.find(name);
+		switch (kind(rng)){
+		case 0: {
+			size_t at = text.find("a + ", fn) + 4;
+			size_t len = text.find(';', at) - at;
+			std::string lit = std::to_string(pick(rng));
+			times.push_back(timedEdit(doc, at, at + len, lit));
+			break;
+		}
+		case 1: {
+			size_t at = text.find("\tint x;\n", fn) + 8;
+			times.push_back(timedEdit(doc, at, at, "\tx = 7;\n"));
+			times.push_back(timedEdit(doc, at, at + 8, ""));
+			break;
+		}
+		case 2: {
+			size_t at = text.find("return x;", fn) + 8;
+			times.push_back(timedEdit(doc, at, at + 1, ""));
+			if (doc.program() != nullptr){
+				std::cerr << "Broken function still parses\n";
+				return 1;
+			}
+			times.push_back(timedEdit(doc, at, at, ";"));
+			break;
+		}
+		case 3:
+			times.push_back(timedEdit(doc, fn, fn, "bool h;\n"));
+			break;
+		}
+		if (++rounds % CHECK_EVERY == 0 && !check(doc)){
+			std::cerr << "Reparse differs from a full parse after "
+				<< times.size() << " edits\n";
+			return 1;
+		}
+	}
+	if (doc.program() == nullptr || !check(doc)){
+		std::cerr << "Reparse differs from a full parse at the end\n";
+		return 1;
+	}
+
+	std::sort(times.begin(), times.end());
+	double sum = 0;
+	for (double t : times){ sum += t; }
+	std::cout << "  " << times.size() << " edits, mean "
+		<< sum / static_cast<double>(times.size()) << " us, median "
+		<< times[times.size() / 2] << " us, p99 "
+		<< times[times.size() * 99 / 100] << " us, max "
+		<< times.back() << " us\n"
+		<< "  declarations reparsed per edit: "
+		<< static_cast<double>(reparsed) / static_cast<double>(times.size())
+		<< "\n";
+	return 0;
+}
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include "arena.hpp"
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "errors.hpp"
+#include "interp.hpp"
+#include "pipeline.hpp"
+#include "vm.hpp"
+
+/*
+Running time of the loop-heavy programs in loops/: counting loops,
+trial division, Collatz chains, recursive calls and record fields.
+Each program is parsed and checked once, then run a few times by the
+tree-walking interpreter (-r) and a few times on the bytecode VM (-R);
+the best time of each is reported, with what the program printed so
+that a wrong answer shows. The VM's time includes compiling to
+bytecode.
+*/
+
+using cshanty::Arena;
+using cshanty::Bytecode;
+using cshanty::Diagnostics;
+using cshanty::Interpreter;
+using cshanty::Pipeline;
+using cshanty::ProgramNode;
+using cshanty::Report;
+using cshanty::VM;
+
+typedef std::chrono::steady_clock Clock;
+
+static const char * const PROGRAMS[] = {
+	"loops/sum.cshanty",
+	"loops/primes.cshanty",
+	"loops/collatz.cshanty",
+	"loops/fib.cshanty",
+	"loops/records.cshanty",
+};
+static const size_t RUNS = 3;
+
+/** Run program once, on the VM if vm; returns how long it took in
+    ms **/
+static double timedRun(ProgramNode * program, bool vm,
+	std::string& output){
+	std::istringstream in;
+	std::ostringstream out;
+	Clock::time_point start = Clock::now();
+	if (vm){
+		std::unique_ptr<Bytecode> code(Bytecode::compile(program));
+		VM machine(*code, in, out);
+		machine.run();
+	} else {
+		Interpreter interpreter(program, in, out);
+		interpreter.run();
+	}
+	std::chrono::duration<double, std::milli> took = Clock::now() - start;
+	output = out.str();
+	return took.count();
+}
+
+/** The best of RUNS runs of program **/
+static double bestRun(ProgramNode * program, bool vm,
+	std::string& output){
+	double best = 0;
+	for (size_t run = 0; run < RUNS; run++){
+		double took = timedRun(program, vm, output);
+		if (run == 0 || took < best){ best = took; }
+	}
+	return best;
+}
+
+int main(){
+	std::cout << "Tree-walking interpreter vs bytecode VM, best of "
+		<< RUNS << " runs:\n";
+	for (const char * path : PROGRAMS){
+		Diagnostics diags(path);
+		Report::collect(&diags);
+		Arena arena;
+		Pipeline pipeline(path, arena);
+		pipeline.mapInput(true);
+		ProgramNode * program = nullptr;
+		try {
+			pipeline.open();
+			program = pipeline.parse();
+		} catch (cshanty::InternalError * e){
+			delete e;
+		}
+		if (program == nullptr || !pipeline.nameAnalysis(program)
+		  || !pipeline.typeAnalysis(program)){
+			Report::collect(nullptr);
+			diags.emit(std::cerr, Diagnostics::Format::Text);
+			std::cerr << "Can't run " << path
+				<< " (run from the bench directory)\n";
+			return 1;
+		}
+
+		std::string walked, compiled;
+		double tree = bestRun(program, false, walked);
+		double vm = bestRun(program, true, compiled);
+		Report::collect(nullptr);
+		std::cout << "  " << path << ": " << tree << " ms vs " << vm
+			<< " ms, " << tree / vm << "x (printed " << walked << ")\n";
+		if (compiled != walked){
+			std::cerr << "The VM printed " << compiled << " instead\n";
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,630 @@
+#include <algorithm>
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "errors.hpp"
+#include "interp.hpp"
+
+namespace cshanty{
+
+/*
+The compiler walks each function's tree once, emitting code for the
+VM as it goes. It uses the same layout as the interpreter (see
+allocate in interp.cpp): a local's slot in its frame is its register,
+so using a local costs no instruction at all, and the temporaries an
+expression needs come after the locals. A call's frame starts at the
+first free register of its caller's, and its arguments are compiled
+straight into their formals' registers there.
+
+Everything runs in the order the interpreter runs it: operands left to
+right, && and || short-circuit, and a record argument is copied when
+it is passed.
+*/
+
+static const char * emptyString(){
+	return Symbol::intern(StrView("", 0)).c_str();
+}
+
+/* The register for slot in a frame */
+static uint16_t reg(uint32_t slot){
+	if (slot >= NO_REG){
+		throw new InternalError("Function too big for the bytecode VM");
+	}
+	return static_cast<uint16_t>(slot);
+}
+
+Bytecode * Bytecode::compile(ProgramNode * program){
+	uint32_t globals;
+	FnDeclNode * main = Interpreter::prepare(program, globals);
+	Bytecode * module = new Bytecode();
+	Slot zero;
+	zero.i = 0;
+	module->myGlobals.assign(globals, zero);
+	//Number every function first, so a call can come before its callee
+	std::vector<FnDeclNode *> fns;
+	for (DeclNode * decl : program->globals()){
+		FnDeclNode * fn = dynamic_cast<FnDeclNode *>(decl);
+		if (fn != nullptr){
+			module->myFnIndex[fn] = static_cast<uint32_t>(fns.size());
+			module->myFns.push_back(
+				VMFunction(fn->id()->getName(), fn->frameSize()));
+			fns.push_back(fn);
+		}
+		VarDeclNode * var = dynamic_cast<VarDeclNode *>(decl);
+		if (var != nullptr){
+			const char * empty = emptyString();
+			std::vector<Slot>& slots = module->myGlobals;
+			FrameLayout::eachScalar(var->type(), var->slot(),
+				[&](uint32_t slot, Type t){
+					if (t.isString()){ slots[slot].s = empty; }
+				});
+		}
+	}
+	module->myMain = module->function(main);
+	for (size_t i = 0; i < fns.size(); i++){
+		FnCompiler fc(*module, module->myFns[i]);
+		for (StmtNode * stmt : fns[i]->body()){ stmt->compile(fc); }
+		bool isVoid = fns[i]->retType()->asType().isVoid();
+		fc.emit(isVoid ? Op::RETV : Op::NORET, 0, 0, 0, fns[i]->pos());
+	}
+	return module;
+}
+
+uint32_t Bytecode::constant(Slot value){
+	auto found = myConstantIndex.find(value.i);
+	if (found != myConstantIndex.end()){ return found->second; }
+	uint32_t index = static_cast<uint32_t>(myConstants.size());
+	myConstants.push_back(value);
+	myConstantIndex[value.i] = index;
+	return index;
+}
+
+uint32_t Bytecode::constant(int32_t value){
+	Slot slot;
+	slot.i = value;
+	return constant(slot);
+}
+
+uint32_t Bytecode::constant(const char * value){
+	Slot slot;
+	slot.i = 0;
+	slot.s = value;
+	return constant(slot);
+}
+
+FnCompiler::FnCompiler(Bytecode& module, VMFunction& fn)
+: myModule(module), myFn(fn), myLocals(reg(fn.locals())),
+  myTemps(myLocals){
+}
+
+uint32_t FnCompiler::emit(Op op, uint16_t a, uint16_t b, uint16_t c,
+	const Position& pos){
+	Instr instr;
+	instr.op = op;
+	instr.a = a;
+	instr.bc = static_cast<uint32_t>(b) | static_cast<uint32_t>(c) << 16;
+	myFn.myCode.push_back(instr);
+	myFn.myWhere.push_back(pos);
+	return here() - 1;
+}
+
+uint32_t FnCompiler::emitK(Op op, uint16_t a, uint32_t k,
+	const Position& pos){
+	Instr instr;
+	instr.op = op;
+	instr.a = a;
+	instr.bc = k;
+	myFn.myCode.push_back(instr);
+	myFn.myWhere.push_back(pos);
+	return here() - 1;
+}
+
+void FnCompiler::patch(uint32_t index, uint32_t target){
+	Instr& jump = myFn.myCode[index];
+	if (jump.op == Op::JMP || jump.op == Op::JMPF || jump.op == Op::JMPT){
+		jump.bc = target;
+	} else {
+		//A compare and jump has only 16 bits for where it goes
+		jump.bc = jump.b() | static_cast<uint32_t>(reg(target)) << 16;
+	}
+}
+
+void FnCompiler::rewind(uint32_t from){
+	myFn.myCode.resize(from);
+	myFn.myWhere.resize(from);
+}
+
+void FnCompiler::insert(uint32_t at, Op op, uint16_t a, uint16_t b,
+	uint16_t c, const Position& pos){
+	uint32_t last = emit(op, a, b, c, pos);
+	std::rotate(myFn.myCode.begin() + at, myFn.myCode.begin() + last,
+		myFn.myCode.end());
+	std::rotate(myFn.myWhere.begin() + at, myFn.myWhere.begin() + last,
+		myFn.myWhere.end());
+	for (uint32_t i = at + 1; i < here(); i++){
+		const Instr& instr = myFn.myCode[i];
+		if (instr.op < Op::JMP || instr.op > Op::JNEK){ continue; }
+		uint32_t target = instr.op <= Op::JMPT ? instr.k() : instr.c();
+		if (target > at){ patch(i, target + 1); }
+	}
+}
+
+bool FnCompiler::calls(uint32_t from) const{
+	for (size_t i = from; i < myFn.myCode.size(); i++){
+		Op op = myFn.myCode[i].op;
+		if (op == Op::CALL || op == Op::CALLR){ return true; }
+	}
+	return false;
+}
+
+uint16_t FnCompiler::temp(uint32_t count){
+	uint16_t first = myTemps;
+	myTemps = reg(myTemps + count);
+	myFn.myRegisters = std::max<uint32_t>(myFn.myRegisters, myTemps);
+	return first;
+}
+
+uint16_t FnCompiler::operand(ExpNode * exp){
+	LValNode * lval = dynamic_cast<LValNode *>(exp);
+	if (lval != nullptr && !exp->type().isRecord()
+	  && !lval->varDecl()->global()){
+		return reg(lval->varDecl()->slot() + lval->offset());
+	}
+	uint16_t into = temp();
+	exp->compile(*this, into);
+	return into;
+}
+
+bool FnCompiler::writes(uint16_t reg, uint32_t from) const{
+	for (size_t i = from; i < myFn.myCode.size(); i++){
+		const Instr& instr = myFn.myCode[i];
+		switch (instr.op){
+		case Op::SET: case Op::JMP: case Op::JMPF: case Op::JMPT:
+		case Op::JLT: case Op::JLE: case Op::JGT: case Op::JGE:
+		case Op::JEQ: case Op::JNE: case Op::JLTK: case Op::JLEK:
+		case Op::JGTK: case Op::JGEK: case Op::JEQK: case Op::JNEK:
+		case Op::RESERVE:
+		case Op::RET: case Op::RETV: case Op::NORET:
+		case Op::PRINTI: case Op::PRINTB: case Op::PRINTS:
+			break;
+		case Op::CALL: case Op::CALLR:
+			if (instr.c() == reg){ return true; }
+			break;
+		case Op::COPY:
+			if (reg >= instr.a && reg < instr.a + instr.c()){ return true; }
+			break;
+		default:
+			if (instr.a == reg){ return true; }
+		}
+	}
+	return false;
+}
+
+void FnCompiler::operands(ExpNode * left, ExpNode * right, uint16_t& l,
+	uint16_t& r){
+	l = operand(left);
+	uint32_t from = here();
+	uint16_t temps = mark();
+	r = operand(right);
+	if (l < myLocals && writes(l, from)){
+		//right assigns to the local left read, so left's value has to
+		// be taken before right runs: compile right again after a copy
+		rewind(from);
+		release(temps);
+		uint16_t copy = temp();
+		emit(Op::MOVE, copy, l, 0, left->pos());
+		l = copy;
+		r = operand(right);
+	}
+}
+
+/* The form of op that takes a constant as its right operand, or op
+   if it has none */
+static Op constantForm(Op op){
+	switch (op){
+	case Op::ADD: return Op::ADDK;
+	case Op::SUB: return Op::SUBK;
+	case Op::MUL: return Op::MULK;
+	case Op::DIV: return Op::DIVK;
+	case Op::JLT: return Op::JLTK;
+	case Op::JLE: return Op::JLEK;
+	case Op::JGT: return Op::JGTK;
+	case Op::JGE: return Op::JGEK;
+	case Op::JEQ: return Op::JEQK;
+	case Op::JNE: return Op::JNEK;
+	default: return op;
+	}
+}
+
+/* Whether some op does what op does with its operands swapped, and
+   if so which */
+static bool mirror(Op op, Op& swapped){
+	switch (op){
+	case Op::ADD: case Op::MUL: case Op::JEQ: case Op::JNE:
+		swapped = op;
+		return true;
+	case Op::JLT: swapped = Op::JGT; return true;
+	case Op::JLE: swapped = Op::JGE; return true;
+	case Op::JGT: swapped = Op::JLT; return true;
+	case Op::JGE: swapped = Op::JLE; return true;
+	default: return false;
+	}
+}
+
+bool FnCompiler::literal(ExpNode * exp, uint16_t& k){
+	uint32_t index;
+	if (IntLitNode * num = dynamic_cast<IntLitNode *>(exp)){
+		index = myModule.constant(num->value());
+	} else if (StrLitNode * str = dynamic_cast<StrLitNode *>(exp)){
+		index = myModule.constant(str->text().c_str());
+	} else if (dynamic_cast<TrueNode *>(exp) != nullptr){
+		index = myModule.constant(1);
+	} else if (dynamic_cast<FalseNode *>(exp) != nullptr){
+		index = myModule.constant(0);
+	} else {
+		return false;
+	}
+	if (index >= NO_REG){ return false; }
+	k = static_cast<uint16_t>(index);
+	return true;
+}
+
+Op FnCompiler::operands(Op op, ExpNode * left, ExpNode * right,
+	uint16_t& l, uint16_t& r){
+	Op withConstant = constantForm(op);
+	if (withConstant != op){
+		//A literal can be read after the other side runs, as it can't
+		// be changed by it
+		Op swapped;
+		if (literal(right, r)){
+			l = operand(left);
+			return withConstant;
+		} else if (mirror(op, swapped) && literal(left, r)){
+			l = operand(right);
+			return constantForm(swapped);
+		}
+	}
+	operands(left, right, l, r);
+	return op;
+}
+
+uint32_t FnCompiler::branch(ExpNode * cond, bool taken){
+	NotNode * negated = dynamic_cast<NotNode *>(cond);
+	if (negated != nullptr){ return branch(negated->operand(), !taken); }
+	//A comparison jumps on its own result, without making a bool
+	Op jump;
+	if (dynamic_cast<LessNode *>(cond) != nullptr){
+		jump = taken ? Op::JLT : Op::JGE;
+	} else if (dynamic_cast<LessEqNode *>(cond) != nullptr){
+		jump = taken ? Op::JLE : Op::JGT;
+	} else if (dynamic_cast<GreaterNode *>(cond) != nullptr){
+		jump = taken ? Op::JGT : Op::JLE;
+	} else if (dynamic_cast<GreaterEqNode *>(cond) != nullptr){
+		jump = taken ? Op::JGE : Op::JLT;
+	} else if (dynamic_cast<EqualsNode *>(cond) != nullptr){
+		jump = taken ? Op::JEQ : Op::JNE;
+	} else if (dynamic_cast<NotEqualsNode *>(cond) != nullptr){
+		jump = taken ? Op::JNE : Op::JEQ;
+	} else {
+		uint16_t temps = mark();
+		uint16_t value = operand(cond);
+		release(temps);
+		return emitK(taken ? Op::JMPT : Op::JMPF, value, 0, cond->pos());
+	}
+	BinaryExpNode * compare = static_cast<BinaryExpNode *>(cond);
+	uint16_t temps = mark();
+	uint16_t l, r;
+	jump = operands(jump, compare->left(), compare->right(), l, r);
+	release(temps);
+	return emit(jump, l, r, 0, cond->pos());
+}
+
+uint16_t FnCompiler::target(LValNode * lval){
+	VarDeclNode * var = lval->varDecl();
+	if (var->global()){ return temp(); }
+	return reg(var->slot() + lval->offset());
+}
+
+void FnCompiler::load(LValNode * lval, uint16_t dst, const Position& pos){
+	VarDeclNode * var = lval->varDecl();
+	uint32_t slot = var->slot() + lval->offset();
+	bool record = lval->type().isRecord();
+	if (var->global()){
+		emitK(record ? Op::GADDR : Op::GET, dst, slot, pos);
+	} else if (record){
+		emit(Op::ADDR, dst, reg(slot), 0, pos);
+	} else if (dst != slot){
+		emit(Op::MOVE, dst, reg(slot), 0, pos);
+	}
+}
+
+void FnCompiler::store(LValNode * lval, uint16_t src, const Position& pos){
+	VarDeclNode * var = lval->varDecl();
+	uint32_t slot = var->slot() + lval->offset();
+	if (var->global()){
+		emitK(Op::SET, src, slot, pos);
+	} else if (src != slot){
+		emit(Op::MOVE, reg(slot), src, 0, pos);
+	}
+}
+
+void FnCompiler::initialize(uint32_t slot, TypeNode * type,
+	const Position& pos){
+	uint32_t zero = myModule.constant(0);
+	uint32_t empty = myModule.constant(emptyString());
+	FrameLayout::eachScalar(type, slot, [&](uint32_t at, Type kind){
+		emitK(Op::LOADK, reg(at), kind.isString() ? empty : zero, pos);
+	});
+}
+
+static void compileAll(NodeSpan<StmtNode> stmts, FnCompiler& fc){
+	for (StmtNode * stmt : stmts){ stmt->compile(fc); }
+}
+
+static void compileBinary(FnCompiler& fc, Op op, ExpNode * left,
+	ExpNode * right, uint16_t dst, const Position& pos){
+	uint16_t temps = fc.mark();
+	uint16_t l, r;
+	op = fc.operands(op, left, right, l, r);
+	fc.emit(op, dst, l, r, pos);
+	fc.release(temps);
+}
+
+static void compileUnary(FnCompiler& fc, Op op, ExpNode * operand,
+	uint16_t dst, const Position& pos){
+	uint16_t temps = fc.mark();
+	fc.emit(op, dst, fc.operand(operand), 0, pos);
+	fc.release(temps);
+}
+
+void VarDeclNode::compile(FnCompiler& fc){
+	fc.initialize(mySlot, myType, pos());
+}
+
+void RecordTypeDeclNode::compile(FnCompiler&){ }
+
+void FnDeclNode::compile(FnCompiler&){ }
+
+void AssignStmtNode::compile(FnCompiler& fc){
+	assignment->compile(fc, NO_REG);
+}
+
+void CallStmtNode::compile(FnCompiler& fc){
+	Function->compile(fc, NO_REG);
+}
+
+void PostIncStmtNode::compile(FnCompiler& fc){
+	uint16_t temps = fc.mark();
+	uint16_t value = fc.operand(variable);
+	fc.emit(Op::INC, value, 0, 0, pos());
+	fc.store(variable, value, pos());
+	fc.release(temps);
+}
+
+void PostDecStmtNode::compile(FnCompiler& fc){
+	uint16_t temps = fc.mark();
+	uint16_t value = fc.operand(variable);
+	fc.emit(Op::DEC, value, 0, 0, pos());
+	fc.store(variable, value, pos());
+	fc.release(temps);
+}
+
+void ReceiveStmtNode::compile(FnCompiler& fc){
+	Type type = variable->type();
+	Op op = type.isString() ? Op::READS
+		: type.isBool() ? Op::READB : Op::READI;
+	uint16_t temps = fc.mark();
+	uint16_t into = fc.target(variable);
+	fc.emit(op, into, 0, 0, pos());
+	fc.store(variable, into, pos());
+	fc.release(temps);
+}
+
+void ReportStmtNode::compile(FnCompiler& fc){
+	Type type = expression->type();
+	Op op = type.isString() ? Op::PRINTS
+		: type.isBool() ? Op::PRINTB : Op::PRINTI;
+	uint16_t temps = fc.mark();
+	fc.emit(op, fc.operand(expression), 0, 0, pos());
+	fc.release(temps);
+}
+
+void ReturnStmtNode::compile(FnCompiler& fc){
+	if (expression == nullptr){
+		fc.emit(Op::RETV, 0, 0, 0, pos());
+		return;
+	}
+	uint16_t temps = fc.mark();
+	fc.emit(Op::RET, fc.operand(expression), 0, 0, pos());
+	fc.release(temps);
+}
+
+void WhileStmtNode::compile(FnCompiler& fc){
+	//The condition goes after the body, so each time round is one jump
+	uint32_t enter = fc.emitK(Op::JMP, 0, 0, pos());
+	uint32_t body = fc.here();
+	compileAll(WhileBody, fc);
+	fc.patch(enter, fc.here());
+	fc.patch(fc.branch(condition, true), body);
+}
+
+void IfStmtNode::compile(FnCompiler& fc){
+	uint32_t skip = fc.branch(condition, false);
+	compileAll(IfBody, fc);
+	fc.patch(skip, fc.here());
+}
+
+void IfElseStmtNode::compile(FnCompiler& fc){
+	uint32_t otherwise = fc.branch(condition, false);
+	compileAll(IfTrueBody, fc);
+	uint32_t done = fc.emitK(Op::JMP, 0, 0, pos());
+	fc.patch(otherwise, fc.here());
+	compileAll(IfFalseBody, fc);
+	fc.patch(done, fc.here());
+}
+
+void TrueNode::compile(FnCompiler& fc, uint16_t dst){
+	fc.emitK(Op::LOADK, dst, fc.module().constant(1), pos());
+}
+
+void FalseNode::compile(FnCompiler& fc, uint16_t dst){
+	fc.emitK(Op::LOADK, dst, fc.module().constant(0), pos());
+}
+
+void IntLitNode::compile(FnCompiler& fc, uint16_t dst){
+	fc.emitK(Op::LOADK, dst, fc.module().constant(numval), pos());
+}
+
+void StrLitNode::compile(FnCompiler& fc, uint16_t dst){
+	fc.emitK(Op::LOADK, dst, fc.module().constant(text().c_str()), pos());
+}
+
+VarDeclNode * IDNode::varDecl() const{
+	return static_cast<VarDeclNode *>(myDecl);
+}
+
+uint32_t IDNode::offset() const{ return 0; }
+
+void IDNode::compile(FnCompiler& fc, uint16_t dst){
+	fc.load(this, dst, pos());
+}
+
+VarDeclNode * IndexNode::varDecl() const{
+	return Id_being_accessed->varDecl();
+}
+
+uint32_t IndexNode::offset() const{
+	VarDeclNode * field = static_cast<VarDeclNode *>(
+		field_Name_being_accessed->decl());
+	return Id_being_accessed->offset() + field->slot();
+}
+
+void IndexNode::compile(FnCompiler& fc, uint16_t dst){
+	fc.load(this, dst, pos());
+}
+
+void NegNode::compile(FnCompiler& fc, uint16_t dst){
+	compileUnary(fc, Op::NEG, expression, dst, pos());
+}
+
+void NotNode::compile(FnCompiler& fc, uint16_t dst){
+	compileUnary(fc, Op::NOT, expression, dst, pos());
+}
+
+void PlusNode::compile(FnCompiler& fc, uint16_t dst){
+	compileBinary(fc, Op::ADD, leftNode, rightNode, dst, pos());
+}
+
+void MinusNode::compile(FnCompiler& fc, uint16_t dst){
+	compileBinary(fc, Op::SUB, leftNode, rightNode, dst, pos());
+}
+
+void TimesNode::compile(FnCompiler& fc, uint16_t dst){
+	compileBinary(fc, Op::MUL, leftNode, rightNode, dst, pos());
+}
+
+void DivideNode::compile(FnCompiler& fc, uint16_t dst){
+	compileBinary(fc, Op::DIV, leftNode, rightNode, dst, pos());
+}
+
+void LessNode::compile(FnCompiler& fc, uint16_t dst){
+	compileBinary(fc, Op::LT, leftNode, rightNode, dst, pos());
+}
+
+void LessEqNode::compile(FnCompiler& fc, uint16_t dst){
+	compileBinary(fc, Op::LE, leftNode, rightNode, dst, pos());
+}
+
+void GreaterNode::compile(FnCompiler& fc, uint16_t dst){
+	compileBinary(fc, Op::GT, leftNode, rightNode, dst, pos());
+}
+
+void GreaterEqNode::compile(FnCompiler& fc, uint16_t dst){
+	compileBinary(fc, Op::GE, leftNode, rightNode, dst, pos());
+}
+
+void EqualsNode::compile(FnCompiler& fc, uint16_t dst){
+	compileBinary(fc, Op::EQ, leftNode, rightNode, dst, pos());
+}
+
+void NotEqualsNode::compile(FnCompiler& fc, uint16_t dst){
+	compileBinary(fc, Op::NE, leftNode, rightNode, dst, pos());
+}
+
+/* left && right or left || right into dst. dst is only written once
+   nothing else in the expression will read it */
+static void compileLogical(FnCompiler& fc, bool isAnd, ExpNode * left,
+	ExpNode * right, uint16_t dst, const Position& pos){
+	uint32_t shortCut = fc.branch(left, !isAnd);
+	right->compile(fc, dst);
+	uint32_t done = fc.emitK(Op::JMP, 0, 0, pos);
+	fc.patch(shortCut, fc.here());
+	fc.emitK(Op::LOADK, dst, fc.module().constant(isAnd ? 0 : 1), pos);
+	fc.patch(done, fc.here());
+}
+
+void AndNode::compile(FnCompiler& fc, uint16_t dst){
+	compileLogical(fc, true, leftNode, rightNode, dst, pos());
+}
+
+void OrNode::compile(FnCompiler& fc, uint16_t dst){
+	compileLogical(fc, false, leftNode, rightNode, dst, pos());
+}
+
+void AssignExpNode::compile(FnCompiler& fc, uint16_t dst){
+	uint16_t temps = fc.mark();
+	uint16_t into = fc.target(variable);
+	if (into >= temps && dst != NO_REG){
+		//A global: compute straight into where the value is wanted
+		fc.release(temps);
+		into = dst;
+	}
+	expression->compile(fc, into);
+	fc.store(variable, into, pos());
+	if (dst != NO_REG && dst != into){
+		fc.emit(Op::MOVE, dst, into, 0, pos());
+	}
+	fc.release(temps);
+}
+
+/* Compile the arguments of a call to fn straight into the formals'
+   registers of its frame, which starts at register base */
+static void compileArgs(FnCompiler& fc, NodeSpan<ExpNode> args,
+	FnDeclNode * fn, uint16_t base){
+	NodeSpan<FormalDeclNode> formals = fn->formals();
+	for (size_t i = 0; i < args.size(); i++){
+		uint16_t slot = reg(base + formals[i]->slot());
+		if (args[i]->type().isRecord()){
+			//Records are passed by value
+			uint16_t temps = fc.mark();
+			uint16_t from = fc.operand(args[i]);
+			fc.emit(Op::COPY, slot, from,
+				reg(FrameLayout::slotsFor(formals[i]->type())),
+				args[i]->pos());
+			fc.release(temps);
+		} else {
+			args[i]->compile(fc, slot);
+		}
+	}
+}
+
+void CallExpNode::compile(FnCompiler& fc, uint16_t dst){
+	FnDeclNode * fn = static_cast<FnDeclNode *>(nameFunc->decl());
+	uint16_t index = reg(fc.module().function(fn));
+	uint16_t temps = fc.mark();
+	uint16_t base = fc.temp(fn->frameSize());
+	uint32_t from = fc.here();
+	compileArgs(fc, arguments, fn, base);
+	Op call = Op::CALL;
+	if (fc.calls(from)){
+		//The interpreter takes a call's frame before working out its
+		// arguments, so when they make calls of their own, this one
+		// has to run out of stack first. Compiling them again after a
+		// RESERVE would double the work at each level of nested calls
+		fc.insert(from, Op::RESERVE, 0, index, 0, pos());
+		call = Op::CALLR;
+	}
+	fc.emit(call, base, index, dst, pos());
+	fc.release(temps);
+}
+
+}
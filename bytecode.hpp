@@ -0,0 +1,223 @@
+#ifndef CSHANTY_BYTECODE_H
+#define CSHANTY_BYTECODE_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "intern.hpp"
+#include "position.hpp"
+
+namespace cshanty{
+
+class FnDeclNode;
+class ExpNode;
+class LValNode;
+class ProgramNode;
+class TypeNode;
+
+/**
+* \class Slot
+* One register or global of the bytecode VM. Slots are untagged: the
+* compiler knows the type of everything it reads. An int is kept
+* sign-extended in i and a bool as 0 or 1 in i; a string is its
+* interned characters, so strings are equal exactly when their slots
+* are; a record is a pointer to its first field.
+**/
+union Slot{
+	int64_t i;
+	const char * s;
+	Slot * p;
+};
+
+/** What an instruction does. R is the registers of the running
+    function's frame, K the constant pool and G the globals. Keep the
+    order in step with the dispatch table in vm.cpp **/
+enum class Op : uint8_t{
+	LOADK,        // R[a] = K[k]
+	MOVE,         // R[a] = R[b]
+	GET,          // R[a] = G[k]
+	SET,          // G[k] = R[a]
+	ADDR,         // R[a] = &R[b]
+	GADDR,        // R[a] = &G[k]
+	COPY,         // R[a], R[a+1], ... = the c slots R[b] points at
+	ADD, SUB, MUL, DIV,      // R[a] = R[b] op R[c], saturating
+	ADDK, SUBK, MULK, DIVK,  // R[a] = R[b] op K[c], saturating
+	NEG,          // R[a] = -R[b]
+	NOT,          // R[a] = !R[b]
+	INC, DEC,     // R[a] = R[a] +/- 1
+	LT, LE, GT, GE, EQ, NE,  // R[a] = R[b] op R[c]
+	JMP,          // go to k
+	JMPF, JMPT,   // go to k if R[a] is false / true
+	JLT, JLE, JGT, JGE, JEQ, JNE,  // go to c if R[a] op R[b]
+	JLTK, JLEK, JGTK, JGEK, JEQK, JNEK,  // go to c if R[a] op K[b]
+	RESERVE,      // take the frame for a call to function b
+	CALL,         // R[c] = function b, its frame starting at R[a]
+	CALLR,        // CALL, the frame already taken by RESERVE
+	RET,          // return R[a]
+	RETV,         // return nothing
+	NORET,        // fail: a function that returns a value didn't
+	PRINTI, PRINTB, PRINTS,  // report R[a]
+	READI, READB, READS      // receive into R[a]
+};
+static const size_t NUM_OPS = static_cast<size_t>(Op::READS) + 1;
+
+/**
+* \class Instr
+* One 8-byte instruction: an op and up to three 16-bit operands, or
+* an op, one 16-bit operand and a 32-bit one (k). Jump targets are
+* instruction indices in the same function.
+**/
+struct Instr{
+	Op op;
+	uint16_t a;
+	uint32_t bc;
+
+	uint16_t b() const { return static_cast<uint16_t>(bc); }
+	uint16_t c() const { return static_cast<uint16_t>(bc >> 16); }
+	uint32_t k() const { return bc; }
+};
+
+/** A register operand meaning "nowhere": the value is not wanted **/
+static const uint16_t NO_REG = 0xFFFF;
+
+/**
+* \class VMFunction
+* One function's code. Its frame has registers() slots: first the
+* locals() slots its formals and locals were allocated (see
+* FnDeclNode::frameSize), then the temporaries its expressions need.
+* where() holds the position of the node each instruction came from,
+* for runtime errors.
+**/
+class VMFunction{
+public:
+	VMFunction(Symbol name, uint32_t locals)
+	: myName(name), myLocals(locals), myRegisters(locals){ }
+	Symbol name() const { return myName; }
+	uint32_t locals() const { return myLocals; }
+	const std::vector<Instr>& code() const { return myCode; }
+	const std::vector<Position>& where() const { return myWhere; }
+	uint32_t registers() const { return myRegisters; }
+private:
+	friend class FnCompiler;
+	Symbol myName;
+	uint32_t myLocals;
+	std::vector<Instr> myCode;
+	std::vector<Position> myWhere;
+	uint32_t myRegisters;
+};
+
+/**
+* \class Bytecode
+* A program compiled for the VM (see vm.hpp): a function for each
+* FnDeclNode, the constant pool and the initial values of the
+* globals. Locals live in registers, at the slots allocate gave them,
+* so reading a local is just an index into the frame.
+**/
+class Bytecode{
+public:
+	/** Compile program, which must have passed type analysis.
+	    Reports "No main() to run" and throws FatalError, as the
+	    interpreter does, if there is nothing to run **/
+	static Bytecode * compile(ProgramNode * program);
+
+	const std::vector<VMFunction>& functions() const { return myFns; }
+	const std::vector<Slot>& constants() const { return myConstants; }
+	const std::vector<Slot>& globals() const { return myGlobals; }
+	uint32_t main() const { return myMain; }
+
+	/** The index of the constant pool entry holding value **/
+	uint32_t constant(int32_t value);
+	uint32_t constant(const char * value);
+	/** The index of fn in functions() **/
+	uint32_t function(FnDeclNode * fn) const { return myFnIndex.at(fn); }
+private:
+	Bytecode() : myMain(0){ }
+	uint32_t constant(Slot value);
+
+	std::vector<VMFunction> myFns;
+	std::vector<Slot> myConstants;
+	std::vector<Slot> myGlobals;
+	uint32_t myMain;
+	std::unordered_map<const FnDeclNode *, uint32_t> myFnIndex;
+	std::unordered_map<int64_t, uint32_t> myConstantIndex;
+};
+
+/**
+* \class FnCompiler
+* Compiles one function's body (see bytecode.cpp). Every ExpNode
+* compiles into a register it is given, and takes temporaries above
+* the function's locals for its operands while it does.
+**/
+class FnCompiler{
+public:
+	FnCompiler(Bytecode& module, VMFunction& fn);
+
+	Bytecode& module(){ return myModule; }
+
+	/** Append an instruction, made at pos. Returns its index **/
+	uint32_t emit(Op op, uint16_t a, uint16_t b, uint16_t c,
+		const Position& pos);
+	uint32_t emitK(Op op, uint16_t a, uint32_t k, const Position& pos);
+	/** The index the next instruction will have **/
+	uint32_t here() const {
+		return static_cast<uint32_t>(myFn.myCode.size());
+	}
+	/** Make the jump at index go to target **/
+	void patch(uint32_t index, uint32_t target);
+	/** Drop every instruction from index from on, to compile them
+	    again differently **/
+	void rewind(uint32_t from);
+	/** Put an instruction, made at pos, in at index at, moving the
+	    ones from there on (and where their jumps go) along one **/
+	void insert(uint32_t at, Op op, uint16_t a, uint16_t b, uint16_t c,
+		const Position& pos);
+	/** Whether an instruction from index from on makes a call **/
+	bool calls(uint32_t from) const;
+
+	/** A fresh temporary, or count of them in a row, until
+	    release(mark()) **/
+	uint16_t temp(uint32_t count = 1);
+	uint16_t mark() const { return myTemps; }
+	void release(uint16_t mark){ myTemps = mark; }
+
+	/** A register holding exp's value: the local itself if exp names
+	    a local that can't change before the value is used, else a
+	    temporary it was compiled into **/
+	uint16_t operand(ExpNode * exp);
+	/** Operands for left and right, evaluated in that order **/
+	void operands(ExpNode * left, ExpNode * right, uint16_t& l,
+		uint16_t& r);
+	/** Operands for op on left and right. Returns the op to use:
+	    op, or its form taking a constant (ADDK, JLTK...) when one
+	    side is a literal, with r the constant's index **/
+	Op operands(Op op, ExpNode * left, ExpNode * right, uint16_t& l,
+		uint16_t& r);
+	/** Compile cond, then a jump that is taken when cond's value is
+	    taken. Returns the jump's index, for patch **/
+	uint32_t branch(ExpNode * cond, bool taken);
+
+	/** The register lval's variable (or field) lives in if it is a
+	    local, else a temporary to put its new value in for store **/
+	uint16_t target(LValNode * lval);
+	/** Compile reading the variable (or field) lval names into dst **/
+	void load(LValNode * lval, uint16_t dst, const Position& pos);
+	/** Compile storing src to lval **/
+	void store(LValNode * lval, uint16_t src, const Position& pos);
+	/** Compile setting the slots from slot on of a local of type to
+	    zero, false or "" **/
+	void initialize(uint32_t slot, TypeNode * type, const Position& pos);
+private:
+	/** Whether exp is a literal, and if so its constant's index **/
+	bool literal(ExpNode * exp, uint16_t& k);
+	/** Whether an instruction from index from on writes reg **/
+	bool writes(uint16_t reg, uint32_t from) const;
+
+	Bytecode& myModule;
+	VMFunction& myFn;
+	uint16_t myLocals;
+	uint16_t myTemps;
+};
+
+}
+
+#endif
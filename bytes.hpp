@@ -0,0 +1,118 @@
+#ifndef CSHANTY_BYTES_H
+#define CSHANTY_BYTES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "errors.hpp"
+#include "strview.hpp"
+
+namespace cshanty{
+
+/** 64-bit FNV-1a hash of len bytes **/
+inline uint64_t hashBytes(const char * data, size_t len){
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++){
+		h ^= static_cast<unsigned char>(data[i]);
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/**
+* \class ByteWriter
+* Writes the little-endian fixed-width fields used by the on-disk
+* formats (token streams, cached ASTs).
+**/
+class ByteWriter{
+public:
+	ByteWriter(std::ostream& out) : myOut(out){ }
+	void u8(uint8_t value){
+		char byte = static_cast<char>(value);
+		myOut.write(&byte, 1);
+	}
+	void u32(uint32_t value){
+		char bytes[4];
+		for (size_t i = 0; i < 4; i++){
+			bytes[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+		}
+		myOut.write(bytes, 4);
+	}
+	void u64(uint64_t value){
+		u32(static_cast<uint32_t>(value));
+		u32(static_cast<uint32_t>(value >> 32));
+	}
+	void raw(const char * data, size_t len){
+		myOut.write(data, static_cast<std::streamsize>(len));
+	}
+	/** Length-prefixed bytes **/
+	void bytes(const char * data, size_t len){
+		u32(static_cast<uint32_t>(len));
+		raw(data, len);
+	}
+private:
+	std::ostream& myOut;
+};
+
+/**
+* \class ByteReader
+* Bounds-checked cursor over bytes written by a ByteWriter. Any read
+* past the end, or a failed check(), throws an InternalError naming
+* what was being read, since it means the data was truncated or was
+* never in this format.
+**/
+class ByteReader{
+public:
+	ByteReader(const char * data, size_t size, const std::string& what)
+	: myAt(data), myEnd(data + size), myWhat(what){ }
+	uint8_t u8(){
+		need(1);
+		return static_cast<uint8_t>(*myAt++);
+	}
+	uint32_t u32(){
+		need(4);
+		uint32_t value = 0;
+		for (size_t i = 0; i < 4; i++){
+			value |= static_cast<uint32_t>(
+				static_cast<unsigned char>(myAt[i])) << (8 * i);
+		}
+		myAt += 4;
+		return value;
+	}
+	uint64_t u64(){
+		uint64_t low = u32();
+		uint64_t high = u32();
+		return low | (high << 32);
+	}
+	StrView raw(size_t len){
+		need(len);
+		StrView view(myAt, len);
+		myAt += len;
+		return view;
+	}
+	StrView bytes(){ return raw(u32()); }
+	void skip(size_t len){ need(len); myAt += len; }
+	/** Fail early on counts that can't fit in what is left **/
+	void fits(uint32_t count, size_t each){
+		need(static_cast<size_t>(count) * each);
+	}
+	const char * at() const { return myAt; }
+	size_t left() const { return static_cast<size_t>(myEnd - myAt); }
+	void check(bool ok){ if (!ok){ corrupt(); } }
+	void corrupt(){
+		std::string msg = "Corrupt " + myWhat;
+		throw new InternalError(msg.c_str());
+	}
+private:
+	void need(size_t len){
+		if (left() < len){ corrupt(); }
+	}
+	const char * myAt;
+	const char * myEnd;
+	std::string myWhat;
+};
+
+}
+
+#endif
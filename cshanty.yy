@@ -31,6 +31,7 @@
 
 %parse-param { cshanty::Scanner &scanner }
 %parse-param { cshanty::ProgramNode** root }
+%parse-param { cshanty::Arena &arena }
 %code{
    // C std code for utility functions
    #include <iostream>
@@ -62,8 +63,8 @@ project)
    cshanty::IntLitToken*                   transIntToken;
    cshanty::StrToken*                      transStrToken;
    cshanty::ProgramNode*                   transProgram;
-   std::list<cshanty::DeclNode *> *        transDeclList;
-   std::list<cshanty::VarDeclNode *> *     transVarList;
+   cshanty::NodeList<cshanty::DeclNode> *  transDeclList;
+   cshanty::NodeList<cshanty::VarDeclNode> * transVarList;
    cshanty::DeclNode *                     transDecl;
    cshanty::VarDeclNode *                  transVarDecl;
    cshanty::TypeNode *                     transType;
@@ -71,17 +72,17 @@ project)
    cshanty::LValNode *                     transLVal;
 
    cshanty::ExpNode *                      transExp;
-   std::list<cshanty::ExpNode * > *        transActualsList;
+   cshanty::NodeList<cshanty::ExpNode> *   transActualsList;
    cshanty::ExpNode *                      transterm;
    cshanty::AssignExpNode *                transAssignExp;
    cshanty::CallExpNode *                  transCallExp;
    cshanty::FnDeclNode *                   transFnDecl;
    cshanty::RecordTypeDeclNode *           transRecordTypeDecl;
    cshanty::FormalDeclNode *               transFormalDecl;
-   std::list<cshanty::FormalDeclNode *> *  transFormalDeclList;
+   cshanty::NodeList<cshanty::FormalDeclNode> * transFormalDeclList;
    cshanty::VarDeclNode *                  transVarDecllist;
    cshanty::StmtNode *                     transStmt;
-   std::list<cshanty::StmtNode *> *        transStmtList;
+   cshanty::NodeList<cshanty::StmtNode> *  transStmtList;
 }
 
 %define parse.assert
@@ -180,7 +181,8 @@ project)
 
 program 	: globals
 		  {
-		  $$ = new ProgramNode($1);
+		  Position pos;
+		  $$ = arena.make<ProgramNode>(pos, $1->freeze());
 		  *root = $$;
 		  }
 
@@ -188,11 +190,11 @@ globals 	: globals decl
 			{
 			$$ = $1;
 			DeclNode * declNode = $2;
-			$$->push_back(declNode);
+			if (declNode != nullptr){ $$->push_back(declNode); }
 			}
 			| /* epsilon */
 			{
-			$$ = new std::list<DeclNode * >();
+			$$ = arena.make<NodeList<DeclNode>>(arena);
 			}
 
 decl 	: varDecl
@@ -213,22 +215,29 @@ decl 	: varDecl
 			/* SDD Rules can even be on the same line if you want */
 			$$ = $1;
 		}
+		| error SEMICOL
+		{
+			//Skip to the end of the broken declaration and carry on,
+			// so one run reports every syntax error
+			$$ = nullptr;
+		}
+		| error CLOSE { $$ = nullptr; }
 
 recordDecl	: RECORD id OPEN varDeclList CLOSE
 			{
-				Position * pos = new Position($1->pos(), $5->pos());
-				$$ = new RecordTypeDeclNode(pos, $2, $4);
+				Position pos($1->pos(), $5->pos());
+				$$ = arena.make<RecordTypeDeclNode>(pos, $2, $4->freeze());
  			}
 
 varDecl 	: type id SEMICOL
 		  	{
-		    	Position * p = new Position($1->pos(), $3->pos());
-		    	$$ = new VarDeclNode(p, $1, $2);
+		    	Position p($1->pos(), $3->pos());
+		    	$$ = arena.make<VarDeclNode>(p, $1, $2);
 		  	}
 
 varDeclList : varDecl
 			{
-				$$ = new std::list<VarDeclNode *>();
+				$$ = arena.make<NodeList<VarDeclNode>>(arena);
 				VarDeclNode * varDecl = $1;
 				$$->push_back(varDecl);
 			}
@@ -239,31 +248,35 @@ varDeclList : varDecl
 				$$->push_back(varDeclNode);
 			}
 
-type 	: INT { $$ = new IntTypeNode($1->pos()); }
-		| BOOL { $$ = new BoolTypeNode($1->pos()); }
+type 	: INT { $$ = arena.make<IntTypeNode>($1->pos()); }
+		| BOOL { $$ = arena.make<BoolTypeNode>($1->pos()); }
 		| id
 		{
-			Position * pos = $1->pos();
-			$$ = new RecordTypeNode(pos,$1);
+			Position pos = $1->pos();
+			$$ = arena.make<RecordTypeNode>(pos,$1);
 		}
-		| STRING { $$ = new StringTypeNode($1->pos()); }
-		| VOID { $$ = new VoidTypeNode($1->pos()); }
+		| STRING { $$ = arena.make<StringTypeNode>($1->pos()); }
+		| VOID { $$ = arena.make<VoidTypeNode>($1->pos()); }
 
 fnDecl 	: type id LPAREN RPAREN OPEN stmtList CLOSE
 		{
-			Position * p = new Position($1->pos(), $7->pos());
-			std::list<FormalDeclNode *> * emptyList = new std::list<FormalDeclNode *>();
-			$$ = new FnDeclNode(p, $1, $2, emptyList, $6);
+			Position p($1->pos(), $7->pos());
+			$$ = arena.make<FnDeclNode>(p, $1, $2, $6->freeze());
 		}
 		| type id LPAREN formals RPAREN OPEN stmtList CLOSE
 		{
-			Position * p = new Position($1->pos(), $8->pos());
-			$$ = new FnDeclNode(p, $1, $2, $4, $7);
+			Position p($1->pos(), $8->pos());
+			$$ = arena.make<FnDeclNode>(p, $1, $2, $4->freeze(), $7->freeze());
+		}
+		| type id LPAREN error RPAREN OPEN stmtList CLOSE
+		{
+			//A broken parameter list still lets the body be checked
+			$$ = nullptr;
 		}
 
 formals : formalDecl
 		{
-			$$ = new std::list<FormalDeclNode *>();
+			$$ = arena.make<NodeList<FormalDeclNode>>(arena);
 			FormalDeclNode * formalDecl = $1;
 			$$->push_back(formalDecl);
 		}
@@ -276,169 +289,169 @@ formals : formalDecl
 
 formalDecl 	: type id
 			{
-				Position * p = new Position($1->pos(), $2->pos());
-		    	$$ = new FormalDeclNode(p, $1, $2);
+				Position p($1->pos(), $2->pos());
+		    	$$ = arena.make<FormalDeclNode>(p, $1, $2);
 			}
 
-stmtList 	: /* epsilon */ { $$ = new std::list<StmtNode *>(); }
+stmtList 	: /* epsilon */ { $$ = arena.make<NodeList<StmtNode>>(arena); }
 			| stmtList stmt
 			{
 				$$ = $1;
 				StmtNode * stmt = $2;
-				$$->push_back(stmt);
+				if (stmt != nullptr){ $$->push_back(stmt); }
 			}
 
 stmt	: varDecl { $$ = $1; }
 		| assignExp SEMICOL
 		{
-			Position * p = new Position($1->pos(), $2
-			->pos());
-		  	$$ = new AssignStmtNode(p, $1);
+			Position p($1->pos(), $2->pos());
+		  	$$ = arena.make<AssignStmtNode>(p, $1);
 		}
 		| lval DEC SEMICOL
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-		  	$$ = new PostDecStmtNode(p, $1);
+			Position p($1->pos(), $3->pos());
+		  	$$ = arena.make<PostDecStmtNode>(p, $1);
 		}
 		| lval INC SEMICOL
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-		  	$$ = new PostIncStmtNode(p, $1);
+			Position p($1->pos(), $3->pos());
+		  	$$ = arena.make<PostIncStmtNode>(p, $1);
 		}
 		| RECEIVE lval SEMICOL
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-		  	$$ = new ReceiveStmtNode(p, $2);
+			Position p($1->pos(), $3->pos());
+		  	$$ = arena.make<ReceiveStmtNode>(p, $2);
 		}
 		| REPORT exp SEMICOL
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-		  	$$ = new ReportStmtNode(p, $2);
+			Position p($1->pos(), $3->pos());
+		  	$$ = arena.make<ReportStmtNode>(p, $2);
 		}
 		| IF LPAREN exp RPAREN OPEN stmtList CLOSE
 		{
-			Position * p = new Position($1->pos(), $7->pos());
-			$$ = new IfStmtNode(p, $3, $6);
+			Position p($1->pos(), $7->pos());
+			$$ = arena.make<IfStmtNode>(p, $3, $6->freeze());
 		}
 		| IF LPAREN exp RPAREN OPEN stmtList CLOSE ELSE OPEN stmtList CLOSE
 		{
-			Position * p = new Position($1->pos(), $11->pos());
-			$$ = new IfElseStmtNode(p, $3, $6, $10);
+			Position p($1->pos(), $11->pos());
+			$$ = arena.make<IfElseStmtNode>(p, $3, $6->freeze(), $10->freeze());
 		}
 		| WHILE LPAREN exp RPAREN OPEN stmtList CLOSE
 		{
-			Position * p = new Position($1->pos(), $7->pos());
-			$$ = new WhileStmtNode(p, $3, $6);
+			Position p($1->pos(), $7->pos());
+			$$ = arena.make<WhileStmtNode>(p, $3, $6->freeze());
 		}
 		| RETURN exp SEMICOL
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-		  	$$ = new ReturnStmtNode(p, $2);
+			Position p($1->pos(), $3->pos());
+		  	$$ = arena.make<ReturnStmtNode>(p, $2);
 		}
 		| RETURN SEMICOL
 		{
-			Position * p = new Position($1->pos(), $2->pos());
-		  	$$ = new ReturnStmtNode(p);
+			Position p($1->pos(), $2->pos());
+		  	$$ = arena.make<ReturnStmtNode>(p);
 		}
 		| callExp SEMICOL
 		{
-			Position * p = new Position($1->pos(), $2->pos());
-		  	$$ = new CallStmtNode(p, $1);
+			Position p($1->pos(), $2->pos());
+		  	$$ = arena.make<CallStmtNode>(p, $1);
 		}
+		| error SEMICOL { $$ = nullptr; }
 
 exp		: assignExp { $$ = $1; }
 		| exp MINUS exp
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new MinusNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<MinusNode>(p, $1, $3);
 		}
 		| exp PLUS exp
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new PlusNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<PlusNode>(p, $1, $3);
 		}
 		| exp TIMES exp
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new TimesNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<TimesNode>(p, $1, $3);
 		}
 		| exp DIVIDE exp
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new DivideNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<DivideNode>(p, $1, $3);
 		}
 		| exp AND exp
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new AndNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<AndNode>(p, $1, $3);
 		}
 		| exp OR exp
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new OrNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<OrNode>(p, $1, $3);
 		}
 		| exp EQUALS exp
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new EqualsNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<EqualsNode>(p, $1, $3);
 		}
 		| exp NOTEQUALS exp
 	  	{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new NotEqualsNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<NotEqualsNode>(p, $1, $3);
 		}
 		| exp GREATER exp
 	  	{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new GreaterNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<GreaterNode>(p, $1, $3);
 		}
 		| exp GREATEREQ exp
 	  	{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new GreaterEqNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<GreaterEqNode>(p, $1, $3);
 		}
 		| exp LESS exp
 	  	{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new LessNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<LessNode>(p, $1, $3);
 		}
 		| exp LESSEQ exp
 	  	{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new LessEqNode(p, $1, $3);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<LessEqNode>(p, $1, $3);
 		}
 		| NOT exp
 		{
-			Position * p = new Position($1->pos(), $2->pos());
-		  	$$ = new NotNode(p, $2);
+			Position p($1->pos(), $2->pos());
+		  	$$ = arena.make<NotNode>(p, $2);
 		}
 		| MINUS term
 		{
-			Position * p = new Position($1->pos(), $2->pos());
-		  	$$ = new NegNode(p, $2);
+			Position p($1->pos(), $2->pos());
+		  	$$ = arena.make<NegNode>(p, $2);
 		}
 		| term { $$ = $1; }
 
 assignExp	: lval ASSIGN exp
 			{
-				Position * p = new Position($1->pos(), $3->pos());
-				$$ = new AssignExpNode(p, $1, $3);
+				Position p($1->pos(), $3->pos());
+				$$ = arena.make<AssignExpNode>(p, $1, $3);
 			}
 
 callExp	: id LPAREN RPAREN
 		{
-			Position * p = new Position($1->pos(), $3->pos());
-			$$ = new CallExpNode(p, $1);
+			Position p($1->pos(), $3->pos());
+			$$ = arena.make<CallExpNode>(p, $1);
 		}
 		| id LPAREN actualsList RPAREN
 		{
-			Position * p = new Position($1->pos(), $4->pos());
-			$$ = new CallExpNode(p, $1, $3);
+			Position p($1->pos(), $4->pos());
+			$$ = arena.make<CallExpNode>(p, $1, $3->freeze());
 		}
 
 actualsList	: exp
 		{
-			$$ = new std::list<ExpNode *>();
+			$$ = arena.make<NodeList<ExpNode>>(arena);
 			ExpNode * expNode = $1;
 			$$->push_back(expNode);
 		}
@@ -452,36 +465,37 @@ actualsList	: exp
 term 	: lval { $$ = $1; }
 		| INTLITERAL
 		{
-			Position * pos = $1->pos();
-		  	$$ = new IntLitNode(pos, $1->num());
+			Position pos = $1->pos();
+		  	$$ = arena.make<IntLitNode>(pos, $1->num());
 		}
 		| STRLITERAL
 		{
-			Position * pos = $1->pos();
-		  	$$ = new StrLitNode(pos, $1->str());
+			Position pos = $1->pos();
+		  	$$ = arena.make<StrLitNode>(pos, $1->str());
 		}
-		| TRUE { $$ = new TrueNode($1->pos());}
-		| FALSE { $$ = new FalseNode($1->pos());}
+		| TRUE { $$ = arena.make<TrueNode>($1->pos());}
+		| FALSE { $$ = arena.make<FalseNode>($1->pos());}
 		| LPAREN exp RPAREN { $$ = $2; }
 		| callExp { $$ = $1; }
 
 lval	: id { $$ = $1; }
 		| id LBRACE id RBRACE
 		{
-			Position * p = new Position($1->pos(), $4->pos());
-			$$ = new IndexNode(p, $1, $3);
+			Position p($1->pos(), $4->pos());
+			$$ = arena.make<IndexNode>(p, $1, $3);
 		}
 
 id		: ID
 		{
-		  Position * pos = $1->pos();
-		  $$ = new IDNode(pos, $1->value());
+		  Position pos = $1->pos();
+		  $$ = arena.make<IDNode>(pos, $1->value());
 		}
 
 
 %%
 
 void cshanty::Parser::error(const std::string& msg){
-	std::cout << msg << std::endl;
-	std::cerr << "syntax error" << std::endl;
+	scanner.syntaxError();
+	Report::report(Diagnostic(Severity::Error, DiagId::SyntaxError,
+		scanner.tokenPos(), 0, 0, "syntax error", msg));
 }
@@ -0,0 +1,292 @@
+#include "ast.hpp"
+#include "deadcode.hpp"
+#include "errors.hpp"
+#include "flatast.hpp"
+
+namespace cshanty{
+
+/*
+Dead code elimination runs once type analysis has passed, after
+folding if that was asked for, which turns conditions like 1 > 2
+into the literals it looks for. It drops:
+  - the statements after one control can't go on past: a return, a
+    while (true), or an if-else whose branches both can't;
+  - if (false) and while (false) statements, and the branch of an
+    if-else that its literal condition never takes;
+  - the locals that no expression left in their function names.
+An if (true) body, or the branch an if-else always takes, is put in
+the statement's place if it declares nothing; otherwise its locals
+need the scope of their block, so it stays in one (an if-else
+becomes an if (true)). Nothing that can run is dropped, so what a
+program does is the same with or without dead code. With warnings
+on, each run of statements that can't run is reported once, at its
+first statement.
+
+Each function's body is pruned twice. The first time through drops
+what can't run and notes the declaration of every name used in what
+is left; only then is it known which locals are unused, and the
+second time through drops them.
+*/
+
+ExpNode * DeadCode::trueLit(const Position& pos){
+	ExpNode * lit = myArena.make<TrueNode>(pos);
+	lit->typeAnalysis(myTypes);
+	return lit;
+}
+
+void DeadCode::eliminate(ASTNode * node){
+	myEliminated += FlatAST::count(node);
+}
+
+void DeadCode::warnUnreachable(const ASTNode * node){
+	if (!myWarn){ return; }
+	Report::report(Diagnostic(Severity::Warning, DiagId::Unreachable,
+		node->pos(), 0, 0, "Unreachable code"));
+}
+
+void DeadCode::warnUnused(const ASTNode * node){
+	if (!myWarn){ return; }
+	Report::report(Diagnostic(Severity::Warning, DiagId::UnusedVariable,
+		node->pos(), 0, 0, "Unused variable"));
+}
+
+NodeSpan<StmtNode> DeadCode::prune(NodeSpan<StmtNode> body,
+	bool& continues){
+	size_t before = myEliminated;
+	NodeList<StmtNode> live(myArena);
+	continues = true;
+	for (size_t i = 0; i < body.size(); i++){
+		if (!continues){
+			//Everything from here on is dead
+			warnUnreachable(body[i]);
+			for (; i < body.size(); i++){ eliminate(body[i]); }
+			break;
+		}
+		continues = body[i]->prune(*this, live);
+	}
+	//Every change leaves something out, so nothing left out means
+	// the body is as it was
+	if (myEliminated == before){ return body; }
+	return live.freeze();
+}
+
+NodeSpan<StmtNode> DeadCode::pruneFunction(NodeSpan<StmtNode> body){
+	bool continues;
+	mySweeping = false;
+	body = prune(body, continues);
+	mySweeping = true;
+	body = prune(body, continues);
+	mySweeping = false;
+	return body;
+}
+
+/* Whether cond is the literal value */
+static bool isLiteral(ExpNode * cond, bool value){
+	if (value){ return dynamic_cast<TrueNode *>(cond) != nullptr; }
+	return dynamic_cast<FalseNode *>(cond) != nullptr;
+}
+
+/* Whether body declares anything, so needs a block of its own */
+static bool declares(NodeSpan<StmtNode> body){
+	for (StmtNode * stmt : body){
+		if (dynamic_cast<DeclNode *>(stmt) != nullptr){ return true; }
+	}
+	return false;
+}
+
+static void eliminateAll(DeadCode& d, NodeSpan<StmtNode> stmts){
+	for (StmtNode * stmt : stmts){ d.eliminate(stmt); }
+}
+
+/* Put stmts in the place of a statement with a condition, dropping
+   the statement and its condition */
+static void splice(DeadCode& d, NodeSpan<StmtNode> stmts,
+	NodeList<StmtNode>& live){
+	for (StmtNode * stmt : stmts){ live.push_back(stmt); }
+	d.eliminate(2);
+}
+
+/* Warn that stmts, the body of stmt, can never run: at the first of
+   them, or at stmt itself if the body is empty */
+static void warnDead(DeadCode& d, NodeSpan<StmtNode> stmts,
+	StmtNode * stmt){
+	d.warnUnreachable(stmts.empty() ? stmt : stmts.front());
+}
+
+void ProgramNode::prune(DeadCode& d){
+	//Only functions have bodies; the globals stay as they are
+	NodeList<StmtNode> globals(d.arena());
+	for (DeclNode * decl : myGlobals){ decl->prune(d, globals); }
+}
+
+bool VarDeclNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	if (d.sweeping() && !d.used(this)){
+		d.warnUnused(myId);
+		d.eliminate(this);
+		return true;
+	}
+	live.push_back(this);
+	return true;
+}
+
+bool RecordTypeDeclNode::prune(DeadCode&, NodeList<StmtNode>& live){
+	live.push_back(this);
+	return true;
+}
+
+bool FnDeclNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	functionBody = d.pruneFunction(functionBody);
+	live.push_back(this);
+	return true;
+}
+
+bool AssignStmtNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	assignment->markUses(d);
+	live.push_back(this);
+	return true;
+}
+
+bool CallStmtNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	Function->markUses(d);
+	live.push_back(this);
+	return true;
+}
+
+bool PostIncStmtNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	variable->markUses(d);
+	live.push_back(this);
+	return true;
+}
+
+bool PostDecStmtNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	variable->markUses(d);
+	live.push_back(this);
+	return true;
+}
+
+bool ReceiveStmtNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	variable->markUses(d);
+	live.push_back(this);
+	return true;
+}
+
+bool ReportStmtNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	expression->markUses(d);
+	live.push_back(this);
+	return true;
+}
+
+bool ReturnStmtNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	if (expression != nullptr){ expression->markUses(d); }
+	live.push_back(this);
+	return false;
+}
+
+bool WhileStmtNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	if (isLiteral(condition, false)){
+		warnDead(d, WhileBody, this);
+		d.eliminate(this);
+		return true;
+	}
+	condition->markUses(d);
+	bool continues;
+	WhileBody = d.prune(WhileBody, continues);
+	live.push_back(this);
+	//Nothing but a return leaves a while (true)
+	return !isLiteral(condition, true);
+}
+
+bool IfStmtNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	if (isLiteral(condition, false)){
+		warnDead(d, IfBody, this);
+		d.eliminate(this);
+		return true;
+	}
+	condition->markUses(d);
+	bool continues;
+	IfBody = d.prune(IfBody, continues);
+	if (!isLiteral(condition, true)){
+		live.push_back(this);
+		return true;
+	}
+	if (declares(IfBody)){
+		live.push_back(this);
+	} else {
+		splice(d, IfBody, live);
+	}
+	return continues;
+}
+
+bool IfElseStmtNode::prune(DeadCode& d, NodeList<StmtNode>& live){
+	condition->markUses(d);
+	bool thenGoesOn, elseGoesOn;
+	if (isLiteral(condition, true)){
+		warnDead(d, IfFalseBody, this);
+		eliminateAll(d, IfFalseBody);
+		IfTrueBody = d.prune(IfTrueBody, thenGoesOn);
+		if (declares(IfTrueBody)){
+			//The else is dropped, leaving an if
+			live.push_back(d.arena().make<IfStmtNode>(pos(), condition,
+				IfTrueBody));
+			d.eliminate(1);
+		} else {
+			splice(d, IfTrueBody, live);
+		}
+		return thenGoesOn;
+	}
+	if (isLiteral(condition, false)){
+		warnDead(d, IfTrueBody, this);
+		eliminateAll(d, IfTrueBody);
+		IfFalseBody = d.prune(IfFalseBody, elseGoesOn);
+		if (declares(IfFalseBody)){
+			//Only the else runs, so it is an if (true)
+			live.push_back(d.arena().make<IfStmtNode>(pos(),
+				d.trueLit(condition->pos()), IfFalseBody));
+			d.eliminate(1);
+		} else {
+			splice(d, IfFalseBody, live);
+		}
+		return elseGoesOn;
+	}
+	IfTrueBody = d.prune(IfTrueBody, thenGoesOn);
+	IfFalseBody = d.prune(IfFalseBody, elseGoesOn);
+	live.push_back(this);
+	return thenGoesOn || elseGoesOn;
+}
+
+void TrueNode::markUses(DeadCode&){ }
+
+void FalseNode::markUses(DeadCode&){ }
+
+void IntLitNode::markUses(DeadCode&){ }
+
+void StrLitNode::markUses(DeadCode&){ }
+
+void IDNode::markUses(DeadCode& d){
+	d.use(myDecl);
+}
+
+void IndexNode::markUses(DeadCode& d){
+	Id_being_accessed->markUses(d);
+}
+
+void UnaryExpNode::markUses(DeadCode& d){
+	expression->markUses(d);
+}
+
+void BinaryExpNode::markUses(DeadCode& d){
+	leftNode->markUses(d);
+	rightNode->markUses(d);
+}
+
+void AssignExpNode::markUses(DeadCode& d){
+	variable->markUses(d);
+	expression->markUses(d);
+}
+
+void CallExpNode::markUses(DeadCode& d){
+	nameFunc->markUses(d);
+	for (ExpNode * arg : arguments){ arg->markUses(d); }
+}
+
+}
@@ -0,0 +1,73 @@
+#ifndef CSHANTY_DEADCODE_H
+#define CSHANTY_DEADCODE_H
+
+#include <cstddef>
+#include <unordered_set>
+#include "arena.hpp"
+#include "position.hpp"
+#include "types.hpp"
+
+namespace cshanty{
+
+class ASTNode;
+class DeclNode;
+class ExpNode;
+class StmtNode;
+template <typename T> class NodeSpan;
+
+/**
+* \class DeadCode
+* Drops the statements of a program that can't run and the locals
+* nothing uses (see deadcode.cpp), counting every node it leaves out
+* of the tree and, if asked to, warning about what the programmer
+* wrote that can never run or is never used.
+**/
+class DeadCode{
+public:
+	DeadCode(Arena& arena, TypeTable& types, bool warn)
+	: myArena(arena), myTypes(types), myWarn(warn), mySweeping(false),
+	  myEliminated(0){ }
+
+	Arena& arena(){ return myArena; }
+	/** A true literal at pos, typed as type analysis would have typed
+	    it **/
+	ExpNode * trueLit(const Position& pos);
+
+	/** What is left of body once the dead code in it is dropped.
+	    continues is set to whether control can go on past it **/
+	NodeSpan<StmtNode> prune(NodeSpan<StmtNode> body, bool& continues);
+	/** Prune a function's body: once to drop what can't run, noting
+	    what the rest uses, then again to drop its unused locals **/
+	NodeSpan<StmtNode> pruneFunction(NodeSpan<StmtNode> body);
+	/** Whether this is the second time through a function's body,
+	    when its unused locals are dropped **/
+	bool sweeping() const { return mySweeping; }
+
+	void use(const DeclNode * decl){ myUsed.insert(decl); }
+	bool used(const DeclNode * decl) const {
+		return myUsed.count(decl) != 0;
+	}
+
+	/** Note that node and everything under it were left out **/
+	void eliminate(ASTNode * node);
+	void eliminate(size_t count){ myEliminated += count; }
+	size_t eliminated() const { return myEliminated; }
+
+	/** Warn, if warnings were asked for, that node can never run or
+	    is never used **/
+	void warnUnreachable(const ASTNode * node);
+	void warnUnused(const ASTNode * node);
+private:
+	Arena& myArena;
+	//Types the literals it makes
+	TypeAnalysis myTypes;
+	bool myWarn;
+	bool mySweeping;
+	size_t myEliminated;
+	//Every declaration a live expression names
+	std::unordered_set<const DeclNode *> myUsed;
+};
+
+}
+
+#endif
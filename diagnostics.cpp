@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include "diagnostics.hpp"
+
+namespace cshanty{
+
+const char * severityString(Severity severity){
+	switch (severity){
+	case Severity::Warning: return "warning";
+	case Severity::Error: return "error";
+	case Severity::Fatal: return "fatal";
+	}
+	return "error";
+}
+
+const char * diagIdString(DiagId id){
+	switch (id){
+	case DiagId::Unspecified: return "unspecified";
+	case DiagId::IllegalChar: return "illegal-char";
+	case DiagId::BadEscape: return "bad-escape";
+	case DiagId::UntermString: return "unterminated-string";
+	case DiagId::UntermBadEscape: return "unterminated-bad-escape";
+	case DiagId::IntOverflow: return "int-overflow";
+	case DiagId::SyntaxError: return "syntax-error";
+	case DiagId::ParseFailed: return "parse-failed";
+	case DiagId::NoAST: return "no-ast";
+	case DiagId::Undeclared: return "undeclared";
+	case DiagId::MultiplyDeclared: return "multiply-declared";
+	case DiagId::BadDeclType: return "bad-decl-type";
+	case DiagId::BadField: return "bad-field";
+	case DiagId::NonRecordIndex: return "non-record-index";
+	case DiagId::NameAnalysisFailed: return "name-analysis-failed";
+	case DiagId::BadOperand: return "bad-operand";
+	case DiagId::TypeMismatch: return "type-mismatch";
+	case DiagId::BadCall: return "bad-call";
+	case DiagId::BadArgCount: return "bad-arg-count";
+	case DiagId::BadArg: return "bad-arg";
+	case DiagId::BadReturn: return "bad-return";
+	case DiagId::BadCondition: return "bad-condition";
+	case DiagId::BadReport: return "bad-report";
+	case DiagId::BadReceive: return "bad-receive";
+	case DiagId::TypeAnalysisFailed: return "type-analysis-failed";
+	case DiagId::RuntimeError: return "runtime-error";
+	case DiagId::Unreachable: return "unreachable";
+	case DiagId::UnusedVariable: return "unused-variable";
+	case DiagId::BadInput: return "bad-input";
+	case DiagId::BadOutput: return "bad-output";
+	case DiagId::CacheWrite: return "cache-write";
+	case DiagId::ToDo: return "todo";
+	case DiagId::TooManyErrors: return "too-many-errors";
+	case DiagId::TooDeep: return "too-deep";
+	}
+	return "unspecified";
+}
+
+Diagnostic::Diagnostic(Severity severityIn, DiagId idIn,
+	const Position& posIn, size_t lineIn, size_t colIn,
+	const std::string& messageIn, const std::string& detailIn)
+: severity(severityIn), id(idIn), pos(posIn), line(lineIn), col(colIn),
+  message(messageIn), detail(detailIn){
+	if (line == 0 && pos.file() != 0){
+		line = pos.line();
+		col = pos.col();
+	}
+}
+
+Diagnostic::Diagnostic(Severity severityIn, DiagId idIn,
+	const std::string& messageIn)
+: Diagnostic(severityIn, idIn, Position(), 0, 0, messageIn){
+}
+
+void Diagnostic::writeText(std::ostream& out) const{
+	switch (id){
+	case DiagId::ParseFailed:
+	case DiagId::NoAST:
+	case DiagId::NameAnalysisFailed:
+	case DiagId::TypeAnalysisFailed:
+		out << message << "\n";
+		return;
+	case DiagId::ToDo:
+		out << "ToDo: " << message << "\n";
+		return;
+	default:
+		break;
+	}
+	if (!located()){
+		out << (severity == Severity::Warning ? "Warning: " : "Error: ")
+			<< message << "\n";
+		return;
+	}
+	switch (severity){
+	case Severity::Warning: out << "*WARNING* "; break;
+	case Severity::Error: out << "ERROR "; break;
+	case Severity::Fatal: out << "FATAL "; break;
+	}
+	out << "[" << line << "," << col << "]: " << message << "\n";
+}
+
+void Diagnostics::add(const Diagnostic& diag){
+	if (full()){ return; }
+	myDiags.push_back(diag);
+	if (diag.severity == Severity::Warning){ return; }
+	myErrors++;
+	if (full()){
+		myDiags.push_back(Diagnostic(Severity::Fatal,
+			DiagId::TooManyErrors, "Too many errors (" +
+			std::to_string(myLimit) + "), giving up"));
+	}
+}
+
+size_t Diagnostics::count(Severity severity) const{
+	size_t total = 0;
+	for (const Diagnostic& diag : myDiags){
+		if (diag.severity == severity){ total++; }
+	}
+	return total;
+}
+
+void Diagnostics::sort(){
+	auto bySource = [](const Diagnostic& a, const Diagnostic& b){
+		if (a.line != b.line){ return a.line < b.line; }
+		return a.col < b.col;
+	};
+	auto run = myDiags.begin();
+	while (run != myDiags.end()){
+		auto stop = std::find_if(run, myDiags.end(),
+			[](const Diagnostic& d){ return !d.located(); });
+		std::stable_sort(run, stop, bySource);
+		run = stop == myDiags.end() ? stop : stop + 1;
+	}
+}
+
+void Diagnostics::emit(std::ostream& out, Format format){
+	sort();
+	//std::cerr is unbuffered, so every << would be a system call;
+	// format everything first and hand it over in one write
+	std::ostringstream text;
+	if (format == Format::JSON){
+		emitJSON(text);
+	} else {
+		for (const Diagnostic& diag : myDiags){ diag.writeText(text); }
+	}
+	std::string bytes = text.str();
+	out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+	out.flush();
+	myDiags.clear();
+}
+
+void Diagnostics::emitJSON(std::ostream& out) const{
+	out << "{\"unit\": ";
+	writeJSONString(out, myUnit);
+	out << ", \"diagnostics\": [";
+	const char * sep = "";
+	for (const Diagnostic& diag : myDiags){
+		out << sep << "\n  {\"severity\": \""
+			<< severityString(diag.severity) << "\", \"id\": \""
+			<< diagIdString(diag.id) << "\"";
+		if (diag.located()){
+			out << ", \"line\": " << diag.line
+				<< ", \"col\": " << diag.col;
+		}
+		if (diag.pos.file() != 0){
+			//Offsets into the text as it is now, should the file
+			// be part of an edited Document
+			const SourceFile& file = SourceFile::get(diag.pos.file());
+			out << ", \"begin\": "
+				<< file.resolve(diag.pos.beginOffset())
+				<< ", \"end\": " << file.resolve(diag.pos.endOffset());
+		}
+		out << ", \"message\": ";
+		writeJSONString(out, diag.message);
+		if (!diag.detail.empty()){
+			out << ", \"detail\": ";
+			writeJSONString(out, diag.detail);
+		}
+		out << "}";
+		sep = ",";
+	}
+	out << (myDiags.empty() ? "]}\n" : "\n]}\n");
+}
+
+void writeJSONString(std::ostream& out, const std::string& text,
+	bool utf8){
+	out << '"';
+	for (char c : text){
+		unsigned char byte = static_cast<unsigned char>(c);
+		switch (c){
+		case '"': out << "\\\""; break;
+		case '\\': out << "\\\\"; break;
+		case '\n': out << "\\n"; break;
+		case '\t': out << "\\t"; break;
+		case '\r': out << "\\r"; break;
+		default:
+			//Source text isn't known to be UTF-8, so anything
+			// outside printable ASCII is escaped byte by byte
+			if (byte < 0x20 || byte == 0x7f || (byte > 0x7f && !utf8)){
+				char escape[8];
+				snprintf(escape, sizeof(escape), "\\u%04x", byte);
+				out << escape;
+			} else {
+				out << c;
+			}
+		}
+	}
+	out << '"';
+}
+
+}
@@ -0,0 +1,117 @@
+#ifndef CSHANTY_DIAGNOSTICS_H
+#define CSHANTY_DIAGNOSTICS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "position.hpp"
+
+namespace cshanty{
+
+enum class Severity : uint8_t{ Warning, Error, Fatal };
+
+/** What a diagnostic is about, independent of its wording **/
+enum class DiagId : uint16_t{
+	Unspecified,
+	//Lexical
+	IllegalChar, BadEscape, UntermString, UntermBadEscape, IntOverflow,
+	//Syntax
+	SyntaxError, ParseFailed, NoAST,
+	//Names
+	Undeclared, MultiplyDeclared, BadDeclType, BadField, NonRecordIndex,
+	NameAnalysisFailed,
+	//Types
+	BadOperand, TypeMismatch, BadCall, BadArgCount, BadArg, BadReturn,
+	BadCondition, BadReport, BadReceive, TypeAnalysisFailed,
+	//Running
+	RuntimeError,
+	//Optimizing
+	Unreachable, UnusedVariable,
+	//Driver
+	BadInput, BadOutput, CacheWrite, ToDo, TooManyErrors, TooDeep
+};
+
+const char * severityString(Severity severity);
+/** Stable, machine-readable name of id, e.g. "illegal-char" **/
+const char * diagIdString(DiagId id);
+
+/** One message about one compilation unit **/
+struct Diagnostic{
+	Diagnostic(Severity severityIn, DiagId idIn, const Position& posIn,
+		size_t lineIn, size_t colIn, const std::string& messageIn,
+		const std::string& detailIn = "");
+	/** A diagnostic about no particular place in the source **/
+	Diagnostic(Severity severityIn, DiagId idIn,
+		const std::string& messageIn);
+
+	bool located() const { return line != 0; }
+	/** The line this prints as in the classic text format **/
+	void writeText(std::ostream& out) const;
+
+	Severity severity;
+	DiagId id;
+	Position pos;
+	//As reported; taken from pos if the reporter didn't give them
+	size_t line;
+	size_t col;
+	std::string message;
+	//Extra explanation (e.g. bison's expected-token list), JSON only
+	std::string detail;
+};
+
+/**
+* \class Diagnostics
+* Collects the diagnostics of one compilation unit instead of writing
+* each one as it happens, then prints them all in one go: no flush
+* per message, and nothing shared between threads compiling different
+* units. Located diagnostics are printed in source order.
+* Diagnostics without a location (driver messages such as an
+* unwritable output file) keep the place they were reported in, and
+* the located ones between two of them are sorted among themselves.
+* Report (errors.hpp) routes to whichever engine the calling thread
+* is collecting into.
+**/
+class Diagnostics{
+public:
+	enum class Format{ Text, JSON };
+
+	Diagnostics(const std::string& unit)
+	: myUnit(unit), myLimit(0), myErrors(0){ }
+
+	/** Stop counting after max errors and fatal errors (warnings
+	    don't count); 0, the default, means no limit. Adding the one
+	    that reaches the limit also adds a TooManyErrors note **/
+	void limit(size_t max){ myLimit = max; }
+	/** Whether the limit has been reached; Report then abandons the
+	    compilation **/
+	bool full() const { return myLimit != 0 && myErrors >= myLimit; }
+
+	void add(const Diagnostic& diag);
+	size_t size() const { return myDiags.size(); }
+	size_t count(Severity severity) const;
+	const Diagnostic& at(size_t index) const { return myDiags[index]; }
+
+	/** Write everything collected so far, sorted, and forget it.
+	    Text is the classic one-line-per-message format; JSON is one
+	    object per unit: {"unit": ..., "diagnostics": [...]} **/
+	void emit(std::ostream& out, Format format);
+private:
+	void sort();
+	void emitJSON(std::ostream& out) const;
+
+	std::string myUnit;
+	std::vector<Diagnostic> myDiags;
+	size_t myLimit;
+	size_t myErrors;
+};
+
+/** Write text as a JSON string literal, quotes included. Bytes
+    outside printable ASCII are escaped one by one unless text is
+    known to be UTF-8, in which case those from 0x80 up are copied **/
+void writeJSONString(std::ostream& out, const std::string& text,
+	bool utf8 = false);
+
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <utility>
+#include "ast.hpp"
+#include "document.hpp"
+#include "errors.hpp"
+#include "scanner.hpp"
+#include "source.hpp"
+
+namespace cshanty{
+
+/*
+Reparsing a stretch of text that parses on its own gives the same
+declarations a full parse would, provided the scanner is in its
+initial state at both ends of the stretch. Each stretch starts right
+after the last token of a declaration (or at the start of the file)
+and ends right before the first token of one (or at the end), so
+nothing but whitespace and comments lies outside the declarations it
+covers. A comment or string that an edit opens can't run past the
+end of its line, and a declaration that shares no line with the edit
+has a newline between it and the edit, so that is the rule for what
+an edit affects.
+
+The diagnostics of text that doesn't parse can differ from a full
+parse's: the parse of its stretch runs into the stretch's end and
+reports an unexpected end of file, where a full parse would report
+the first token of the declaration after.
+*/
+
+Document::Document(const std::string& name, bool fast)
+: myName(name), myFast(fast), myFile(0), myLiveBytes(0),
+  myProgram(nullptr), myReparsed(0), myReused(0){
+}
+
+Document::~Document(){
+	if (myFile != 0){ SourceFile::release(myFile); }
+}
+
+ProgramNode * Document::load(const std::string& text){
+	myText = text;
+	//The old file goes, its pieces and its edits with it, as the
+	// arena's nodes that refer to them do
+	if (myFile != 0){ SourceFile::release(myFile); }
+	myPieces.clear();
+	myFile = SourceFile::add(myName);
+	SourceFile::get(myFile).edit(0, 0, myText.data(), myText.size());
+	myArena.reset(new Arena());
+	myEntries.clear();
+	parseRegion(0, static_cast<uint32_t>(myText.size()), myEntries);
+	myLiveBytes = myArena->bytesUsed();
+	myReparsed = myEntries.size();
+	myReused = 0;
+	return rebuild();
+}
+
+ProgramNode * Document::edit(size_t beginIn, size_t endIn,
+	const std::string& text){
+	if (beginIn > endIn || endIn > myText.size()){
+		throw new InternalError("Edit outside the document");
+	}
+	//Every reparse leaves its predecessor's nodes behind in the
+	// arena; once they outweigh the live tree, start over
+	if (myArena == nullptr || myArena->bytesUsed() > 4 * myLiveBytes){
+		std::string updated = myText;
+		updated.replace(beginIn, endIn - beginIn, text);
+		return load(updated);
+	}
+	uint32_t begin = static_cast<uint32_t>(beginIn);
+	uint32_t end = static_cast<uint32_t>(endIn);
+	int64_t delta = static_cast<int64_t>(text.size())
+		- static_cast<int64_t>(end - begin);
+
+	//The lines the edit touches, in the old text
+	size_t newline = begin == 0 ? std::string::npos
+		: myText.rfind('\n', begin - 1);
+	uint32_t lineBegin = newline == std::string::npos ? 0
+		: static_cast<uint32_t>(newline + 1);
+	newline = myText.find('\n', end);
+	uint32_t lineEnd = newline == std::string::npos
+		? static_cast<uint32_t>(myText.size())
+		: static_cast<uint32_t>(newline);
+	size_t first = static_cast<size_t>(std::partition_point(
+		myEntries.begin(), myEntries.end(),
+		[lineBegin](const Entry& e){ return e.end <= lineBegin; })
+		- myEntries.begin());
+	size_t last = static_cast<size_t>(std::partition_point(
+		myEntries.begin() + static_cast<std::ptrdiff_t>(first),
+		myEntries.end(),
+		[lineEnd](const Entry& e){ return e.begin <= lineEnd; })
+		- myEntries.begin());
+
+	//Entries [first, last) go, along with any entry that had
+	// diagnostics; runs of them that touch are reparsed as one. Text
+	// that didn't parse may be completed by the edit or by other text
+	// that didn't (an open brace and its close), so everything from
+	// the first broken entry to the last, and to the edit, is one run
+	std::vector<std::pair<size_t, size_t>> runs;
+	runs.push_back(std::make_pair(first, last));
+	size_t brokenFirst = myEntries.size();
+	size_t brokenLast = 0;
+	for (size_t i = 0; i < myEntries.size(); i++){
+		if (myEntries[i].clean){ continue; }
+		runs.push_back(std::make_pair(i, i + 1));
+		if (myEntries[i].decl == nullptr){
+			brokenFirst = std::min(brokenFirst, i);
+			brokenLast = i + 1;
+		}
+	}
+	if (brokenFirst < brokenLast){
+		runs.push_back(std::make_pair(std::min(brokenFirst, first),
+			std::max(brokenLast, last)));
+	}
+	std::sort(runs.begin(), runs.end());
+	std::vector<std::pair<size_t, size_t>> merged;
+	for (const auto& run : runs){
+		if (!merged.empty() && run.first <= merged.back().second){
+			merged.back().second = std::max(merged.back().second,
+				run.second);
+		} else {
+			merged.push_back(run);
+		}
+	}
+
+	myText.replace(begin, end - begin, text);
+	SourceFile::get(myFile).edit(begin, end, text.data(), text.size());
+	for (size_t i = last; i < myEntries.size(); i++){
+		Entry& entry = myEntries[i];
+		entry.begin = static_cast<uint32_t>(entry.begin + delta);
+		entry.end = static_cast<uint32_t>(entry.end + delta);
+	}
+
+	//Back to front, so that splicing in one run's entries doesn't
+	// move the runs still to be done
+	myReparsed = 0;
+	std::vector<Entry> parsed;
+	for (auto run = merged.rbegin(); run != merged.rend(); ++run){
+		uint32_t from = run->first == 0 ? 0
+			: myEntries[run->first - 1].end;
+		uint32_t to = run->second == myEntries.size()
+			? static_cast<uint32_t>(myText.size())
+			: myEntries[run->second].begin;
+		parsed.clear();
+		parseRegion(from, to, parsed);
+		myReparsed += parsed.size();
+		for (size_t i = run->first; i < run->second; i++){
+			drop(myEntries[i]);
+		}
+		auto at = myEntries.erase(
+			myEntries.begin() + static_cast<std::ptrdiff_t>(run->first),
+			myEntries.begin() + static_cast<std::ptrdiff_t>(run->second));
+		myEntries.insert(at, parsed.begin(), parsed.end());
+	}
+	myReused = myEntries.size() - myReparsed;
+
+	size_t kept = 0;
+	for (const Piece& piece : myPieces){
+		if (piece.uses == 0){
+			SourceFile::release(piece.file);
+		} else {
+			myPieces[kept++] = piece;
+		}
+	}
+	myPieces.resize(kept);
+	return rebuild();
+}
+
+void Document::parseRegion(uint32_t begin, uint32_t end,
+	std::vector<Entry>& out){
+	std::unique_ptr<SourceBuffer> buffer(SourceBuffer::copy(
+		myText.data() + begin, end - begin));
+	Scanner scanner(*buffer, *myArena, myName, myFast);
+	scanner.embed(myFile, begin, end - begin);
+	uint32_t file = scanner.file();
+	Piece piece = { file, 0 };
+	myPieces.push_back(piece);
+	ProgramNode * root = nullptr;
+	Parser parser(scanner, &root, *myArena);
+	int errCode = 1;
+	try {
+		errCode = parser.parse();
+	} catch (FatalError * e){
+		//The diagnostics' error limit was reached
+		delete e;
+	}
+	bool failed = errCode != 0 || scanner.syntaxErrors() != 0;
+	if (root == nullptr){
+		Entry broken = { nullptr, begin, end, false, file };
+		out.push_back(broken);
+		myPieces.back().uses++;
+		return;
+	}
+	//Declarations the parser recovered around a syntax error are kept
+	// (for document symbols), but only until the next edit: the whole
+	// region, closed by a broken entry, is dirty and reparsed as one
+	bool clean = !failed && scanner.reported() == 0;
+	uint32_t at = begin;
+	for (DeclNode * decl : root->globals()){
+		Entry entry = { decl, begin + decl->pos().beginOffset(),
+			begin + decl->pos().endOffset(), clean, file };
+		out.push_back(entry);
+		myPieces.back().uses++;
+		at = entry.end;
+	}
+	if (failed){
+		Entry broken = { nullptr, at, end, false, file };
+		out.push_back(broken);
+		myPieces.back().uses++;
+	}
+}
+
+void Document::drop(const Entry& entry){
+	for (Piece& piece : myPieces){
+		if (piece.file == entry.file){
+			piece.uses--;
+			return;
+		}
+	}
+}
+
+std::vector<DeclNode *> Document::declarations() const{
+	std::vector<DeclNode *> decls;
+	for (const Entry& entry : myEntries){
+		if (entry.decl != nullptr){ decls.push_back(entry.decl); }
+	}
+	return decls;
+}
+
+ProgramNode * Document::rebuild(){
+	myProgram = nullptr;
+	for (const Entry& entry : myEntries){
+		if (entry.decl == nullptr){ return nullptr; }
+	}
+	//The program's globals live here rather than in the arena, so
+	// that an edit leaves no copy of them behind
+	myDecls.clear();
+	for (const Entry& entry : myEntries){
+		myDecls.push_back(entry.decl);
+	}
+	Position pos;
+	myProgram = myArena->make<ProgramNode>(pos,
+		NodeSpan<DeclNode>(myDecls.data(), myDecls.size()));
+	return myProgram;
+}
+
+}
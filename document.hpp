@@ -0,0 +1,106 @@
+#ifndef CSHANTY_DOCUMENT_H
+#define CSHANTY_DOCUMENT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cshanty{
+
+class Arena;
+class DeclNode;
+class ProgramNode;
+
+/**
+* \class Document
+* An input that is edited in place, as in an editor, and kept parsed.
+* After an edit only the top-level declarations that share a line with
+* it are rescanned and reparsed (together with the whitespace and
+* comments around them); every other declaration keeps its nodes. The
+* reused nodes aren't touched at all: the text each parse covered is
+* registered as a file embedded in the document's own file, and the
+* edits since are applied when one of their positions is printed (see
+* SourceFile::embed). Declarations that had diagnostics are reparsed on
+* every edit, so that each edit reports the full set.
+*
+* Diagnostics go to Report, as for any other parse. Text that doesn't
+* parse is parsed apart from the declarations after it, so its syntax
+* error may be reported at its end rather than at the next token. The
+* program returned by load and edit is only valid until the next call.
+**/
+class Document{
+public:
+	/** A document known to diagnostics as name; fast selects the
+	    hand-written scanner **/
+	Document(const std::string& name, bool fast);
+	/** Releases the files the document registered, so nothing in its
+	    program may be printed after **/
+	~Document();
+	Document(const Document&) = delete;
+	Document& operator=(const Document&) = delete;
+
+	/** Replace the whole text and parse it from scratch. Returns the
+	    program, or nullptr if the text doesn't parse **/
+	ProgramNode * load(const std::string& text);
+	/** Replace [begin, end) of the text with text and reparse what
+	    that affects. Returns as load does **/
+	ProgramNode * edit(size_t begin, size_t end, const std::string& text);
+
+	ProgramNode * program() const { return myProgram; }
+	/** Every declaration that parsed, in order, including while other
+	    parts of the text don't **/
+	std::vector<DeclNode *> declarations() const;
+	const std::string& text() const { return myText; }
+	/** Id of the SourceFile that positions in the program resolve to **/
+	uint32_t file() const { return myFile; }
+	/** Declarations parsed afresh, and reused as they were, by the
+	    last load or edit **/
+	size_t reparsed() const { return myReparsed; }
+	size_t reused() const { return myReused; }
+private:
+	/** One top-level declaration, or a stretch of text that didn't
+	    parse (decl is then null). Offsets are in the current text **/
+	struct Entry{
+		DeclNode * decl;
+		uint32_t begin;
+		uint32_t end;
+		//Parsed without any diagnostics
+		bool clean;
+		//The file the parse that made it registered
+		uint32_t file;
+	};
+
+	/** Parse [begin, end) of the text, appending its entries **/
+	void parseRegion(uint32_t begin, uint32_t end,
+		std::vector<Entry>& out);
+	/** Stop counting entry among those that come from its file **/
+	void drop(const Entry& entry);
+	ProgramNode * rebuild();
+
+	std::string myName;
+	bool myFast;
+	std::string myText;
+	uint32_t myFile;
+	//The files registered by the parses since the last load, each
+	// embedded in myFile, with how many entries come from each; those
+	// no entry comes from any more are released
+	struct Piece{
+		uint32_t file;
+		size_t uses;
+	};
+	std::vector<Piece> myPieces;
+	std::unique_ptr<Arena> myArena;
+	//Arena use right after the last full parse; once the garbage
+	// left by reparses outgrows it, the next edit starts afresh
+	size_t myLiveBytes;
+	std::vector<Entry> myEntries;
+	std::vector<DeclNode *> myDecls;
+	ProgramNode * myProgram;
+	size_t myReparsed;
+	size_t myReused;
+};
+
+}
+
+#endif
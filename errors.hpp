@@ -7,6 +7,7 @@
 #define TODO(x) throw new ToDoError(CODELOC #x);
 
 #include <iostream>
+#include "diagnostics.hpp"
 
 namespace cshanty{
 
@@ -26,15 +27,57 @@ private:
 	const char * myMsg;
 };
 
+/** Thrown to abandon an input after a fatal error, which has already
+    been reported; the rest of the process carries on **/
+class FatalError{
+public:
+	FatalError(const char * msgIn) : myMsg(msgIn){}
+	const char * msg(){ return myMsg; }
+private:
+	const char * myMsg;
+};
+
 class Report{
 public:
-	static void fatal(
-		size_t l, 
-		size_t c, 
-		const char * msg
-	){
-		std::cerr << "FATAL [" << l << "," << c << "]: " 
-		<< msg  << std::endl;
+	/** Where this thread's diagnostics go: std::cerr, unless the
+	    thread is compiling one file of a batch, which gets its own
+	    stream (see redirect) **/
+	static std::ostream& err(){ return *errStream(); }
+	/** Where this thread's other console output goes: std::cout
+	    unless redirected **/
+	static std::ostream& out(){ return *outStream(); }
+	/** Send this thread's output to out and diagnostics to err;
+	    null restores std::cout or std::cerr **/
+	static void redirect(std::ostream * out, std::ostream * err){
+		outStream() = out == nullptr ? &std::cout : out;
+		errStream() = err == nullptr ? &std::cerr : err;
+	}
+
+	/** Collect this thread's diagnostics in sink until the next
+	    call; null goes back to writing each one to err() at once **/
+	static void collect(Diagnostics * sink){ sinkSlot() = sink; }
+	static Diagnostics * collecting(){ return sinkSlot(); }
+
+	/** Once the sink's error limit is reached this throws a
+	    FatalError, abandoning the rest of the compilation **/
+	static void report(const Diagnostic& diag){
+		Diagnostics * sink = sinkSlot();
+		if (sink != nullptr){
+			bool wasFull = sink->full();
+			sink->add(diag);
+			if (!wasFull && sink->full()){
+				throw new FatalError("Too many errors");
+			}
+		} else {
+			diag.writeText(err());
+			err().flush();
+		}
+	}
+
+	/** A driver message, about no place in the source **/
+	static void report(Severity severity, DiagId id,
+		const std::string& msg){
+		report(Diagnostic(severity, id, msg));
 	}
 
 	static void fatal(
@@ -42,16 +85,8 @@ public:
 		size_t c, 
 		const std::string msg
 	){
-		fatal(l,c,msg.c_str());
-	}
-
-	static void warn(
-		size_t l,
-		size_t c,
-		const char * msg
-	){
-		std::cerr << "*WARNING* [" << l << "," << c << "]: " 
-		<< msg  << std::endl;
+		report(Diagnostic(Severity::Fatal, DiagId::Unspecified,
+			Position(), l, c, msg));
 	}
 
 	static void warn(
@@ -59,7 +94,21 @@ public:
 		size_t c,
 		const std::string msg
 	){
-		warn(l,c,msg.c_str());
+		report(Diagnostic(Severity::Warning, DiagId::Unspecified,
+			Position(), l, c, msg));
+	}
+private:
+	static std::ostream *& outStream(){
+		static thread_local std::ostream * stream = &std::cout;
+		return stream;
+	}
+	static std::ostream *& errStream(){
+		static thread_local std::ostream * stream = &std::cerr;
+		return stream;
+	}
+	static Diagnostics *& sinkSlot(){
+		static thread_local Diagnostics * sink = nullptr;
+		return sink;
 	}
 };
 
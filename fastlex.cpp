@@ -0,0 +1,381 @@
+#include <cstring>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "intlit.hpp"
+#include "scanner.hpp"
+
+/*
+A hand-written alternative to the flex scanner in cshanty.l. It scans
+a SourceBuffer in place and must produce exactly the same tokens,
+positions and diagnostics as the flex rules, including flex's
+"longest match, then earliest rule" tie breaking. Any change to the
+rules in cshanty.l needs a matching change here (make difftest
+compares the two backends on every .cshanty file in the tree).
+*/
+
+namespace cshanty{
+
+using TokenKind = cshanty::Parser::token;
+
+/* Mirrors EXIT_ON_ERR in cshanty.l */
+static const bool EXIT_ON_ERR = false;
+
+struct Keyword{
+	const char * text;
+	size_t len;
+	int kind;
+};
+
+static const Keyword KEYWORDS[] = {
+	{"int", 3, TokenKind::INT},
+	{"bool", 4, TokenKind::BOOL},
+	{"string", 6, TokenKind::STRING},
+	{"record", 6, TokenKind::RECORD},
+	{"void", 4, TokenKind::VOID},
+	{"if", 2, TokenKind::IF},
+	{"else", 4, TokenKind::ELSE},
+	{"while", 5, TokenKind::WHILE},
+	{"return", 6, TokenKind::RETURN},
+	{"false", 5, TokenKind::FALSE},
+	{"nay", 3, TokenKind::FALSE},
+	{"true", 4, TokenKind::TRUE},
+	{"aye", 3, TokenKind::TRUE},
+	{"report", 6, TokenKind::REPORT},
+	{"receive", 7, TokenKind::RECEIVE},
+	{"ahoy", 4, TokenKind::OPEN},
+	{"plus", 4, TokenKind::PLUS},
+	{"minus", 5, TokenKind::MINUS},
+	{"times", 5, TokenKind::TIMES},
+	{"divide", 6, TokenKind::DIVIDE},
+	{"and", 3, TokenKind::AND},
+	{"or", 2, TokenKind::OR},
+	{"equals", 6, TokenKind::EQUALS},
+	{"gets", 4, TokenKind::ASSIGN},
+};
+
+/* Keywords containing spaces or quotes. Each is longer than the
+   identifier that starts it, so when one matches it always wins */
+static const Keyword PHRASES[] = {
+	{"we'll take our leave and go", 27, TokenKind::RETURN},
+	{"shove off", 9, TokenKind::CLOSE},
+	{"heave and go", 12, TokenKind::SEMICOL},
+	{"roll and go", 11, TokenKind::SEMICOL},
+};
+
+/*
+Perfect hash over the keywords above: first char, last char and
+length pick a unique slot out of 64. The table is checked for
+collisions when it is built, so adding a keyword that collides fails
+loudly instead of silently misclassifying identifiers.
+*/
+static const size_t KEYWORD_SLOTS = 64;
+
+static size_t keywordSlot(const char * word, size_t len){
+	size_t first = static_cast<unsigned char>(word[0]);
+	size_t last = static_cast<unsigned char>(word[len - 1]);
+	return (first * 7 + last * 6 + len) & (KEYWORD_SLOTS - 1);
+}
+
+class KeywordTable{
+public:
+	KeywordTable(){
+		for (size_t i = 0; i < KEYWORD_SLOTS; i++){ mySlots[i] = nullptr; }
+		for (const Keyword& kw : KEYWORDS){
+			size_t slot = keywordSlot(kw.text, kw.len);
+			if (mySlots[slot] != nullptr){
+				throw new InternalError("Keyword hash collision");
+			}
+			mySlots[slot] = &kw;
+		}
+	}
+	/** Token kind of word, or TokenKind::ID if it isn't a keyword **/
+	int lookup(const char * word, size_t len) const{
+		const Keyword * kw = mySlots[keywordSlot(word, len)];
+		if (kw != nullptr && kw->len == len
+		  && std::memcmp(kw->text, word, len) == 0){
+			return kw->kind;
+		}
+		return TokenKind::ID;
+	}
+private:
+	const Keyword * mySlots[KEYWORD_SLOTS];
+};
+
+static const KeywordTable& keywords(){
+	static const KeywordTable table;
+	return table;
+}
+
+static bool isWordChar(char c){
+	unsigned char u = static_cast<unsigned char>(c);
+	return static_cast<unsigned char>((u | 0x20) - 'a') < 26
+	|| static_cast<unsigned char>(u - '0') < 10 || c == '_';
+}
+
+static bool isDigit(char c){
+	return static_cast<unsigned char>(c - '0') < 10;
+}
+
+/* Advance past spaces and tabs, 16 bytes at a time where possible.
+   Never reads past end, which may be the end of a mapping. */
+static const char * skipBlanks(const char * p, const char * end){
+#if defined(__SSE2__)
+	const __m128i spaces = _mm_set1_epi8(' ');
+	const __m128i tabs = _mm_set1_epi8('\t');
+	while (end - p >= 16){
+		__m128i chunk = _mm_loadu_si128(
+			reinterpret_cast<const __m128i *>(p));
+		__m128i blank = _mm_or_si128(
+			_mm_cmpeq_epi8(chunk, spaces),
+			_mm_cmpeq_epi8(chunk, tabs));
+		unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(blank));
+		if (mask != 0xFFFF){
+			return p + __builtin_ctz(~mask);
+		}
+		p += 16;
+	}
+#endif
+	while (p < end && (*p == ' ' || *p == '\t')){ p++; }
+	return p;
+}
+
+/* Skip a // comment: everything up to (not including) the newline.
+   glibc's memchr is vectorized, so this runs 16-32 bytes a step. */
+static const char * skipComment(const char * p, const char * end){
+	const void * nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+	return nl == nullptr ? end : static_cast<const char *>(nl);
+}
+
+/* The four rules in cshanty.l that start with a double quote, in
+   rule order (which is also tie-break order) */
+enum StrRule { STR_GOOD, STR_UNTERM, STR_BAD_UNTERM, STR_BAD };
+
+static bool isEscapee(char c){
+	return c == 'n' || c == 't' || c == '"' || c == '\\';
+}
+
+/*
+Find the longest match of any quote rule at p (an opening quote).
+Without a backslash the answer is immediate. With one, BADESC can
+match a bare backslash, so several parses are possible; this walks
+the rest of the line tracking which element boundaries are reachable
+having seen no bad escape (reach0) or at least one (reach1).
+*/
+static StrRule matchString(const char * p, const char * end, size_t& len){
+	const char * q = p + 1;
+	while (q < end && *q != '"' && *q != '\\' && *q != '\n'){ q++; }
+	if (q == end || *q == '\n'){
+		len = static_cast<size_t>(q - p);
+		return STR_UNTERM;
+	}
+	if (*q == '"'){
+		len = static_cast<size_t>(q + 1 - p);
+		return STR_GOOD;
+	}
+
+	const char * body = p + 1;
+	const char * lineEnd = skipComment(body, end);
+	size_t n = static_cast<size_t>(lineEnd - body);
+	std::vector<char> reach0(n + 2, 0);
+	std::vector<char> reach1(n + 2, 0);
+	reach0[0] = 1;
+	long best[4] = {-1, 0, -1, -1};
+	for (size_t i = 0; i <= n; i++){
+		if (!reach0[i] && !reach1[i]){ continue; }
+		long here = static_cast<long>(i) + 1;
+		if (reach0[i]){ best[STR_UNTERM] = here; }
+		if (reach1[i]){ best[STR_BAD_UNTERM] = here; }
+		if (i == n){ break; }
+
+		char c = body[i];
+		if (c == '"'){
+			if (reach0[i] && best[STR_GOOD] < 0){
+				best[STR_GOOD] = here + 1;
+			}
+			if (reach1[i]){ best[STR_BAD] = here + 1; }
+		} else if (c != '\\'){
+			reach0[i + 1] |= reach0[i];
+			reach1[i + 1] |= reach1[i];
+		} else {
+			char any = reach0[i] | reach1[i];
+			//A bare backslash is always a BADESC
+			reach1[i + 1] |= any;
+			if (i + 1 < n && isEscapee(body[i + 1])){
+				reach0[i + 2] |= reach0[i];
+				reach1[i + 2] |= reach1[i];
+			} else if (i + 1 < n){
+				reach1[i + 2] |= any;
+			}
+		}
+	}
+
+	int rule = STR_GOOD;
+	for (int r = STR_UNTERM; r <= STR_BAD; r++){
+		if (best[r] > best[rule]){ rule = r; }
+	}
+	len = static_cast<size_t>(best[rule]);
+	return static_cast<StrRule>(rule);
+}
+
+int Scanner::fastBare(const char * at, size_t len, int tag){
+	myTokBegin = static_cast<uint32_t>(at - myBuffer->data());
+	myNextOffset = myTokBegin + static_cast<uint32_t>(len);
+	this->yylval->lexeme = myArena.make<Token>(tokenPos(), tag);
+	colNum += len;
+	return tag;
+}
+
+int Scanner::fastLex(cshanty::Parser::semantic_type * const lval){
+	this->yylval = lval;
+	const char * const base = myBuffer->data();
+	const char * const end = base + myBuffer->size();
+	const char * p = base + myNextOffset;
+
+	while (true){
+		const char * blankEnd = skipBlanks(p, end);
+		colNum += static_cast<size_t>(blankEnd - p);
+		p = blankEnd;
+		myNextOffset = static_cast<uint32_t>(p - base);
+		if (p == end){ return TokenKind::END; }
+
+		const char c = *p;
+		const size_t left = static_cast<size_t>(end - p);
+		const char next = left > 1 ? p[1] : '\0';
+
+		if (isWordChar(c) && !isDigit(c)){
+			for (const Keyword& phrase : PHRASES){
+				if (phrase.text[0] == c && phrase.len <= left
+				  && std::memcmp(phrase.text, p, phrase.len) == 0){
+					return fastBare(p, phrase.len, phrase.kind);
+				}
+			}
+			const char * q = p + 1;
+			while (q < end && isWordChar(*q)){ q++; }
+			size_t len = static_cast<size_t>(q - p);
+			int kind = keywords().lookup(p, len);
+			if (kind != TokenKind::ID){ return fastBare(p, len, kind); }
+
+			myTokBegin = static_cast<uint32_t>(p - base);
+			myNextOffset = myTokBegin + static_cast<uint32_t>(len);
+			yylval->transIDToken = myArena.make<IDToken>(tokenPos(),
+				Symbol::intern(StrView(p, len)));
+			colNum += len;
+			return TokenKind::ID;
+		}
+
+		if (isDigit(c)){
+			const char * q = p + 1;
+			while (q < end && isDigit(*q)){ q++; }
+			size_t len = static_cast<size_t>(q - p);
+			int intVal;
+			myTokBegin = static_cast<uint32_t>(p - base);
+			myNextOffset = myTokBegin + static_cast<uint32_t>(len);
+			if (!parseIntLit(p, len, intVal)){
+				errIntOverflow(lineNum, colNum);
+			}
+			yylval->transIntToken = myArena.make<IntLitToken>(
+				tokenPos(), intVal);
+			colNum += len;
+			return TokenKind::INTLITERAL;
+		}
+
+		switch (c){
+		case '\n':
+			lineNum++;
+			colNum = 1;
+			p++;
+			mySource->addLine(static_cast<uint32_t>(p - base));
+			continue;
+		case '\r':
+			if (next == '\n'){
+				lineNum++;
+				colNum = 1;
+				p += 2;
+				mySource->addLine(static_cast<uint32_t>(p - base));
+				continue;
+			}
+			break;
+		case '"': {
+			size_t len;
+			StrRule rule = matchString(p, end, len);
+			//Set even for a bad literal, so diagnostics get its span
+			myTokBegin = static_cast<uint32_t>(p - base);
+			myNextOffset = myTokBegin + static_cast<uint32_t>(len);
+			if (rule == STR_GOOD){
+				yylval->transStrToken = myArena.make<StrToken>(
+					tokenPos(), Symbol::intern(StrView(p, len)));
+				colNum += len;
+				return TokenKind::STRLITERAL;
+			}
+			if (rule == STR_UNTERM){
+				errStrUnterm(lineNum, colNum);
+				colNum += len;
+				if (EXIT_ON_ERR){ bail(); }
+			} else if (rule == STR_BAD_UNTERM){
+				errStrEscAndUnterm(lineNum, colNum);
+				colNum += len;
+			} else {
+				errStrEsc(lineNum, colNum);
+				colNum += len;
+			}
+			p += len;
+			continue;
+		}
+		case '/':
+			if (next == '/'){
+				const char * q = skipComment(p, end);
+				colNum += static_cast<size_t>(q - p);
+				p = q;
+				continue;
+			}
+			return fastBare(p, 1, TokenKind::DIVIDE);
+		case '[': return fastBare(p, 1, TokenKind::LBRACE);
+		case ']': return fastBare(p, 1, TokenKind::RBRACE);
+		case '{': return fastBare(p, 1, TokenKind::OPEN);
+		case '}': return fastBare(p, 1, TokenKind::CLOSE);
+		case '(': return fastBare(p, 1, TokenKind::LPAREN);
+		case ')': return fastBare(p, 1, TokenKind::RPAREN);
+		case ';': return fastBare(p, 1, TokenKind::SEMICOL);
+		case ',': return fastBare(p, 1, TokenKind::COMMA);
+		case '*': return fastBare(p, 1, TokenKind::TIMES);
+		case '+':
+			if (next == '+'){ return fastBare(p, 2, TokenKind::INC); }
+			return fastBare(p, 1, TokenKind::PLUS);
+		case '-':
+			if (next == '-'){ return fastBare(p, 2, TokenKind::DEC); }
+			return fastBare(p, 1, TokenKind::MINUS);
+		case '!':
+			if (next == '='){ return fastBare(p, 2, TokenKind::NOTEQUALS); }
+			return fastBare(p, 1, TokenKind::NOT);
+		case '=':
+			if (next == '='){ return fastBare(p, 2, TokenKind::EQUALS); }
+			return fastBare(p, 1, TokenKind::ASSIGN);
+		case '<':
+			if (next == '='){ return fastBare(p, 2, TokenKind::LESSEQ); }
+			return fastBare(p, 1, TokenKind::LESS);
+		case '>':
+			if (next == '='){ return fastBare(p, 2, TokenKind::GREATEREQ); }
+			return fastBare(p, 1, TokenKind::GREATER);
+		case '&':
+			if (next == '&'){ return fastBare(p, 2, TokenKind::AND); }
+			break;
+		case '|':
+			if (next == '|'){ return fastBare(p, 2, TokenKind::OR); }
+			break;
+		default:
+			break;
+		}
+
+		//Anything else is a single illegal character
+		myTokBegin = static_cast<uint32_t>(p - base);
+		myNextOffset = myTokBegin + 1;
+		errIllegal(lineNum, colNum, std::string(1, c));
+		if (EXIT_ON_ERR){ bail(); }
+		colNum += 1;
+		p++;
+	}
+}
+
+}
@@ -0,0 +1,517 @@
+#include <algorithm>
+#include <initializer_list>
+#include <memory>
+#include "ast.hpp"
+#include "bytes.hpp"
+#include "flatast.hpp"
+
+namespace cshanty{
+
+const char * nodeKindString(NodeKind kind){
+	switch (kind){
+	case NodeKind::Program: return "Program";
+	case NodeKind::VarDecl: return "VarDecl";
+	case NodeKind::FormalDecl: return "FormalDecl";
+	case NodeKind::RecordTypeDecl: return "RecordTypeDecl";
+	case NodeKind::FnDecl: return "FnDecl";
+	case NodeKind::IntType: return "IntType";
+	case NodeKind::BoolType: return "BoolType";
+	case NodeKind::VoidType: return "VoidType";
+	case NodeKind::StringType: return "StringType";
+	case NodeKind::RecordType: return "RecordType";
+	case NodeKind::ID: return "ID";
+	case NodeKind::Index: return "Index";
+	case NodeKind::IntLit: return "IntLit";
+	case NodeKind::StrLit: return "StrLit";
+	case NodeKind::True: return "True";
+	case NodeKind::False: return "False";
+	case NodeKind::Neg: return "Neg";
+	case NodeKind::Not: return "Not";
+	case NodeKind::Plus: return "Plus";
+	case NodeKind::Minus: return "Minus";
+	case NodeKind::Times: return "Times";
+	case NodeKind::Divide: return "Divide";
+	case NodeKind::And: return "And";
+	case NodeKind::Or: return "Or";
+	case NodeKind::Equals: return "Equals";
+	case NodeKind::NotEquals: return "NotEquals";
+	case NodeKind::Less: return "Less";
+	case NodeKind::LessEq: return "LessEq";
+	case NodeKind::Greater: return "Greater";
+	case NodeKind::GreaterEq: return "GreaterEq";
+	case NodeKind::AssignExp: return "AssignExp";
+	case NodeKind::CallExp: return "CallExp";
+	case NodeKind::AssignStmt: return "AssignStmt";
+	case NodeKind::CallStmt: return "CallStmt";
+	case NodeKind::PostDec: return "PostDec";
+	case NodeKind::PostInc: return "PostInc";
+	case NodeKind::Receive: return "Receive";
+	case NodeKind::Report: return "Report";
+	case NodeKind::Return: return "Return";
+	case NodeKind::While: return "While";
+	case NodeKind::If: return "If";
+	case NodeKind::IfElse: return "IfElse";
+	}
+	return "OTHER";
+}
+
+FlatAST * FlatAST::build(ASTNode * node){
+	std::unique_ptr<FlatAST> ast(new FlatAST());
+	FlatBuilder builder(*ast);
+	builder.flatten(node);
+	return ast.release();
+}
+
+size_t FlatAST::count(ASTNode * node){
+	FlatAST ast;
+	FlatBuilder builder(ast);
+	builder.flatten(node);
+	return ast.size();
+}
+
+void FlatAST::write(ByteWriter& out) const{
+	out.u32(static_cast<uint32_t>(size()));
+	for (NodeKind kind : myKinds){ out.u8(static_cast<uint8_t>(kind)); }
+	for (const std::vector<uint32_t> * column : {&myBegins, &myEnds,
+	  &myFirstChild, &myChildCount, &myPayloads}){
+		for (uint32_t value : *column){ out.u32(value); }
+	}
+	out.u32(static_cast<uint32_t>(myChildren.size()));
+	for (NodeId child : myChildren){ out.u32(child); }
+	out.u32(static_cast<uint32_t>(mySymbols.size()));
+	for (Symbol sym : mySymbols){
+		StrView text = sym.view();
+		out.bytes(text.data(), text.size());
+	}
+}
+
+/** Does a node of this kind allow count children? **/
+static bool arityOk(NodeKind kind, uint32_t count, uint32_t payload){
+	switch (kind){
+	case NodeKind::Program:
+		return true;
+	case NodeKind::IntType: case NodeKind::BoolType:
+	case NodeKind::VoidType: case NodeKind::StringType:
+	case NodeKind::ID: case NodeKind::IntLit: case NodeKind::StrLit:
+	case NodeKind::True: case NodeKind::False:
+		return count == 0;
+	case NodeKind::RecordType: case NodeKind::Neg: case NodeKind::Not:
+	case NodeKind::AssignStmt: case NodeKind::CallStmt:
+	case NodeKind::PostDec: case NodeKind::PostInc:
+	case NodeKind::Receive: case NodeKind::Report:
+		return count == 1;
+	case NodeKind::VarDecl: case NodeKind::FormalDecl:
+	case NodeKind::Index: case NodeKind::AssignExp:
+	case NodeKind::Plus: case NodeKind::Minus: case NodeKind::Times:
+	case NodeKind::Divide: case NodeKind::And: case NodeKind::Or:
+	case NodeKind::Equals: case NodeKind::NotEquals:
+	case NodeKind::Less: case NodeKind::LessEq:
+	case NodeKind::Greater: case NodeKind::GreaterEq:
+		return count == 2;
+	case NodeKind::Return:
+		return count <= 1;
+	case NodeKind::RecordTypeDecl: case NodeKind::CallExp:
+	case NodeKind::While: case NodeKind::If:
+		return count >= 1;
+	case NodeKind::FnDecl:
+		return count >= 2 && payload <= count - 2;
+	case NodeKind::IfElse:
+		return count >= 1 && payload <= count - 1;
+	}
+	return false;
+}
+
+static void readColumn(ByteReader& in, std::vector<uint32_t>& column,
+	uint32_t count){
+	in.fits(count, 4);
+	column.reserve(count);
+	for (uint32_t i = 0; i < count; i++){ column.push_back(in.u32()); }
+}
+
+FlatAST * FlatAST::read(ByteReader& in, uint32_t file){
+	std::unique_ptr<FlatAST> ast(new FlatAST());
+	ast->myFile = file;
+	uint32_t count = in.u32();
+	in.check(count != 0);
+	in.fits(count, 1);
+	ast->myKinds.reserve(count);
+	for (uint32_t i = 0; i < count; i++){
+		uint8_t kind = in.u8();
+		in.check(kind <= static_cast<uint8_t>(NodeKind::IfElse));
+		ast->myKinds.push_back(static_cast<NodeKind>(kind));
+	}
+	in.check(ast->myKinds[0] == NodeKind::Program);
+	readColumn(in, ast->myBegins, count);
+	readColumn(in, ast->myEnds, count);
+	readColumn(in, ast->myFirstChild, count);
+	readColumn(in, ast->myChildCount, count);
+	readColumn(in, ast->myPayloads, count);
+	readColumn(in, ast->myChildren, in.u32());
+	uint32_t symbols = in.u32();
+	in.fits(symbols, 4);
+	for (uint32_t i = 0; i < symbols; i++){
+		ast->mySymbols.push_back(Symbol::intern(in.bytes()));
+	}
+
+	/* Every node but the root must be the child of exactly one
+	   node numbered before it, which makes the tables a tree */
+	std::vector<bool> seen(count, false);
+	size_t total = ast->myChildren.size();
+	for (NodeId node = 0; node < count; node++){
+		in.check(ast->myBegins[node] <= ast->myEnds[node]);
+		uint64_t first = ast->myFirstChild[node];
+		in.check(first + ast->myChildCount[node] <= total);
+		for (NodeId child : ast->children(node)){
+			in.check(child > node && child < count && !seen[child]);
+			seen[child] = true;
+		}
+		NodeKind kind = ast->myKinds[node];
+		in.check(arityOk(kind, ast->myChildCount[node],
+			ast->myPayloads[node]));
+		if (kind == NodeKind::ID || kind == NodeKind::StrLit){
+			in.check(ast->myPayloads[node] < symbols);
+		}
+	}
+	for (NodeId node = 1; node < count; node++){ in.check(seen[node]); }
+	return ast.release();
+}
+
+size_t FlatAST::bytes() const{
+	return myKinds.size() * sizeof(NodeKind)
+		+ (myBegins.size() + myEnds.size() + myFirstChild.size()
+		  + myChildCount.size() + myPayloads.size()
+		  + myChildren.size()) * sizeof(uint32_t)
+		+ mySymbols.size() * sizeof(Symbol);
+}
+
+bool FlatAST::sameTree(const FlatAST& other) const{
+	//Both are numbered in preorder, so equal trees have equal tables
+	// apart from the spans and the order symbols were first seen in
+	if (myKinds != other.myKinds || myChildCount != other.myChildCount
+		|| myChildren != other.myChildren){
+		return false;
+	}
+	for (NodeId node = 0; node < size(); node++){
+		NodeKind k = kind(node);
+		if (k == NodeKind::ID || k == NodeKind::StrLit){
+			if (symbol(node) != other.symbol(node)){ return false; }
+		} else if (payload(node) != other.payload(node)){
+			return false;
+		}
+	}
+	return true;
+}
+
+FlatAST::NodeId FlatBuilder::open(NodeKind kind, const ASTNode * node,
+	size_t count, uint32_t payload){
+	NodeId id = static_cast<NodeId>(myAst.myKinds.size());
+	const Position& pos = node->pos();
+	if (myAst.myFile == 0){ myAst.myFile = pos.file(); }
+	myAst.myKinds.push_back(kind);
+	myAst.myBegins.push_back(pos.beginOffset());
+	myAst.myEnds.push_back(pos.endOffset());
+	myAst.myFirstChild.push_back(
+		static_cast<uint32_t>(myAst.myChildren.size()));
+	myAst.myChildCount.push_back(static_cast<uint32_t>(count));
+	myAst.myPayloads.push_back(payload);
+	myAst.myChildren.resize(myAst.myChildren.size() + count);
+	return id;
+}
+
+FlatAST::NodeId FlatBuilder::flatten(ASTNode * node){
+	//A slot past any child's, for the root, which has no parent
+	static const size_t ROOT = SIZE_MAX;
+	NodeId root = static_cast<NodeId>(myAst.myKinds.size());
+	myPending.push_back(Pending{node, ROOT});
+	while (!myPending.empty()){
+		Pending next = myPending.back();
+		myPending.pop_back();
+		size_t queued = myPending.size();
+		NodeId id = next.node->flatten(*this);
+		//Its children were queued first to last; the first must be
+		// flattened first to keep the ids in preorder
+		std::reverse(myPending.begin() + static_cast<long>(queued),
+			myPending.end());
+		if (next.slot != ROOT){ myAst.myChildren[next.slot] = id; }
+	}
+	return root;
+}
+
+void FlatBuilder::child(NodeId parent, size_t index, ASTNode * node){
+	myPending.push_back(Pending{node,
+		myAst.myFirstChild[parent] + index});
+}
+
+uint32_t FlatBuilder::symbol(Symbol sym){
+	auto found = mySymbolIndex.find(sym);
+	if (found != mySymbolIndex.end()){ return found->second; }
+	uint32_t index = static_cast<uint32_t>(myAst.mySymbols.size());
+	myAst.mySymbols.push_back(sym);
+	mySymbolIndex.emplace(sym, index);
+	return index;
+}
+
+void FlatVisitor::walk(const FlatAST& ast){
+	if (ast.size() == 0){ return; }
+	struct Frame{
+		FlatAST::NodeId node;
+		size_t next;
+	};
+	std::vector<Frame> stack;
+	if (enter(ast, ast.root())){
+		stack.push_back(Frame{ast.root(), 0});
+	} else {
+		leave(ast, ast.root());
+	}
+	while (!stack.empty()){
+		Frame& top = stack.back();
+		FlatAST::Children kids = ast.children(top.node);
+		if (top.next == kids.size()){
+			FlatAST::NodeId done = top.node;
+			stack.pop_back();
+			leave(ast, done);
+			continue;
+		}
+		FlatAST::NodeId kid = kids[top.next++];
+		if (enter(ast, kid)){
+			stack.push_back(Frame{kid, 0});
+		} else {
+			leave(ast, kid);
+		}
+	}
+}
+
+/*
+The flat unparser. Each case reproduces the corresponding
+ASTNode::unparse in unparse.cpp, so the two must be changed together.
+Rather than recursing, a node lays out what it prints as a run of
+text and child nodes, which go on a stack of work still to do; text
+that needs nothing after it is written straight away.
+*/
+class FlatUnparser{
+public:
+	FlatUnparser(const FlatAST& ast, std::ostream& out)
+	: myAst(ast), myOut(out){ }
+
+	void run(FlatAST::NodeId root){
+		myWork.push_back(Work{nullptr, root, 0});
+		while (!myWork.empty()){
+			Work next = myWork.back();
+			myWork.pop_back();
+			if (next.text != nullptr){
+				myOut << next.text;
+			} else {
+				expand(next.node, next.indent);
+			}
+		}
+	}
+private:
+	//Text to write, or (if text is null) a node to unparse
+	struct Work{
+		const char * text;
+		FlatAST::NodeId node;
+		int indent;
+	};
+
+	void text(const char * text){
+		myLayout.push_back(Work{text, 0, 0});
+	}
+	void node(FlatAST::NodeId node, int indent = 0){
+		myLayout.push_back(Work{nullptr, node, indent});
+	}
+	void body(FlatAST::Children stmts, int indent){
+		for (FlatAST::NodeId stmt : stmts){ node(stmt, indent); }
+	}
+	void list(FlatAST::Children items){
+		const char * comma = "";
+		for (FlatAST::NodeId item : items){
+			text(comma);
+			node(item);
+			comma = ", ";
+		}
+	}
+	void binary(FlatAST::Children kids, const char * op){
+		text("(");
+		node(kids[0]);
+		text(op);
+		node(kids[1]);
+		text(")");
+	}
+	void unary(FlatAST::Children kids, const char * op){
+		text(op);
+		node(kids[0]);
+		text(")");
+	}
+	/* An assignment's lval and expression, without the parentheses
+	   it needs as an operand */
+	void assign(FlatAST::Children kids){
+		node(kids[0]);
+		text(" = ");
+		node(kids[1]);
+	}
+
+	void expand(FlatAST::NodeId n, int indent);
+
+	const FlatAST& myAst;
+	std::ostream& myOut;
+	std::vector<Work> myWork;
+	//What the node being expanded prints, first to last
+	std::vector<Work> myLayout;
+};
+
+void FlatUnparser::expand(FlatAST::NodeId n, int indent){
+	FlatAST::Children kids = myAst.children(n);
+	if (myAst.kind(n) != NodeKind::Program){
+		for (int k = 0 ; k < indent; k++){ myOut << "\t"; }
+	}
+	switch (myAst.kind(n)){
+	case NodeKind::Program:
+		body(kids, indent);
+		break;
+	case NodeKind::VarDecl:
+		node(kids[0]);
+		text(" ");
+		node(kids[1]);
+		text(";\n");
+		break;
+	case NodeKind::FormalDecl:
+		node(kids[0]);
+		text(" ");
+		node(kids[1]);
+		break;
+	case NodeKind::RecordTypeDecl:
+		text("record ");
+		node(kids[0]);
+		text("{\n");
+		body(kids.from(1), indent + 1);
+		text("\n}\n");
+		break;
+	case NodeKind::FnDecl: {
+		size_t formals = myAst.payload(n);
+		node(kids[0]);
+		text(" ");
+		node(kids[1]);
+		text("(");
+		list(kids.from(2).first(formals));
+		text(") {\n");
+		body(kids.from(2 + formals), indent + 1);
+		text("\n}\n");
+		break;
+	}
+	case NodeKind::IntType: myOut << "int"; break;
+	case NodeKind::BoolType: myOut << "bool"; break;
+	case NodeKind::VoidType: myOut << "void"; break;
+	case NodeKind::StringType: myOut << "string"; break;
+	case NodeKind::RecordType:
+		node(kids[0]);
+		break;
+	case NodeKind::ID:
+	case NodeKind::StrLit:
+		myOut << myAst.symbol(n);
+		break;
+	case NodeKind::Index:
+		node(kids[0]);
+		text("[");
+		node(kids[1]);
+		text("]");
+		break;
+	case NodeKind::IntLit: myOut << myAst.intValue(n); break;
+	case NodeKind::True: myOut << "true"; break;
+	case NodeKind::False: myOut << "false"; break;
+	case NodeKind::Neg: unary(kids, "(-"); break;
+	case NodeKind::Not: unary(kids, "(!"); break;
+	case NodeKind::Plus: binary(kids, " + "); break;
+	case NodeKind::Minus: binary(kids, " - "); break;
+	case NodeKind::Times: binary(kids, " * "); break;
+	case NodeKind::Divide: binary(kids, " / "); break;
+	case NodeKind::And: binary(kids, " && "); break;
+	case NodeKind::Or: binary(kids, " || "); break;
+	case NodeKind::Equals: binary(kids, " == "); break;
+	case NodeKind::NotEquals: binary(kids, " != "); break;
+	case NodeKind::Less: binary(kids, " < "); break;
+	case NodeKind::LessEq: binary(kids, " <= "); break;
+	case NodeKind::Greater: binary(kids, " > "); break;
+	case NodeKind::GreaterEq: binary(kids, " >= "); break;
+	case NodeKind::AssignExp:
+		text("(");
+		assign(kids);
+		text(")");
+		break;
+	case NodeKind::CallExp:
+		node(kids[0]);
+		text("(");
+		list(kids.from(1));
+		text(")");
+		break;
+	case NodeKind::AssignStmt:
+		assign(myAst.children(kids[0]));
+		text("; \n");
+		break;
+	case NodeKind::CallStmt:
+		node(kids[0]);
+		text("; \n");
+		break;
+	case NodeKind::PostDec:
+		node(kids[0]);
+		text("--; \n");
+		break;
+	case NodeKind::PostInc:
+		node(kids[0]);
+		text("++; \n");
+		break;
+	case NodeKind::Receive:
+		text("receive ");
+		node(kids[0]);
+		text("; \n");
+		break;
+	case NodeKind::Report:
+		text("report ");
+		node(kids[0]);
+		text("; \n");
+		break;
+	case NodeKind::Return:
+		text("return");
+		if (!kids.empty()){
+			text(" ");
+			node(kids[0]);
+		}
+		text("; \n");
+		break;
+	case NodeKind::While:
+		text("while (");
+		node(kids[0]);
+		text(") {\n");
+		body(kids.from(1), indent + 1);
+		text("\n}\n");
+		break;
+	case NodeKind::If:
+		text("if (");
+		node(kids[0]);
+		text(") {\n");
+		body(kids.from(1), indent);
+		text("\n}\n");
+		break;
+	case NodeKind::IfElse: {
+		size_t thenCount = myAst.payload(n);
+		text("if (");
+		node(kids[0]);
+		text(") {\n");
+		body(kids.from(1).first(thenCount), indent + 1);
+		text("\n}\n else {\n");
+		body(kids.from(1 + thenCount), indent + 1);
+		text("\n}\n");
+		break;
+	}
+	}
+	//Last pushed is done first
+	myWork.insert(myWork.end(), myLayout.rbegin(), myLayout.rend());
+	myLayout.clear();
+}
+
+void FlatAST::unparse(std::ostream& out) const{
+	if (size() == 0){ return; }
+	FlatUnparser unparser(*this, out);
+	unparser.run(root());
+}
+
+}
@@ -0,0 +1,211 @@
+#ifndef CSHANTY_FLATAST_H
+#define CSHANTY_FLATAST_H
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "intern.hpp"
+#include "position.hpp"
+
+namespace cshanty{
+
+class Arena;
+class ASTNode;
+class ByteReader;
+class ByteWriter;
+class ProgramNode;
+
+/** One tag per concrete ASTNode class **/
+enum class NodeKind : uint8_t{
+	Program,
+	VarDecl, FormalDecl, RecordTypeDecl, FnDecl,
+	IntType, BoolType, VoidType, StringType, RecordType,
+	ID, Index,
+	IntLit, StrLit, True, False,
+	Neg, Not,
+	Plus, Minus, Times, Divide, And, Or,
+	Equals, NotEquals, Less, LessEq, Greater, GreaterEq,
+	AssignExp, CallExp,
+	AssignStmt, CallStmt, PostDec, PostInc, Receive, Report, Return,
+	While, If, IfElse
+};
+
+const char * nodeKindString(NodeKind kind);
+
+/**
+* \class FlatAST
+* Whole-program AST stored as parallel arrays instead of a pointer
+* tree. Nodes are numbered in preorder from 0 (the ProgramNode), so a
+* pass that does not care about nesting is a plain loop over the ids,
+* and a subtree is never laid out before its root. For each node the
+* tables hold its kind, its span, a payload, and a range of the shared
+* children array. Children appear in a fixed order for each kind:
+*   VarDecl, FormalDecl    type id
+*   RecordTypeDecl         id field...
+*   FnDecl                 type id formal... stmt...   (payload: #formals)
+*   RecordType             id
+*   Index                  id field
+*   Neg, Not               operand
+*   binary operators       lhs rhs
+*   AssignExp              lval exp
+*   CallExp                id arg...
+*   AssignStmt, CallStmt   exp
+*   PostDec, PostInc,
+*   Receive                lval
+*   Report                 exp
+*   Return                 [exp]
+*   While, If              cond stmt...
+*   IfElse                 cond stmt... stmt...        (payload: #then)
+*   Program                decl...
+* ID and StrLit payloads index the symbol table; IntLit payloads are
+* the literal's value.
+**/
+class FlatAST{
+public:
+	typedef uint32_t NodeId;
+
+	/** A run of node ids in the children array **/
+	class Children{
+	public:
+		typedef const NodeId * iterator;
+		Children(const NodeId * first, size_t count)
+		: myFirst(first), myCount(count){ }
+		iterator begin() const { return myFirst; }
+		iterator end() const { return myFirst + myCount; }
+		size_t size() const { return myCount; }
+		bool empty() const { return myCount == 0; }
+		NodeId operator[](size_t index) const { return myFirst[index]; }
+		/** The children from index start on **/
+		Children from(size_t start) const {
+			return Children(myFirst + start, myCount - start);
+		}
+		/** The first count children **/
+		Children first(size_t count) const {
+			return Children(myFirst, count);
+		}
+	private:
+		const NodeId * myFirst;
+		size_t myCount;
+	};
+
+	/** Flatten the tree rooted at node, usually a program **/
+	static FlatAST * build(ASTNode * node);
+	/** How many nodes are in the tree rooted at node **/
+	static size_t count(ASTNode * node);
+	/** Read tables saved by write; spans refer to file. Throws
+	    InternalError if the data is malformed **/
+	static FlatAST * read(ByteReader& in, uint32_t file);
+	void write(ByteWriter& out) const;
+
+	/** Rebuild the pointer tree in arena (see inflate.cpp). Throws
+	    InternalError if a node's children don't fit its kind **/
+	ProgramNode * inflate(Arena& arena) const;
+	/** A copy in arena of the tree rooted at node, by flattening and
+	    inflating it: its names are unresolved and it has no types **/
+	static ASTNode * copy(ASTNode * node, Arena& arena);
+
+	size_t size() const { return myKinds.size(); }
+	NodeId root() const { return 0; }
+	NodeKind kind(NodeId node) const { return myKinds[node]; }
+	Position pos(NodeId node) const {
+		return Position(myFile, myBegins[node], myEnds[node]);
+	}
+	Children children(NodeId node) const {
+		return Children(myChildren.data() + myFirstChild[node],
+			myChildCount[node]);
+	}
+	uint32_t payload(NodeId node) const { return myPayloads[node]; }
+	/** Name of an ID or text of a StrLit **/
+	Symbol symbol(NodeId node) const {
+		return mySymbols[myPayloads[node]];
+	}
+	int intValue(NodeId node) const {
+		return static_cast<int>(myPayloads[node]);
+	}
+
+	/** Same text as ProgramNode::unparse on the tree this was built
+	    from **/
+	void unparse(std::ostream& out) const;
+	/** Whether other holds the same program, wherever its nodes are
+	    in the source **/
+	bool sameTree(const FlatAST& other) const;
+
+	/** Bytes held by the tables **/
+	size_t bytes() const;
+
+private:
+	friend class FlatBuilder;
+	FlatAST() : myFile(0){ }
+
+	uint32_t myFile;
+	std::vector<NodeKind> myKinds;
+	std::vector<uint32_t> myBegins;
+	std::vector<uint32_t> myEnds;
+	std::vector<uint32_t> myFirstChild;
+	std::vector<uint32_t> myChildCount;
+	std::vector<uint32_t> myPayloads;
+	std::vector<NodeId> myChildren;
+	std::vector<Symbol> mySymbols;
+};
+
+/**
+* \class FlatVisitor
+* Depth-first walk over a FlatAST without recursion. enter is called
+* on the way down; returning false skips the node's children (leave
+* is still called). leave is called once all children are done.
+**/
+class FlatVisitor{
+public:
+	virtual ~FlatVisitor(){ }
+	virtual bool enter(const FlatAST& ast, FlatAST::NodeId node){
+		return true;
+	}
+	virtual void leave(const FlatAST& ast, FlatAST::NodeId node){ }
+
+	void walk(const FlatAST& ast);
+};
+
+/**
+* \class FlatBuilder
+* Used by the ASTNode::flatten methods (flatten.cpp) to append
+* themselves to a FlatAST in preorder. A node's children are queued
+* rather than flattened on the spot, and flatten works through the
+* queue with a stack of its own, so trees of any depth flatten
+* without recursion.
+**/
+class FlatBuilder{
+public:
+	typedef FlatAST::NodeId NodeId;
+	FlatBuilder(FlatAST& ast) : myAst(ast){ }
+
+	/** Flatten the tree rooted at node. Returns node's id **/
+	NodeId flatten(ASTNode * node);
+	/** Append a node with room for count children **/
+	NodeId open(NodeKind kind, const ASTNode * node, size_t count,
+		uint32_t payload = 0);
+	/** Queue node to be flattened as parent's index'th child, once
+	    the flatten method that queued it returns **/
+	void child(NodeId parent, size_t index, ASTNode * node);
+	/** Flatten each of nodes into consecutive children of parent **/
+	template <typename Nodes>
+	void children(NodeId parent, size_t index, const Nodes& nodes){
+		for (auto node : nodes){ child(parent, index++, node); }
+	}
+	/** Index of sym in the symbol table **/
+	uint32_t symbol(Symbol sym);
+private:
+	//A node waiting to be flattened, and where its id goes
+	struct Pending{
+		ASTNode * node;
+		size_t slot;
+	};
+
+	FlatAST& myAst;
+	std::unordered_map<Symbol, uint32_t> mySymbolIndex;
+	std::vector<Pending> myPending;
+};
+
+}
+
+#endif
@@ -0,0 +1,258 @@
+#include "ast.hpp"
+
+namespace cshanty{
+
+/*
+The flatten methods, one per concrete node class, grouped here by
+purpose like the unparse methods in unparse.cpp. Each one opens its
+own node (which fixes its preorder id and reserves its children's
+slots) and then queues its children for those slots, in the order
+documented on FlatAST; FlatBuilder::flatten takes them from there.
+*/
+
+FlatAST::NodeId ProgramNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::Program, this, myGlobals.size());
+	b.children(me, 0, myGlobals);
+	return me;
+}
+
+FlatAST::NodeId VarDeclNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::VarDecl, this, 2);
+	b.child(me, 0, myType);
+	b.child(me, 1, myId);
+	return me;
+}
+
+FlatAST::NodeId FormalDeclNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::FormalDecl, this, 2);
+	b.child(me, 0, myType);
+	b.child(me, 1, myId);
+	return me;
+}
+
+FlatAST::NodeId RecordTypeDeclNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::RecordTypeDecl, this,
+		1 + variables.size());
+	b.child(me, 0, myId);
+	b.children(me, 1, variables);
+	return me;
+}
+
+FlatAST::NodeId FnDeclNode::flatten(FlatBuilder& b){
+	size_t formals = parameters.size();
+	FlatAST::NodeId me = b.open(NodeKind::FnDecl, this,
+		2 + formals + functionBody.size(),
+		static_cast<uint32_t>(formals));
+	b.child(me, 0, myType);
+	b.child(me, 1, myId);
+	b.children(me, 2, parameters);
+	b.children(me, 2 + formals, functionBody);
+	return me;
+}
+
+FlatAST::NodeId IntTypeNode::flatten(FlatBuilder& b){
+	return b.open(NodeKind::IntType, this, 0);
+}
+
+FlatAST::NodeId BoolTypeNode::flatten(FlatBuilder& b){
+	return b.open(NodeKind::BoolType, this, 0);
+}
+
+FlatAST::NodeId VoidTypeNode::flatten(FlatBuilder& b){
+	return b.open(NodeKind::VoidType, this, 0);
+}
+
+FlatAST::NodeId StringTypeNode::flatten(FlatBuilder& b){
+	return b.open(NodeKind::StringType, this, 0);
+}
+
+FlatAST::NodeId RecordTypeNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::RecordType, this, 1);
+	b.child(me, 0, myId);
+	return me;
+}
+
+FlatAST::NodeId IDNode::flatten(FlatBuilder& b){
+	return b.open(NodeKind::ID, this, 0, b.symbol(name));
+}
+
+FlatAST::NodeId IndexNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::Index, this, 2);
+	b.child(me, 0, Id_being_accessed);
+	b.child(me, 1, field_Name_being_accessed);
+	return me;
+}
+
+FlatAST::NodeId IntLitNode::flatten(FlatBuilder& b){
+	return b.open(NodeKind::IntLit, this, 0,
+		static_cast<uint32_t>(numval));
+}
+
+FlatAST::NodeId StrLitNode::flatten(FlatBuilder& b){
+	return b.open(NodeKind::StrLit, this, 0, b.symbol(stringVal));
+}
+
+FlatAST::NodeId TrueNode::flatten(FlatBuilder& b){
+	return b.open(NodeKind::True, this, 0);
+}
+
+FlatAST::NodeId FalseNode::flatten(FlatBuilder& b){
+	return b.open(NodeKind::False, this, 0);
+}
+
+FlatAST::NodeId UnaryExpNode::flattenAs(FlatBuilder& b, NodeKind kind){
+	FlatAST::NodeId me = b.open(kind, this, 1);
+	b.child(me, 0, expression);
+	return me;
+}
+
+FlatAST::NodeId NegNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::Neg);
+}
+
+FlatAST::NodeId NotNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::Not);
+}
+
+FlatAST::NodeId BinaryExpNode::flattenAs(FlatBuilder& b, NodeKind kind){
+	FlatAST::NodeId me = b.open(kind, this, 2);
+	b.child(me, 0, leftNode);
+	b.child(me, 1, rightNode);
+	return me;
+}
+
+FlatAST::NodeId PlusNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::Plus);
+}
+
+FlatAST::NodeId MinusNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::Minus);
+}
+
+FlatAST::NodeId TimesNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::Times);
+}
+
+FlatAST::NodeId DivideNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::Divide);
+}
+
+FlatAST::NodeId AndNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::And);
+}
+
+FlatAST::NodeId OrNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::Or);
+}
+
+FlatAST::NodeId EqualsNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::Equals);
+}
+
+FlatAST::NodeId NotEqualsNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::NotEquals);
+}
+
+FlatAST::NodeId LessNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::Less);
+}
+
+FlatAST::NodeId LessEqNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::LessEq);
+}
+
+FlatAST::NodeId GreaterNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::Greater);
+}
+
+FlatAST::NodeId GreaterEqNode::flatten(FlatBuilder& b){
+	return flattenAs(b, NodeKind::GreaterEq);
+}
+
+FlatAST::NodeId AssignExpNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::AssignExp, this, 2);
+	b.child(me, 0, variable);
+	b.child(me, 1, expression);
+	return me;
+}
+
+FlatAST::NodeId CallExpNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::CallExp, this,
+		1 + arguments.size());
+	b.child(me, 0, nameFunc);
+	b.children(me, 1, arguments);
+	return me;
+}
+
+FlatAST::NodeId AssignStmtNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::AssignStmt, this, 1);
+	b.child(me, 0, assignment);
+	return me;
+}
+
+FlatAST::NodeId CallStmtNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::CallStmt, this, 1);
+	b.child(me, 0, Function);
+	return me;
+}
+
+FlatAST::NodeId PostDecStmtNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::PostDec, this, 1);
+	b.child(me, 0, variable);
+	return me;
+}
+
+FlatAST::NodeId PostIncStmtNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::PostInc, this, 1);
+	b.child(me, 0, variable);
+	return me;
+}
+
+FlatAST::NodeId ReceiveStmtNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::Receive, this, 1);
+	b.child(me, 0, variable);
+	return me;
+}
+
+FlatAST::NodeId ReportStmtNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::Report, this, 1);
+	b.child(me, 0, expression);
+	return me;
+}
+
+FlatAST::NodeId ReturnStmtNode::flatten(FlatBuilder& b){
+	if (expression == nullptr){
+		return b.open(NodeKind::Return, this, 0);
+	}
+	FlatAST::NodeId me = b.open(NodeKind::Return, this, 1);
+	b.child(me, 0, expression);
+	return me;
+}
+
+FlatAST::NodeId WhileStmtNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::While, this,
+		1 + WhileBody.size());
+	b.child(me, 0, condition);
+	b.children(me, 1, WhileBody);
+	return me;
+}
+
+FlatAST::NodeId IfStmtNode::flatten(FlatBuilder& b){
+	FlatAST::NodeId me = b.open(NodeKind::If, this, 1 + IfBody.size());
+	b.child(me, 0, condition);
+	b.children(me, 1, IfBody);
+	return me;
+}
+
+FlatAST::NodeId IfElseStmtNode::flatten(FlatBuilder& b){
+	size_t thenCount = IfTrueBody.size();
+	FlatAST::NodeId me = b.open(NodeKind::IfElse, this,
+		1 + thenCount + IfFalseBody.size(),
+		static_cast<uint32_t>(thenCount));
+	b.child(me, 0, condition);
+	b.children(me, 1, IfTrueBody);
+	b.children(me, 1 + thenCount, IfFalseBody);
+	return me;
+}
+
+} // End namespace cshanty
@@ -0,0 +1,349 @@
+#include <climits>
+#include "arith.hpp"
+#include "ast.hpp"
+#include "flatast.hpp"
+#include "fold.hpp"
+
+namespace cshanty{
+
+/*
+Folding runs once type analysis has passed, so the operands of every
+operator have the types it wants. An operator whose operands are all
+literals becomes the literal it would evaluate to, with the same
+saturating arithmetic the program would run with (see arith.hpp).
+Dividing by a literal 0 is left for the running program to report,
+and so is a result of INT_MIN, which no literal can spell.
+
+These identities drop an operator and the literal it was applied to,
+keeping the other operand:
+	x + 0, 0 + x, x - 0, x * 1, 1 * x, x / 1  are  x
+	true && b, b && true, false || b, b || false  are  b
+	!!b  is  b
+and false && b is false and true || b is true, b and all, as b would
+never have been evaluated. Nothing that would have been evaluated is
+dropped, so what a program does, calls and assignments included, is
+the same folded or not.
+*/
+
+ExpNode * Folder::intLit(int32_t value, const Position& pos){
+	IntLitNode * lit = myArena.make<IntLitNode>(pos, value);
+	lit->typeAnalysis(myTypes);
+	return lit;
+}
+
+ExpNode * Folder::boolLit(bool value, const Position& pos){
+	ExpNode * lit;
+	if (value){ lit = myArena.make<TrueNode>(pos); }
+	else { lit = myArena.make<FalseNode>(pos); }
+	lit->typeAnalysis(myTypes);
+	return lit;
+}
+
+void Folder::eliminate(ASTNode * node){
+	myEliminated += FlatAST::count(node);
+}
+
+/* Whether exp is an int literal, and if so its value */
+static bool intValue(ExpNode * exp, int32_t& value){
+	IntLitNode * lit = dynamic_cast<IntLitNode *>(exp);
+	if (lit == nullptr){ return false; }
+	value = lit->value();
+	return true;
+}
+
+/* Whether exp is true or false, and if so which */
+static bool boolValue(ExpNode * exp, bool& value){
+	if (dynamic_cast<TrueNode *>(exp) != nullptr){
+		value = true;
+		return true;
+	}
+	if (dynamic_cast<FalseNode *>(exp) != nullptr){
+		value = false;
+		return true;
+	}
+	return false;
+}
+
+static bool isInt(ExpNode * exp, int32_t value){
+	int32_t actual;
+	return intValue(exp, actual) && actual == value;
+}
+
+/* An operator on two literals folded to value: a new literal in its
+   place, or the operator itself if value can't be written as one */
+static ExpNode * folded(Folder& f, ExpNode * op, int32_t value){
+	if (value == INT_MIN){ return op; }
+	f.eliminate(2);
+	return f.intLit(value, op->pos());
+}
+
+static ExpNode * folded(Folder& f, ExpNode * op, bool value){
+	f.eliminate(2);
+	return f.boolLit(value, op->pos());
+}
+
+/* The operand an identity leaves of an operator and a literal */
+static ExpNode * kept(Folder& f, ExpNode * operand){
+	f.eliminate(2);
+	return operand;
+}
+
+void ProgramNode::fold(Folder& f){
+	for (DeclNode * decl : myGlobals){ decl->fold(f); }
+}
+
+static void foldAll(NodeSpan<StmtNode> stmts, Folder& f){
+	for (StmtNode * stmt : stmts){ stmt->fold(f); }
+}
+
+void VarDeclNode::fold(Folder&){ }
+
+void RecordTypeDeclNode::fold(Folder&){ }
+
+void FnDeclNode::fold(Folder& f){
+	foldAll(functionBody, f);
+}
+
+void AssignStmtNode::fold(Folder& f){
+	assignment->fold(f);
+}
+
+void CallStmtNode::fold(Folder& f){
+	Function->fold(f);
+}
+
+void PostIncStmtNode::fold(Folder&){ }
+
+void PostDecStmtNode::fold(Folder&){ }
+
+void ReceiveStmtNode::fold(Folder&){ }
+
+void ReportStmtNode::fold(Folder& f){
+	expression = expression->fold(f);
+}
+
+void ReturnStmtNode::fold(Folder& f){
+	if (expression != nullptr){ expression = expression->fold(f); }
+}
+
+void WhileStmtNode::fold(Folder& f){
+	condition = condition->fold(f);
+	foldAll(WhileBody, f);
+}
+
+void IfStmtNode::fold(Folder& f){
+	condition = condition->fold(f);
+	foldAll(IfBody, f);
+}
+
+void IfElseStmtNode::fold(Folder& f){
+	condition = condition->fold(f);
+	foldAll(IfTrueBody, f);
+	foldAll(IfFalseBody, f);
+}
+
+ExpNode * TrueNode::fold(Folder&){ return this; }
+
+ExpNode * FalseNode::fold(Folder&){ return this; }
+
+ExpNode * IntLitNode::fold(Folder&){ return this; }
+
+ExpNode * StrLitNode::fold(Folder&){ return this; }
+
+ExpNode * IDNode::fold(Folder&){ return this; }
+
+ExpNode * IndexNode::fold(Folder&){ return this; }
+
+void UnaryExpNode::foldOperand(Folder& f){
+	expression = expression->fold(f);
+}
+
+ExpNode * NegNode::fold(Folder& f){
+	foldOperand(f);
+	int32_t value;
+	if (!intValue(expression, value)){ return this; }
+	f.eliminate(1);
+	return f.intLit(satNeg(value), pos());
+}
+
+ExpNode * NotNode::fold(Folder& f){
+	foldOperand(f);
+	bool value;
+	if (boolValue(expression, value)){
+		f.eliminate(1);
+		return f.boolLit(!value, pos());
+	}
+	NotNode * inner = dynamic_cast<NotNode *>(expression);
+	if (inner != nullptr){ return kept(f, inner->expression); }
+	return this;
+}
+
+void BinaryExpNode::foldOperands(Folder& f){
+	leftNode = leftNode->fold(f);
+	rightNode = rightNode->fold(f);
+}
+
+ExpNode * PlusNode::fold(Folder& f){
+	foldOperands(f);
+	int32_t l, r;
+	if (intValue(leftNode, l) && intValue(rightNode, r)){
+		return folded(f, this, satAdd(l, r));
+	}
+	if (isInt(rightNode, 0)){ return kept(f, leftNode); }
+	if (isInt(leftNode, 0)){ return kept(f, rightNode); }
+	return this;
+}
+
+ExpNode * MinusNode::fold(Folder& f){
+	foldOperands(f);
+	int32_t l, r;
+	if (intValue(leftNode, l) && intValue(rightNode, r)){
+		return folded(f, this, satSub(l, r));
+	}
+	if (isInt(rightNode, 0)){ return kept(f, leftNode); }
+	return this;
+}
+
+ExpNode * TimesNode::fold(Folder& f){
+	foldOperands(f);
+	int32_t l, r;
+	if (intValue(leftNode, l) && intValue(rightNode, r)){
+		return folded(f, this, satMul(l, r));
+	}
+	if (isInt(rightNode, 1)){ return kept(f, leftNode); }
+	if (isInt(leftNode, 1)){ return kept(f, rightNode); }
+	return this;
+}
+
+ExpNode * DivideNode::fold(Folder& f){
+	foldOperands(f);
+	int32_t l, r;
+	if (intValue(leftNode, l) && intValue(rightNode, r) && r != 0){
+		return folded(f, this, satDiv(l, r));
+	}
+	if (isInt(rightNode, 1)){ return kept(f, leftNode); }
+	return this;
+}
+
+ExpNode * LessNode::fold(Folder& f){
+	foldOperands(f);
+	int32_t l, r;
+	if (intValue(leftNode, l) && intValue(rightNode, r)){
+		return folded(f, this, l < r);
+	}
+	return this;
+}
+
+ExpNode * LessEqNode::fold(Folder& f){
+	foldOperands(f);
+	int32_t l, r;
+	if (intValue(leftNode, l) && intValue(rightNode, r)){
+		return folded(f, this, l <= r);
+	}
+	return this;
+}
+
+ExpNode * GreaterNode::fold(Folder& f){
+	foldOperands(f);
+	int32_t l, r;
+	if (intValue(leftNode, l) && intValue(rightNode, r)){
+		return folded(f, this, l > r);
+	}
+	return this;
+}
+
+ExpNode * GreaterEqNode::fold(Folder& f){
+	foldOperands(f);
+	int32_t l, r;
+	if (intValue(leftNode, l) && intValue(rightNode, r)){
+		return folded(f, this, l >= r);
+	}
+	return this;
+}
+
+/* Whether left and right are literals, and if so whether they are
+   equal */
+static bool literalsEqual(ExpNode * left, ExpNode * right, bool& equal){
+	int32_t li, ri;
+	bool lb, rb;
+	if (intValue(left, li) && intValue(right, ri)){
+		equal = li == ri;
+		return true;
+	}
+	if (boolValue(left, lb) && boolValue(right, rb)){
+		equal = lb == rb;
+		return true;
+	}
+	StrLitNode * ls = dynamic_cast<StrLitNode *>(left);
+	StrLitNode * rs = dynamic_cast<StrLitNode *>(right);
+	if (ls != nullptr && rs != nullptr){
+		equal = ls->text() == rs->text();
+		return true;
+	}
+	return false;
+}
+
+ExpNode * EqualsNode::fold(Folder& f){
+	foldOperands(f);
+	bool equal;
+	if (literalsEqual(leftNode, rightNode, equal)){
+		return folded(f, this, equal);
+	}
+	return this;
+}
+
+ExpNode * NotEqualsNode::fold(Folder& f){
+	foldOperands(f);
+	bool equal;
+	if (literalsEqual(leftNode, rightNode, equal)){
+		return folded(f, this, !equal);
+	}
+	return this;
+}
+
+/* op, left && right or left || right with its operands folded.
+   settles is the value of left that settles the result */
+static ExpNode * foldLogical(Folder& f, ExpNode * op, ExpNode * left,
+	ExpNode * right, bool settles){
+	bool value;
+	if (boolValue(left, value)){
+		if (value != settles){ return kept(f, right); }
+		//right is never evaluated
+		f.eliminate(1);
+		f.eliminate(right);
+		return left;
+	}
+	if (boolValue(right, value) && value != settles){
+		return kept(f, left);
+	}
+	return op;
+}
+
+ExpNode * AndNode::fold(Folder& f){
+	foldOperands(f);
+	return foldLogical(f, this, leftNode, rightNode, false);
+}
+
+ExpNode * OrNode::fold(Folder& f){
+	foldOperands(f);
+	return foldLogical(f, this, leftNode, rightNode, true);
+}
+
+ExpNode * AssignExpNode::fold(Folder& f){
+	expression = expression->fold(f);
+	return this;
+}
+
+ExpNode * CallExpNode::fold(Folder& f){
+	NodeList<ExpNode> args(f.arena());
+	bool changed = false;
+	for (ExpNode * arg : arguments){
+		ExpNode * now = arg->fold(f);
+		changed = changed || now != arg;
+		args.push_back(now);
+	}
+	if (changed){ arguments = args.freeze(); }
+	return this;
+}
+
+}
@@ -0,0 +1,47 @@
+#ifndef CSHANTY_FOLD_H
+#define CSHANTY_FOLD_H
+
+#include <cstddef>
+#include <cstdint>
+#include "arena.hpp"
+#include "position.hpp"
+#include "types.hpp"
+
+namespace cshanty{
+
+class ASTNode;
+class ExpNode;
+
+/**
+* \class Folder
+* Folds the constant parts of a program's expressions (see fold.cpp).
+* The literals that replace them are made in the compilation's arena,
+* and every node folding leaves out of the tree is counted.
+**/
+class Folder{
+public:
+	Folder(Arena& arena, TypeTable& types)
+	: myArena(arena), myTypes(types), myEliminated(0){ }
+
+	/** An int literal or a bool literal (true or false) at pos, typed
+	    as type analysis would have typed it **/
+	ExpNode * intLit(int32_t value, const Position& pos);
+	ExpNode * boolLit(bool value, const Position& pos);
+	Arena& arena(){ return myArena; }
+
+	/** Note that count nodes were left out of the tree **/
+	void eliminate(size_t count){ myEliminated += count; }
+	/** Note that node and everything under it were left out **/
+	void eliminate(ASTNode * node);
+	/** How many nodes folding has left out, less those it made **/
+	size_t eliminated() const { return myEliminated; }
+private:
+	Arena& myArena;
+	//Types the literals it makes
+	TypeAnalysis myTypes;
+	size_t myEliminated;
+};
+
+}
+
+#endif
@@ -0,0 +1,208 @@
+#include <vector>
+#include "ast.hpp"
+#include "errors.hpp"
+
+namespace cshanty{
+
+/*
+Rebuilds the pointer tree from a FlatAST, e.g. one loaded from the
+AST cache, so that every later phase can run without scanning or
+parsing. FlatAST::read has already checked that each node has the
+right number of children for its kind, but not what kinds those
+children are, so each child is checked against what its parent
+expects before it is cast. Every child is numbered after its parent,
+so building the nodes from the last id back to the first makes each
+one's children before it, without recursing.
+*/
+
+typedef FlatAST::NodeId NodeId;
+
+static bool isType(NodeKind k){
+	return k >= NodeKind::IntType && k <= NodeKind::RecordType;
+}
+
+static bool isExp(NodeKind k){
+	return k >= NodeKind::ID && k <= NodeKind::CallExp;
+}
+
+static bool isLVal(NodeKind k){
+	return k == NodeKind::ID || k == NodeKind::Index;
+}
+
+static bool isID(NodeKind k){ return k == NodeKind::ID; }
+
+static bool isStmt(NodeKind k){
+	return k == NodeKind::VarDecl
+		|| (k >= NodeKind::AssignStmt && k <= NodeKind::IfElse);
+}
+
+static bool isDecl(NodeKind k){
+	return k == NodeKind::VarDecl || k == NodeKind::RecordTypeDecl
+		|| k == NodeKind::FnDecl;
+}
+
+static bool isVarDecl(NodeKind k){ return k == NodeKind::VarDecl; }
+static bool isFormal(NodeKind k){ return k == NodeKind::FormalDecl; }
+static bool isAssign(NodeKind k){ return k == NodeKind::AssignExp; }
+static bool isCall(NodeKind k){ return k == NodeKind::CallExp; }
+
+class Inflater{
+public:
+	Inflater(const FlatAST& ast, Arena& arena)
+	: myAst(ast), myArena(arena), myBuilt(ast.size(), nullptr){ }
+
+	/** Build every node; returns the root **/
+	ASTNode * all(){
+		for (NodeId n = static_cast<NodeId>(myAst.size()); n-- > 0;){
+			myBuilt[n] = node(n);
+		}
+		return myBuilt[myAst.root()];
+	}
+
+	template <typename T>
+	T * as(NodeId n, bool (*ok)(NodeKind)){
+		if (!ok(myAst.kind(n))){
+			throw new InternalError("Malformed flat AST");
+		}
+		return static_cast<T *>(myBuilt[n]);
+	}
+
+	template <typename T>
+	NodeSpan<T> span(FlatAST::Children kids, bool (*ok)(NodeKind)){
+		NodeList<T> list(myArena);
+		for (NodeId kid : kids){ list.push_back(as<T>(kid, ok)); }
+		return list.freeze();
+	}
+
+private:
+	template <typename T>
+	T * binary(NodeId n){
+		FlatAST::Children kids = myAst.children(n);
+		return myArena.make<T>(myAst.pos(n),
+			as<ExpNode>(kids[0], isExp), as<ExpNode>(kids[1], isExp));
+	}
+
+	/** Node n, whose children are built already **/
+	ASTNode * node(NodeId n);
+
+	const FlatAST& myAst;
+	Arena& myArena;
+	std::vector<ASTNode *> myBuilt;
+};
+
+ASTNode * Inflater::node(NodeId n){
+	Position p = myAst.pos(n);
+	FlatAST::Children kids = myAst.children(n);
+	switch (myAst.kind(n)){
+	case NodeKind::Program:
+		return myArena.make<ProgramNode>(p,
+			span<DeclNode>(kids, isDecl));
+	case NodeKind::VarDecl:
+		return myArena.make<VarDeclNode>(p,
+			as<TypeNode>(kids[0], isType), as<IDNode>(kids[1], isID));
+	case NodeKind::FormalDecl:
+		return myArena.make<FormalDeclNode>(p,
+			as<TypeNode>(kids[0], isType), as<IDNode>(kids[1], isID));
+	case NodeKind::RecordTypeDecl:
+		return myArena.make<RecordTypeDeclNode>(p,
+			as<IDNode>(kids[0], isID),
+			span<VarDeclNode>(kids.from(1), isVarDecl));
+	case NodeKind::FnDecl: {
+		size_t formals = myAst.payload(n);
+		return myArena.make<FnDeclNode>(p,
+			as<TypeNode>(kids[0], isType), as<IDNode>(kids[1], isID),
+			span<FormalDeclNode>(kids.from(2).first(formals), isFormal),
+			span<StmtNode>(kids.from(2 + formals), isStmt));
+	}
+	case NodeKind::IntType: return myArena.make<IntTypeNode>(p);
+	case NodeKind::BoolType: return myArena.make<BoolTypeNode>(p);
+	case NodeKind::VoidType: return myArena.make<VoidTypeNode>(p);
+	case NodeKind::StringType: return myArena.make<StringTypeNode>(p);
+	case NodeKind::RecordType:
+		return myArena.make<RecordTypeNode>(p, as<IDNode>(kids[0], isID));
+	case NodeKind::ID:
+		return myArena.make<IDNode>(p, myAst.symbol(n));
+	case NodeKind::Index:
+		return myArena.make<IndexNode>(p,
+			as<IDNode>(kids[0], isID), as<IDNode>(kids[1], isID));
+	case NodeKind::IntLit:
+		return myArena.make<IntLitNode>(p, myAst.intValue(n));
+	case NodeKind::StrLit:
+		return myArena.make<StrLitNode>(p, myAst.symbol(n));
+	case NodeKind::True: return myArena.make<TrueNode>(p);
+	case NodeKind::False: return myArena.make<FalseNode>(p);
+	case NodeKind::Neg:
+		return myArena.make<NegNode>(p, as<ExpNode>(kids[0], isExp));
+	case NodeKind::Not:
+		return myArena.make<NotNode>(p, as<ExpNode>(kids[0], isExp));
+	case NodeKind::Plus: return binary<PlusNode>(n);
+	case NodeKind::Minus: return binary<MinusNode>(n);
+	case NodeKind::Times: return binary<TimesNode>(n);
+	case NodeKind::Divide: return binary<DivideNode>(n);
+	case NodeKind::And: return binary<AndNode>(n);
+	case NodeKind::Or: return binary<OrNode>(n);
+	case NodeKind::Equals: return binary<EqualsNode>(n);
+	case NodeKind::NotEquals: return binary<NotEqualsNode>(n);
+	case NodeKind::Less: return binary<LessNode>(n);
+	case NodeKind::LessEq: return binary<LessEqNode>(n);
+	case NodeKind::Greater: return binary<GreaterNode>(n);
+	case NodeKind::GreaterEq: return binary<GreaterEqNode>(n);
+	case NodeKind::AssignExp:
+		return myArena.make<AssignExpNode>(p,
+			as<LValNode>(kids[0], isLVal), as<ExpNode>(kids[1], isExp));
+	case NodeKind::CallExp:
+		return myArena.make<CallExpNode>(p, as<IDNode>(kids[0], isID),
+			span<ExpNode>(kids.from(1), isExp));
+	case NodeKind::AssignStmt:
+		return myArena.make<AssignStmtNode>(p,
+			as<AssignExpNode>(kids[0], isAssign));
+	case NodeKind::CallStmt:
+		return myArena.make<CallStmtNode>(p,
+			as<CallExpNode>(kids[0], isCall));
+	case NodeKind::PostDec:
+		return myArena.make<PostDecStmtNode>(p,
+			as<LValNode>(kids[0], isLVal));
+	case NodeKind::PostInc:
+		return myArena.make<PostIncStmtNode>(p,
+			as<LValNode>(kids[0], isLVal));
+	case NodeKind::Receive:
+		return myArena.make<ReceiveStmtNode>(p,
+			as<LValNode>(kids[0], isLVal));
+	case NodeKind::Report:
+		return myArena.make<ReportStmtNode>(p,
+			as<ExpNode>(kids[0], isExp));
+	case NodeKind::Return:
+		if (kids.empty()){ return myArena.make<ReturnStmtNode>(p); }
+		return myArena.make<ReturnStmtNode>(p,
+			as<ExpNode>(kids[0], isExp));
+	case NodeKind::While:
+		return myArena.make<WhileStmtNode>(p, as<ExpNode>(kids[0], isExp),
+			span<StmtNode>(kids.from(1), isStmt));
+	case NodeKind::If:
+		return myArena.make<IfStmtNode>(p, as<ExpNode>(kids[0], isExp),
+			span<StmtNode>(kids.from(1), isStmt));
+	case NodeKind::IfElse: {
+		size_t thenCount = myAst.payload(n);
+		return myArena.make<IfElseStmtNode>(p,
+			as<ExpNode>(kids[0], isExp),
+			span<StmtNode>(kids.from(1).first(thenCount), isStmt),
+			span<StmtNode>(kids.from(1 + thenCount), isStmt));
+	}
+	}
+	throw new InternalError("Malformed flat AST");
+}
+
+ProgramNode * FlatAST::inflate(Arena& arena) const{
+	Inflater inflater(*this, arena);
+	return static_cast<ProgramNode *>(inflater.all());
+}
+
+ASTNode * FlatAST::copy(ASTNode * node, Arena& arena){
+	FlatAST ast;
+	FlatBuilder builder(ast);
+	builder.flatten(node);
+	Inflater inflater(ast, arena);
+	return inflater.all();
+}
+
+} // End namespace cshanty
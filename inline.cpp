@@ -0,0 +1,391 @@
+#include <memory>
+#include "ast.hpp"
+#include "errors.hpp"
+#include "flatast.hpp"
+#include "inline.hpp"
+
+namespace cshanty{
+
+/*
+Inlining runs once type analysis has passed, before folding, so that
+what it puts in place of a call can be folded with the code around
+it. Only functions that call nothing and flatten to at most the
+budget's nodes are inlined, so none is recursive. Functions are
+visited in order, and one whose calls have all been inlined calls
+nothing itself, so it may be inlined into the functions after it.
+A call is inlined in one of two ways:
+  - A call anywhere to a function whose body is just return e;, where
+    e assigns nothing, becomes a copy of e with each formal replaced
+    by its argument. Each argument must call nothing, assign nothing
+    and divide by nothing, so that it can't fail or change anything
+    and it doesn't matter when, or whether, it is evaluated; one for
+    a formal that e names more than once must be a literal or a
+    variable, not to repeat work.
+  - A call statement to a void function that takes no records and
+    returns only at the end of its body, if at all, becomes
+    if (true) { its formals, declared as locals; each assigned its
+    argument, in order; a copy of its body }.
+Either way, what is inlined must mean the same where it is put: no
+name the callee uses for a global may be declared by the function it
+is inlined into, and no argument may name anything the callee
+declares, as its formals and locals hide it in the inlined block.
+Copies keep the positions of what they copy, so a division by zero
+in inlined code is reported where the callee has it. A program only
+behaves differently if calls nest so deep that one more frame runs
+out of room: its inlined calls no longer take one.
+*/
+
+/* What inlining needs to know about the code under a node */
+struct Scan{
+	bool calls = false;
+	bool assigns = false;
+	bool divides = false;
+	size_t returns = 0;
+	std::unordered_set<Symbol> declared;
+	//How often each name is used, not counting fields and the name
+	// of the function scanned
+	std::unordered_map<Symbol, size_t> used;
+};
+
+static void scan(ASTNode * node, Scan& s){
+	std::unique_ptr<FlatAST> ast(FlatAST::build(node));
+	//Names that are declared or aren't looked up in a scope. Children
+	// come after their parent, so a name is marked before it is seen
+	std::vector<bool> skip(ast->size(), false);
+	for (FlatAST::NodeId n = 0; n < ast->size(); n++){
+		FlatAST::Children kids = ast->children(n);
+		switch (ast->kind(n)){
+		case NodeKind::CallExp: s.calls = true; break;
+		case NodeKind::AssignExp: s.assigns = true; break;
+		case NodeKind::Divide: s.divides = true; break;
+		case NodeKind::Return: s.returns++; break;
+		case NodeKind::VarDecl: case NodeKind::FormalDecl:
+			s.declared.insert(ast->symbol(kids[1]));
+			skip[kids[1]] = true;
+			break;
+		case NodeKind::Index: case NodeKind::FnDecl:
+			skip[kids[1]] = true;
+			break;
+		case NodeKind::ID:
+			if (!skip[n]){ s.used[ast->symbol(n)]++; }
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* Whether exp is a literal or a variable, which are as cheap to
+   repeat as to name */
+static bool trivial(ExpNode * exp){
+	return dynamic_cast<LValNode *>(exp) != nullptr
+		|| dynamic_cast<IntLitNode *>(exp) != nullptr
+		|| dynamic_cast<StrLitNode *>(exp) != nullptr
+		|| dynamic_cast<TrueNode *>(exp) != nullptr
+		|| dynamic_cast<FalseNode *>(exp) != nullptr;
+}
+
+Inliner::Inliner(Arena& arena, TypeTable& types, ProgramNode * program,
+	size_t budget)
+: myArena(arena), myTypes(types), myBudget(budget), myInlined(0){
+	myGlobals.enterScope();
+	for (DeclNode * decl : program->globals()){
+		IDNode * id = nullptr;
+		if (VarDeclNode * var = dynamic_cast<VarDeclNode *>(decl)){
+			id = var->id();
+		} else if (FnDeclNode * fn = dynamic_cast<FnDeclNode *>(decl)){
+			id = fn->id();
+		} else {
+			id = static_cast<RecordTypeDeclNode *>(decl)->id();
+		}
+		myGlobals.declare(id->getName(), decl);
+		myGlobalNames.insert(id->getName());
+	}
+}
+
+const Inliner::Callee& Inliner::callee(FnDeclNode * fn){
+	auto found = myCallees.find(fn);
+	if (found != myCallees.end()){ return found->second; }
+	Callee& c = myCallees[fn];
+	if (FlatAST::count(fn) > myBudget){ return c; }
+	Scan s;
+	scan(fn, s);
+	if (s.calls){ return c; }
+	c.ok = true;
+
+	c.declared = s.declared;
+	for (const auto& use : s.used){
+		if (c.declared.count(use.first) == 0){
+			c.globals.insert(use.first);
+		}
+	}
+	//A name declared in a block may be a global's outside it
+	for (Symbol name : c.declared){
+		if (myGlobalNames.count(name) != 0){ c.globals.insert(name); }
+	}
+
+	NodeSpan<StmtNode> body = fn->body();
+	ReturnStmtNode * only = body.size() == 1
+		? dynamic_cast<ReturnStmtNode *>(body.front()) : nullptr;
+	if (only != nullptr && only->value() != nullptr && !s.assigns){
+		c.result = only->value();
+		for (FormalDeclNode * formal : fn->formals()){
+			auto uses = s.used.find(formal->id()->getName());
+			c.uses.push_back(uses == s.used.end() ? 0 : uses->second);
+		}
+	}
+
+	bool records = false;
+	for (FormalDeclNode * formal : fn->formals()){
+		records = records || formal->declType().isRecord();
+	}
+	ReturnStmtNode * last = body.empty() ? nullptr
+		: dynamic_cast<ReturnStmtNode *>(body.back());
+	bool returnsAtEnd = s.returns == 0
+		|| (s.returns == 1 && last != nullptr);
+	c.block = fn->retType()->asType().isVoid() && !records
+		&& returnsAtEnd;
+	return c;
+}
+
+bool Inliner::hidden(const Callee& fn) const{
+	for (Symbol name : fn.globals){
+		if (myCallerNames.count(name) != 0){ return true; }
+	}
+	return false;
+}
+
+void Inliner::resolve(ASTNode * node){
+	if (!node->nameAnalysis(myGlobals)){
+		throw new InternalError("Inlined code did not resolve");
+	}
+}
+
+void Inliner::enterFn(FnDeclNode * fn){
+	Scan s;
+	scan(fn, s);
+	myCallerNames = s.declared;
+}
+
+NodeSpan<StmtNode> Inliner::inlineAll(NodeSpan<StmtNode> body){
+	NodeList<StmtNode> stmts(myArena);
+	bool changed = false;
+	for (StmtNode * stmt : body){
+		StmtNode * now = stmt->inlineCalls(*this);
+		changed = changed || now != stmt;
+		stmts.push_back(now);
+	}
+	if (!changed){ return body; }
+	return stmts.freeze();
+}
+
+ExpNode * Inliner::inlineExp(CallExpNode * call){
+	FnDeclNode * fn = call->callee();
+	const Callee& c = callee(fn);
+	if (!c.ok || c.result == nullptr || hidden(c)){ return call; }
+	NodeSpan<FormalDeclNode> formals = fn->formals();
+	NodeSpan<ExpNode> args = call->args();
+	for (size_t i = 0; i < args.size(); i++){
+		Scan s;
+		scan(args[i], s);
+		if (s.calls || s.assigns || s.divides){ return call; }
+		if (c.uses[i] > 1 && !trivial(args[i])){ return call; }
+		//An index into a record formal must be left an index
+		if (formals[i]->declType().isRecord()
+		  && dynamic_cast<IDNode *>(args[i]) == nullptr){
+			return call;
+		}
+	}
+
+	ExpNode * result = static_cast<ExpNode *>(
+		FlatAST::copy(c.result, myArena));
+	myGlobals.enterScope();
+	for (FormalDeclNode * formal : formals){
+		myGlobals.declare(formal->id()->getName(), formal);
+	}
+	resolve(result);
+	myGlobals.leaveScope();
+	result->typeAnalysis(myTypes);
+
+	for (size_t i = 0; i < args.size(); i++){ myArgs[formals[i]] = args[i]; }
+	result = result->inlineCalls(*this);
+	myArgs.clear();
+	myInlined++;
+	return result;
+}
+
+StmtNode * Inliner::inlineStmt(CallStmtNode * stmt, CallExpNode * call){
+	FnDeclNode * fn = call->callee();
+	const Callee& c = callee(fn);
+	if (!c.ok || !c.block || hidden(c)){ return stmt; }
+	NodeSpan<FormalDeclNode> formals = fn->formals();
+	NodeSpan<ExpNode> args = call->args();
+	for (ExpNode * arg : args){
+		Scan s;
+		scan(arg, s);
+		for (const auto& use : s.used){
+			if (c.declared.count(use.first) != 0){ return stmt; }
+		}
+	}
+
+	NodeList<StmtNode> body(myArena);
+	myGlobals.enterScope();
+	for (FormalDeclNode * formal : formals){
+		TypeNode * type = static_cast<TypeNode *>(
+			FlatAST::copy(formal->type(), myArena));
+		IDNode * id = myArena.make<IDNode>(formal->id()->pos(),
+			formal->id()->getName());
+		VarDeclNode * local = myArena.make<VarDeclNode>(formal->pos(),
+			type, id);
+		resolve(local);
+		body.push_back(local);
+	}
+	for (size_t i = 0; i < args.size(); i++){
+		IDNode * id = myArena.make<IDNode>(formals[i]->id()->pos(),
+			formals[i]->id()->getName());
+		resolve(id);
+		AssignExpNode * assign = myArena.make<AssignExpNode>(
+			args[i]->pos(), id, args[i]);
+		body.push_back(myArena.make<AssignStmtNode>(args[i]->pos(),
+			assign));
+	}
+	NodeSpan<StmtNode> fnBody = fn->body();
+	size_t end = fnBody.size();
+	if (end != 0 && dynamic_cast<ReturnStmtNode *>(fnBody.back())){
+		end--;
+	}
+	for (size_t i = 0; i < end; i++){
+		StmtNode * copy = static_cast<StmtNode *>(
+			FlatAST::copy(fnBody[i], myArena));
+		resolve(copy);
+		body.push_back(copy);
+	}
+	myGlobals.leaveScope();
+
+	const Position& pos = stmt->pos();
+	IfStmtNode * block = myArena.make<IfStmtNode>(pos,
+		myArena.make<TrueNode>(pos), body.freeze());
+	block->typeAnalysis(myTypes);
+	myInlined++;
+	return block;
+}
+
+ExpNode * Inliner::substitute(IDNode * id){
+	if (myArgs.empty()){ return id; }
+	auto arg = myArgs.find(id->decl());
+	return arg == myArgs.end() ? id : arg->second;
+}
+
+void ProgramNode::inlineCalls(Inliner& in){
+	for (DeclNode * decl : myGlobals){ decl->inlineCalls(in); }
+}
+
+StmtNode * VarDeclNode::inlineCalls(Inliner&){ return this; }
+
+StmtNode * RecordTypeDeclNode::inlineCalls(Inliner&){ return this; }
+
+StmtNode * FnDeclNode::inlineCalls(Inliner& in){
+	in.enterFn(this);
+	functionBody = in.inlineAll(functionBody);
+	return this;
+}
+
+StmtNode * AssignStmtNode::inlineCalls(Inliner& in){
+	assignment->inlineCalls(in);
+	return this;
+}
+
+StmtNode * CallStmtNode::inlineCalls(Inliner& in){
+	Function->inlineArgs(in);
+	return in.inlineStmt(this, Function);
+}
+
+StmtNode * PostIncStmtNode::inlineCalls(Inliner&){ return this; }
+
+StmtNode * PostDecStmtNode::inlineCalls(Inliner&){ return this; }
+
+StmtNode * ReceiveStmtNode::inlineCalls(Inliner&){ return this; }
+
+StmtNode * ReportStmtNode::inlineCalls(Inliner& in){
+	expression = expression->inlineCalls(in);
+	return this;
+}
+
+StmtNode * ReturnStmtNode::inlineCalls(Inliner& in){
+	if (expression != nullptr){
+		expression = expression->inlineCalls(in);
+	}
+	return this;
+}
+
+StmtNode * WhileStmtNode::inlineCalls(Inliner& in){
+	condition = condition->inlineCalls(in);
+	WhileBody = in.inlineAll(WhileBody);
+	return this;
+}
+
+StmtNode * IfStmtNode::inlineCalls(Inliner& in){
+	condition = condition->inlineCalls(in);
+	IfBody = in.inlineAll(IfBody);
+	return this;
+}
+
+StmtNode * IfElseStmtNode::inlineCalls(Inliner& in){
+	condition = condition->inlineCalls(in);
+	IfTrueBody = in.inlineAll(IfTrueBody);
+	IfFalseBody = in.inlineAll(IfFalseBody);
+	return this;
+}
+
+ExpNode * TrueNode::inlineCalls(Inliner&){ return this; }
+
+ExpNode * FalseNode::inlineCalls(Inliner&){ return this; }
+
+ExpNode * IntLitNode::inlineCalls(Inliner&){ return this; }
+
+ExpNode * StrLitNode::inlineCalls(Inliner&){ return this; }
+
+ExpNode * IDNode::inlineCalls(Inliner& in){
+	return in.substitute(this);
+}
+
+ExpNode * IndexNode::inlineCalls(Inliner& in){
+	//inlineExp only lets a variable stand for a record formal
+	Id_being_accessed = static_cast<IDNode *>(
+		in.substitute(Id_being_accessed));
+	return this;
+}
+
+ExpNode * UnaryExpNode::inlineCalls(Inliner& in){
+	expression = expression->inlineCalls(in);
+	return this;
+}
+
+ExpNode * BinaryExpNode::inlineCalls(Inliner& in){
+	leftNode = leftNode->inlineCalls(in);
+	rightNode = rightNode->inlineCalls(in);
+	return this;
+}
+
+ExpNode * AssignExpNode::inlineCalls(Inliner& in){
+	expression = expression->inlineCalls(in);
+	return this;
+}
+
+void CallExpNode::inlineArgs(Inliner& in){
+	NodeList<ExpNode> args(in.arena());
+	bool changed = false;
+	for (ExpNode * arg : arguments){
+		ExpNode * now = arg->inlineCalls(in);
+		changed = changed || now != arg;
+		args.push_back(now);
+	}
+	if (changed){ arguments = args.freeze(); }
+}
+
+ExpNode * CallExpNode::inlineCalls(Inliner& in){
+	inlineArgs(in);
+	return in.inlineExp(this);
+}
+
+}
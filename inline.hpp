@@ -0,0 +1,99 @@
+#ifndef CSHANTY_INLINE_H
+#define CSHANTY_INLINE_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "arena.hpp"
+#include "intern.hpp"
+#include "symboltable.hpp"
+#include "types.hpp"
+
+namespace cshanty{
+
+class ASTNode;
+class CallExpNode;
+class CallStmtNode;
+class DeclNode;
+class ExpNode;
+class FnDeclNode;
+class IDNode;
+class ProgramNode;
+class StmtNode;
+template <typename T> class NodeSpan;
+
+/**
+* \class Inliner
+* Puts the bodies of small functions that call nothing in place of
+* the calls to them (see inline.cpp). What it builds is made in the
+* compilation's arena, with its names resolved and its types found as
+* if the program had been written that way.
+**/
+class Inliner{
+public:
+	/** Inline calls in program to functions of at most budget
+	    nodes **/
+	Inliner(Arena& arena, TypeTable& types, ProgramNode * program,
+		size_t budget);
+
+	Arena& arena(){ return myArena; }
+
+	/** Start on the calls in fn's body **/
+	void enterFn(FnDeclNode * fn);
+	/** body with the calls in it inlined **/
+	NodeSpan<StmtNode> inlineAll(NodeSpan<StmtNode> body);
+
+	/** What to put in the place of call, its arguments inlined: the
+	    callee's result, or call itself **/
+	ExpNode * inlineExp(CallExpNode * call);
+	/** What to put in the place of stmt, a call its arguments
+	    inlined: a block running the callee's body, or stmt itself **/
+	StmtNode * inlineStmt(CallStmtNode * stmt, CallExpNode * call);
+	/** What to put in the place of id: the argument it stands for
+	    while a callee's result is being inlined, else id itself **/
+	ExpNode * substitute(IDNode * id);
+
+	/** How many calls were inlined **/
+	size_t inlined() const { return myInlined; }
+private:
+	/** What inlining needs to know about a function **/
+	struct Callee{
+		//Calls nothing and is within the budget
+		bool ok = false;
+		//Its body is just return result;, and result assigns nothing
+		ExpNode * result = nullptr;
+		//How often result names each formal
+		std::vector<size_t> uses;
+		//Returns nothing, takes no records and returns only at the
+		// end of its body, if at all
+		bool block = false;
+		//The names it declares
+		std::unordered_set<Symbol> declared;
+		//The names it may use for a global
+		std::unordered_set<Symbol> globals;
+	};
+	const Callee& callee(FnDeclNode * fn);
+	/** Whether a global fn uses is hidden where it is inlined **/
+	bool hidden(const Callee& fn) const;
+	/** Resolve the names in node, a copy of some of a function's
+	    code, as they were resolved in the function **/
+	void resolve(ASTNode * node);
+
+	Arena& myArena;
+	TypeAnalysis myTypes;
+	size_t myBudget;
+	size_t myInlined;
+	//The globals, in a scope of their own
+	SymbolTable myGlobals;
+	std::unordered_set<Symbol> myGlobalNames;
+	std::unordered_map<const FnDeclNode *, Callee> myCallees;
+	//The names the function being inlined into declares
+	std::unordered_set<Symbol> myCallerNames;
+	//While a result is inlined, the argument for each formal
+	std::unordered_map<const DeclNode *, ExpNode *> myArgs;
+};
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "arena.hpp"
+#include "bytes.hpp"
+#include "intern.hpp"
+
+namespace cshanty{
+
+struct Symbol::Entry{
+	uint64_t hash;
+	uint32_t id;
+	uint32_t length;
+	const char * text;
+};
+
+/*
+The table is split into shards by hash so that threads compiling
+different files rarely wait on each other. Each shard owns an arena
+holding its entries and their NUL-terminated text, and an
+open-addressing table of entry pointers (linear probing, kept at most
+half full).
+*/
+static const size_t SHARD_BITS = 4;
+static const size_t SHARDS = size_t(1) << SHARD_BITS;
+
+struct Shard{
+	std::mutex lock;
+	Arena arena;
+	std::vector<const Symbol::Entry *> slots =
+		std::vector<const Symbol::Entry *>(64, nullptr);
+	size_t count = 0;
+	Interner::Stats stats;
+};
+
+static Shard * shards(){
+	static Shard all[SHARDS];
+	return all;
+}
+
+static std::atomic<uint32_t> nextId(1);
+
+static void grow(Shard& shard){
+	std::vector<const Symbol::Entry *> bigger(
+		shard.slots.size() * 2, nullptr);
+	size_t mask = bigger.size() - 1;
+	for (auto entry : shard.slots){
+		if (entry == nullptr){ continue; }
+		size_t at = static_cast<size_t>(entry->hash) & mask;
+		while (bigger[at] != nullptr){ at = (at + 1) & mask; }
+		bigger[at] = entry;
+	}
+	shard.slots.swap(bigger);
+}
+
+Symbol Symbol::intern(StrView text){
+	uint64_t hash = hashBytes(text.data(), text.size());
+	Shard& shard = shards()[hash >> (64 - SHARD_BITS)];
+	std::lock_guard<std::mutex> guard(shard.lock);
+	shard.stats.lookups++;
+
+	size_t mask = shard.slots.size() - 1;
+	size_t at = static_cast<size_t>(hash) & mask;
+	while (const Entry * entry = shard.slots[at]){
+		if (entry->hash == hash && entry->length == text.size()
+		  && std::memcmp(entry->text, text.data(), text.size()) == 0){
+			shard.stats.bytesSaved += text.size();
+			return Symbol(entry);
+		}
+		at = (at + 1) & mask;
+	}
+
+	char * copy = static_cast<char *>(shard.arena.allocate(
+		text.size() + 1, 1, Arena::kindOf<char>()));
+	std::memcpy(copy, text.data(), text.size());
+	copy[text.size()] = '\0';
+
+	Entry * entry = shard.arena.make<Entry>();
+	entry->hash = hash;
+	entry->id = nextId++;
+	entry->length = static_cast<uint32_t>(text.size());
+	entry->text = copy;
+
+	shard.slots[at] = entry;
+	shard.stats.unique++;
+	shard.stats.uniqueBytes += text.size();
+	if (++shard.count * 2 > shard.slots.size()){ grow(shard); }
+	return Symbol(entry);
+}
+
+uint32_t Symbol::id() const{
+	return myEntry == nullptr ? 0 : myEntry->id;
+}
+
+StrView Symbol::view() const{
+	if (myEntry == nullptr){ return StrView(); }
+	return StrView(myEntry->text, myEntry->length);
+}
+
+const char * Symbol::c_str() const{
+	return myEntry == nullptr ? "" : myEntry->text;
+}
+
+Interner::Stats Interner::stats(){
+	Stats total;
+	for (size_t i = 0; i < SHARDS; i++){
+		Shard& shard = shards()[i];
+		std::lock_guard<std::mutex> guard(shard.lock);
+		total.lookups += shard.stats.lookups;
+		total.unique += shard.stats.unique;
+		total.uniqueBytes += shard.stats.uniqueBytes;
+		total.bytesSaved += shard.stats.bytesSaved;
+	}
+	return total;
+}
+
+void Interner::reportStats(std::ostream& out){
+	Stats s = stats();
+	out << "Interner: " << s.unique << " unique strings ("
+	<< s.uniqueBytes << " bytes) from " << s.lookups
+	<< " lookups, " << s.bytesSaved << " bytes saved\n";
+}
+
+}
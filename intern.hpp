@@ -0,0 +1,81 @@
+#ifndef CSHANTY_INTERN_H
+#define CSHANTY_INTERN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include "strview.hpp"
+
+namespace cshanty{
+
+/**
+* \class Symbol
+* Handle to an interned string (identifier or string literal text).
+* All occurrences of the same text share one entry in the process-wide
+* intern table, so two Symbols name the same text exactly when their
+* handles are equal, and comparing or hashing them is O(1). The
+* interned characters stay alive for the rest of the process.
+**/
+class Symbol{
+public:
+	Symbol() : myEntry(nullptr){ }
+
+	/** The unique handle for text, adding it to the table if new **/
+	static Symbol intern(StrView text);
+
+	bool valid() const { return myEntry != nullptr; }
+	/** Dense id (1, 2, ...) in order of first interning; 0 if invalid **/
+	uint32_t id() const;
+	StrView view() const;
+	std::string str() const { return view().str(); }
+	const char * c_str() const;
+
+	bool operator==(const Symbol& other) const{
+		return myEntry == other.myEntry;
+	}
+	bool operator!=(const Symbol& other) const{
+		return myEntry != other.myEntry;
+	}
+
+	struct Entry;
+private:
+	Symbol(const Entry * entry) : myEntry(entry){ }
+	const Entry * myEntry;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const Symbol& sym){
+	return out << sym.view();
+}
+
+/**
+* \class Interner
+* Statistics about the process-wide intern table
+**/
+class Interner{
+public:
+	struct Stats{
+		size_t lookups = 0;
+		size_t unique = 0;
+		size_t uniqueBytes = 0;
+		/** Bytes of text that did not need their own copy because
+		    the string had been interned already **/
+		size_t bytesSaved = 0;
+	};
+	static Stats stats();
+	static void reportStats(std::ostream& out);
+};
+
+}
+
+namespace std{
+template <>
+struct hash<cshanty::Symbol>{
+	size_t operator()(const cshanty::Symbol& sym) const{
+		return sym.id();
+	}
+};
+}
+
+#endif
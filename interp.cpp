@@ -0,0 +1,509 @@
+#include <climits>
+#include <exception>
+#include <string>
+#include <pthread.h>
+#include "arith.hpp"
+#include "ast.hpp"
+#include "errors.hpp"
+#include "interp.hpp"
+#include "intlit.hpp"
+
+namespace cshanty{
+
+/*
+The interpreter walks the tree of a program that has passed type
+analysis, so it trusts the tree: a name used as a variable was
+declared by a VarDeclNode, a callee by a FnDeclNode, and the operands
+of each operator have the types it wants. Before running, allocate
+gives each variable a slot: globals in the interpreter's global area,
+formals and locals in their function's frame, and fields at an
+offset in their record. A record variable's fields are its slots,
+one after another, nested records included.
+
+Arithmetic saturates (see arith.hpp). report writes ints in decimal,
+bools as true or false and strings as their characters, with nothing
+after; receive reads one whitespace-separated word. A function that
+isn't void and ends without returning a value is a runtime error.
+*/
+
+//Slots in the stack the frames come from
+static const size_t STACK_SLOTS = 1 << 20;
+//What of the C++ stack is kept back from calls, for the work a
+// function does between them
+static const size_t NATIVE_STACK_MARGIN = 1 << 20;
+
+bool Value::operator==(const Value& other) const{
+	switch (tag){
+	case Tag::Int: return i == other.i;
+	case Tag::Bool: return b == other.b;
+	case Tag::String: return s == other.s;
+	case Tag::Record: return fields == other.fields;
+	case Tag::Void: return other.tag == Tag::Void;
+	}
+	return false;
+}
+
+void Value::print(std::ostream& out) const{
+	switch (tag){
+	case Tag::Int: out << i; return;
+	case Tag::Bool: out << (b ? "true" : "false"); return;
+	case Tag::String: out << s; return;
+	//Type analysis doesn't let these be reported
+	case Tag::Record: case Tag::Void: return;
+	}
+}
+
+uint32_t FrameLayout::slotsFor(TypeNode * type){
+	if (!type->asType().isRecord()){ return 1; }
+	RecordTypeNode * record = static_cast<RecordTypeNode *>(type);
+	return static_cast<RecordTypeDeclNode *>(record->id()->decl())->size();
+}
+
+void FrameLayout::eachScalar(TypeNode * type, uint32_t slot,
+	const std::function<void(uint32_t, Type)>& f){
+	Type kind = type->asType();
+	if (!kind.isRecord()){
+		f(slot, kind);
+		return;
+	}
+	RecordTypeDeclNode * record = static_cast<RecordTypeDeclNode *>(
+		static_cast<RecordTypeNode *>(type)->id()->decl());
+	for (VarDeclNode * field : record->fields()){
+		eachScalar(field->type(), slot + field->slot(), f);
+	}
+}
+
+Interpreter::Interpreter(ProgramNode * program, std::istream& in,
+	std::ostream& out)
+: myProgram(program), myIn(in), myOut(out),
+  //Left uninitialized: only the pages a program reaches are touched
+  myStack(new Value[STACK_SLOTS]), myFrame(myStack.get()),
+  myTop(myStack.get()), myLimit(myStack.get() + STACK_SLOTS),
+  myDepth(0), myNativeLimit(0), myResult(Value::none()),
+  myEmpty(Symbol::intern(StrView("", 0)).c_str()){
+}
+
+uint32_t Interpreter::layOut(ProgramNode * program){
+	FrameLayout layout(true);
+	for (DeclNode * decl : program->globals()){ decl->allocate(layout); }
+	return layout.size();
+}
+
+FnDeclNode * Interpreter::prepare(ProgramNode * program,
+	uint32_t& globals){
+	static const Symbol MAIN = Symbol::intern(StrView("main", 4));
+	globals = layOut(program);
+	FnDeclNode * main = nullptr;
+	for (DeclNode * decl : program->globals()){
+		FnDeclNode * fn = dynamic_cast<FnDeclNode *>(decl);
+		if (fn != nullptr && fn->id()->getName() == MAIN){ main = fn; }
+	}
+	if (main == nullptr || !main->formals().empty()){
+		Report::report(Severity::Fatal, DiagId::RuntimeError,
+			"No main() to run");
+		throw new FatalError("No main");
+	}
+	return main;
+}
+
+/* What run hands the thread it starts: the interpreter, the streams
+   and sink Report uses on the thread that called run, and what the
+   program threw */
+struct RunThread{
+	Interpreter * interpreter;
+	std::ostream * out;
+	std::ostream * err;
+	Diagnostics * sink;
+	std::exception_ptr thrown;
+};
+
+void Interpreter::run(){
+	RunThread thread;
+	thread.interpreter = this;
+	thread.out = &Report::out();
+	thread.err = &Report::err();
+	thread.sink = Report::collecting();
+	pthread_attr_t attr;
+	pthread_t id;
+	if (pthread_attr_init(&attr) != 0){
+		throw new InternalError("Can't set up the program's thread");
+	}
+	int made = pthread_attr_setstacksize(&attr, NATIVE_STACK_BYTES);
+	if (made == 0){ made = pthread_create(&id, &attr, start, &thread); }
+	pthread_attr_destroy(&attr);
+	if (made != 0){
+		throw new InternalError("Can't start the program's thread");
+	}
+	pthread_join(id, nullptr);
+	if (thread.thrown){ std::rethrow_exception(thread.thrown); }
+}
+
+void * Interpreter::start(void * run){
+	RunThread& thread = *static_cast<RunThread *>(run);
+	Report::redirect(thread.out, thread.err);
+	Report::collect(thread.sink);
+	try {
+		thread.interpreter->runHere();
+	} catch (...){
+		thread.thrown = std::current_exception();
+	}
+	return nullptr;
+}
+
+void Interpreter::runHere(){
+	char base;
+	myNativeLimit = reinterpret_cast<uintptr_t>(&base)
+		- (NATIVE_STACK_BYTES - NATIVE_STACK_MARGIN);
+	uint32_t globals;
+	FnDeclNode * main = prepare(myProgram, globals);
+	myGlobals.resize(globals);
+	for (DeclNode * decl : myProgram->globals()){ decl->exec(*this); }
+	call(main, reserve(main->frameSize(), main->pos()));
+	myOut.flush();
+}
+
+Value * Interpreter::reserve(uint32_t slots, const Position& pos){
+	char here;
+	if (static_cast<size_t>(myLimit - myTop) < slots
+	  || myDepth == MAX_CALL_DEPTH
+	  || reinterpret_cast<uintptr_t>(&here) < myNativeLimit){
+		fail(pos, "Stack overflow");
+	}
+	Value * base = myTop;
+	myTop += slots;
+	return base;
+}
+
+/* Run stmts in order; true if one of them returned */
+static bool execAll(NodeSpan<StmtNode> stmts, Interpreter& in){
+	for (StmtNode * stmt : stmts){
+		if (stmt->exec(in)){ return true; }
+	}
+	return false;
+}
+
+Value Interpreter::call(FnDeclNode * fn, Value * base){
+	Value * caller = myFrame;
+	myFrame = base;
+	myDepth++;
+	myResult = Value::none();
+	if (!execAll(fn->body(), *this) && !fn->retType()->asType().isVoid()){
+		fail(fn->pos(), "Missing return value");
+	}
+	myFrame = caller;
+	myTop = base;
+	myDepth--;
+	return myResult;
+}
+
+void Interpreter::initialize(Value * slots, TypeNode * type){
+	Type kind = type->asType();
+	if (kind.isRecord()){
+		RecordTypeDeclNode * record = static_cast<RecordTypeDeclNode *>(
+			static_cast<RecordTypeNode *>(type)->id()->decl());
+		for (VarDeclNode * field : record->fields()){
+			initialize(slots + field->slot(), field->type());
+		}
+	} else if (kind.isBool()){
+		*slots = Value::ofBool(false);
+	} else if (kind.isString()){
+		*slots = Value::ofString(myEmpty);
+	} else {
+		*slots = Value::ofInt(0);
+	}
+}
+
+const char * Value::read(std::istream& in, Type type, Value& value){
+	std::string word;
+	if (!(in >> word)){ return "No input left to receive"; }
+	if (type.isString()){
+		value = Value::ofString(
+			Symbol::intern(StrView(word.data(), word.size())).c_str());
+		return nullptr;
+	}
+	if (type.isBool()){
+		if (word == "true" || word == "aye" || word == "1"){
+			value = Value::ofBool(true);
+			return nullptr;
+		}
+		if (word == "false" || word == "nay" || word == "0"){
+			value = Value::ofBool(false);
+			return nullptr;
+		}
+		return "Input is not a bool";
+	}
+	size_t digits = word[0] == '-' ? 1 : 0;
+	if (digits == word.size()
+	  || word.find_first_not_of("0123456789", digits) != std::string::npos){
+		return "Input is not an int";
+	}
+	//Clamped as the scanner clamps literals, at either end
+	int parsed;
+	bool fits = parseIntLit(word.data() + digits, word.size() - digits,
+		parsed);
+	if (digits == 1){ parsed = fits ? -parsed : INT_MIN; }
+	value = Value::ofInt(parsed);
+	return nullptr;
+}
+
+Value Interpreter::receive(Type type, const Position& pos){
+	Value value;
+	myOut.flush();
+	const char * msg = Value::read(myIn, type, value);
+	if (msg != nullptr){ fail(pos, msg); }
+	return value;
+}
+
+void Interpreter::fail(const Position& pos, const char * msg){
+	myOut.flush();
+	Report::report(Diagnostic(Severity::Fatal, DiagId::RuntimeError, pos,
+		0, 0, msg));
+	throw new FatalError(msg);
+}
+
+static void allocateAll(NodeSpan<StmtNode> stmts, FrameLayout& frame){
+	uint32_t mark = frame.mark();
+	for (StmtNode * stmt : stmts){ stmt->allocate(frame); }
+	frame.leave(mark);
+}
+
+void VarDeclNode::allocate(FrameLayout& frame){
+	myGlobal = frame.global();
+	mySlot = frame.place(FrameLayout::slotsFor(myType));
+}
+
+bool VarDeclNode::exec(Interpreter& in){
+	in.initialize((myGlobal ? in.globals() : in.frame()) + mySlot, myType);
+	return false;
+}
+
+void RecordTypeDeclNode::allocate(FrameLayout&){
+	FrameLayout fields(false);
+	for (VarDeclNode * field : variables){ field->allocate(fields); }
+	mySize = fields.size();
+}
+
+bool RecordTypeDeclNode::exec(Interpreter&){ return false; }
+
+void FnDeclNode::allocate(FrameLayout&){
+	FrameLayout frame(false);
+	for (FormalDeclNode * formal : parameters){ formal->allocate(frame); }
+	for (StmtNode * stmt : functionBody){ stmt->allocate(frame); }
+	myFrameSize = frame.size();
+}
+
+bool FnDeclNode::exec(Interpreter&){ return false; }
+
+void WhileStmtNode::allocate(FrameLayout& frame){
+	allocateAll(WhileBody, frame);
+}
+
+void IfStmtNode::allocate(FrameLayout& frame){
+	allocateAll(IfBody, frame);
+}
+
+void IfElseStmtNode::allocate(FrameLayout& frame){
+	allocateAll(IfTrueBody, frame);
+	allocateAll(IfFalseBody, frame);
+}
+
+bool AssignStmtNode::exec(Interpreter& in){
+	assignment->eval(in);
+	return false;
+}
+
+bool CallStmtNode::exec(Interpreter& in){
+	Function->eval(in);
+	return false;
+}
+
+bool PostIncStmtNode::exec(Interpreter& in){
+	Value * slot = variable->locate(in);
+	slot->i = satAdd(slot->i, 1);
+	return false;
+}
+
+bool PostDecStmtNode::exec(Interpreter& in){
+	Value * slot = variable->locate(in);
+	slot->i = satSub(slot->i, 1);
+	return false;
+}
+
+bool ReceiveStmtNode::exec(Interpreter& in){
+	Value value = in.receive(variable->type(), pos());
+	*variable->locate(in) = value;
+	return false;
+}
+
+bool ReportStmtNode::exec(Interpreter& in){
+	expression->eval(in).print(in.out());
+	return false;
+}
+
+bool ReturnStmtNode::exec(Interpreter& in){
+	in.result(expression == nullptr ? Value::none() : expression->eval(in));
+	return true;
+}
+
+bool WhileStmtNode::exec(Interpreter& in){
+	while (condition->eval(in).b){
+		if (execAll(WhileBody, in)){ return true; }
+	}
+	return false;
+}
+
+bool IfStmtNode::exec(Interpreter& in){
+	if (condition->eval(in).b){ return execAll(IfBody, in); }
+	return false;
+}
+
+bool IfElseStmtNode::exec(Interpreter& in){
+	if (condition->eval(in).b){ return execAll(IfTrueBody, in); }
+	return execAll(IfFalseBody, in);
+}
+
+Value TrueNode::eval(Interpreter&){ return Value::ofBool(true); }
+
+Value FalseNode::eval(Interpreter&){ return Value::ofBool(false); }
+
+Value IntLitNode::eval(Interpreter&){ return Value::ofInt(numval); }
+
+Symbol StrLitNode::text(){
+	if (!myText.valid()){
+		//Drop the quotes and undo the escapes, once
+		StrView quoted = stringVal.view();
+		std::string text;
+		for (size_t i = 1; i + 1 < quoted.size(); i++){
+			char c = quoted.data()[i];
+			if (c == '\\'){
+				c = quoted.data()[++i];
+				if (c == 'n'){ c = '\n'; }
+				else if (c == 't'){ c = '\t'; }
+			}
+			text += c;
+		}
+		myText = Symbol::intern(StrView(text.data(), text.size()));
+	}
+	return myText;
+}
+
+Value StrLitNode::eval(Interpreter&){
+	return Value::ofString(text().c_str());
+}
+
+Value * IDNode::locate(Interpreter& in){
+	VarDeclNode * var = static_cast<VarDeclNode *>(myDecl);
+	return (var->global() ? in.globals() : in.frame()) + var->slot();
+}
+
+Value IDNode::eval(Interpreter& in){
+	Value * slot = locate(in);
+	return type().isRecord() ? Value::ofRecord(slot) : *slot;
+}
+
+Value * IndexNode::locate(Interpreter& in){
+	VarDeclNode * field = static_cast<VarDeclNode *>(
+		field_Name_being_accessed->decl());
+	return Id_being_accessed->locate(in) + field->slot();
+}
+
+Value IndexNode::eval(Interpreter& in){
+	Value * slot = locate(in);
+	return type().isRecord() ? Value::ofRecord(slot) : *slot;
+}
+
+Value NegNode::eval(Interpreter& in){
+	return Value::ofInt(satNeg(expression->eval(in).i));
+}
+
+Value NotNode::eval(Interpreter& in){
+	return Value::ofBool(!expression->eval(in).b);
+}
+
+Value PlusNode::eval(Interpreter& in){
+	int32_t left = leftNode->eval(in).i;
+	return Value::ofInt(satAdd(left, rightNode->eval(in).i));
+}
+
+Value MinusNode::eval(Interpreter& in){
+	int32_t left = leftNode->eval(in).i;
+	return Value::ofInt(satSub(left, rightNode->eval(in).i));
+}
+
+Value TimesNode::eval(Interpreter& in){
+	int32_t left = leftNode->eval(in).i;
+	return Value::ofInt(satMul(left, rightNode->eval(in).i));
+}
+
+Value DivideNode::eval(Interpreter& in){
+	int32_t left = leftNode->eval(in).i;
+	int32_t right = rightNode->eval(in).i;
+	if (right == 0){ in.fail(pos(), "Division by zero"); }
+	return Value::ofInt(satDiv(left, right));
+}
+
+Value LessNode::eval(Interpreter& in){
+	int32_t left = leftNode->eval(in).i;
+	return Value::ofBool(left < rightNode->eval(in).i);
+}
+
+Value LessEqNode::eval(Interpreter& in){
+	int32_t left = leftNode->eval(in).i;
+	return Value::ofBool(left <= rightNode->eval(in).i);
+}
+
+Value GreaterNode::eval(Interpreter& in){
+	int32_t left = leftNode->eval(in).i;
+	return Value::ofBool(left > rightNode->eval(in).i);
+}
+
+Value GreaterEqNode::eval(Interpreter& in){
+	int32_t left = leftNode->eval(in).i;
+	return Value::ofBool(left >= rightNode->eval(in).i);
+}
+
+Value AndNode::eval(Interpreter& in){
+	return Value::ofBool(leftNode->eval(in).b && rightNode->eval(in).b);
+}
+
+Value OrNode::eval(Interpreter& in){
+	return Value::ofBool(leftNode->eval(in).b || rightNode->eval(in).b);
+}
+
+Value EqualsNode::eval(Interpreter& in){
+	Value left = leftNode->eval(in);
+	return Value::ofBool(left == rightNode->eval(in));
+}
+
+Value NotEqualsNode::eval(Interpreter& in){
+	Value left = leftNode->eval(in);
+	return Value::ofBool(!(left == rightNode->eval(in)));
+}
+
+Value AssignExpNode::eval(Interpreter& in){
+	Value value = expression->eval(in);
+	*variable->locate(in) = value;
+	return value;
+}
+
+Value CallExpNode::eval(Interpreter& in){
+	FnDeclNode * fn = static_cast<FnDeclNode *>(nameFunc->decl());
+	Value * base = in.reserve(fn->frameSize(), pos());
+	NodeSpan<FormalDeclNode> formals = fn->formals();
+	//The frame is above any a call in an argument makes, so the
+	// arguments can go straight into it
+	for (size_t i = 0; i < arguments.size(); i++){
+		Value arg = arguments[i]->eval(in);
+		Value * slot = base + formals[i]->slot();
+		if (arg.tag == Value::Tag::Record){
+			//Records are passed by value
+			uint32_t size = FrameLayout::slotsFor(formals[i]->type());
+			std::copy(arg.fields, arg.fields + size, slot);
+		} else {
+			*slot = arg;
+		}
+	}
+	return in.call(fn, base);
+}
+
+}
@@ -0,0 +1,185 @@
+#ifndef CSHANTY_INTERP_H
+#define CSHANTY_INTERP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "intern.hpp"
+#include "position.hpp"
+#include "types.hpp"
+
+namespace cshanty{
+
+class FnDeclNode;
+class ProgramNode;
+class TypeNode;
+
+/**
+* \class Value
+* A value in a running program: a tag saying which member of the
+* union is live, and the union. Values are copied, never allocated,
+* and a slot holds garbage until the program stores to it. Strings
+* are interned, so two strings are equal exactly when their pointers
+* are. A record's value points at its first field, which is where the
+* record variable lives; its fields are the slots that follow.
+**/
+struct Value{
+	enum class Tag : uint8_t{ Void, Int, Bool, String, Record };
+
+	Tag tag;
+	union{
+		int32_t i;
+		bool b;
+		const char * s;
+		Value * fields;
+	};
+
+	/** What a function that returns nothing returns **/
+	static Value none(){
+		Value x; x.tag = Tag::Void; x.fields = nullptr; return x;
+	}
+	static Value ofInt(int32_t v){
+		Value x; x.tag = Tag::Int; x.i = v; return x;
+	}
+	static Value ofBool(bool v){
+		Value x; x.tag = Tag::Bool; x.b = v; return x;
+	}
+	static Value ofString(const char * v){
+		Value x; x.tag = Tag::String; x.s = v; return x;
+	}
+	static Value ofRecord(Value * v){
+		Value x; x.tag = Tag::Record; x.fields = v; return x;
+	}
+
+	/** Whether two values of the same type are equal **/
+	bool operator==(const Value& other) const;
+	/** Write the value as report does: 12, true, or the string's
+	    characters **/
+	void print(std::ostream& out) const;
+	/** Read the next word of in as receive does, into value of type.
+	    Returns nullptr, or what is wrong with the input **/
+	static const char * read(std::istream& in, Type type, Value& value);
+};
+
+/** How many calls may be in progress at once in a running program.
+    The interpreter recurses on the C++ stack for each one **/
+static const size_t MAX_CALL_DEPTH = 20000;
+
+/** The C++ stack a program runs on (see Interpreter::run): room for
+    MAX_CALL_DEPTH calls, each through a deep nest of blocks and
+    expressions. Only the pages the program reaches are touched **/
+static const size_t NATIVE_STACK_BYTES = size_t(1) << 29;
+
+/**
+* \class FrameLayout
+* Hands out the slots of one frame (or of the globals, or of one
+* record's fields) as allocate walks the declarations in it. The
+* variables of blocks that can't be live at once (an if body and the
+* while loop after it) share slots, so the frame is only as big as the
+* deepest nest of blocks needs.
+**/
+class FrameLayout{
+public:
+	FrameLayout(bool global) : myGlobal(global), mySize(0), myMax(0){ }
+	bool global() const { return myGlobal; }
+	/** The first of count new slots **/
+	uint32_t place(uint32_t count){
+		uint32_t at = mySize;
+		mySize += count;
+		myMax = std::max(myMax, mySize);
+		return at;
+	}
+	/** Enter a block: its slots are freed again by leave(mark) **/
+	uint32_t mark() const { return mySize; }
+	void leave(uint32_t mark){ mySize = mark; }
+	/** The most slots in use at once **/
+	uint32_t size() const { return myMax; }
+	/** Slots taken by a variable of type **/
+	static uint32_t slotsFor(TypeNode * type);
+	/** Call f(slot, type) for each int, bool or string slot of a
+	    variable of type whose first slot is slot, fields and nested
+	    fields included **/
+	static void eachScalar(TypeNode * type, uint32_t slot,
+		const std::function<void(uint32_t, Type)>& f);
+private:
+	bool myGlobal;
+	uint32_t mySize;
+	uint32_t myMax;
+};
+
+/**
+* \class Interpreter
+* Runs a program by walking its tree (see interp.cpp). The program
+* must have passed type analysis. Every slot of every frame comes from
+* one stack allocated up front, and each call takes the next
+* frameSize() slots of it, so running an expression never allocates.
+* report writes to out and receive reads from in.
+*
+* A runtime error (dividing by zero, running out of stack, input that
+* isn't what receive wanted) is reported at the node that caused it,
+* and stops the program by throwing a FatalError.
+**/
+class Interpreter{
+public:
+	Interpreter(ProgramNode * program, std::istream& in,
+		std::ostream& out);
+
+	/** Lay the program out, initialize the globals and call main,
+	    on a thread of its own with a stack of NATIVE_STACK_BYTES.
+	    What the program throws is thrown again here **/
+	void run();
+	/** Give every variable in program its slot (see allocate).
+	    Returns the slots the globals need **/
+	static uint32_t layOut(ProgramNode * program);
+	/** Lay program out and find main. Sets globals to the slots the
+	    globals need. Reports and throws FatalError if there is no
+	    main to run **/
+	static FnDeclNode * prepare(ProgramNode * program, uint32_t& globals);
+
+	Value * globals(){ return myGlobals.data(); }
+	Value * frame(){ return myFrame; }
+	/** Take slots for the frame of a call about to be made, above
+	    every frame in use. Fails with a stack overflow if there are
+	    too few, or too many calls in progress, or too little of the
+	    C++ stack left to make the call on **/
+	Value * reserve(uint32_t slots, const Position& pos);
+	/** Run fn's body in the frame at base, which reserve made and the
+	    caller filled with the arguments. Returns what fn returned **/
+	Value call(FnDeclNode * fn, Value * base);
+	/** Set what the function running returns **/
+	void result(const Value& value){ myResult = value; }
+
+	/** Set the slots of a variable of type to zero, false or "" **/
+	void initialize(Value * slots, TypeNode * type);
+	/** Read the next word of input for a variable of type **/
+	Value receive(Type type, const Position& pos);
+	std::ostream& out(){ return myOut; }
+
+	/** Report a runtime error at pos and stop the program **/
+	[[noreturn]] void fail(const Position& pos, const char * msg);
+private:
+	static void * start(void * run);
+	void runHere();
+
+	ProgramNode * myProgram;
+	std::istream& myIn;
+	std::ostream& myOut;
+	std::vector<Value> myGlobals;
+	std::unique_ptr<Value[]> myStack;
+	Value * myFrame;
+	Value * myTop;
+	Value * myLimit;
+	size_t myDepth;
+	//The lowest address the C++ stack may reach before a call
+	uintptr_t myNativeLimit;
+	Value myResult;
+	const char * myEmpty;
+};
+
+}
+
+#endif
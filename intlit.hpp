@@ -0,0 +1,40 @@
+#ifndef CSHANTY_INTLIT_H
+#define CSHANTY_INTLIT_H
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+
+namespace cshanty{
+
+/**
+* Convert a run of decimal digits (as matched by {DIGIT}+) to an int
+* in a single pass, without allocating. Returns false if the value
+* does not fit in an int, in which case value is clamped to INT_MAX,
+* matching the scanner's "Integer literal too large" behavior.
+**/
+inline bool parseIntLit(const char * digits, size_t len, int& value){
+	size_t i = 0;
+	//Leading zeros never matter, however many there are
+	while (i < len && digits[i] == '0'){ i++; }
+	//Anything past 10 significant digits is too big for 32 bits,
+	// and 10 digits can't overflow the 64-bit accumulator
+	if (len - i > 10){
+		value = INT_MAX;
+		return false;
+	}
+	uint64_t acc = 0;
+	for (; i < len; i++){
+		acc = acc * 10 + static_cast<uint64_t>(digits[i] - '0');
+	}
+	if (acc > INT_MAX){
+		value = INT_MAX;
+		return false;
+	}
+	value = static_cast<int>(acc);
+	return true;
+}
+
+}
+
+#endif
@@ -0,0 +1,531 @@
+#include <algorithm>
+#include <cstddef>
+#include "ast.hpp"
+#include "errors.hpp"
+#include "interp.hpp"
+#include "ir.hpp"
+
+namespace cshanty{
+
+/*
+finish puts each function's blocks in reverse postorder, so a block
+comes after every block that has to run before it and the dump reads
+in the order of the program. Instructions are numbered from 0 in each
+function, in block order, phis first; the value an instruction makes
+goes by its number.
+*/
+
+const char * irOpString(IROp op){
+	switch (op){
+	case IROp::Const: return "const";
+	case IROp::Param: return "param";
+	case IROp::Phi: return "phi";
+	case IROp::Add: return "add";
+	case IROp::Sub: return "sub";
+	case IROp::Mul: return "mul";
+	case IROp::Div: return "div";
+	case IROp::Neg: return "neg";
+	case IROp::Not: return "not";
+	case IROp::Lt: return "lt";
+	case IROp::Le: return "le";
+	case IROp::Gt: return "gt";
+	case IROp::Ge: return "ge";
+	case IROp::Eq: return "eq";
+	case IROp::Ne: return "ne";
+	case IROp::Addr: return "addr";
+	case IROp::GAddr: return "gaddr";
+	case IROp::Offset: return "offset";
+	case IROp::Load: return "load";
+	case IROp::Store: return "store";
+	case IROp::Copy: return "copy";
+	case IROp::Reserve: return "reserve";
+	case IROp::Call: return "call";
+	case IROp::Report: return "report";
+	case IROp::Receive: return "receive";
+	case IROp::Jump: return "jump";
+	case IROp::Branch: return "branch";
+	case IROp::Return: return "return";
+	case IROp::NoReturn: return "noreturn";
+	}
+	throw new InternalError("Bad IR op");
+}
+
+static const char * typeString(IRType type){
+	switch (type){
+	case IRType::None: return "void";
+	case IRType::Int: return "int";
+	case IRType::Bool: return "bool";
+	case IRType::String: return "string";
+	case IRType::Addr: return "addr";
+	}
+	throw new InternalError("Bad IR type");
+}
+
+Symbol IRFunction::name() const{
+	return myDecl->id()->getName();
+}
+
+IRBuilder::IRBuilder(IRProgram& program, IRFunction& fn)
+: myProgram(program), myFn(fn), myCurrent(0),
+  myVariables(fn.decl()->frameSize()){
+	myCurrent = block();
+	seal(myCurrent);
+}
+
+int32_t IRBuilder::function(FnDeclNode * fn) const{
+	return myProgram.myFnIndex.at(fn);
+}
+
+BlockId IRBuilder::block(){
+	BlockId id = static_cast<BlockId>(myFn.myBlocks.size());
+	myFn.myBlocks.push_back(IRBlock());
+	mySealed.push_back(false);
+	myDefs.emplace_back();
+	myPending.emplace_back();
+	return id;
+}
+
+ValueId IRBuilder::add(IROp op, IRType type, const ValueId * ops,
+	size_t count, int32_t imm, const Position& pos){
+	ValueId id = static_cast<ValueId>(myFn.myInstrs.size());
+	IRInstr instr;
+	instr.op = op;
+	instr.type = type;
+	instr.first = static_cast<uint32_t>(myFn.myOperands.size());
+	instr.count = static_cast<uint32_t>(count);
+	instr.imm = imm;
+	myFn.myInstrs.push_back(instr);
+	myFn.myOperands.insert(myFn.myOperands.end(), ops, ops + count);
+	myFn.myWhere.push_back(pos);
+	return id;
+}
+
+ValueId IRBuilder::emit(IROp op, IRType type,
+	std::initializer_list<ValueId> ops, int32_t imm, const Position& pos){
+	ValueId id = add(op, type, ops.begin(), ops.size(), imm, pos);
+	myFn.myBlocks[myCurrent].code.push_back(id);
+	return id;
+}
+
+ValueId IRBuilder::emit(IROp op, IRType type,
+	const std::vector<ValueId>& ops, int32_t imm, const Position& pos){
+	ValueId id = add(op, type, ops.data(), ops.size(), imm, pos);
+	myFn.myBlocks[myCurrent].code.push_back(id);
+	return id;
+}
+
+IRBuilder::Mark IRBuilder::here() const{
+	Mark mark;
+	mark.block = myCurrent;
+	mark.index = myFn.myBlocks[myCurrent].code.size();
+	mark.next = static_cast<ValueId>(myFn.myInstrs.size());
+	return mark;
+}
+
+bool IRBuilder::calls(const Mark& since) const{
+	for (size_t v = since.next; v < myFn.myInstrs.size(); v++){
+		if (myFn.myInstrs[v].op == IROp::Call){ return true; }
+	}
+	return false;
+}
+
+ValueId IRBuilder::insert(const Mark& at, IROp op, int32_t imm,
+	const Position& pos){
+	ValueId id = add(op, IRType::None, nullptr, 0, imm, pos);
+	std::vector<ValueId>& code = myFn.myBlocks[at.block].code;
+	code.insert(code.begin() + static_cast<std::ptrdiff_t>(at.index), id);
+	return id;
+}
+
+ValueId IRBuilder::constant(IRType type, int32_t value, const Position& pos){
+	return emit(IROp::Const, type, {}, value, pos);
+}
+
+ValueId IRBuilder::string(Symbol text, const Position& pos){
+	auto found = myProgram.myStringIndex.find(text);
+	int32_t index;
+	if (found != myProgram.myStringIndex.end()){
+		index = found->second;
+	} else {
+		index = static_cast<int32_t>(myProgram.myStrings.size());
+		myProgram.myStrings.push_back(text);
+		myProgram.myStringIndex[text] = index;
+	}
+	return constant(IRType::String, index, pos);
+}
+
+ValueId IRBuilder::frame(uint32_t slots, const Position& pos){
+	uint32_t at = myFn.myFrameSlots;
+	myFn.myFrameSlots += slots;
+	return emit(IROp::Addr, IRType::Addr, {}, static_cast<int32_t>(at), pos);
+}
+
+void IRBuilder::end(IROp op, std::initializer_list<ValueId> ops,
+	std::initializer_list<BlockId> succs, const Position& pos){
+	emit(op, IRType::None, ops, 0, pos);
+	for (BlockId succ : succs){
+		myFn.myBlocks[myCurrent].succs.push_back(succ);
+		myFn.myBlocks[succ].preds.push_back(myCurrent);
+	}
+}
+
+void IRBuilder::jump(BlockId to, const Position& pos){
+	end(IROp::Jump, {}, {to}, pos);
+}
+
+void IRBuilder::branch(ValueId cond, BlockId yes, BlockId no,
+	const Position& pos){
+	end(IROp::Branch, {cond}, {yes, no}, pos);
+}
+
+void IRBuilder::ret(ValueId value, const Position& pos){
+	if (value == NO_ID){ end(IROp::Return, {}, {}, pos); }
+	else { end(IROp::Return, {value}, {}, pos); }
+	myCurrent = block();
+	seal(myCurrent);
+}
+
+void IRBuilder::noReturn(const Position& pos){
+	end(IROp::NoReturn, {}, {}, pos);
+	myCurrent = block();
+	seal(myCurrent);
+}
+
+/* Set slot to value in block */
+static void define(std::vector<std::pair<uint32_t, ValueId>>& defs,
+	uint32_t slot, ValueId value){
+	for (auto& def : defs){
+		if (def.first == slot){
+			def.second = value;
+			return;
+		}
+	}
+	defs.push_back(std::make_pair(slot, value));
+}
+
+void IRBuilder::write(uint32_t slot, ValueId value){
+	define(myDefs[myCurrent], slot, value);
+}
+
+ValueId IRBuilder::read(uint32_t slot, IRType type){
+	return readFrom(myCurrent, slot, type);
+}
+
+ValueId IRBuilder::phi(BlockId block, uint32_t slot, IRType type){
+	ValueId id = add(IROp::Phi, type, nullptr, 0, static_cast<int32_t>(slot),
+		Position());
+	myFn.myBlocks[block].phis.push_back(id);
+	return id;
+}
+
+ValueId IRBuilder::readFrom(BlockId block, uint32_t slot, IRType type){
+	for (const auto& def : myDefs[block]){
+		if (def.first == slot){ return def.second; }
+	}
+	const std::vector<BlockId>& preds = myFn.myBlocks[block].preds;
+	ValueId value;
+	if (!mySealed[block]){
+		//Not every way in is known yet: seal fills this in
+		value = phi(block, slot, type);
+		myPending[block].push_back(std::make_pair(slot, value));
+	} else if (preds.size() == 1){
+		value = readFrom(preds[0], slot, type);
+	} else if (preds.empty()){
+		//Only a block nothing reaches can read a variable not yet
+		// written, and finish drops it
+		value = add(IROp::Const, type, nullptr, 0, 0, Position());
+		std::vector<ValueId>& code = myFn.myBlocks[block].code;
+		code.insert(code.begin(), value);
+	} else {
+		//Defined first, so a loop back to this block finds the phi
+		value = phi(block, slot, type);
+		define(myDefs[block], slot, value);
+		fillPhi(value, block, slot);
+	}
+	define(myDefs[block], slot, value);
+	return value;
+}
+
+void IRBuilder::fillPhi(ValueId phi, BlockId block, uint32_t slot){
+	IRType type = myFn.myInstrs[phi].type;
+	std::vector<ValueId> ops;
+	for (BlockId pred : myFn.myBlocks[block].preds){
+		ops.push_back(readFrom(pred, slot, type));
+	}
+	IRInstr& instr = myFn.myInstrs[phi];
+	instr.first = static_cast<uint32_t>(myFn.myOperands.size());
+	instr.count = static_cast<uint32_t>(ops.size());
+	myFn.myOperands.insert(myFn.myOperands.end(), ops.begin(), ops.end());
+}
+
+void IRBuilder::seal(BlockId block){
+	std::vector<std::pair<uint32_t, ValueId>> pending;
+	pending.swap(myPending[block]);
+	for (const auto& incomplete : pending){
+		fillPhi(incomplete.second, block, incomplete.first);
+	}
+	mySealed[block] = true;
+}
+
+ValueId IRBuilder::resolve(ValueId value) const{
+	while (myForward[value] != NO_ID){ value = myForward[value]; }
+	return value;
+}
+
+void IRBuilder::finish(){
+	std::vector<IRBlock>& blocks = myFn.myBlocks;
+	std::vector<IRInstr>& instrs = myFn.myInstrs;
+	std::vector<ValueId>& operands = myFn.myOperands;
+
+	//The blocks the entry reaches, in reverse postorder. Successors are
+	// visited last first, so a then comes before its else, and a loop
+	// body before what follows the loop
+	std::vector<bool> reached(blocks.size(), false);
+	std::vector<BlockId> post;
+	std::vector<std::pair<BlockId, size_t>> path(1, std::make_pair(0, 0));
+	reached[0] = true;
+	while (!path.empty()){
+		BlockId at = path.back().first;
+		const std::vector<BlockId>& succs = blocks[at].succs;
+		size_t& next = path.back().second;
+		if (next == succs.size()){
+			post.push_back(at);
+			path.pop_back();
+			continue;
+		}
+		BlockId succ = succs[succs.size() - ++next];
+		if (!reached[succ]){
+			reached[succ] = true;
+			path.push_back(std::make_pair(succ, 0));
+		}
+	}
+	std::vector<BlockId> order(post.rbegin(), post.rend());
+	//Forget the ways in from the others, and the phi operands that
+	// came along them
+	for (BlockId b = 0; b < blocks.size(); b++){
+		if (!reached[b]){ continue; }
+		std::vector<BlockId>& preds = blocks[b].preds;
+		for (ValueId phi : blocks[b].phis){
+			IRInstr& instr = instrs[phi];
+			uint32_t kept = 0;
+			for (uint32_t i = 0; i < instr.count; i++){
+				if (reached[preds[i]]){
+					operands[instr.first + kept++] = operands[instr.first + i];
+				}
+			}
+			instr.count = kept;
+		}
+		preds.erase(std::remove_if(preds.begin(), preds.end(),
+			[&](BlockId pred){ return !reached[pred]; }), preds.end());
+	}
+
+	//A phi whose operands are all one value (or itself) is that value
+	myForward.assign(instrs.size(), NO_ID);
+	bool changed = true;
+	while (changed){
+		changed = false;
+		for (BlockId b = 0; b < blocks.size(); b++){
+			if (!reached[b]){ continue; }
+			for (ValueId phi : blocks[b].phis){
+				if (myForward[phi] != NO_ID){ continue; }
+				const IRInstr& instr = instrs[phi];
+				ValueId same = NO_ID;
+				bool trivial = true;
+				for (uint32_t i = 0; i < instr.count && trivial; i++){
+					ValueId op = resolve(operands[instr.first + i]);
+					if (op == phi || op == same){ continue; }
+					if (same != NO_ID){ trivial = false; }
+					same = op;
+				}
+				if (trivial && same != NO_ID){
+					myForward[phi] = same;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	//Number what is left in order, and make the arrays again from it
+	std::vector<ValueId> number(instrs.size(), NO_ID);
+	std::vector<BlockId> blockNumber(blocks.size(), NO_ID);
+	std::vector<ValueId> values;
+	for (size_t i = 0; i < order.size(); i++){
+		BlockId b = order[i];
+		blockNumber[b] = static_cast<BlockId>(i);
+		for (ValueId phi : blocks[b].phis){
+			if (myForward[phi] == NO_ID){
+				number[phi] = static_cast<ValueId>(values.size());
+				values.push_back(phi);
+			}
+		}
+		for (ValueId id : blocks[b].code){
+			number[id] = static_cast<ValueId>(values.size());
+			values.push_back(id);
+		}
+	}
+	std::vector<IRInstr> newInstrs;
+	std::vector<ValueId> newOperands;
+	std::vector<Position> newWhere;
+	newInstrs.reserve(values.size());
+	newWhere.reserve(values.size());
+	for (ValueId id : values){
+		IRInstr instr = instrs[id];
+		uint32_t first = static_cast<uint32_t>(newOperands.size());
+		for (uint32_t i = 0; i < instr.count; i++){
+			newOperands.push_back(
+				number[resolve(operands[instr.first + i])]);
+		}
+		instr.first = first;
+		newInstrs.push_back(instr);
+		newWhere.push_back(myFn.myWhere[id]);
+	}
+	std::vector<IRBlock> newBlocks;
+	newBlocks.reserve(order.size());
+	for (BlockId b : order){
+		IRBlock block;
+		for (ValueId phi : blocks[b].phis){
+			if (myForward[phi] == NO_ID){ block.phis.push_back(number[phi]); }
+		}
+		for (ValueId id : blocks[b].code){ block.code.push_back(number[id]); }
+		for (BlockId pred : blocks[b].preds){
+			block.preds.push_back(blockNumber[pred]);
+		}
+		for (BlockId succ : blocks[b].succs){
+			block.succs.push_back(blockNumber[succ]);
+		}
+		newBlocks.push_back(block);
+	}
+	instrs.swap(newInstrs);
+	operands.swap(newOperands);
+	myFn.myWhere.swap(newWhere);
+	blocks.swap(newBlocks);
+}
+
+/* Write text as a string literal */
+static void quote(std::ostream& out, Symbol text){
+	out << '"';
+	for (const char * c = text.c_str(); *c != '\0'; c++){
+		if (*c == '\n'){ out << "\\n"; }
+		else if (*c == '\t'){ out << "\\t"; }
+		else if (*c == '"' || *c == '\\'){ out << '\\' << *c; }
+		else { out << *c; }
+	}
+	out << '"';
+}
+
+void IRProgram::dump(std::ostream& out) const{
+	for (VarDeclNode * global : myGlobals){
+		out << "global @" << global->id()->getName() << " slot "
+			<< global->slot() << " size "
+			<< FrameLayout::slotsFor(global->type()) << "\n";
+	}
+	for (size_t i = 0; i < myFns.size(); i++){
+		if (i != 0 || !myGlobals.empty()){ out << "\n"; }
+		dump(out, myFns[i]);
+	}
+}
+
+void IRProgram::dump(std::ostream& out, const IRFunction& fn) const{
+	out << "fn " << fn.name();
+	if (fn.frameSlots() != 0){ out << " frame " << fn.frameSlots(); }
+	out << " {\n";
+	const std::vector<IRBlock>& blocks = fn.blocks();
+	for (BlockId b = 0; b < blocks.size(); b++){
+		out << "b" << b << ":";
+		if (!blocks[b].preds.empty()){
+			out << "\t\t; preds";
+			for (BlockId pred : blocks[b].preds){ out << " b" << pred; }
+		}
+		out << "\n";
+		auto line = [&](ValueId v){
+			const IRInstr& instr = fn.instr(v);
+			out << "\t";
+			//A reserve makes nothing, but its call names it
+			if (instr.type != IRType::None || instr.op == IROp::Reserve){
+				out << "%" << v << " = ";
+			}
+			out << irOpString(instr.op);
+			//Addresses are all of one type, which goes without saying
+			if (instr.type != IRType::None && instr.op != IROp::Addr
+			  && instr.op != IROp::GAddr && instr.op != IROp::Offset){
+				out << " " << typeString(instr.type);
+			}
+			auto ops = [&](uint32_t from, const char * sep){
+				for (uint32_t i = from; i < instr.count; i++){
+					out << (i == from ? sep : ", ") << "%" << fn.operand(v, i);
+				}
+			};
+			switch (instr.op){
+			case IROp::Const:
+				if (instr.type == IRType::String){
+					out << " ";
+					quote(out, string(instr.imm));
+				} else if (instr.type == IRType::Bool){
+					out << (instr.imm != 0 ? " true" : " false");
+				} else {
+					out << " " << instr.imm;
+				}
+				break;
+			case IROp::Param: case IROp::Addr:
+				out << " " << instr.imm;
+				break;
+			case IROp::GAddr:
+				for (VarDeclNode * global : myGlobals){
+					if (global->slot() == static_cast<uint32_t>(instr.imm)){
+						out << " @" << global->id()->getName();
+					}
+				}
+				break;
+			case IROp::Phi:
+				for (uint32_t i = 0; i < instr.count; i++){
+					out << (i == 0 ? " [%" : ", [%") << fn.operand(v, i)
+						<< ", b" << blocks[b].preds[i] << "]";
+				}
+				break;
+			case IROp::Offset: case IROp::Load:
+				out << " %" << fn.operand(v, 0) << ", " << instr.imm;
+				break;
+			case IROp::Store:
+				out << " %" << fn.operand(v, 0) << ", " << instr.imm
+					<< ", %" << fn.operand(v, 1);
+				break;
+			case IROp::Copy:
+				ops(0, " ");
+				out << ", " << instr.imm;
+				break;
+			case IROp::Reserve:
+				out << " " << myFns[static_cast<size_t>(instr.imm)].name();
+				break;
+			case IROp::Call:{
+				out << " " << myFns[static_cast<size_t>(instr.imm)].name()
+					<< "(";
+				uint32_t args = instr.count;
+				ValueId frame = args == 0 ? NO_ID : fn.operand(v, args - 1);
+				bool reserved = frame != NO_ID
+					&& fn.instr(frame).op == IROp::Reserve;
+				for (uint32_t i = 0; i < args - (reserved ? 1 : 0); i++){
+					out << (i == 0 ? "" : ", ") << "%" << fn.operand(v, i);
+				}
+				out << ")";
+				if (reserved){ out << " in %" << frame; }
+				break;
+			}
+			case IROp::Jump:
+				out << " b" << blocks[b].succs[0];
+				break;
+			case IROp::Branch:
+				out << " %" << fn.operand(v, 0) << ", b" << blocks[b].succs[0]
+					<< ", b" << blocks[b].succs[1];
+				break;
+			default:
+				ops(0, " ");
+			}
+			out << "\n";
+		};
+		for (ValueId phi : blocks[b].phis){ line(phi); }
+		for (ValueId v : blocks[b].code){ line(v); }
+	}
+	out << "}\n";
+}
+
+}
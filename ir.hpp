@@ -0,0 +1,251 @@
+#ifndef CSHANTY_IR_H
+#define CSHANTY_IR_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "intern.hpp"
+#include "position.hpp"
+#include "types.hpp"
+
+namespace cshanty{
+
+class FnDeclNode;
+class ProgramNode;
+class VarDeclNode;
+
+/** A value in an IRFunction: the index of the instruction making it **/
+typedef uint32_t ValueId;
+/** A basic block in an IRFunction: an index into its blocks **/
+typedef uint32_t BlockId;
+static const uint32_t NO_ID = 0xFFFFFFFF;
+
+/** What an IR instruction computes. Arithmetic saturates and
+    comparisons compare as the interpreter does (see arith.hpp) **/
+enum class IROp : uint8_t{
+	Const,        // imm (an int or bool), or string imm of the program
+	Param,        // the imm'th formal
+	Phi,          // one operand for each predecessor, in their order
+	Add, Sub, Mul,
+	Div,          // stops the program if its right operand is 0
+	Neg, Not,
+	Lt, Le, Gt, Ge, Eq, Ne,
+	Addr,         // the address of slot imm of the frame
+	GAddr,        // the address of global slot imm
+	Offset,       // the address imm slots past address operand 0
+	Load,         // the slot imm slots past address operand 0
+	Store,        // set that slot to operand 1
+	Copy,         // copy imm slots from operand 1's address to operand 0's
+	Reserve,      // take the frame of a call to function imm ahead of
+	              // the call, as its arguments make calls of their own
+	Call,         // call function imm with the operands, the last the
+	              // Reserve that took its frame if one did
+	Report,       // report operand 0
+	Receive,      // read a value of the instruction's type
+	//Each block ends in exactly one of these
+	Jump,         // go to the block's one successor
+	Branch,       // go to its first successor if operand 0, else its second
+	Return,       // return operand 0, if any
+	NoReturn      // stop: a function that returns a value didn't
+};
+
+const char * irOpString(IROp op);
+
+/** The type of an IR value. A record is only ever handled through
+    its address **/
+enum class IRType : uint8_t{ None, Int, Bool, String, Addr };
+
+/**
+* \class IRInstr
+* One instruction. Its operands are count() entries of its function's
+* operand array from first(); imm is its constant, slot or callee.
+**/
+struct IRInstr{
+	IROp op;
+	IRType type;
+	uint32_t first;
+	uint32_t count;
+	int32_t imm;
+};
+
+/**
+* \class IRBlock
+* A basic block: its phis, then its other instructions, the last of
+* which is its terminator. succs are in the order the terminator
+* names them.
+**/
+struct IRBlock{
+	std::vector<ValueId> phis;
+	std::vector<ValueId> code;
+	std::vector<BlockId> preds;
+	std::vector<BlockId> succs;
+};
+
+/**
+* \class IRFunction
+* One function in SSA form: every scalar formal and local is an SSA
+* value, defined once and merged by phis where control flow joins.
+* Records live in memory, in the frame or in the globals, as do the
+* globals themselves; a record variable is the SSA value of its
+* address. The frame holds nothing else: it is only as big as the
+* function's records need.
+*
+* A record argument is the address of a copy made for that call alone,
+* which the callee uses as its formal. A call to a function returning
+* a record takes the address to copy the result to as its first
+* operand, and returns that address.
+**/
+class IRFunction{
+public:
+	IRFunction(FnDeclNode * decl) : myDecl(decl), myFrameSlots(0){ }
+	FnDeclNode * decl() const { return myDecl; }
+	Symbol name() const;
+
+	const std::vector<IRInstr>& instrs() const { return myInstrs; }
+	const IRInstr& instr(ValueId v) const { return myInstrs[v]; }
+	ValueId operand(ValueId v, size_t i) const {
+		return myOperands[myInstrs[v].first + i];
+	}
+	/** Where in the program instruction v came from **/
+	const Position& where(ValueId v) const { return myWhere[v]; }
+	/** Blocks in order; block 0 is the entry **/
+	const std::vector<IRBlock>& blocks() const { return myBlocks; }
+	/** The slots the frame needs for records **/
+	uint32_t frameSlots() const { return myFrameSlots; }
+private:
+	friend class IRBuilder;
+	FnDeclNode * myDecl;
+	std::vector<IRInstr> myInstrs;
+	std::vector<ValueId> myOperands;
+	std::vector<Position> myWhere;
+	std::vector<IRBlock> myBlocks;
+	uint32_t myFrameSlots;
+};
+
+/**
+* \class IRProgram
+* A whole program lowered to SSA (see lower.cpp): a function for each
+* FnDeclNode, and the strings their constants use.
+**/
+class IRProgram{
+public:
+	/** Lower program, which must have passed type analysis **/
+	static IRProgram * lower(ProgramNode * program);
+
+	const std::vector<IRFunction>& functions() const { return myFns; }
+	Symbol string(int32_t index) const {
+		return myStrings[static_cast<size_t>(index)];
+	}
+	/** The global variables, in order; each starts at its slot() **/
+	const std::vector<VarDeclNode *>& globals() const { return myGlobals; }
+	uint32_t globalSlots() const { return myGlobalSlots; }
+
+	/** Write every function, one instruction a line **/
+	void dump(std::ostream& out) const;
+	void dump(std::ostream& out, const IRFunction& fn) const;
+private:
+	friend class IRBuilder;
+	IRProgram() : myGlobalSlots(0){ }
+
+	std::vector<IRFunction> myFns;
+	std::vector<Symbol> myStrings;
+	std::vector<VarDeclNode *> myGlobals;
+	uint32_t myGlobalSlots;
+	std::unordered_map<const FnDeclNode *, int32_t> myFnIndex;
+	std::unordered_map<Symbol, int32_t> myStringIndex;
+};
+
+/**
+* \class IRBuilder
+* Builds one IRFunction as lower walks its body, putting it in SSA
+* form as it goes (Braun et al., "Simple and Efficient Construction of
+* Static Single Assignment Form", 2013). Each variable is known by
+* its slot in the interpreter's frame (see allocate in interp.cpp).
+* Writing one records its value in
+* the current block; reading one looks back through the blocks before,
+* adding phis where they join. A block is sealed once every block
+* that can jump to it has been made, and only then are its phis given
+* their operands. finish() drops phis that turned out to merge just
+* one value and blocks nothing can reach, and numbers what is left in
+* order.
+**/
+class IRBuilder{
+public:
+	IRBuilder(IRProgram& program, IRFunction& fn);
+
+	IRProgram& program(){ return myProgram; }
+	/** The index of fn's function in the program **/
+	int32_t function(FnDeclNode * fn) const;
+
+	BlockId block();
+	/** Carry on emitting at the end of block **/
+	void enter(BlockId block){ myCurrent = block; }
+	BlockId current() const { return myCurrent; }
+	void seal(BlockId block);
+
+	ValueId emit(IROp op, IRType type, std::initializer_list<ValueId> ops,
+		int32_t imm, const Position& pos);
+	ValueId emit(IROp op, IRType type, const std::vector<ValueId>& ops,
+		int32_t imm, const Position& pos);
+	/** Where the next instruction emitted goes **/
+	struct Mark{
+		BlockId block;
+		size_t index;
+		ValueId next;
+	};
+	Mark here() const;
+	/** Whether a call was emitted since mark **/
+	bool calls(const Mark& since) const;
+	/** Put an instruction at mark, ahead of what was emitted since **/
+	ValueId insert(const Mark& at, IROp op, int32_t imm,
+		const Position& pos);
+
+	ValueId constant(IRType type, int32_t value, const Position& pos);
+	ValueId string(Symbol text, const Position& pos);
+
+	/** End the current block. What follows a return, until the next
+	    block that is jumped to, is in a block nothing reaches **/
+	void jump(BlockId to, const Position& pos);
+	void branch(ValueId cond, BlockId yes, BlockId no, const Position& pos);
+	void ret(ValueId value, const Position& pos);
+	void noReturn(const Position& pos);
+
+	/** Set the variable at slot to value **/
+	void write(uint32_t slot, ValueId value);
+	/** The value of the variable at slot, of type **/
+	ValueId read(uint32_t slot, IRType type);
+	/** A variable of lower's own, after every slot, to merge the
+	    values of the ways through an expression in **/
+	uint32_t variable(){ return myVariables++; }
+	/** The address of slots new slots of the frame, for a record **/
+	ValueId frame(uint32_t slots, const Position& pos);
+
+	void finish();
+private:
+	ValueId add(IROp op, IRType type, const ValueId * ops, size_t count,
+		int32_t imm, const Position& pos);
+	void end(IROp op, std::initializer_list<ValueId> ops,
+		std::initializer_list<BlockId> succs, const Position& pos);
+	ValueId readFrom(BlockId block, uint32_t slot, IRType type);
+	ValueId phi(BlockId block, uint32_t slot, IRType type);
+	void fillPhi(ValueId phi, BlockId block, uint32_t slot);
+	ValueId resolve(ValueId value) const;
+
+	IRProgram& myProgram;
+	IRFunction& myFn;
+	BlockId myCurrent;
+	uint32_t myVariables;
+	//Per block: sealed?, the value of each variable written in it,
+	// and the phis made before it was sealed
+	std::vector<bool> mySealed;
+	std::vector<std::vector<std::pair<uint32_t, ValueId>>> myDefs;
+	std::vector<std::vector<std::pair<uint32_t, ValueId>>> myPending;
+	//The value each removed phi stands for
+	std::vector<ValueId> myForward;
+};
+
+}
+
+#endif
@@ -0,0 +1,290 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "diagnostics.hpp"
+#include "errors.hpp"
+#include "json.hpp"
+
+namespace cshanty{
+
+static const JSON missing;
+
+//Deepest nesting of arrays and objects a request may use; real
+// requests stay within a handful of levels, and the limit keeps the
+// recursion below from running off the stack
+static const size_t maxDepth = 512;
+
+/* Recursive descent over the text of one request */
+class JSON::Reader{
+public:
+	Reader(const std::string& text) : myText(text), myAt(0), myDepth(0){ }
+
+	JSON document(){
+		JSON value = this->value();
+		skipSpace();
+		if (myAt != myText.size()){ fail("trailing text"); }
+		return value;
+	}
+private:
+	[[noreturn]] void fail(const char * what){
+		std::string msg = "Malformed JSON (";
+		msg += what;
+		msg += ") at offset " + std::to_string(myAt);
+		throw new InternalError(msg.c_str());
+	}
+
+	void skipSpace(){
+		while (myAt < myText.size()){
+			char c = myText[myAt];
+			if (c != ' ' && c != '\t' && c != '\n' && c != '\r'){ break; }
+			myAt++;
+		}
+	}
+
+	bool skip(const char * word){
+		size_t len = strlen(word);
+		if (myText.compare(myAt, len, word) != 0){ return false; }
+		myAt += len;
+		return true;
+	}
+
+	JSON value(){
+		skipSpace();
+		if (myAt == myText.size()){ fail("unexpected end"); }
+		JSON result;
+		char c = myText[myAt];
+		if (c == '{' || c == '['){
+			if (++myDepth > maxDepth){ fail("nested too deeply"); }
+			if (c == '{'){
+				object(result);
+			} else {
+				array(result);
+			}
+			myDepth--;
+		} else if (c == '"'){
+			result.myKind = Kind::String;
+			result.myString = string();
+		} else if (skip("true")){
+			result.myKind = Kind::Bool;
+			result.myBool = true;
+		} else if (skip("false")){
+			result.myKind = Kind::Bool;
+		} else if (skip("null")){
+			//result is already null
+		} else if (c == '-' || (c >= '0' && c <= '9')){
+			result.myKind = Kind::Number;
+			result.myNumber = number();
+		} else {
+			fail("unexpected character");
+		}
+		return result;
+	}
+
+	/* Skip the digits at myAt, failing if there are none */
+	void digits(){
+		size_t start = myAt;
+		while (myAt < myText.size()
+		  && myText[myAt] >= '0' && myText[myAt] <= '9'){
+			myAt++;
+		}
+		if (myAt == start){ fail("bad number"); }
+	}
+
+	/* A number in JSON's grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?
+	   ([eE][+-]?[0-9]+)?. Once that has matched, strtod converts it;
+	   on its own it also takes hex, inf and nan */
+	double number(){
+		size_t start = myAt;
+		skip("-");
+		if (!skip("0")){ digits(); }
+		if (skip(".")){ digits(); }
+		if (skip("e") || skip("E")){
+			if (!skip("+")){ skip("-"); }
+			digits();
+		}
+		return strtod(myText.c_str() + start, nullptr);
+	}
+
+	void object(JSON& result){
+		result.myKind = Kind::Object;
+		myAt++;
+		skipSpace();
+		if (skip("}")){ return; }
+		while (true){
+			skipSpace();
+			if (myAt == myText.size() || myText[myAt] != '"'){
+				fail("expected a member name");
+			}
+			result.myKeys.push_back(string());
+			skipSpace();
+			if (!skip(":")){ fail("expected ':'"); }
+			result.myItems.push_back(value());
+			skipSpace();
+			if (skip("}")){ return; }
+			if (!skip(",")){ fail("expected ',' or '}'"); }
+		}
+	}
+
+	void array(JSON& result){
+		result.myKind = Kind::Array;
+		myAt++;
+		skipSpace();
+		if (skip("]")){ return; }
+		while (true){
+			result.myItems.push_back(value());
+			skipSpace();
+			if (skip("]")){ return; }
+			if (!skip(",")){ fail("expected ',' or ']'"); }
+		}
+	}
+
+	uint32_t hex4(){
+		if (myAt + 4 > myText.size()){ fail("short \\u escape"); }
+		uint32_t code = 0;
+		for (size_t i = 0; i < 4; i++){
+			char c = myText[myAt++];
+			int digit;
+			if (c >= '0' && c <= '9'){
+				digit = c - '0';
+			} else if (c >= 'a' && c <= 'f'){
+				digit = c - 'a' + 10;
+			} else if (c >= 'A' && c <= 'F'){
+				digit = c - 'A' + 10;
+			} else {
+				fail("bad \\u escape");
+			}
+			code = (code << 4) | static_cast<uint32_t>(digit);
+		}
+		return code;
+	}
+
+	static void appendUTF8(std::string& out, uint32_t code){
+		if (code < 0x80){
+			out += static_cast<char>(code);
+		} else if (code < 0x800){
+			out += static_cast<char>(0xc0 | (code >> 6));
+			out += static_cast<char>(0x80 | (code & 0x3f));
+		} else if (code < 0x10000){
+			out += static_cast<char>(0xe0 | (code >> 12));
+			out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+			out += static_cast<char>(0x80 | (code & 0x3f));
+		} else {
+			out += static_cast<char>(0xf0 | (code >> 18));
+			out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+			out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+			out += static_cast<char>(0x80 | (code & 0x3f));
+		}
+	}
+
+	std::string string(){
+		std::string out;
+		myAt++;
+		while (true){
+			if (myAt == myText.size()){ fail("unterminated string"); }
+			char c = myText[myAt++];
+			if (c == '"'){ return out; }
+			if (c != '\\'){
+				out += c;
+				continue;
+			}
+			if (myAt == myText.size()){ fail("unterminated string"); }
+			char escape = myText[myAt++];
+			switch (escape){
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				uint32_t code = hex4();
+				//Characters outside the BMP come as surrogate pairs
+				if (code >= 0xd800 && code < 0xdc00 && skip("\\u")){
+					uint32_t low = hex4();
+					code = 0x10000 + ((code - 0xd800) << 10)
+						+ (low - 0xdc00);
+				}
+				appendUTF8(out, code);
+				break;
+			}
+			default:
+				fail("bad escape");
+			}
+		}
+	}
+
+	const std::string& myText;
+	size_t myAt;
+	size_t myDepth;
+};
+
+JSON JSON::parse(const std::string& text){
+	Reader reader(text);
+	return reader.document();
+}
+
+size_t JSON::index() const{
+	//Past 2^53 a double no longer holds every integer, and casting
+	// one that is out of range (or not a number) is undefined
+	if (myKind != Kind::Number || !std::isfinite(myNumber)
+	  || myNumber < 0 || myNumber >= 9007199254740992.0){
+		return 0;
+	}
+	return static_cast<size_t>(myNumber);
+}
+
+const JSON& JSON::operator[](size_t index) const{
+	if (myKind != Kind::Array || index >= myItems.size()){
+		return missing;
+	}
+	return myItems[index];
+}
+
+const JSON& JSON::operator[](const char * key) const{
+	if (myKind != Kind::Object){ return missing; }
+	for (size_t i = 0; i < myKeys.size(); i++){
+		if (myKeys[i] == key){ return myItems[i]; }
+	}
+	return missing;
+}
+
+bool JSON::has(const char * key) const{
+	if (myKind != Kind::Object){ return false; }
+	for (const std::string& name : myKeys){
+		if (name == key){ return true; }
+	}
+	return false;
+}
+
+void JSON::write(std::ostream& out) const{
+	switch (myKind){
+	case Kind::Null: out << "null"; return;
+	case Kind::Bool: out << (myBool ? "true" : "false"); return;
+	case Kind::Number:
+		if (std::floor(myNumber) == myNumber
+			&& std::fabs(myNumber) < 1e15){
+			out << static_cast<long long>(myNumber);
+		} else {
+			out << myNumber;
+		}
+		return;
+	case Kind::String: writeJSONString(out, myString, true); return;
+	case Kind::Array:
+	case Kind::Object:
+		break;
+	}
+	out << (myKind == Kind::Array ? '[' : '{');
+	for (size_t i = 0; i < myItems.size(); i++){
+		if (i != 0){ out << ','; }
+		if (myKind == Kind::Object){
+			writeJSONString(out, myKeys[i], true);
+			out << ':';
+		}
+		myItems[i].write(out);
+	}
+	out << (myKind == Kind::Array ? ']' : '}');
+}
+
+}
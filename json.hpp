@@ -0,0 +1,59 @@
+#ifndef CSHANTY_JSON_H
+#define CSHANTY_JSON_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cshanty{
+
+/**
+* \class JSON
+* A parsed JSON value, as read from a language server request (see
+* LanguageServer). Only reading is covered: replies are small and are
+* written out directly, with writeJSONString (diagnostics.hpp) for
+* their strings. Looking up a missing member, or indexing something
+* that isn't an object or array, gives a null value rather than an
+* error, so optional fields can be read without checking each level.
+**/
+class JSON{
+public:
+	enum class Kind : uint8_t{ Null, Bool, Number, String, Array, Object };
+
+	JSON() : myKind(Kind::Null), myBool(false), myNumber(0){ }
+	/** Parse text; throws InternalError if it isn't one JSON value **/
+	static JSON parse(const std::string& text);
+
+	Kind kind() const { return myKind; }
+	bool isNull() const { return myKind == Kind::Null; }
+	bool boolean() const { return myBool; }
+	double number() const { return myNumber; }
+	/** The number as a count or offset; 0 if it isn't one **/
+	size_t index() const;
+	const std::string& string() const { return myString; }
+
+	/** Items of an array, or members of an object **/
+	size_t size() const { return myItems.size(); }
+	const JSON& operator[](size_t index) const;
+	/** The member named key **/
+	const JSON& operator[](const char * key) const;
+	bool has(const char * key) const;
+
+	/** Write this value back out as JSON text **/
+	void write(std::ostream& out) const;
+private:
+	class Reader;
+
+	Kind myKind;
+	bool myBool;
+	double myNumber;
+	std::string myString;
+	std::vector<JSON> myItems;
+	//For objects, the name of each item
+	std::vector<std::string> myKeys;
+};
+
+}
+
+#endif
@@ -0,0 +1,364 @@
+#include "ast.hpp"
+#include "interp.hpp"
+#include "ir.hpp"
+
+namespace cshanty{
+
+/*
+lower walks each function's tree once, in the order the interpreter
+runs it, adding IR to the block it has reached. It uses the layout
+allocate gave the program (see interp.cpp): a scalar formal or local
+is the SSA variable of its slot, and a record variable is the SSA
+variable of its address, which for a local is a new object in the IR
+frame. Globals are read and written through their addresses.
+
+if, if/else and while make the blocks their bodies need and join
+again after them. && and || branch on their left operand, so their
+right operand is only computed on the way that needs it, and the
+result is a phi of the two ways. x++ and x-- are an add or a subtract
+of 1, which saturates as the interpreter's does.
+*/
+
+static IRType irType(Type type){
+	if (type.isInt()){ return IRType::Int; }
+	if (type.isBool()){ return IRType::Bool; }
+	if (type.isString()){ return IRType::String; }
+	if (type.isRecord()){ return IRType::Addr; }
+	return IRType::None;
+}
+
+static int32_t imm(uint32_t value){
+	return static_cast<int32_t>(value);
+}
+
+IRProgram * IRProgram::lower(ProgramNode * program){
+	IRProgram * ir = new IRProgram();
+	ir->myGlobalSlots = Interpreter::layOut(program);
+	std::vector<FnDeclNode *> fns;
+	for (DeclNode * decl : program->globals()){
+		FnDeclNode * fn = dynamic_cast<FnDeclNode *>(decl);
+		if (fn != nullptr){
+			ir->myFnIndex[fn] = static_cast<int32_t>(fns.size());
+			ir->myFns.push_back(IRFunction(fn));
+			fns.push_back(fn);
+		}
+		VarDeclNode * var = dynamic_cast<VarDeclNode *>(decl);
+		if (var != nullptr){ ir->myGlobals.push_back(var); }
+	}
+	for (size_t i = 0; i < fns.size(); i++){
+		IRBuilder b(*ir, ir->myFns[i]);
+		NodeSpan<FormalDeclNode> formals = fns[i]->formals();
+		for (size_t f = 0; f < formals.size(); f++){
+			b.write(formals[f]->slot(), b.emit(IROp::Param,
+				irType(formals[f]->type()->asType()), {},
+				static_cast<int32_t>(f), formals[f]->pos()));
+		}
+		for (StmtNode * stmt : fns[i]->body()){ stmt->lower(b); }
+		if (fns[i]->retType()->asType().isVoid()){
+			b.ret(NO_ID, fns[i]->pos());
+		} else {
+			b.noReturn(fns[i]->pos());
+		}
+		b.finish();
+	}
+	return ir;
+}
+
+static void lowerAll(NodeSpan<StmtNode> stmts, IRBuilder& b){
+	for (StmtNode * stmt : stmts){ stmt->lower(b); }
+}
+
+/* Whether lval names a scalar formal or local: an SSA variable */
+static bool inSSA(LValNode * lval){
+	VarDeclNode * var = lval->varDecl();
+	return !var->global() && !var->type()->asType().isRecord();
+}
+
+/* The address of the variable lval names or is a field of, when it
+   isn't in SSA */
+static ValueId base(IRBuilder& b, LValNode * lval, const Position& pos){
+	VarDeclNode * var = lval->varDecl();
+	if (var->global()){
+		return b.emit(IROp::GAddr, IRType::Addr, {}, imm(var->slot()), pos);
+	}
+	return b.read(var->slot(), IRType::Addr);
+}
+
+/* The value of what lval names; for a record, its address */
+static ValueId load(IRBuilder& b, LValNode * lval, const Position& pos){
+	IRType type = irType(lval->type());
+	if (inSSA(lval)){ return b.read(lval->varDecl()->slot(), type); }
+	ValueId at = base(b, lval, pos);
+	uint32_t offset = lval->offset();
+	if (type != IRType::Addr){
+		return b.emit(IROp::Load, type, {at}, imm(offset), pos);
+	}
+	if (offset == 0){ return at; }
+	return b.emit(IROp::Offset, IRType::Addr, {at}, imm(offset), pos);
+}
+
+/* Set what lval names to value. Type analysis doesn't let a record
+   be assigned, so it is an int, bool or string */
+static void store(IRBuilder& b, LValNode * lval, ValueId value,
+	const Position& pos){
+	if (inSSA(lval)){
+		b.write(lval->varDecl()->slot(), value);
+		return;
+	}
+	ValueId at = base(b, lval, pos);
+	b.emit(IROp::Store, IRType::None, {at, value}, imm(lval->offset()), pos);
+}
+
+/* The value a variable of kind starts with */
+static ValueId zero(IRBuilder& b, Type kind, const Position& pos){
+	if (kind.isString()){
+		return b.string(Symbol::intern(StrView("", 0)), pos);
+	}
+	return b.constant(irType(kind), 0, pos);
+}
+
+void VarDeclNode::lower(IRBuilder& b){
+	if (!myType->asType().isRecord()){
+		b.write(mySlot, zero(b, myType->asType(), pos()));
+		return;
+	}
+	ValueId at = b.frame(FrameLayout::slotsFor(myType), pos());
+	FrameLayout::eachScalar(myType, 0, [&](uint32_t slot, Type kind){
+		b.emit(IROp::Store, IRType::None, {at, zero(b, kind, pos())},
+			imm(slot), pos());
+	});
+	b.write(mySlot, at);
+}
+
+void RecordTypeDeclNode::lower(IRBuilder&){ }
+
+void FnDeclNode::lower(IRBuilder&){ }
+
+void AssignStmtNode::lower(IRBuilder& b){
+	assignment->lower(b);
+}
+
+void CallStmtNode::lower(IRBuilder& b){
+	Function->lower(b);
+}
+
+/* Add step to the int lval names */
+static void bump(IRBuilder& b, LValNode * lval, IROp step,
+	const Position& pos){
+	ValueId value = load(b, lval, pos);
+	ValueId one = b.constant(IRType::Int, 1, pos);
+	store(b, lval, b.emit(step, IRType::Int, {value, one}, 0, pos), pos);
+}
+
+void PostIncStmtNode::lower(IRBuilder& b){
+	bump(b, variable, IROp::Add, pos());
+}
+
+void PostDecStmtNode::lower(IRBuilder& b){
+	bump(b, variable, IROp::Sub, pos());
+}
+
+void ReceiveStmtNode::lower(IRBuilder& b){
+	ValueId value = b.emit(IROp::Receive, irType(variable->type()), {}, 0,
+		pos());
+	store(b, variable, value, pos());
+}
+
+void ReportStmtNode::lower(IRBuilder& b){
+	b.emit(IROp::Report, IRType::None, {expression->lower(b)}, 0, pos());
+}
+
+void ReturnStmtNode::lower(IRBuilder& b){
+	b.ret(expression == nullptr ? NO_ID : expression->lower(b), pos());
+}
+
+void WhileStmtNode::lower(IRBuilder& b){
+	BlockId test = b.block();
+	BlockId body = b.block();
+	BlockId done = b.block();
+	b.jump(test, pos());
+	b.enter(test);
+	b.branch(condition->lower(b), body, done, pos());
+	b.seal(body);
+	b.seal(done);
+	b.enter(body);
+	lowerAll(WhileBody, b);
+	b.jump(test, pos());
+	//The way back round is known now
+	b.seal(test);
+	b.enter(done);
+}
+
+void IfStmtNode::lower(IRBuilder& b){
+	BlockId then = b.block();
+	BlockId done = b.block();
+	b.branch(condition->lower(b), then, done, pos());
+	b.seal(then);
+	b.enter(then);
+	lowerAll(IfBody, b);
+	b.jump(done, pos());
+	b.seal(done);
+	b.enter(done);
+}
+
+void IfElseStmtNode::lower(IRBuilder& b){
+	BlockId then = b.block();
+	BlockId otherwise = b.block();
+	BlockId done = b.block();
+	b.branch(condition->lower(b), then, otherwise, pos());
+	b.seal(then);
+	b.seal(otherwise);
+	b.enter(then);
+	lowerAll(IfTrueBody, b);
+	b.jump(done, pos());
+	b.enter(otherwise);
+	lowerAll(IfFalseBody, b);
+	b.jump(done, pos());
+	b.seal(done);
+	b.enter(done);
+}
+
+ValueId TrueNode::lower(IRBuilder& b){
+	return b.constant(IRType::Bool, 1, pos());
+}
+
+ValueId FalseNode::lower(IRBuilder& b){
+	return b.constant(IRType::Bool, 0, pos());
+}
+
+ValueId IntLitNode::lower(IRBuilder& b){
+	return b.constant(IRType::Int, numval, pos());
+}
+
+ValueId StrLitNode::lower(IRBuilder& b){
+	return b.string(text(), pos());
+}
+
+ValueId IDNode::lower(IRBuilder& b){
+	return load(b, this, pos());
+}
+
+ValueId IndexNode::lower(IRBuilder& b){
+	return load(b, this, pos());
+}
+
+ValueId NegNode::lower(IRBuilder& b){
+	return b.emit(IROp::Neg, IRType::Int, {expression->lower(b)}, 0, pos());
+}
+
+ValueId NotNode::lower(IRBuilder& b){
+	return b.emit(IROp::Not, IRType::Bool, {expression->lower(b)}, 0, pos());
+}
+
+static ValueId lowerBinary(IRBuilder& b, IROp op, IRType type,
+	ExpNode * left, ExpNode * right, const Position& pos){
+	ValueId l = left->lower(b);
+	ValueId r = right->lower(b);
+	return b.emit(op, type, {l, r}, 0, pos);
+}
+
+ValueId PlusNode::lower(IRBuilder& b){
+	return lowerBinary(b, IROp::Add, IRType::Int, leftNode, rightNode, pos());
+}
+
+ValueId MinusNode::lower(IRBuilder& b){
+	return lowerBinary(b, IROp::Sub, IRType::Int, leftNode, rightNode, pos());
+}
+
+ValueId TimesNode::lower(IRBuilder& b){
+	return lowerBinary(b, IROp::Mul, IRType::Int, leftNode, rightNode, pos());
+}
+
+ValueId DivideNode::lower(IRBuilder& b){
+	return lowerBinary(b, IROp::Div, IRType::Int, leftNode, rightNode, pos());
+}
+
+ValueId LessNode::lower(IRBuilder& b){
+	return lowerBinary(b, IROp::Lt, IRType::Bool, leftNode, rightNode, pos());
+}
+
+ValueId LessEqNode::lower(IRBuilder& b){
+	return lowerBinary(b, IROp::Le, IRType::Bool, leftNode, rightNode, pos());
+}
+
+ValueId GreaterNode::lower(IRBuilder& b){
+	return lowerBinary(b, IROp::Gt, IRType::Bool, leftNode, rightNode, pos());
+}
+
+ValueId GreaterEqNode::lower(IRBuilder& b){
+	return lowerBinary(b, IROp::Ge, IRType::Bool, leftNode, rightNode, pos());
+}
+
+ValueId EqualsNode::lower(IRBuilder& b){
+	return lowerBinary(b, IROp::Eq, IRType::Bool, leftNode, rightNode, pos());
+}
+
+ValueId NotEqualsNode::lower(IRBuilder& b){
+	return lowerBinary(b, IROp::Ne, IRType::Bool, leftNode, rightNode, pos());
+}
+
+/* left && right or left || right. When left settles it, that is the
+   result, so the result is a phi of left and right */
+static ValueId lowerLogical(IRBuilder& b, bool isAnd, ExpNode * left,
+	ExpNode * right, const Position& pos){
+	uint32_t result = b.variable();
+	ValueId l = left->lower(b);
+	b.write(result, l);
+	BlockId rest = b.block();
+	BlockId done = b.block();
+	if (isAnd){ b.branch(l, rest, done, pos); }
+	else { b.branch(l, done, rest, pos); }
+	b.seal(rest);
+	b.enter(rest);
+	b.write(result, right->lower(b));
+	b.jump(done, pos);
+	b.seal(done);
+	b.enter(done);
+	return b.read(result, IRType::Bool);
+}
+
+ValueId AndNode::lower(IRBuilder& b){
+	return lowerLogical(b, true, leftNode, rightNode, pos());
+}
+
+ValueId OrNode::lower(IRBuilder& b){
+	return lowerLogical(b, false, leftNode, rightNode, pos());
+}
+
+ValueId AssignExpNode::lower(IRBuilder& b){
+	ValueId value = expression->lower(b);
+	store(b, variable, value, pos());
+	return value;
+}
+
+ValueId CallExpNode::lower(IRBuilder& b){
+	FnDeclNode * fn = static_cast<FnDeclNode *>(nameFunc->decl());
+	IRBuilder::Mark start = b.here();
+	std::vector<ValueId> args;
+	TypeNode * ret = fn->retType();
+	if (ret->asType().isRecord()){
+		args.push_back(b.frame(FrameLayout::slotsFor(ret), pos()));
+	}
+	NodeSpan<FormalDeclNode> formals = fn->formals();
+	for (size_t i = 0; i < arguments.size(); i++){
+		ValueId arg = arguments[i]->lower(b);
+		if (arguments[i]->type().isRecord()){
+			//Records are passed by value: the callee gets its own copy
+			uint32_t slots = FrameLayout::slotsFor(formals[i]->type());
+			ValueId copy = b.frame(slots, arguments[i]->pos());
+			b.emit(IROp::Copy, IRType::None, {copy, arg}, imm(slots),
+				arguments[i]->pos());
+			arg = copy;
+		}
+		args.push_back(arg);
+	}
+	if (b.calls(start)){
+		//The interpreter takes a call's frame before working out its
+		// arguments, so when they make calls of their own, this one
+		// has to run out of stack first
+		args.push_back(b.insert(start, IROp::Reserve, b.function(fn), pos()));
+	}
+	return b.emit(IROp::Call, irType(type()), args, b.function(fn), pos());
+}
+
+}
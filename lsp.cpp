@@ -0,0 +1,451 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include "ast.hpp"
+#include "diagnostics.hpp"
+#include "document.hpp"
+#include "errors.hpp"
+#include "json.hpp"
+#include "lsp.hpp"
+
+namespace cshanty{
+
+//JSON-RPC and LSP error codes
+static const int PARSE_ERROR = -32700;
+static const int METHOD_NOT_FOUND = -32601;
+static const int INTERNAL_ERROR = -32603;
+static const int REQUEST_FAILED = -32803;
+
+//Largest message body accepted; anything bigger is skipped unread
+// rather than buffered
+static const size_t MAX_MESSAGE = 64 << 20;
+
+//LSP SymbolKind values
+static const int SYMBOL_FIELD = 8;
+static const int SYMBOL_FUNCTION = 12;
+static const int SYMBOL_VARIABLE = 13;
+static const int SYMBOL_STRUCT = 23;
+
+/* Bytes in the UTF-8 sequence that starts with lead */
+static size_t utf8Length(unsigned char lead){
+	if (lead < 0xc0){ return 1; }
+	if (lead < 0xe0){ return 2; }
+	if (lead < 0xf0){ return 3; }
+	return 4;
+}
+
+/* The byte offset of an LSP position, whose character is counted in
+   UTF-16 code units. Positions past the end of a line or of the text
+   are clamped to it, as the protocol asks */
+static size_t offsetAt(const Document& doc, const JSON& position){
+	const SourceFile& file = SourceFile::get(doc.file());
+	const std::string& text = doc.text();
+	size_t line = position["line"].index();
+	if (line >= file.lineCount()){ return text.size(); }
+	size_t at = file.lineStart(line);
+	size_t units = position["character"].index();
+	while (units > 0 && at < text.size() && text[at] != '\n'){
+		size_t len = utf8Length(static_cast<unsigned char>(text[at]));
+		units -= std::min<size_t>(units, len == 4 ? 2 : 1);
+		at = std::min(at + len, text.size());
+	}
+	return at;
+}
+
+static void writePosition(std::ostream& out, const Document& doc,
+	uint32_t offset){
+	const SourceFile& file = SourceFile::get(doc.file());
+	const std::string& text = doc.text();
+	size_t line, col;
+	file.lineCol(offset, line, col);
+	size_t units = 0;
+	for (size_t at = file.lineStart(line - 1); at < offset; ){
+		size_t len = utf8Length(static_cast<unsigned char>(text[at]));
+		units += len == 4 ? 2 : 1;
+		at += len;
+	}
+	out << "{\"line\":" << line - 1 << ",\"character\":" << units << "}";
+}
+
+static void writeRange(std::ostream& out, const Document& doc,
+	uint32_t begin, uint32_t end){
+	out << "{\"start\":";
+	writePosition(out, doc, begin);
+	out << ",\"end\":";
+	writePosition(out, doc, end);
+	out << "}";
+}
+
+/* A node's span, in the document as it is now */
+static void writeRange(std::ostream& out, const Document& doc,
+	const Position& pos){
+	const SourceFile& file = SourceFile::get(pos.file());
+	writeRange(out, doc, file.resolve(pos.beginOffset()),
+		file.resolve(pos.endOffset()));
+}
+
+/* Open a DocumentSymbol for node, named by id; the caller adds any
+   children and closes it */
+static void writeSymbol(std::ostream& out, const Document& doc,
+	const ASTNode * node, const IDNode * id, int kind){
+	out << "{\"name\":";
+	writeJSONString(out, id->getName().str(), true);
+	out << ",\"kind\":" << kind << ",\"range\":";
+	writeRange(out, doc, node->pos());
+	out << ",\"selectionRange\":";
+	writeRange(out, doc, id->pos());
+}
+
+/* Whether text, which scans cleanly, has a // comment anywhere */
+static bool hasComment(const std::string& text){
+	for (size_t at = 0; at < text.size(); at++){
+		if (text[at] == '"'){
+			//Skip the string, escapes and all
+			for (at++; at < text.size() && text[at] != '"'; at++){
+				if (text[at] == '\\'){ at++; }
+			}
+		} else if (text.compare(at, 2, "//") == 0){
+			return true;
+		}
+	}
+	return false;
+}
+
+LanguageServer::LanguageServer(std::istream& in, std::ostream& out,
+	bool fast, size_t maxErrors)
+: myIn(in), myOut(out), myFast(fast), myMaxErrors(maxErrors),
+  myShutdown(false){
+}
+
+LanguageServer::~LanguageServer(){ }
+
+int LanguageServer::run(){
+	std::string body;
+	while (true){
+		JSON message;
+		try {
+			if (!read(body)){ break; }
+			message = JSON::parse(body);
+		} catch (InternalError * e){
+			fail(JSON(), PARSE_ERROR, e->msg());
+			delete e;
+			continue;
+		}
+		if (message["method"].string() == "exit"){
+			return myShutdown ? 0 : 1;
+		}
+		dispatch(message);
+	}
+	return myShutdown ? 0 : 1;
+}
+
+bool LanguageServer::read(std::string& body){
+	//Headers, then an empty line, then exactly Content-Length bytes
+	size_t length = 0;
+	bool sized = false;
+	bool valid = true;
+	std::string header;
+	while (std::getline(myIn, header)){
+		if (!header.empty() && header.back() == '\r'){ header.pop_back(); }
+		if (header.empty()){
+			if (!sized){ continue; }
+			if (!valid){
+				throw new InternalError("Bad Content-Length");
+			}
+			if (length > MAX_MESSAGE){
+				//Drop the body without holding it, so the next
+				// message is still found
+				myIn.ignore(static_cast<std::streamsize>(std::min(length,
+					static_cast<size_t>(
+					std::numeric_limits<std::streamsize>::max()))));
+				throw new InternalError("Message too large");
+			}
+			body.resize(length);
+			myIn.read(&body[0], static_cast<std::streamsize>(length));
+			return static_cast<size_t>(myIn.gcount()) == length;
+		}
+		static const std::string field = "content-length:";
+		if (header.size() > field.size()){
+			std::string name = header.substr(0, field.size());
+			std::transform(name.begin(), name.end(), name.begin(),
+				::tolower);
+			if (name == field){
+				const char * start = header.c_str() + field.size();
+				char * stop = nullptr;
+				errno = 0;
+				unsigned long value = strtoul(start, &stop, 10);
+				while (*stop == ' ' || *stop == '\t'){ stop++; }
+				//strtoul would accept (and negate) a minus sign
+				valid = errno != ERANGE && stop != start && *stop == '\0'
+					&& strchr(start, '-') == nullptr;
+				length = valid ? value : 0;
+				sized = true;
+			}
+		}
+	}
+	return false;
+}
+
+void LanguageServer::send(const std::string& body){
+	myOut << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+	myOut.flush();
+}
+
+void LanguageServer::respond(const JSON& id, const std::string& result){
+	std::ostringstream body;
+	body << "{\"jsonrpc\":\"2.0\",\"id\":";
+	id.write(body);
+	body << ",\"result\":" << result << "}";
+	send(body.str());
+}
+
+void LanguageServer::fail(const JSON& id, int code,
+	const std::string& message){
+	std::ostringstream body;
+	body << "{\"jsonrpc\":\"2.0\",\"id\":";
+	id.write(body);
+	body << ",\"error\":{\"code\":" << code << ",\"message\":";
+	writeJSONString(body, message, true);
+	body << "}}";
+	send(body.str());
+}
+
+void LanguageServer::log(const std::string& message){
+	std::ostringstream body;
+	body << "{\"jsonrpc\":\"2.0\",\"method\":\"window/logMessage\","
+		<< "\"params\":{\"type\":1,\"message\":";
+	writeJSONString(body, message, true);
+	body << "}}";
+	send(body.str());
+}
+
+void LanguageServer::dispatch(const JSON& message){
+	const std::string& method = message["method"].string();
+	const JSON& params = message["params"];
+	const JSON& id = message["id"];
+	bool request = message.has("id");
+	try {
+		if (method == "initialize"){
+			respond(id, "{\"capabilities\":{"
+				"\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+				"\"documentSymbolProvider\":true,"
+				"\"documentFormattingProvider\":true},"
+				"\"serverInfo\":{\"name\":\"cshantyc\"}}");
+		} else if (method == "shutdown"){
+			myShutdown = true;
+			respond(id, "null");
+		} else if (method == "textDocument/didOpen"){
+			open(params);
+		} else if (method == "textDocument/didChange"){
+			change(params);
+		} else if (method == "textDocument/didClose"){
+			close(params);
+		} else if (method == "textDocument/documentSymbol"){
+			Document * doc = find(params);
+			respond(id, doc == nullptr ? "null" : symbols(*doc));
+		} else if (method == "textDocument/formatting"){
+			Document * doc = find(params);
+			if (doc == nullptr){
+				fail(id, REQUEST_FAILED, "Unknown document");
+			} else {
+				format(id, *doc);
+			}
+		} else if (request){
+			fail(id, METHOD_NOT_FOUND, "Unsupported method " + method);
+		}
+		//Other notifications (initialized, $/cancelRequest, ...)
+		// need nothing from us
+	} catch (InternalError * e){
+		if (request){
+			fail(id, INTERNAL_ERROR, e->msg());
+		} else {
+			log(e->msg());
+		}
+		delete e;
+	}
+}
+
+Document * LanguageServer::find(const JSON& params){
+	auto found = myDocs.find(params["textDocument"]["uri"].string());
+	return found == myDocs.end() ? nullptr : found->second.get();
+}
+
+void LanguageServer::open(const JSON& params){
+	const JSON& item = params["textDocument"];
+	const std::string& uri = item["uri"].string();
+	Document * doc = new Document(uri, myFast);
+	myDocs[uri].reset(doc);
+	Diagnostics diags(uri);
+	diags.limit(myMaxErrors);
+	Report::collect(&diags);
+	doc->load(item["text"].string());
+	Report::collect(nullptr);
+	publish(uri, doc, &diags, item["version"]);
+}
+
+void LanguageServer::change(const JSON& params){
+	Document * doc = find(params);
+	if (doc == nullptr){
+		throw new InternalError("Change to a document that isn't open");
+	}
+	const std::string& uri = params["textDocument"]["uri"].string();
+	const JSON& changes = params["contentChanges"];
+	//Every edit reports the diagnostics of the whole document, so
+	// only the last one's are published
+	std::unique_ptr<Diagnostics> diags;
+	for (size_t i = 0; i < changes.size(); i++){
+		const JSON& edit = changes[i];
+		diags.reset(new Diagnostics(uri));
+		diags->limit(myMaxErrors);
+		Report::collect(diags.get());
+		if (edit.has("range")){
+			size_t begin = offsetAt(*doc, edit["range"]["start"]);
+			size_t end = offsetAt(*doc, edit["range"]["end"]);
+			doc->edit(begin, std::max(begin, end), edit["text"].string());
+		} else {
+			doc->load(edit["text"].string());
+		}
+		Report::collect(nullptr);
+	}
+	publish(uri, doc, diags.get(), params["textDocument"]["version"]);
+}
+
+void LanguageServer::close(const JSON& params){
+	const std::string& uri = params["textDocument"]["uri"].string();
+	myDocs.erase(uri);
+	//Clear what the client shows for it
+	publish(uri, nullptr, nullptr, JSON());
+}
+
+void LanguageServer::publish(const std::string& uri, const Document * doc,
+	const Diagnostics * diags, const JSON& version){
+	std::ostringstream body;
+	body << "{\"jsonrpc\":\"2.0\","
+		<< "\"method\":\"textDocument/publishDiagnostics\","
+		<< "\"params\":{\"uri\":";
+	writeJSONString(body, uri, true);
+	if (version.kind() == JSON::Kind::Number){
+		body << ",\"version\":";
+		version.write(body);
+	}
+	body << ",\"diagnostics\":[";
+	size_t count = doc == nullptr || diags == nullptr ? 0 : diags->size();
+	for (size_t i = 0; i < count; i++){
+		const Diagnostic& diag = diags->at(i);
+		body << (i == 0 ? "" : ",") << "{\"range\":";
+		if (diag.pos.file() != 0){
+			writeRange(body, *doc, diag.pos);
+		} else {
+			//Driver messages (e.g. too many errors) belong nowhere
+			body << "{\"start\":{\"line\":0,\"character\":0},"
+				<< "\"end\":{\"line\":0,\"character\":0}}";
+		}
+		body << ",\"severity\":"
+			<< (diag.severity == Severity::Warning ? 2 : 1)
+			<< ",\"code\":\"" << diagIdString(diag.id) << "\""
+			<< ",\"source\":\"cshantyc\",\"message\":";
+		//Not passed through as UTF-8: lexer messages quote single
+		// bytes, which may be cut from a multibyte character
+		writeJSONString(body,
+			diag.detail.empty() ? diag.message : diag.detail, false);
+		body << "}";
+	}
+	body << "]}}";
+	send(body.str());
+}
+
+std::string LanguageServer::symbols(const Document& doc){
+	std::ostringstream out;
+	out << "[";
+	const char * sep = "";
+	for (DeclNode * decl : doc.declarations()){
+		out << sep;
+		sep = ",";
+		if (FnDeclNode * fn = dynamic_cast<FnDeclNode *>(decl)){
+			writeSymbol(out, doc, fn, fn->id(), SYMBOL_FUNCTION);
+			out << ",\"children\":[";
+			const char * inner = "";
+			for (FormalDeclNode * formal : fn->formals()){
+				out << inner;
+				writeSymbol(out, doc, formal, formal->id(),
+					SYMBOL_VARIABLE);
+				out << "}";
+				inner = ",";
+			}
+			for (StmtNode * stmt : fn->body()){
+				VarDeclNode * local = dynamic_cast<VarDeclNode *>(stmt);
+				if (local == nullptr){ continue; }
+				out << inner;
+				writeSymbol(out, doc, local, local->id(), SYMBOL_VARIABLE);
+				out << "}";
+				inner = ",";
+			}
+			out << "]}";
+		} else if (RecordTypeDeclNode * record =
+			dynamic_cast<RecordTypeDeclNode *>(decl)){
+			writeSymbol(out, doc, record, record->id(), SYMBOL_STRUCT);
+			out << ",\"children\":[";
+			const char * inner = "";
+			for (VarDeclNode * field : record->fields()){
+				out << inner;
+				writeSymbol(out, doc, field, field->id(), SYMBOL_FIELD);
+				out << "}";
+				inner = ",";
+			}
+			out << "]}";
+		} else if (VarDeclNode * var = dynamic_cast<VarDeclNode *>(decl)){
+			writeSymbol(out, doc, var, var->id(), SYMBOL_VARIABLE);
+			out << "}";
+		}
+	}
+	out << "]";
+	return out.str();
+}
+
+void LanguageServer::format(const JSON& id, const Document& doc){
+	ProgramNode * program = doc.program();
+	if (program == nullptr){
+		fail(id, REQUEST_FAILED, "The document has syntax errors");
+		return;
+	}
+	//Comments aren't in the tree, so unparsing would drop them
+	if (hasComment(doc.text())){
+		fail(id, REQUEST_FAILED, "Formatting would remove comments");
+		return;
+	}
+	std::ostringstream text;
+	program->unparse(text, 0);
+
+	//The unparser doesn't print every construct back faithfully, so
+	// only offer text that parses back to the same program
+	Diagnostics quiet("format");
+	Report::collect(&quiet);
+	Document check("format", myFast);
+	ProgramNode * reparsed = check.load(text.str());
+	Report::collect(nullptr);
+	bool same = false;
+	if (reparsed != nullptr){
+		std::unique_ptr<FlatAST> before(FlatAST::build(program));
+		std::unique_ptr<FlatAST> after(FlatAST::build(reparsed));
+		same = before->sameTree(*after);
+	}
+	if (!same){
+		fail(id, REQUEST_FAILED,
+			"Formatting would change the meaning of the program");
+		return;
+	}
+
+	std::ostringstream edits;
+	edits << "[{\"range\":";
+	writeRange(edits, doc, 0, static_cast<uint32_t>(doc.text().size()));
+	edits << ",\"newText\":";
+	writeJSONString(edits, text.str(), true);
+	edits << "}]";
+	respond(id, edits.str());
+}
+
+}
@@ -0,0 +1,69 @@
+#ifndef CSHANTY_LSP_H
+#define CSHANTY_LSP_H
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+namespace cshanty{
+
+class Diagnostics;
+class Document;
+class JSON;
+
+/**
+* \class LanguageServer
+* cshantyc --lsp: a Language Server Protocol server speaking JSON-RPC
+* over a pair of streams (stdin and stdout). Each open file is kept as
+* a Document, so a change only reparses the declarations it touches,
+* and the trees, tokens and interned names of the rest are reused from
+* one request to the next. Supported:
+*   initialize, shutdown, exit
+*   textDocument/didOpen, didChange (incremental or full), didClose,
+*     each answered with textDocument/publishDiagnostics
+*   textDocument/documentSymbol: functions (with their parameters and
+*     locals), records (with their fields) and global variables
+*   textDocument/formatting: the unparsed program, offered only if
+*     the text has no comments and it parses back to the same tree
+* Positions are converted between the protocol's UTF-16 columns and
+* the byte offsets used by the front end.
+**/
+class LanguageServer{
+public:
+	LanguageServer(std::istream& in, std::ostream& out, bool fast,
+		size_t maxErrors);
+	~LanguageServer();
+
+	/** Serve requests until exit or the end of the input. Returns the
+	    exit status the protocol asks for: 0 if shutdown came first **/
+	int run();
+private:
+	bool read(std::string& body);
+	void send(const std::string& body);
+	void dispatch(const JSON& message);
+	void respond(const JSON& id, const std::string& result);
+	void fail(const JSON& id, int code, const std::string& message);
+	void log(const std::string& message);
+
+	Document * find(const JSON& params);
+	void open(const JSON& params);
+	void change(const JSON& params);
+	void close(const JSON& params);
+	void publish(const std::string& uri, const Document * doc,
+		const Diagnostics * diags, const JSON& version);
+	std::string symbols(const Document& doc);
+	void format(const JSON& id, const Document& doc);
+
+	std::istream& myIn;
+	std::ostream& myOut;
+	bool myFast;
+	size_t myMaxErrors;
+	bool myShutdown;
+	std::unordered_map<std::string, std::unique_ptr<Document>> myDocs;
+};
+
+}
+
+#endif
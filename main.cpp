@@ -2,91 +2,383 @@
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "arena.hpp"
+#include "ast.hpp"
+#include "astcache.hpp"
 #include "errors.hpp"
-#include "scanner.hpp"
+#include "intern.hpp"
+#include "lsp.hpp"
+#include "pipeline.hpp"
+#include "threadpool.hpp"
 
 using namespace cshanty;
 
 static void usageAndDie(){
-	std::cerr << "Usage: cshantyc <infile>"
+	std::cerr << "Usage: cshantyc <infile>... | @<manifest>"
 	<< " [-u <unparseFile>]: Output canonical program form\n"
 	<< " [-p]: Parse the input to check syntax\n"
+	<< " [-n <namesFile>]: Resolve every name to its declaration and\n"
+	<< "       output the program with each identifier annotated\n"
+	<< "       with its declaration's type\n"
+	<< " [-k]: Check the types of every expression (after resolving\n"
+	<< "       names as -n does)\n"
+	<< " [-r]: Run the program, once its types check (implies -k)\n"
+	<< " [-R]: Run the program as -r does, compiled to bytecode for\n"
+	<< "       a VM instead of walking its tree (neither -r nor -R\n"
+	<< "       can be given more than one input)\n"
+	<< " [-O]: Once types check (implies -k), inline small calls,\n"
+	<< "       fold constant expressions, then drop code that can't\n"
+	<< "       run and unused locals; -u then writes the optimized\n"
+	<< "       program\n"
+	<< " [-W]: Warn about code that can't run and unused locals\n"
+	<< "       (implies -O)\n"
+	<< " [-I <budget>]: Inline functions of at most <budget> nodes\n"
+	<< "       (default: 40; 0 inlines none; implies -O)\n"
+	<< " [-i <irFile>]: Output the program lowered to SSA form, once\n"
+	<< "       its types check (implies -k)\n"
+	<< " [-S <asmFile>]: Output the program compiled to x86-64\n"
+	<< "       assembly for the GNU assembler, once its types check\n"
+	<< "       (implies -k); link it with cc to run it\n"
 	<< " [-t <tokensFile>]: Output tokens to <tokensFile>\n"
+	<< " [-b <streamFile>]: Save the scanned tokens in binary form;\n"
+	<< "       a later run given <streamFile> as its input\n"
+	<< "       replays them instead of lexing\n"
+	<< " [-c <cacheDir>]: Reuse parsed ASTs cached in <cacheDir>,\n"
+	<< "       keyed by a hash of the input (implies -M)\n"
+	<< " [-C]: Report AST cache hits and misses\n"
+	<< " [-f]: Unparse (-u) from the flat AST encoding\n"
+	<< " [-m]: Report front-end memory use per node kind and\n"
+	<< "       identifier/string interning statistics\n"
+	<< " [-M]: Memory-map the input instead of reading a stream\n"
+	<< " [-F]: Use the hand-written scanner (implies -M)\n"
+	<< " [-T]: Report the time spent in each phase\n"
+	<< " [-J]: Print diagnostics as JSON, one object per input\n"
+	<< " [-e <maxErrors>]: Give up on an input after this many errors\n"
+	<< "       (default: 100; 0 means no limit)\n"
+	<< " [-j <threads>]: Threads for batch mode (default: one per core)\n"
+	<< "   or: cshantyc --lsp [-F] [-e <maxErrors>]\n"
+	<< "Run as a language server, speaking LSP on stdin and stdout\n"
+	<< "Given more than one input, or a manifest file listing one\n"
+	<< "input per line, cshantyc compiles them all in one process.\n"
+	<< "Output arguments are then suffixes: -u .unparse writes\n"
+	<< "foo.unparse for foo.cshanty. Each file's messages are\n"
+	<< "printed together, in input order.\n"
 	;
 	exit(1);
 }
 
-static void writeTokenStream(const char * inPath, const char * outPath){
-	std::ifstream inStream(inPath);
-	if (!inStream.good()){
-		std::string msg = "Bad input stream";
-		msg += inPath;
-		throw new InternalError(msg.c_str());
+/** What to do with each input **/
+struct Options{
+	const char * tokensFile = nullptr;
+	const char * streamFile = nullptr;
+	bool checkParse = false;
+	const char * unparseFile = nullptr;
+	const char * namesFile = nullptr;
+	const char * irFile = nullptr;
+	const char * asmFile = nullptr;
+	bool checkTypes = false;
+	bool optimize = false;
+	bool warnDead = false;
+	size_t inlineBudget = 40;
+	bool runProgram = false;
+	bool useVM = false;
+	bool reportMemory = false;
+	const char * cacheDir = nullptr;
+	bool reportCache = false;
+	bool mapInput = false;
+	bool fastScan = false;
+	bool flatUnparse = false;
+	bool reportTimes = false;
+	bool jsonDiagnostics = false;
+	size_t maxErrors = 100;
+};
+
+enum class Outcome{
+	Compiled, //Every requested output was written
+	Rejected, //The input had errors, or an output couldn't be written
+	Aborted   //The compilation couldn't go on at all
+};
+
+static Outcome parseAndUnparse(const Options& opts, Pipeline& pipeline,
+	const char * unparseFile, const char * namesFile, const char * irFile,
+	const char * asmFile){
+	ProgramNode * program = pipeline.parse();
+	if (program == nullptr){
+		if (opts.checkParse){
+			Report::report(Severity::Error, DiagId::ParseFailed,
+				"Parse failed");
+		}
+		if (unparseFile != nullptr || namesFile != nullptr
+		  || opts.checkTypes){
+			Report::report(Severity::Error, DiagId::NoAST,
+				"No AST built");
+		}
+		return Outcome::Rejected;
 	}
-	if (outPath == nullptr){
-		std::string msg = "No tokens output file given";
-		throw new InternalError(msg.c_str());
+	//The optimized program is unparsed once it has been optimized
+	if (unparseFile != nullptr && !opts.optimize){
+		try {
+			pipeline.unparse(program, unparseFile);
+		} catch (InternalError * e){
+			Report::report(Severity::Error, DiagId::BadOutput, e->msg());
+			delete e;
+			return Outcome::Rejected;
+		}
 	}
-
-	Scanner scanner(&inStream);
-	if (strcmp(outPath, "--") == 0){
-		scanner.outputTokens(std::cout);
-	} else {
-		std::ofstream outStream(outPath);
-		if (!outStream.good()){
-			std::string msg = "Bad output file ";
-			msg += outPath;
-			throw new InternalError(msg.c_str());
+	if (namesFile == nullptr && !opts.checkTypes){
+		return Outcome::Compiled;
+	}
+	if (!pipeline.nameAnalysis(program)){
+		Report::report(Severity::Error, DiagId::NameAnalysisFailed,
+			"Name Analysis Failed");
+		return Outcome::Rejected;
+	}
+	if (namesFile != nullptr){
+		try {
+			pipeline.unparseNames(program, namesFile);
+		} catch (InternalError * e){
+			Report::report(Severity::Error, DiagId::BadOutput, e->msg());
+			delete e;
+			return Outcome::Rejected;
 		}
-		scanner.outputTokens(outStream);
-		outStream.close();
 	}
-}
-
-static cshanty::ProgramNode * parse(const char * inFile){
-	std::ifstream inStream(inFile);
-	if (!inStream.good()){
-		std::string msg = "Bad input stream ";
-		msg += inFile;
-		throw new InternalError(msg.c_str());
+	if (opts.checkTypes && !pipeline.typeAnalysis(program)){
+		Report::report(Severity::Error, DiagId::TypeAnalysisFailed,
+			"Type Analysis Failed");
+		return Outcome::Rejected;
+	}
+	if (opts.optimize){
+		pipeline.inlineCalls(program, opts.inlineBudget);
+		pipeline.fold(program);
+		pipeline.removeDeadCode(program, opts.warnDead);
+		if (unparseFile != nullptr){
+			try {
+				pipeline.unparse(program, unparseFile);
+			} catch (InternalError * e){
+				Report::report(Severity::Error, DiagId::BadOutput,
+					e->msg());
+				delete e;
+				return Outcome::Rejected;
+			}
+		}
+	}
+	if (irFile != nullptr){
+		try {
+			pipeline.writeIR(program, irFile);
+		} catch (InternalError * e){
+			Report::report(Severity::Error, DiagId::BadOutput, e->msg());
+			delete e;
+			return Outcome::Rejected;
+		}
 	}
+	if (asmFile != nullptr){
+		try {
+			pipeline.writeAsm(program, asmFile);
+		} catch (InternalError * e){
+			Report::report(Severity::Error, DiagId::BadOutput, e->msg());
+			delete e;
+			return Outcome::Rejected;
+		}
+	}
+	if (opts.runProgram){ pipeline.execute(program, opts.useVM); }
+	return Outcome::Compiled;
+}
 
-	//This pointer will be set to the root of the
-	// AST after parsing
-	cshanty::ProgramNode * root = nullptr;
+/*
+Compile one input, writing tokens, token stream, unparse, names, IR
+and assembly to the given paths (each may be null). Diagnostics are collected for the
+whole compilation and printed in one go at the end, to Report::err,
+which in batch mode is the file's own stream. Nothing here exits or
+lets an error escape: one bad file must not stop a batch.
+*/
+static Outcome compile(const Options& opts, const char * inFile,
+	const char * tokensFile, const char * streamFile,
+	const char * unparseFile, const char * namesFile, const char * irFile,
+	const char * asmFile){
+	Diagnostics diags(inFile);
+	diags.limit(opts.maxErrors);
+	Report::collect(&diags);
+	//Everything the front end builds for this compilation
+	// lives here and is released in one go when it is done
+	Arena arena;
+	//The input is scanned and parsed once, and every output asked
+	// for is fed from that one run
+	Pipeline pipeline(inFile, arena);
+	if (opts.mapInput){ pipeline.mapInput(opts.fastScan); }
+	if (tokensFile != nullptr){ pipeline.listTokens(tokensFile); }
+	if (streamFile != nullptr){ pipeline.saveTokens(streamFile); }
+	if (opts.flatUnparse){ pipeline.flatUnparse(); }
+	if (opts.reportTimes){ pipeline.timeScanning(); }
 
-	cshanty::Scanner scanner(&inStream);
-	cshanty::Parser parser(scanner, &root);
+	Outcome outcome = Outcome::Compiled;
+	try {
+		if (opts.cacheDir != nullptr){ pipeline.useCache(opts.cacheDir); }
+		pipeline.open();
+		//Token outputs alone don't need the parser, nor its errors
+		if (opts.checkParse || unparseFile != nullptr
+		  || namesFile != nullptr || opts.checkTypes){
+			outcome = parseAndUnparse(opts, pipeline, unparseFile,
+				namesFile, irFile, asmFile);
+		} else {
+			pipeline.scan();
+		}
+	} catch (InternalError * e){
+		Report::report(Severity::Fatal, DiagId::BadInput, e->msg());
+		delete e;
+		outcome = Outcome::Aborted;
+	} catch (FatalError * e){
+		delete e;
+		outcome = Outcome::Aborted;
+	} catch (ToDoError * e){
+		Report::report(Severity::Fatal, DiagId::ToDo, e->msg());
+		delete e;
+		outcome = Outcome::Aborted;
+	}
+	Report::collect(nullptr);
+	//The lexer reports and skips what it can't scan, so a program
+	// can parse in spite of lexical errors; it still doesn't count
+	if (outcome == Outcome::Compiled && diags.count(Severity::Fatal) != 0){
+		outcome = Outcome::Rejected;
+	}
+	diags.emit(Report::err(), opts.jsonDiagnostics
+		? Diagnostics::Format::JSON : Diagnostics::Format::Text);
+	if (outcome == Outcome::Aborted){ return outcome; }
 
-	int errCode = parser.parse();
-	if (errCode != 0){ return nullptr; }
+	if (opts.optimize && outcome == Outcome::Compiled){
+		Report::err() << "Inlining: " << pipeline.inlined()
+			<< " calls inlined\n";
+		Report::err() << "Constant folding: " << pipeline.folded()
+			<< " nodes eliminated\n";
+		Report::err() << "Dead code: " << pipeline.pruned()
+			<< " nodes eliminated\n";
+	}
+	if (opts.reportCache && pipeline.cache() != nullptr){
+		pipeline.cache()->reportStats(Report::err());
+	}
+	if (opts.reportTimes){
+		pipeline.times().report(Report::err());
+	}
+	if (opts.reportMemory){
+		arena.reportUsage(Report::err());
+	}
+	return outcome;
+}
 
-	return root;
+/** Where a batch writes one of inPath's outputs: the path minus any
+    .cshanty extension, plus suffix. "--" still means stdout **/
+static std::string batchOutput(const std::string& inPath,
+	const char * suffix){
+	if (strcmp(suffix, "--") == 0){ return suffix; }
+	static const std::string EXT = ".cshanty";
+	std::string stem = inPath;
+	if (stem.size() > EXT.size()
+	  && stem.compare(stem.size() - EXT.size(), EXT.size(), EXT) == 0){
+		stem.resize(stem.size() - EXT.size());
+	}
+	return stem + suffix;
 }
 
-static void outputAST(ASTNode * ast, const char * outPath){
-	if (strcmp(outPath, "--") == 0){
-		ast->unparse(std::cout, 0);
-	} else {
-		std::ofstream outStream(outPath);
-		if (!outStream.good()){
-			std::string msg = "Bad output file ";
-			msg += outPath;
-			throw new cshanty::InternalError(msg.c_str());
-		}
-		ast->unparse(outStream, 0);
+/** Append the inputs listed in manifest, one per line, to files.
+    Blank lines and lines starting with # are skipped **/
+static void readManifest(const char * manifest,
+	std::vector<std::string>& files){
+	std::ifstream in(manifest);
+	if (!in.good()){
+		std::string msg = "Bad manifest ";
+		msg += manifest;
+		throw new InternalError(msg.c_str());
+	}
+	std::string line;
+	while (std::getline(in, line)){
+		size_t end = line.find_last_not_of(" \t\r");
+		if (end == std::string::npos || line[0] == '#'){ continue; }
+		files.push_back(line.substr(0, end + 1));
 	}
 }
 
-static bool doUnparsing(const char * inputPath, const char * outPath){
-	cshanty::ProgramNode * ast = parse(inputPath);
-	if (ast == nullptr){ 
-		std::cerr << "No AST built\n";
-		return false;
+/** One input of a batch and everything it printed **/
+struct BatchFile{
+	std::string path;
+	std::ostringstream out;
+	std::ostringstream err;
+	Outcome outcome = Outcome::Compiled;
+};
+
+/*
+Compile every input on a thread pool. Each file has its own arena,
+scanner, parser and output streams; the streams are printed in input
+order once all files are done, so the output doesn't depend on how
+the work was scheduled. Returns false if any file failed.
+*/
+static bool compileBatch(const Options& opts,
+	const std::vector<std::string>& files, size_t threads){
+	PhaseTimes::Clock::time_point start = PhaseTimes::Clock::now();
+	std::vector<std::unique_ptr<BatchFile>> batch;
+	for (const std::string& path : files){
+		batch.emplace_back(new BatchFile());
+		batch.back()->path = path;
 	}
 
-	outputAST(ast, outPath);
-	return true;
+	ThreadPool pool(threads);
+	for (auto& entry : batch){
+		BatchFile * file = entry.get();
+		pool.submit([&opts, file]{
+			std::string tokens, stream, unparse, names, ir, assembly;
+			if (opts.tokensFile != nullptr){
+				tokens = batchOutput(file->path, opts.tokensFile);
+			}
+			if (opts.streamFile != nullptr){
+				stream = batchOutput(file->path, opts.streamFile);
+			}
+			if (opts.unparseFile != nullptr){
+				unparse = batchOutput(file->path, opts.unparseFile);
+			}
+			if (opts.namesFile != nullptr){
+				names = batchOutput(file->path, opts.namesFile);
+			}
+			if (opts.irFile != nullptr){
+				ir = batchOutput(file->path, opts.irFile);
+			}
+			if (opts.asmFile != nullptr){
+				assembly = batchOutput(file->path, opts.asmFile);
+			}
+			Report::redirect(&file->out, &file->err);
+			file->outcome = compile(opts, file->path.c_str(),
+				tokens.empty() ? nullptr : tokens.c_str(),
+				stream.empty() ? nullptr : stream.c_str(),
+				unparse.empty() ? nullptr : unparse.c_str(),
+				names.empty() ? nullptr : names.c_str(),
+				ir.empty() ? nullptr : ir.c_str(),
+				assembly.empty() ? nullptr : assembly.c_str());
+			Report::redirect(nullptr, nullptr);
+		});
+	}
+	pool.wait();
+
+	size_t failed = 0;
+	for (auto& file : batch){
+		std::cout << file->out.str();
+		std::string err = file->err.str();
+		//JSON diagnostics already name their unit
+		if (!err.empty() && !opts.jsonDiagnostics){
+			std::cerr << file->path << ":\n";
+		}
+		std::cerr << err;
+		if (file->outcome != Outcome::Compiled){ failed++; }
+	}
+	if (opts.reportTimes){
+		std::chrono::duration<double> spent =
+			PhaseTimes::Clock::now() - start;
+		std::cerr << "Batch: " << files.size() << " files, "
+			<< failed << " failed, on " << pool.size()
+			<< " threads (" << pool.steals() << " jobs stolen) in "
+			<< spent.count() * 1000 << " ms\n";
+	}
+	return failed == 0;
 }
 
 int 
@@ -95,44 +387,134 @@ main( const int argc, const char **argv )
 	if (argc == 0){
 		usageAndDie();
 	}
-	const char * inFile = NULL;
-	const char * tokensFile = NULL;
-	bool checkParse = false;
-	const char * unparseFile = NULL;
+	std::vector<std::string> inFiles;
+	Options opts;
+	size_t threads = 0;
+	bool batch = false;
 
 	bool useful = false;
-	int i = 1;
+	bool serve = false;
 	for (int i = 1 ; i < argc ; i++){
-		if (argv[i][0] == '-'){
+		if (strcmp(argv[i], "--lsp") == 0){
+			serve = true;
+		} else if (argv[i][0] == '-'){
 			if (argv[i][1] == 't'){
 				i++;
-				tokensFile = argv[i];
+				if (i >= argc){ usageAndDie(); }
+				opts.tokensFile = argv[i];
 				useful = true;
-			} else if (argv[i][1] == 'p'){
+			} else if (argv[i][1] == 'b'){
 				i++;
-				checkParse = true;
+				if (i >= argc){ usageAndDie(); }
+				opts.streamFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'p'){
+				opts.checkParse = true;
 				useful = true;
 			} else if (argv[i][1] == 'u'){
 				i++;
 				if (i >= argc){ usageAndDie(); }
-				unparseFile = argv[i];
+				opts.unparseFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'n'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				opts.namesFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'i'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				opts.irFile = argv[i];
+				opts.checkTypes = true;
+				useful = true;
+			} else if (argv[i][1] == 'S'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				opts.asmFile = argv[i];
+				opts.checkTypes = true;
+				useful = true;
+			} else if (argv[i][1] == 'O'){
+				opts.checkTypes = true;
+				opts.optimize = true;
+				useful = true;
+			} else if (argv[i][1] == 'W'){
+				opts.checkTypes = true;
+				opts.optimize = true;
+				opts.warnDead = true;
+				useful = true;
+			} else if (argv[i][1] == 'I'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				opts.inlineBudget = strtoul(argv[i], nullptr, 10);
+				opts.checkTypes = true;
+				opts.optimize = true;
+				useful = true;
+			} else if (argv[i][1] == 'k'){
+				opts.checkTypes = true;
+				useful = true;
+			} else if (argv[i][1] == 'r'){
+				opts.checkTypes = true;
+				opts.runProgram = true;
+				useful = true;
+			} else if (argv[i][1] == 'R'){
+				opts.checkTypes = true;
+				opts.runProgram = true;
+				opts.useVM = true;
 				useful = true;
+			} else if (argv[i][1] == 'c'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				opts.cacheDir = argv[i];
+				opts.mapInput = true;
+			} else if (argv[i][1] == 'C'){
+				opts.reportCache = true;
+			} else if (argv[i][1] == 'f'){
+				opts.flatUnparse = true;
+			} else if (argv[i][1] == 'm'){
+				opts.reportMemory = true;
+			} else if (argv[i][1] == 'M'){
+				opts.mapInput = true;
+			} else if (argv[i][1] == 'F'){
+				opts.mapInput = true;
+				opts.fastScan = true;
+			} else if (argv[i][1] == 'T'){
+				opts.reportTimes = true;
+			} else if (argv[i][1] == 'J'){
+				opts.jsonDiagnostics = true;
+			} else if (argv[i][1] == 'e'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				opts.maxErrors = strtoul(argv[i], nullptr, 10);
+			} else if (argv[i][1] == 'j'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				threads = strtoul(argv[i], nullptr, 10);
+				if (threads == 0){ usageAndDie(); }
 			} else {
 				std::cerr << "Unrecognized argument: ";
 				std::cerr << argv[i] << std::endl;
 				usageAndDie();
 			}
-		} else {
-			if (inFile == NULL){
-				inFile = argv[i];
-			} else {
-				std::cerr << "Only 1 input file allowed";
-				std::cerr << argv[i] << std::endl;
-				usageAndDie();
+		} else if (argv[i][0] == '@'){
+			try {
+				readManifest(argv[i] + 1, inFiles);
+			} catch (InternalError * e){
+				std::cerr << "Error: " << e->msg() << std::endl;
+				exit(1);
 			}
+			//A manifest means batch mode even if it lists one file
+			batch = true;
+		} else {
+			inFiles.push_back(argv[i]);
 		}
 	}
-	if (inFile == NULL){
+	if (serve){
+		if (!inFiles.empty()){ usageAndDie(); }
+		LanguageServer server(std::cin, std::cout, opts.fastScan,
+			opts.maxErrors);
+		return server.run();
+	}
+	if (inFiles.empty()){
 		usageAndDie();
 	}
 	if (!useful){
@@ -140,28 +522,26 @@ main( const int argc, const char **argv )
 		usageAndDie();
 	}
 
-	if (tokensFile != NULL){
-		try {
-			writeTokenStream(inFile, tokensFile);
-		} catch (InternalError * e){
-			std::cerr << "Error: " << e->msg() << std::endl;
-		}
+	bool ok = true;
+	if (inFiles.size() > 1){ batch = true; }
+	if (batch && opts.runProgram){
+		//Programs run on a pool would share stdin, and which one
+		// read each line would depend on scheduling
+		std::cerr << "-r and -R run one program at a time\n";
+		usageAndDie();
 	}
-
-	if (checkParse){
-		try {
-			if (!parse(inFile)){
-				std::cerr << "Parse failed" << std::endl;
-			}
-		} catch (ToDoError * e){
-			std::cerr << "ToDo: " << e->msg() << std::endl;
-			exit(1);
-		}
+	if (!batch){
+		Outcome outcome = compile(opts, inFiles[0].c_str(),
+			opts.tokensFile, opts.streamFile, opts.unparseFile,
+			opts.namesFile, opts.irFile, opts.asmFile);
+		if (outcome == Outcome::Aborted){ exit(1); }
+	} else {
+		ok = compileBatch(opts, inFiles, threads);
 	}
 
-	if (unparseFile != nullptr){
-		doUnparsing(inFile, unparseFile);
+	if (opts.reportMemory){
+		Interner::reportStats(std::cerr);
 	}
 	
-	return 0;
+	return ok ? 0 : 1;
 }
@@ -0,0 +1,247 @@
+#include "ast.hpp"
+#include "errors.hpp"
+#include "symboltable.hpp"
+
+namespace cshanty{
+
+/*
+Name analysis walks the program in order, binding each declared name
+in the innermost scope and resolving each use to the declaration in
+scope at that point, so a name must be declared before it is used
+(a function is declared before its body, so it may call itself).
+The scopes are:
+  - the globals;
+  - each function, holding its formals and the locals at the top of
+    its body;
+  - each if, else and while body;
+  - each record's fields, which are only visible through an index
+    (r[f]) into a variable of that record type.
+A declaration whose type is void, or names something other than a
+record declared above it, is not bound, so its uses are undeclared.
+Every error is reported, and analysis carries on past it.
+*/
+
+static void nameError(const Position& pos, DiagId id, const char * msg){
+	Report::report(Diagnostic(Severity::Fatal, id, pos, 0, 0, msg));
+}
+
+static bool analyzeAll(NodeSpan<StmtNode> stmts, SymbolTable& table){
+	bool ok = true;
+	for (StmtNode * stmt : stmts){
+		ok = stmt->nameAnalysis(table) && ok;
+	}
+	return ok;
+}
+
+static bool analyzeBlock(NodeSpan<StmtNode> body, SymbolTable& table){
+	table.enterScope();
+	bool ok = analyzeAll(body, table);
+	table.leaveScope();
+	return ok;
+}
+
+/* Bind id to decl in the innermost scope */
+static bool declare(IDNode * id, DeclNode * decl, SymbolTable& table){
+	id->attach(decl);
+	if (!table.declare(id->getName(), decl)){
+		nameError(id->pos(), DiagId::MultiplyDeclared,
+			"Multiply declared identifier");
+		return false;
+	}
+	return true;
+}
+
+bool ProgramNode::nameAnalysis(SymbolTable& table){
+	bool ok = true;
+	table.enterScope();
+	for (DeclNode * global : myGlobals){
+		ok = global->nameAnalysis(table) && ok;
+	}
+	table.leaveScope();
+	return ok;
+}
+
+bool VarDeclNode::nameAnalysis(SymbolTable& table){
+	bool typed = myType->nameAnalysis(table)
+		&& dynamic_cast<VoidTypeNode *>(myType) == nullptr;
+	if (!typed){
+		myId->attach(this);
+		nameError(myId->pos(), DiagId::BadDeclType,
+			"Invalid type in declaration");
+		//Still a clash if the name is taken, but bind nothing
+		if (table.lookupHere(myId->getName()) != nullptr){
+			nameError(myId->pos(), DiagId::MultiplyDeclared,
+				"Multiply declared identifier");
+		}
+		return false;
+	}
+	return declare(myId, this, table);
+}
+
+bool FormalDeclNode::nameAnalysis(SymbolTable& table){
+	return VarDeclNode::nameAnalysis(table);
+}
+
+bool RecordTypeDeclNode::nameAnalysis(SymbolTable& table){
+	//The fields get a scope of their own, so that they can't clash
+	// with anything but each other
+	table.enterScope();
+	bool ok = true;
+	for (VarDeclNode * field : variables){
+		ok = field->nameAnalysis(table) && ok;
+	}
+	table.leaveScope();
+	return declare(myId, this, table) && ok;
+}
+
+VarDeclNode * RecordTypeDeclNode::field(Symbol name) const{
+	//Records are small; a scan beats hashing
+	for (VarDeclNode * field : variables){
+		if (field->id()->getName() == name){ return field; }
+	}
+	return nullptr;
+}
+
+bool FnDeclNode::nameAnalysis(SymbolTable& table){
+	bool ok = true;
+	if (!myType->nameAnalysis(table)){
+		nameError(myId->pos(), DiagId::BadDeclType,
+			"Invalid type in declaration");
+		ok = false;
+	}
+	ok = declare(myId, this, table) && ok;
+	table.enterScope();
+	for (FormalDeclNode * formal : parameters){
+		ok = formal->nameAnalysis(table) && ok;
+	}
+	ok = analyzeAll(functionBody, table) && ok;
+	table.leaveScope();
+	return ok;
+}
+
+bool IDNode::nameAnalysis(SymbolTable& table){
+	myDecl = table.lookup(name);
+	if (myDecl == nullptr){
+		nameError(pos(), DiagId::Undeclared, "Undeclared identifier");
+		return false;
+	}
+	return true;
+}
+
+bool IndexNode::nameAnalysis(SymbolTable& table){
+	if (!Id_being_accessed->nameAnalysis(table)){ return false; }
+	VarDeclNode * var = dynamic_cast<VarDeclNode *>(
+		Id_being_accessed->decl());
+	RecordTypeNode * type = var == nullptr ? nullptr
+		: dynamic_cast<RecordTypeNode *>(var->type());
+	if (type == nullptr){
+		nameError(Id_being_accessed->pos(), DiagId::NonRecordIndex,
+			"Index into a non-record");
+		return false;
+	}
+	//The variable was bound, so its type resolved to a record
+	RecordTypeDeclNode * record = static_cast<RecordTypeDeclNode *>(
+		type->id()->decl());
+	VarDeclNode * field = record->field(
+		field_Name_being_accessed->getName());
+	if (field == nullptr){
+		nameError(field_Name_being_accessed->pos(), DiagId::BadField,
+			"Invalid record field name");
+		return false;
+	}
+	field_Name_being_accessed->attach(field);
+	return true;
+}
+
+bool IntTypeNode::nameAnalysis(SymbolTable&){ return true; }
+
+bool BoolTypeNode::nameAnalysis(SymbolTable&){ return true; }
+
+bool VoidTypeNode::nameAnalysis(SymbolTable&){ return true; }
+
+bool StringTypeNode::nameAnalysis(SymbolTable&){ return true; }
+
+bool RecordTypeNode::nameAnalysis(SymbolTable& table){
+	DeclNode * decl = table.lookup(myId->getName());
+	if (dynamic_cast<RecordTypeDeclNode *>(decl) == nullptr){
+		return false;
+	}
+	myId->attach(decl);
+	return true;
+}
+
+bool TrueNode::nameAnalysis(SymbolTable&){ return true; }
+
+bool FalseNode::nameAnalysis(SymbolTable&){ return true; }
+
+bool StrLitNode::nameAnalysis(SymbolTable&){ return true; }
+
+bool IntLitNode::nameAnalysis(SymbolTable&){ return true; }
+
+bool UnaryExpNode::nameAnalysis(SymbolTable& table){
+	return expression->nameAnalysis(table);
+}
+
+bool BinaryExpNode::nameAnalysis(SymbolTable& table){
+	bool ok = leftNode->nameAnalysis(table);
+	return rightNode->nameAnalysis(table) && ok;
+}
+
+bool CallExpNode::nameAnalysis(SymbolTable& table){
+	bool ok = nameFunc->nameAnalysis(table);
+	for (ExpNode * arg : arguments){
+		ok = arg->nameAnalysis(table) && ok;
+	}
+	return ok;
+}
+
+bool AssignExpNode::nameAnalysis(SymbolTable& table){
+	bool ok = variable->nameAnalysis(table);
+	return expression->nameAnalysis(table) && ok;
+}
+
+bool AssignStmtNode::nameAnalysis(SymbolTable& table){
+	return assignment->nameAnalysis(table);
+}
+
+bool CallStmtNode::nameAnalysis(SymbolTable& table){
+	return Function->nameAnalysis(table);
+}
+
+bool PostDecStmtNode::nameAnalysis(SymbolTable& table){
+	return variable->nameAnalysis(table);
+}
+
+bool PostIncStmtNode::nameAnalysis(SymbolTable& table){
+	return variable->nameAnalysis(table);
+}
+
+bool ReceiveStmtNode::nameAnalysis(SymbolTable& table){
+	return variable->nameAnalysis(table);
+}
+
+bool ReportStmtNode::nameAnalysis(SymbolTable& table){
+	return expression->nameAnalysis(table);
+}
+
+bool ReturnStmtNode::nameAnalysis(SymbolTable& table){
+	return expression == nullptr || expression->nameAnalysis(table);
+}
+
+bool WhileStmtNode::nameAnalysis(SymbolTable& table){
+	bool ok = condition->nameAnalysis(table);
+	return analyzeBlock(WhileBody, table) && ok;
+}
+
+bool IfStmtNode::nameAnalysis(SymbolTable& table){
+	bool ok = condition->nameAnalysis(table);
+	return analyzeBlock(IfBody, table) && ok;
+}
+
+bool IfElseStmtNode::nameAnalysis(SymbolTable& table){
+	bool ok = condition->nameAnalysis(table);
+	ok = analyzeBlock(IfTrueBody, table) && ok;
+	return analyzeBlock(IfFalseBody, table) && ok;
+}
+
+}
@@ -0,0 +1,37 @@
+Content-Length: 83
+
+{"jsonrpc": "2.0", "id": 1, "method": "initialize", "params": {"capabilities": {}}}Content-Length: 57
+
+{"jsonrpc": "2.0", "method": "initialized", "params": {}}Content-Length: 315
+
+{"jsonrpc": "2.0", "method": "textDocument/didOpen", "params": {"textDocument": {"uri": "file:///testLanguageServer.cshanty", "languageId": "cshanty", "version": 1, "text": "// Ahoy 🚢 matey\nint count;\nrecord Ship { int crew; bool afloat; }\nint sail(int knots){ int left; left = knots - 1; return left; }\n"}}}Content-Length: 143
+
+{"jsonrpc": "2.0", "id": 2, "method": "textDocument/documentSymbol", "params": {"textDocument": {"uri": "file:///testLanguageServer.cshanty"}}}Content-Length: 189
+
+{"jsonrpc": "2.0", "id": 3, "method": "textDocument/formatting", "params": {"textDocument": {"uri": "file:///testLanguageServer.cshanty"}, "options": {"tabSize": 4, "insertSpaces": false}}}Content-Length: 263
+
+{"jsonrpc": "2.0", "method": "textDocument/didChange", "params": {"textDocument": {"uri": "file:///testLanguageServer.cshanty", "version": 2}, "contentChanges": [{"range": {"start": {"line": 1, "character": 9}, "end": {"line": 1, "character": 10}}, "text": ""}]}}Content-Length: 154
+
+{"jsonrpc": "2.0", "id": 4, "method": "textDocument/formatting", "params": {"textDocument": {"uri": "file:///testLanguageServer.cshanty"}, "options": {}}}Content-Length: 367
+
+{"jsonrpc": "2.0", "method": "textDocument/didChange", "params": {"textDocument": {"uri": "file:///testLanguageServer.cshanty", "version": 3}, "contentChanges": [{"range": {"start": {"line": 1, "character": 9}, "end": {"line": 1, "character": 9}}, "text": ";"}, {"range": {"start": {"line": 0, "character": 11}, "end": {"line": 0, "character": 11}}, "text": "\n@"}]}}Content-Length: 265
+
+{"jsonrpc": "2.0", "method": "textDocument/didChange", "params": {"textDocument": {"uri": "file:///testLanguageServer.cshanty", "version": 4}, "contentChanges": [{"range": {"start": {"line": 1, "character": 0}, "end": {"line": 1, "character": 1}}, "text": "// "}]}}Content-Length: 154
+
+{"jsonrpc": "2.0", "id": 7, "method": "textDocument/formatting", "params": {"textDocument": {"uri": "file:///testLanguageServer.cshanty"}, "options": {}}}Content-Length: 211
+
+{"jsonrpc": "2.0", "method": "textDocument/didOpen", "params": {"textDocument": {"uri": "file:///plain.cshanty", "languageId": "cshanty", "version": 1, "text": "bool  calm;\nint tide( int  h ){return h*2;}\n"}}}Content-Length: 141
+
+{"jsonrpc": "2.0", "id": 8, "method": "textDocument/formatting", "params": {"textDocument": {"uri": "file:///plain.cshanty"}, "options": {}}}Content-Length: 207
+
+{"jsonrpc": "2.0", "method": "textDocument/didChange", "params": {"textDocument": {"uri": "file:///plain.cshanty", "version": 2}, "contentChanges": [{"text": "bool calm;\nbool still(){ return !calm; }\n"}]}}Content-Length: 141
+
+{"jsonrpc": "2.0", "id": 9, "method": "textDocument/formatting", "params": {"textDocument": {"uri": "file:///plain.cshanty"}, "options": {}}}Content-Length: 175
+
+{"jsonrpc": "2.0", "id": 5, "method": "textDocument/hover", "params": {"textDocument": {"uri": "file:///testLanguageServer.cshanty"}, "position": {"line": 0, "character": 0}}}Content-Length: 128
+
+{"jsonrpc": "2.0", "method": "textDocument/didClose", "params": {"textDocument": {"uri": "file:///testLanguageServer.cshanty"}}}Content-Length: 49
+
+{"jsonrpc": "2.0", "id": 6, "method": "shutdown"}Content-Length: 36
+
+{"jsonrpc": "2.0", "method": "exit"}
\ No newline at end of file
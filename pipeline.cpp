@@ -0,0 +1,333 @@
+#include <cstring>
+#include <iomanip>
+#include "ast.hpp"
+#include "astcache.hpp"
+#include "bytecode.hpp"
+#include "deadcode.hpp"
+#include "errors.hpp"
+#include "flatast.hpp"
+#include "fold.hpp"
+#include "inline.hpp"
+#include "interp.hpp"
+#include "ir.hpp"
+#include "pipeline.hpp"
+#include "scanner.hpp"
+#include "source.hpp"
+#include "symboltable.hpp"
+#include "tokenio.hpp"
+#include "vm.hpp"
+#include "x86.hpp"
+
+namespace cshanty{
+
+void PhaseTimes::add(const char * phase, double seconds){
+	for (auto& entry : myTimes){
+		if (strcmp(entry.first, phase) == 0){
+			entry.second += seconds;
+			return;
+		}
+	}
+	myTimes.push_back(std::make_pair(phase, seconds));
+}
+
+void PhaseTimes::lap(const char * phase, Clock::time_point& since){
+	Clock::time_point now = Clock::now();
+	std::chrono::duration<double> spent = now - since;
+	add(phase, spent.count());
+	since = now;
+}
+
+double PhaseTimes::total() const{
+	double sum = 0;
+	for (const auto& entry : myTimes){ sum += entry.second; }
+	return sum;
+}
+
+void PhaseTimes::report(std::ostream& out) const{
+	std::ios::fmtflags flags = out.flags();
+	out << "Phase times (ms):\n" << std::fixed << std::setprecision(3);
+	for (const auto& entry : myTimes){
+		out << "  " << std::left << std::setw(14) << entry.first
+			<< std::right << std::setw(10) << entry.second * 1000
+			<< "\n";
+	}
+	out << "  " << std::left << std::setw(14) << "total"
+		<< std::right << std::setw(10) << total() * 1000 << "\n";
+	out.flags(flags);
+}
+
+Pipeline::Pipeline(const char * inPath, Arena& arena)
+: myInPath(inPath), myArena(arena), myMap(false), myFast(false),
+  myFlat(false), myTimeScan(false), myResolved(false),
+  myTokensPath(nullptr), myStreamPath(nullptr), myInlined(0),
+  myFolded(0), myPruned(0){
+}
+
+Pipeline::~Pipeline(){ }
+
+void Pipeline::mapInput(bool fast){
+	myMap = true;
+	myFast = myFast || fast;
+}
+
+void Pipeline::useCache(const char * dir){
+	myCache.reset(new ASTCache(dir));
+	myMap = true;
+}
+
+void Pipeline::open(){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	const char * path = myInPath.c_str();
+	if (TokenStream::sniff(path)){
+		myReplay.reset(TokenStream::load(path));
+	} else if (myMap){
+		myMapped.reset(SourceBuffer::map(path));
+	} else {
+		myStream.open(path);
+		if (!myStream.good()){
+			std::string msg = "Bad input stream ";
+			msg += path;
+			throw new InternalError(msg.c_str());
+		}
+		checkSourceSize(path);
+	}
+	myTimes.lap("open", since);
+}
+
+std::ostream * Pipeline::openOutput(const char * path,
+	std::ofstream& file, std::ios::openmode mode){
+	if (strcmp(path, "--") == 0){ return &Report::out(); }
+	file.open(path, mode);
+	if (!file.good()){
+		std::string msg = "Bad output file ";
+		msg += path;
+		throw new InternalError(msg.c_str());
+	}
+	return &file;
+}
+
+ProgramNode * Pipeline::parse(){
+	return run(true);
+}
+
+void Pipeline::scan(){
+	run(false);
+}
+
+ProgramNode * Pipeline::run(bool parse){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	bool listing = myTokensPath != nullptr || myStreamPath != nullptr;
+
+	//A cache hit skips scanning altogether, so it is no use when
+	// the tokens themselves are wanted
+	bool cached = parse && myCache != nullptr && myMapped != nullptr;
+	if (cached && !listing){
+		ProgramNode * hit = myCache->lookup(*myMapped, myInPath,
+			myArena);
+		myTimes.lap("cache lookup", since);
+		if (hit != nullptr){ return hit; }
+	}
+
+	//A token output that can't be opened is reported and skipped;
+	// the rest of the compilation goes ahead
+	std::ofstream tokensFile;
+	std::ofstream streamFile;
+	std::unique_ptr<TokenWriter> text;
+	std::unique_ptr<TokenStreamWriter> binary;
+	if (myTokensPath != nullptr){
+		try {
+			text.reset(new TokenWriter(*openOutput(myTokensPath,
+				tokensFile, std::ios::out)));
+		} catch (InternalError * e){
+			Report::report(Severity::Error, DiagId::BadOutput,
+				e->msg());
+			delete e;
+		}
+	}
+	if (myStreamPath != nullptr){
+		try {
+			binary.reset(new TokenStreamWriter(*openOutput(
+				myStreamPath, streamFile,
+				std::ios::out | std::ios::binary)));
+		} catch (InternalError * e){
+			Report::report(Severity::Error, DiagId::BadOutput,
+				e->msg());
+			delete e;
+		}
+	}
+
+	std::unique_ptr<Scanner> scanner;
+	if (myReplay != nullptr){
+		scanner.reset(new Scanner(*myReplay, myArena));
+	} else if (myMapped != nullptr){
+		scanner.reset(new Scanner(*myMapped, myArena, myInPath, myFast));
+	} else {
+		scanner.reset(new Scanner(&myStream, myArena, myInPath));
+	}
+	scanner->tap(text.get(), binary.get(), myTimeScan);
+	if (!parse){
+		scanner->drain();
+		myTimes.lap("scan", since);
+		return nullptr;
+	}
+
+	//This pointer will be set to the root of the
+	// AST after parsing
+	ProgramNode * root = nullptr;
+	Parser parser(*scanner, &root, myArena);
+	int errCode = parser.parse();
+	//An error the parser can't recover from stops it early, but the
+	// listings still cover the whole input
+	if (listing){ scanner->drain(); }
+
+	if (myTimeScan){
+		PhaseTimes::Clock::time_point now = PhaseTimes::Clock::now();
+		std::chrono::duration<double> spent = now - since;
+		myTimes.add("scan", scanner->scanTime());
+		myTimes.add("parse", spent.count() - scanner->scanTime());
+		since = now;
+	} else {
+		myTimes.lap("scan+parse", since);
+	}
+	if (errCode != 0 || scanner->syntaxErrors() != 0){ return nullptr; }
+
+	//Only cache programs that scanned cleanly, so that a hit never
+	// hides a lexical warning
+	if (cached && scanner->reported() == 0){
+		try {
+			myCache->store(*myMapped, scanner->file(), root);
+		} catch (InternalError * e){
+			Report::report(Severity::Warning, DiagId::CacheWrite,
+				e->msg());
+			delete e;
+		}
+		myTimes.lap("cache store", since);
+	}
+	return root;
+}
+
+void Pipeline::unparse(ProgramNode * program, const char * path){
+	//The tree annotates the names it has resolved; the flat encoding
+	// has no room for them, so it writes the canonical form
+	write(program, path, myFlat || myResolved);
+}
+
+bool Pipeline::nameAnalysis(ProgramNode * program){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	SymbolTable table;
+	bool ok = program->nameAnalysis(table);
+	myResolved = true;
+	myTimes.lap("names", since);
+	return ok;
+}
+
+void Pipeline::unparseNames(ProgramNode * program, const char * path){
+	//The flat encoding has no room for what names resolved to
+	write(program, path, false);
+}
+
+bool Pipeline::typeAnalysis(ProgramNode * program){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	TypeAnalysis ta(myTypes);
+	program->typeAnalysis(ta);
+	myTimes.lap("types", since);
+	return ta.ok();
+}
+
+void Pipeline::inlineCalls(ProgramNode * program, size_t budget){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	Inliner inliner(myArena, myTypes, program, budget);
+	program->inlineCalls(inliner);
+	myInlined += inliner.inlined();
+	//An argument takes the place of a formal inside the callee's
+	// result, so inlining nested calls nests deeper than type analysis
+	// checked for. Children come after their parent, so one loop
+	// finds each expression's depth
+	if (inliner.inlined() != 0){
+		std::unique_ptr<FlatAST> ast(FlatAST::build(program));
+		std::vector<size_t> depth(ast->size(), 0);
+		for (FlatAST::NodeId n = 0; n < ast->size(); n++){
+			for (FlatAST::NodeId kid : ast->children(n)){
+				NodeKind kind = ast->kind(kid);
+				bool exp = kind >= NodeKind::ID
+					&& kind <= NodeKind::CallExp;
+				depth[kid] = depth[n] + (exp ? 1 : 0);
+				if (depth[kid] > MAX_EXP_DEPTH){
+					TypeAnalysis::tooDeep(ast->pos(kid));
+				}
+			}
+		}
+	}
+	myTimes.lap("inline", since);
+}
+
+void Pipeline::fold(ProgramNode * program){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	Folder folder(myArena, myTypes);
+	program->fold(folder);
+	myFolded += folder.eliminated();
+	myTimes.lap("fold", since);
+}
+
+void Pipeline::removeDeadCode(ProgramNode * program, bool warn){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	DeadCode dead(myArena, myTypes, warn);
+	program->prune(dead);
+	myPruned += dead.eliminated();
+	myTimes.lap("dead code", since);
+}
+
+void Pipeline::writeIR(ProgramNode * program, const char * path){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	std::unique_ptr<IRProgram> ir(IRProgram::lower(program));
+	myTimes.lap("lower", since);
+	std::ofstream file;
+	std::ostream * out = openOutput(path, file, std::ios::out);
+	ir->dump(*out);
+	out->flush();
+	myTimes.lap("dump IR", since);
+}
+
+void Pipeline::writeAsm(ProgramNode * program, const char * path){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	uint32_t globals;
+	FnDeclNode * main = Interpreter::prepare(program, globals);
+	std::unique_ptr<IRProgram> ir(IRProgram::lower(program));
+	myTimes.lap("lower", since);
+	std::ofstream file;
+	std::ostream * out = openOutput(path, file, std::ios::out);
+	X86Writer writer(*ir, *out);
+	writer.write(main);
+	myTimes.lap("x86", since);
+}
+
+void Pipeline::execute(ProgramNode * program, bool vm){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	if (vm){
+		std::unique_ptr<Bytecode> code(Bytecode::compile(program));
+		myTimes.lap("bytecode", since);
+		VM machine(*code, std::cin, Report::out());
+		machine.run();
+	} else {
+		Interpreter interpreter(program, std::cin, Report::out());
+		interpreter.run();
+	}
+	myTimes.lap("run", since);
+}
+
+void Pipeline::write(ProgramNode * program, const char * path, bool flat){
+	PhaseTimes::Clock::time_point since = PhaseTimes::Clock::now();
+	std::ofstream file;
+	std::ostream * out = openOutput(path, file, std::ios::out);
+	if (flat){
+		std::unique_ptr<FlatAST> flat(FlatAST::build(program));
+		myTimes.lap("flatten", since);
+		flat->unparse(*out);
+	} else {
+		program->unparse(*out, 0);
+	}
+	out->flush();
+	myTimes.lap("unparse", since);
+}
+
+}
@@ -0,0 +1,159 @@
+#ifndef CSHANTY_PIPELINE_H
+#define CSHANTY_PIPELINE_H
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "types.hpp"
+
+namespace cshanty{
+
+class Arena;
+class ASTCache;
+class ProgramNode;
+class SourceBuffer;
+class TokenStream;
+
+/**
+* \class PhaseTimes
+* Wall-clock time spent in each phase of a compilation, in the order
+* the phases ran. A phase that runs more than once is added up.
+**/
+class PhaseTimes{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	void add(const char * phase, double seconds);
+	/** Add the time since since to phase, and restart since **/
+	void lap(const char * phase, Clock::time_point& since);
+	double total() const;
+	void report(std::ostream& out) const;
+private:
+	std::vector<std::pair<const char *, double>> myTimes;
+};
+
+/**
+* \class Pipeline
+* One compilation of one input. The input is opened once and the
+* front end runs at most once, however many outputs are asked for:
+* the token listings (-t, -b) are written by tapping the scanner while
+* the parser pulls tokens from it, and the unparse (-u) reuses the
+* tree that parse built. Configure it, then call open, then parse (or
+* just scan), then unparse, then nameAnalysis and unparseNames, then
+* typeAnalysis, then inlineCalls, fold and removeDeadCode (and
+* unparse, to see what they left), then writeIR and writeAsm, then
+* execute.
+**/
+class Pipeline{
+public:
+	Pipeline(const char * inPath, Arena& arena);
+	~Pipeline();
+
+	/** Read the input through a memory mapping; if fast is set, scan
+	    it with the hand-written scanner **/
+	void mapInput(bool fast);
+	/** Reuse ASTs cached in dir (see ASTCache); implies mapInput.
+	    Throws InternalError if dir can't be used **/
+	void useCache(const char * dir);
+	/** Write the -t listing to path ("--" for stdout) **/
+	void listTokens(const char * path){ myTokensPath = path; }
+	/** Save the tokens in binary form to path (-b) **/
+	void saveTokens(const char * path){ myStreamPath = path; }
+	/** Unparse from the flat AST encoding (-f) **/
+	void flatUnparse(){ myFlat = true; }
+	/** Split scanning time out of parsing time. This costs a clock
+	    read per token, so it is off unless times are reported **/
+	void timeScanning(){ myTimeScan = true; }
+
+	/** Load or map the input; throws InternalError if it can't be
+	    read **/
+	void open();
+	/** Scan and parse the input, writing any token outputs on the
+	    way. Returns the program, or nullptr if it didn't parse **/
+	ProgramNode * parse();
+	/** Just scan the input, writing the token outputs, for when no
+	    tree is wanted **/
+	void scan();
+	/** Write program's canonical form to path ("--" for stdout);
+	    throws InternalError if path can't be written **/
+	void unparse(ProgramNode * program, const char * path);
+	/** Resolve every name in program to its declaration (see
+	    nameanalysis.cpp). Returns false if any didn't resolve **/
+	bool nameAnalysis(ProgramNode * program);
+	/** After nameAnalysis, write program to path (-n) with each
+	    identifier annotated with its declaration's type; throws as
+	    unparse does **/
+	void unparseNames(ProgramNode * program, const char * path);
+	/** After nameAnalysis, find the type of every expression in
+	    program (see typeanalysis.cpp). Returns false if any was
+	    ill-typed **/
+	bool typeAnalysis(ProgramNode * program);
+	/** After typeAnalysis, put the bodies of functions of at most
+	    budget nodes in place of the calls to them (see inline.cpp) **/
+	void inlineCalls(ProgramNode * program, size_t budget);
+	/** After typeAnalysis, fold the constant parts of program's
+	    expressions in place (see fold.cpp) **/
+	void fold(ProgramNode * program);
+	/** After typeAnalysis (and fold), drop the code in program that
+	    can't run and its unused locals (see deadcode.cpp), warning
+	    about each if warn is set **/
+	void removeDeadCode(ProgramNode * program, bool warn);
+	/** After typeAnalysis, lower program to SSA (see lower.cpp) and
+	    write it to path (-i); throws as unparse does **/
+	void writeIR(ProgramNode * program, const char * path);
+	/** After typeAnalysis, compile program to x86-64 assembly (see
+	    x86.cpp) and write it to path (-S); throws as unparse does.
+	    Reports and throws FatalError if there is no main **/
+	void writeAsm(ProgramNode * program, const char * path);
+	/** After typeAnalysis, run program's main (-r), reading from
+	    std::cin and reporting to Report::out(): on the bytecode VM
+	    (-R) if vm, else by walking the tree. Throws FatalError,
+	    having reported it, if the program fails **/
+	void execute(ProgramNode * program, bool vm);
+
+	/** The record and function types typeAnalysis made **/
+	const TypeTable& types() const { return myTypes; }
+	/** How many calls inlineCalls inlined **/
+	size_t inlined() const { return myInlined; }
+	/** How many nodes fold left out of the tree **/
+	size_t folded() const { return myFolded; }
+	/** How many nodes removeDeadCode left out of the tree **/
+	size_t pruned() const { return myPruned; }
+
+	ASTCache * cache() const { return myCache.get(); }
+	const PhaseTimes& times() const { return myTimes; }
+private:
+	ProgramNode * run(bool parse);
+	void write(ProgramNode * program, const char * path, bool flat);
+	std::ostream * openOutput(const char * path, std::ofstream& file,
+		std::ios::openmode mode);
+
+	std::string myInPath;
+	Arena& myArena;
+	bool myMap;
+	bool myFast;
+	bool myFlat;
+	bool myTimeScan;
+	bool myResolved;
+	const char * myTokensPath;
+	const char * myStreamPath;
+	//The scanner reads from one of these, so they outlive
+	// everything parse builds
+	std::ifstream myStream;
+	std::unique_ptr<SourceBuffer> myMapped;
+	std::unique_ptr<TokenStream> myReplay;
+	std::unique_ptr<ASTCache> myCache;
+	PhaseTimes myTimes;
+	TypeTable myTypes;
+	size_t myInlined;
+	size_t myFolded;
+	size_t myPruned;
+};
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include "errors.hpp"
+#include "position.hpp"
+
+namespace cshanty{
+
+/*
+Every position printed looks its file up, and an embedded file its
+host as well, so lookups take no lock. The registry is a fixed table
+of chunks of slots; a chunk, once allocated, never moves, and a file
+is published in its slot only once it is built. Registering and
+releasing files take the lock. The ids of released files are handed
+out again, so the table only grows as far as the most files alive at
+once.
+*/
+static const uint32_t CHUNK_BITS = 12;
+static const uint32_t CHUNK_SIZE = 1 << CHUNK_BITS;
+static const uint32_t CHUNKS = 1 << 12;
+typedef std::atomic<SourceFile *> FileSlot;
+
+struct FileRegistry{
+	std::mutex lock;
+	std::atomic<FileSlot *> chunks[CHUNKS];
+	//The next id never handed out; 0 means "no file"
+	uint32_t next = 1;
+	std::vector<uint32_t> released;
+};
+
+static FileRegistry& files(){
+	static FileRegistry registry;
+	return registry;
+}
+
+static FileSlot * slot(uint32_t id){
+	if (id == 0 || id >= CHUNKS * CHUNK_SIZE){ return nullptr; }
+	FileSlot * chunk = files().chunks[id >> CHUNK_BITS].load(
+		std::memory_order_acquire);
+	return chunk == nullptr ? nullptr : &chunk[id & (CHUNK_SIZE - 1)];
+}
+
+uint32_t SourceFile::add(const std::string& name){
+	FileRegistry& registry = files();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	uint32_t id;
+	if (registry.released.empty()){
+		if (registry.next == CHUNKS * CHUNK_SIZE){
+			throw new InternalError("Too many source files");
+		}
+		id = registry.next++;
+	} else {
+		id = registry.released.back();
+		registry.released.pop_back();
+	}
+	std::atomic<FileSlot *>& chunk = registry.chunks[id >> CHUNK_BITS];
+	if (chunk.load(std::memory_order_relaxed) == nullptr){
+		FileSlot * slots = new FileSlot[CHUNK_SIZE];
+		for (uint32_t i = 0; i < CHUNK_SIZE; i++){
+			slots[i].store(nullptr, std::memory_order_relaxed);
+		}
+		chunk.store(slots, std::memory_order_release);
+	}
+	SourceFile * file = new SourceFile(name);
+	file->myId = id;
+	slot(id)->store(file, std::memory_order_release);
+	return id;
+}
+
+SourceFile& SourceFile::get(uint32_t id){
+	FileSlot * at = slot(id);
+	SourceFile * file = at == nullptr ? nullptr
+		: at->load(std::memory_order_acquire);
+	if (file == nullptr){ throw new InternalError("No such source file"); }
+	return *file;
+}
+
+void SourceFile::release(uint32_t id){
+	SourceFile * file = &get(id);
+	if (file->myHost != 0){
+		std::vector<uint32_t>& pieces = get(file->myHost).myEmbedded;
+		pieces.erase(std::find(pieces.begin(), pieces.end(), id));
+	}
+	std::vector<uint32_t> pieces;
+	pieces.swap(file->myEmbedded);
+	for (uint32_t piece : pieces){
+		get(piece).myHost = 0;
+		release(piece);
+	}
+	FileRegistry& registry = files();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	slot(id)->store(nullptr, std::memory_order_release);
+	registry.released.push_back(id);
+	delete file;
+}
+
+void SourceFile::lineCol(uint32_t offset, size_t& line, size_t& col) const{
+	if (myHost != 0){
+		SourceFile::get(myHost).lineCol(resolve(offset), line, col);
+		return;
+	}
+	auto after = std::upper_bound(myLineStarts.begin(),
+		myLineStarts.end(), offset);
+	size_t index = static_cast<size_t>(after - myLineStarts.begin()) - 1;
+	line = index + 1;
+	col = offset - myLineStarts[index] + 1;
+}
+
+void SourceFile::edit(uint32_t begin, uint32_t end, const char * text,
+	size_t len){
+	uint32_t added = static_cast<uint32_t>(len);
+	//Lines that began inside the replaced text are gone, the ones
+	// after it move, and the new text may start some of its own
+	auto first = std::upper_bound(myLineStarts.begin(),
+		myLineStarts.end(), begin);
+	auto last = std::upper_bound(first, myLineStarts.end(), end);
+	std::vector<uint32_t> starts;
+	for (size_t i = 0; i < len; i++){
+		if (text[i] == '\n'){
+			starts.push_back(begin + static_cast<uint32_t>(i) + 1);
+		}
+	}
+	for (auto it = last; it != myLineStarts.end(); ++it){
+		*it = *it - end + begin + added;
+	}
+	first = myLineStarts.erase(first, last);
+	myLineStarts.insert(first, starts.begin(), starts.end());
+
+	//A piece the edit is past is left alone, one it is before
+	// moves, and one it overlaps has to remember it
+	int64_t delta = static_cast<int64_t>(added) - (end - begin);
+	for (uint32_t id : myEmbedded){
+		SourceFile& piece = SourceFile::get(id);
+		if (end <= piece.myFrom){
+			piece.myBase = static_cast<uint32_t>(piece.myBase + delta);
+			piece.myFrom = static_cast<uint32_t>(piece.myFrom + delta);
+			piece.myTo = static_cast<uint32_t>(piece.myTo + delta);
+		} else if (begin <= piece.myTo){
+			Edit change;
+			change.begin = static_cast<int64_t>(begin) - piece.myBase;
+			change.end = static_cast<int64_t>(end) - piece.myBase;
+			change.len = added;
+			piece.myEdits.push_back(change);
+			//What the edit replaced is no longer in the piece
+			if (piece.myFrom >= begin){ piece.myFrom = begin + added; }
+			piece.myTo = piece.myTo >= end
+				? static_cast<uint32_t>(piece.myTo + delta) : begin + added;
+		}
+	}
+}
+
+void SourceFile::embed(uint32_t host, uint32_t base, uint32_t length){
+	myHost = host;
+	myBase = base;
+	myFrom = base;
+	myTo = base + length;
+	myEdits.clear();
+	SourceFile::get(host).myEmbedded.push_back(myId);
+}
+
+uint32_t SourceFile::resolve(uint32_t offset) const{
+	if (myHost == 0){ return offset; }
+	int64_t at = offset;
+	for (const Edit& change : myEdits){
+		if (at >= change.end){
+			at = at - change.end + change.begin + change.len;
+		}
+	}
+	return static_cast<uint32_t>(myBase + at);
+}
+
+size_t Position::line() const{
+	if (myFile == 0){ return 0; }
+	size_t line, col;
+	SourceFile::get(myFile).lineCol(myBegin, line, col);
+	return line;
+}
+
+size_t Position::col() const{
+	if (myFile == 0){ return 0; }
+	size_t line, col;
+	SourceFile::get(myFile).lineCol(myBegin, line, col);
+	return col;
+}
+
+static std::string lineColStr(uint32_t file, uint32_t offset){
+	size_t line = 0;
+	size_t col = 0;
+	if (file != 0){
+		SourceFile::get(file).lineCol(offset, line, col);
+	}
+	return "[" + std::to_string(line) + "," + std::to_string(col) + "]";
+}
+
+std::string Position::begin() const{
+	return lineColStr(myFile, myBegin);
+}
+
+std::string Position::span() const{
+	return lineColStr(myFile, myBegin) + "-" + lineColStr(myFile, myEnd);
+}
+
+}
@@ -1,48 +1,124 @@
 #ifndef CSHANTY_POSITION_H
 #define CSHANTY_POSITION_H
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace cshanty{
 
-class Position{
-public: 
-	Position(size_t lineI, size_t colI, size_t lineE, size_t colE)
-	: myLineI(lineI), myColI(colI), myLineE(lineE), myColE(colE){
-	}
-	Position(Position * start, Position * end)
-	: myLineI(start->myLineI), myColI(start->myColI),
-	  myLineE(end->myLineE),myColE(end->myColE){
+/**
+* \class SourceFile
+* Per-file table of line start offsets, filled in by the scanner as it
+* consumes newlines. Positions only carry byte offsets; line and column
+* numbers are recovered from this table when (and only if) a position
+* is printed. Files are identified by a small integer id; id 0 is
+* reserved for "no file" and always maps to [0,0].
+*
+* A file whose text is edited in place (see Document) keeps its line
+* table current, and the pieces of it that get rescanned are
+* registered as files of their own, embedded in it. A position in an
+* embedded file is translated through the edits made since the piece
+* was scanned, so nodes built before an edit still print where they
+* are now. Only edits inside a piece are kept for it; one before it
+* just moves it.
+**/
+class SourceFile{
+public:
+	/** Register a new file and return its id **/
+	static uint32_t add(const std::string& name);
+	/** The file registered under id (which must be non-zero) **/
+	static SourceFile& get(uint32_t id);
+	/** Forget file id, and the files embedded in it, so that their
+	    ids can be handed out again. Nothing may print a position in
+	    them after, and no other thread may be using them **/
+	static void release(uint32_t id);
+
+	const std::string& name() const { return myName; }
+	/** Record that a new line begins at offset **/
+	void addLine(uint32_t offset){ myLineStarts.push_back(offset); }
+	/** Translate a byte offset to a 1-based line and column **/
+	void lineCol(uint32_t offset, size_t& line, size_t& col) const;
+	size_t lineCount() const { return myLineStarts.size(); }
+	/** Offset at which the (0-based) index'th line begins **/
+	uint32_t lineStart(size_t index) const { return myLineStarts[index]; }
+
+	/** Record that [begin, end) of this file's text was replaced by
+	    the len bytes at text, keeping the line table current and
+	    moving the files embedded in it **/
+	void edit(uint32_t begin, uint32_t end, const char * text,
+		size_t len);
+	/** Make this file the piece of host (which must not itself be
+	    embedded) that is the length bytes at offset base of host's
+	    text as it is now. Call before any position in this file is
+	    printed **/
+	void embed(uint32_t host, uint32_t base, uint32_t length);
+	/** Where offset is in the current text of the file this one is
+	    embedded in; offset itself for a file that isn't embedded.
+	    The edits since embedding must not have touched offset **/
+	uint32_t resolve(uint32_t offset) const;
+private:
+	//An edit inside an embedded file, in offsets from its base; one
+	// that starts before the base begins below zero
+	struct Edit{
+		int64_t begin;
+		int64_t end;
+		uint32_t len;
+	};
+
+	SourceFile(const std::string& name)
+	: myName(name), myId(0), myHost(0), myBase(0), myFrom(0), myTo(0){
+		myLineStarts.push_back(0);
 	}
-	virtual void expand(Position * start, Position * end){
-	  myLineI = start->myLineI;
-	  myColI = start->myColI;
-	  myLineE = end->myLineE;
-	  myColE = end->myColE;
+	std::string myName;
+	uint32_t myId;
+	std::vector<uint32_t> myLineStarts;
+	//Host: the files embedded in it
+	std::vector<uint32_t> myEmbedded;
+	//Embedded: the offset in its host the edits are taken from, the
+	// stretch of the host's text now that the piece can be in, and
+	// the edits made there
+	uint32_t myHost;
+	uint32_t myBase;
+	uint32_t myFrom;
+	uint32_t myTo;
+	std::vector<Edit> myEdits;
+};
+
+/**
+* \class Position
+* A span of source text: a file id plus begin and end byte offsets.
+* Positions are small values meant to be stored inline in tokens and
+* AST nodes and copied freely. Offsets are 32 bits, so an input must
+* be under 4 GiB (MAX_SOURCE_SIZE in source.hpp); larger ones are
+* rejected when they are opened.
+**/
+class Position{
+public:
+	Position() : myFile(0), myBegin(0), myEnd(0){ }
+	Position(uint32_t file, uint32_t begin, uint32_t end)
+	: myFile(file), myBegin(begin), myEnd(end){
 	}
-	virtual std::string begin() const{
-		std::string result = "[" 
-		+ std::to_string(myLineI)
-		+ "," 
-		+ std::to_string(myColI)
-		+ "]";
-		return result;
+	Position(const Position& start, const Position& end)
+	: myFile(start.myFile), myBegin(start.myBegin), myEnd(end.myEnd){
 	}
-	virtual std::string span() const{
-		std::string result = begin()
-		+ "-[" 
-		+ std::to_string(myLineE)
-		+ "," 
-		+ std::to_string(myColE)
-		+ "]";
-		return result;
+	void expand(const Position& start, const Position& end){
+		myFile = start.myFile;
+		myBegin = start.myBegin;
+		myEnd = end.myEnd;
 	}
-private:
-	size_t myLineI;
-	size_t myColI;
-	size_t myLineE;
-	size_t myColE;
+	uint32_t file() const { return myFile; }
+	uint32_t beginOffset() const { return myBegin; }
+	uint32_t endOffset() const { return myEnd; }
 
+	size_t line() const;
+	size_t col() const;
+	std::string begin() const;
+	std::string span() const;
+private:
+	uint32_t myFile;
+	uint32_t myBegin;
+	uint32_t myEnd;
 };
 
 }
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include "regalloc.hpp"
+
+namespace cshanty{
+
+/*
+A value's position is its number: finish numbers instructions in
+block order, phis first, so the instructions of a block are a run of
+positions and every block comes after the blocks that dominate it.
+
+A value's live interval runs from its definition to the last position
+at which it is live: its last use, or the end of the last block it
+is live out of, found by the usual backwards dataflow over the
+blocks. Intervals have no holes, so a value live in two blocks with
+others laid out between is taken to be live in those as well; that
+only ever keeps a register busy for longer than it need be. A phi is
+live from the start of its block, with the other phis there, as the
+moves on the edges into the block set them all at once; it is its
+operands that are live out of the blocks before, as those moves read
+them. Formals, likewise, are set together on the way in.
+
+The scan goes through the intervals in order of their starts. A
+value whose interval expires before the next interval starts frees
+its register, so the value an instruction makes never shares a
+register with its operands, and the target can write the result
+before it has read them all. A value live across a call gets a
+preserved register, others a clobbered one if one is free. When
+none is, whichever of the value and those holding the registers it
+could have lives longest is spilled: it lives in its spill slot for
+the whole of its interval. Spill slots are handed out by a second
+scan over just the spilled values.
+*/
+
+/* A set of values, one bit each */
+typedef std::vector<uint64_t> ValueSet;
+
+static bool has(const ValueSet& set, ValueId v){
+	return (set[v / 64] >> (v % 64) & 1) != 0;
+}
+
+static void put(ValueSet& set, ValueId v){
+	set[v / 64] |= uint64_t(1) << (v % 64);
+}
+
+LinearScan::LinearScan(const IRFunction& fn, const Registers& regs,
+	const std::vector<bool>& wanted, const std::vector<bool>& calls)
+: myFn(fn), myWhere(fn.instrs().size(), Location::none()),
+  mySpillSlots(0){
+	liveIntervals(wanted);
+	allocate(regs, wanted, calls);
+}
+
+void LinearScan::liveIntervals(const std::vector<bool>& wanted){
+	const std::vector<IRBlock>& blocks = myFn.blocks();
+	size_t count = myFn.instrs().size();
+	size_t words = (count + 63) / 64;
+	std::vector<ValueSet> liveIn(blocks.size(), ValueSet(words, 0));
+	std::vector<ValueSet> liveOut(blocks.size(), ValueSet(words, 0));
+	std::vector<ValueSet> uses(blocks.size(), ValueSet(words, 0));
+	std::vector<ValueSet> defs(blocks.size(), ValueSet(words, 0));
+	std::vector<uint32_t> first(blocks.size());
+	myStart.assign(count, 0);
+	myEnd.assign(count, 0);
+
+	for (BlockId b = 0; b < blocks.size(); b++){
+		const IRBlock& block = blocks[b];
+		first[b] = block.phis.empty() ? block.code.front() : block.phis.front();
+		for (ValueId phi : block.phis){
+			put(defs[b], phi);
+			myStart[phi] = myEnd[phi] = first[b];
+		}
+		for (ValueId v : block.code){
+			const IRInstr& instr = myFn.instr(v);
+			for (uint32_t i = 0; i < instr.count; i++){
+				ValueId op = myFn.operand(v, i);
+				if (wanted[op] && !has(defs[b], op)){ put(uses[b], op); }
+			}
+			put(defs[b], v);
+			myStart[v] = myEnd[v] = instr.op == IROp::Param ? 0 : v;
+		}
+	}
+
+	//Live sets settle in a few passes, fewer the later blocks go first
+	bool changed = true;
+	while (changed){
+		changed = false;
+		for (BlockId b = static_cast<BlockId>(blocks.size()); b-- > 0;){
+			ValueSet out(words, 0);
+			for (BlockId succ : blocks[b].succs){
+				for (size_t w = 0; w < words; w++){ out[w] |= liveIn[succ][w]; }
+				const std::vector<BlockId>& preds = blocks[succ].preds;
+				size_t edge = static_cast<size_t>(
+					std::find(preds.begin(), preds.end(), b) - preds.begin());
+				for (ValueId phi : blocks[succ].phis){
+					ValueId op = myFn.operand(phi, edge);
+					if (wanted[op]){ put(out, op); }
+				}
+			}
+			ValueSet in(words, 0);
+			for (size_t w = 0; w < words; w++){
+				in[w] = uses[b][w] | (out[w] & ~defs[b][w]);
+			}
+			if (in != liveIn[b] || out != liveOut[b]){
+				liveIn[b].swap(in);
+				liveOut[b].swap(out);
+				changed = true;
+			}
+		}
+	}
+
+	for (BlockId b = 0; b < blocks.size(); b++){
+		const IRBlock& block = blocks[b];
+		uint32_t last = block.code.back();
+		for (ValueId v = 0; v < count; v++){
+			if (!wanted[v]){ continue; }
+			if (has(liveIn[b], v)){ myStart[v] = std::min(myStart[v], first[b]); }
+			if (has(liveOut[b], v)){ myEnd[v] = std::max(myEnd[v], last); }
+		}
+		for (ValueId v : block.code){
+			const IRInstr& instr = myFn.instr(v);
+			for (uint32_t i = 0; i < instr.count; i++){
+				ValueId op = myFn.operand(v, i);
+				myEnd[op] = std::max(myEnd[op], v);
+			}
+		}
+	}
+}
+
+void LinearScan::allocate(const Registers& regs,
+	const std::vector<bool>& wanted, const std::vector<bool>& calls){
+	std::vector<uint32_t> callsAt;
+	std::vector<ValueId> order;
+	for (ValueId v = 0; v < myFn.instrs().size(); v++){
+		if (calls[v]){ callsAt.push_back(v); }
+		if (wanted[v]){ order.push_back(v); }
+	}
+	std::stable_sort(order.begin(), order.end(),
+		[&](ValueId a, ValueId b){ return myStart[a] < myStart[b]; });
+	//Whether a call is made while v is live, once v is made and
+	// while it is still wanted after
+	auto acrossCall = [&](ValueId v){
+		auto call = std::upper_bound(callsAt.begin(), callsAt.end(),
+			myStart[v]);
+		return call != callsAt.end() && *call < myEnd[v];
+	};
+
+	std::vector<ValueId> active;
+	std::vector<ValueId> spilled;
+	auto isFree = [&](uint32_t reg){
+		for (ValueId a : active){
+			if (myWhere[a].index == reg){ return false; }
+		}
+		return true;
+	};
+	for (ValueId v : order){
+		active.erase(std::remove_if(active.begin(), active.end(),
+			[&](ValueId a){ return myEnd[a] < myStart[v]; }), active.end());
+
+		bool across = acrossCall(v);
+		std::vector<uint32_t> usable;
+		if (!across){
+			usable.insert(usable.end(), regs.clobbered.begin(),
+				regs.clobbered.end());
+		}
+		usable.insert(usable.end(), regs.preserved.begin(),
+			regs.preserved.end());
+		bool placed = false;
+		for (uint32_t reg : usable){
+			if (isFree(reg)){
+				myWhere[v] = Location::reg(reg);
+				active.push_back(v);
+				placed = true;
+				break;
+			}
+		}
+		if (placed){ continue; }
+
+		//Spill whichever lives longest of v and the values holding a
+		// register v could have
+		ValueId longest = NO_ID;
+		for (ValueId a : active){
+			bool fits = std::find(usable.begin(), usable.end(),
+				myWhere[a].index) != usable.end();
+			if (fits && (longest == NO_ID || myEnd[a] > myEnd[longest])){
+				longest = a;
+			}
+		}
+		if (longest != NO_ID && myEnd[longest] > myEnd[v]){
+			myWhere[v] = myWhere[longest];
+			active.erase(std::find(active.begin(), active.end(), longest));
+			active.push_back(v);
+			spilled.push_back(longest);
+		} else {
+			spilled.push_back(v);
+		}
+	}
+
+	spill(spilled);
+	for (ValueId v : order){
+		if (myWhere[v].kind != Location::Kind::Reg){ continue; }
+		uint32_t reg = myWhere[v].index;
+		if (std::find(regs.preserved.begin(), regs.preserved.end(), reg)
+		  != regs.preserved.end()
+		  && std::find(mySaved.begin(), mySaved.end(), reg)
+		  == mySaved.end()){
+			mySaved.push_back(reg);
+		}
+	}
+}
+
+void LinearScan::spill(std::vector<ValueId>& spilled){
+	std::stable_sort(spilled.begin(), spilled.end(),
+		[&](ValueId a, ValueId b){ return myStart[a] < myStart[b]; });
+	std::vector<ValueId> active;
+	std::vector<uint32_t> free;
+	for (ValueId v : spilled){
+		for (size_t i = 0; i < active.size();){
+			if (myEnd[active[i]] < myStart[v]){
+				free.push_back(myWhere[active[i]].index);
+				active.erase(active.begin() + static_cast<std::ptrdiff_t>(i));
+			} else {
+				i++;
+			}
+		}
+		uint32_t slot;
+		if (free.empty()){
+			slot = mySpillSlots++;
+		} else {
+			slot = free.back();
+			free.pop_back();
+		}
+		myWhere[v] = Location::spill(slot);
+		active.push_back(v);
+	}
+}
+
+}
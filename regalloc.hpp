@@ -0,0 +1,85 @@
+#ifndef CSHANTY_REGALLOC_H
+#define CSHANTY_REGALLOC_H
+
+#include <cstdint>
+#include <vector>
+#include "ir.hpp"
+
+namespace cshanty{
+
+/**
+* \class Location
+* Where a value is kept for as long as it is live: one of the target's
+* registers, or a slot of the frame set aside for values that didn't
+* get one. A value that needs no location (see LinearScan) has none.
+**/
+struct Location{
+	enum class Kind : uint8_t{ None, Reg, Spill };
+	Kind kind;
+	uint32_t index;
+
+	static Location none(){
+		Location l; l.kind = Kind::None; l.index = 0; return l;
+	}
+	static Location reg(uint32_t r){
+		Location l; l.kind = Kind::Reg; l.index = r; return l;
+	}
+	static Location spill(uint32_t slot){
+		Location l; l.kind = Kind::Spill; l.index = slot; return l;
+	}
+	bool operator==(const Location& other) const {
+		return kind == other.kind && index == other.index;
+	}
+};
+
+/**
+* \class Registers
+* The registers a target lets the allocator hand out, by the target's
+* numbers: those a call leaves alone, which can hold a value across
+* one but have to be saved by the function that uses them, and those
+* a call clobbers.
+**/
+struct Registers{
+	std::vector<uint32_t> preserved;
+	std::vector<uint32_t> clobbered;
+};
+
+/**
+* \class LinearScan
+* Gives each value of an IRFunction a register or a spill slot by
+* linear scan (Poletto and Sarkar, "Linear Scan Register Allocation",
+* 1999), over the live intervals of its values (see regalloc.cpp).
+**/
+class LinearScan{
+public:
+	/** Allocate fn's values. wanted says which need a location:
+	    not those that make nothing, nor those the target works out
+	    again wherever they are used. calls says which instructions
+	    call out, clobbering every clobbered register **/
+	LinearScan(const IRFunction& fn, const Registers& regs,
+		const std::vector<bool>& wanted, const std::vector<bool>& calls);
+
+	const Location& where(ValueId v) const { return myWhere[v]; }
+	uint32_t spillSlots() const { return mySpillSlots; }
+	/** The preserved registers handed out, which the function must
+	    save and restore **/
+	const std::vector<uint32_t>& saved() const { return mySaved; }
+private:
+	void liveIntervals(const std::vector<bool>& wanted);
+	void allocate(const Registers& regs, const std::vector<bool>& wanted,
+		const std::vector<bool>& calls);
+	void spill(std::vector<ValueId>& spilled);
+
+	const IRFunction& myFn;
+	//The first and last position at which each value is live; a
+	// position is the number of the instruction there
+	std::vector<uint32_t> myStart;
+	std::vector<uint32_t> myEnd;
+	std::vector<Location> myWhere;
+	uint32_t mySpillSlots;
+	std::vector<uint32_t> mySaved;
+};
+
+}
+
+#endif
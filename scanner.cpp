@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include "scanner.hpp"
 
@@ -6,20 +9,90 @@ using namespace cshanty;
 using TokenKind = cshanty::Parser::token;
 using Lexeme = cshanty::Parser::semantic_type;
 
-void Scanner::outputTokens(std::ostream& outstream){
+void Scanner::tap(TokenWriter * text, TokenStreamWriter * binary,
+	bool timed){
+	myWriter = text;
+	myStreamWriter = binary;
+	myTimed = timed;
+	myTapped = text != nullptr || binary != nullptr || timed;
+}
+
+void Scanner::drain(){
 	Lexeme lex;
-	int tokenKind;
-	while(true){
-		tokenKind = this->yylex(&lex);
-		if (tokenKind == TokenKind::END){
-			outstream << "EOF" 
-			  << " [" << this->lineNum 
-			  << "," << this->colNum << "]"
-			  << std::endl;
-			return;
-		} else {
-			outstream << lex.lexeme->toString()
-			  << std::endl;
+	while (!myAtEnd && this->yylex(&lex) != TokenKind::END){ }
+}
+
+int Scanner::tapLex(Lexeme * const lval){
+	if (!myTimed){ return copyToken(nextToken(lval), lval); }
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	int kind = copyToken(nextToken(lval), lval);
+	std::chrono::duration<double> spent =
+		std::chrono::steady_clock::now() - start;
+	myScanTime += spent.count();
+	return kind;
+}
+
+int Scanner::copyToken(int kind, Lexeme * const lval){
+	if (kind != TokenKind::END){
+		if (myWriter != nullptr){ myWriter->write(lval->lexeme); }
+		if (myStreamWriter != nullptr){
+			myStreamWriter->add(lval->lexeme);
 		}
+		return kind;
+	}
+	myAtEnd = true;
+	if (myWriter != nullptr){
+		myWriter->writeEOF(this->lineNum, this->colNum);
+		myWriter = nullptr;
+	}
+	if (myStreamWriter != nullptr){
+		myStreamWriter->finish(myFile, myNextOffset);
+		myStreamWriter = nullptr;
+	}
+	return kind;
+}
+
+int Scanner::replayLex(Lexeme * const lval){
+	this->yylval = lval;
+	if (myFed == myReplay->size()){
+		myNextOffset = myReplay->endOffset();
+		mySource->lineCol(myNextOffset, lineNum, colNum);
+		return TokenKind::END;
+	}
+	const TokenRecord& rec = myReplay->at(myFed++);
+	myTokBegin = rec.begin;
+	myNextOffset = rec.end;
+	int kind = static_cast<int>(rec.kind);
+	switch (kind){
+	case TokenKind::ID:
+		yylval->transIDToken = myArena.make<IDToken>(tokenPos(),
+			myReplay->string(rec.payload));
+		break;
+	case TokenKind::STRLITERAL:
+		yylval->transStrToken = myArena.make<StrToken>(tokenPos(),
+			myReplay->string(rec.payload));
+		break;
+	case TokenKind::INTLITERAL:
+		yylval->transIntToken = myArena.make<IntLitToken>(tokenPos(),
+			static_cast<int>(rec.payload));
+		break;
+	default:
+		yylval->lexeme = myArena.make<Token>(tokenPos(), kind);
+	}
+	return kind;
+}
+
+int Scanner::LexerInput(char * buf, int max_size){
+	if (myBuffer == nullptr){
+		return yyFlexLexer::LexerInput(buf, max_size);
 	}
+	/* Hand flex the next piece of the mapping directly; there is
+	   no istream in between. (The C++ flex skeleton has no
+	   yy_scan_buffer, so flex still keeps its own chunk buffer.) */
+	size_t left = myBuffer->size() - myFed;
+	size_t count = std::min(left, static_cast<size_t>(max_size));
+	std::memcpy(buf, myBuffer->data() + myFed, count);
+	myFed += count;
+	return static_cast<int>(count);
 }
@@ -6,7 +6,10 @@
 #endif
 
 #include "grammar.hh"
+#include "arena.hpp"
 #include "errors.hpp"
+#include "source.hpp"
+#include "tokenio.hpp"
 
 using TokenKind = cshanty::Parser::token;
 
@@ -15,10 +18,32 @@ namespace cshanty{
 class Scanner : public yyFlexLexer{
 public:
    
-   Scanner(std::istream *in) : yyFlexLexer(in)
+   Scanner(std::istream *in, Arena& arena, const std::string& name)
+   : yyFlexLexer(in), myArena(arena), myBuffer(nullptr), myFast(false),
+     myReplay(nullptr)
    {
-	lineNum = 1;
-	colNum = 1;
+	init(name);
+   };
+   /** Scan a (typically memory-mapped) buffer, either through flex
+       or, if fast is set, with the hand-written scanner in
+       fastlex.cpp, which works on the buffer in place **/
+   Scanner(const SourceBuffer& buffer, Arena& arena,
+	const std::string& name, bool fast)
+   : yyFlexLexer(nullptr), myArena(arena), myBuffer(&buffer),
+     myFast(fast), myReplay(nullptr)
+   {
+	init(name);
+   };
+   /** Replay a token stream saved by an earlier run (-b) instead
+       of lexing; the stream must outlive the scanner **/
+   Scanner(const TokenStream& stream, Arena& arena)
+   : yyFlexLexer(nullptr), myArena(arena), myBuffer(nullptr),
+     myFast(false), myReplay(&stream)
+   {
+	init(stream.name());
+	for (size_t i = 1; i < stream.lineStarts().size(); i++){
+		mySource->addLine(stream.lineStarts()[i]);
+	}
    };
    virtual ~Scanner() {
    };
@@ -26,62 +51,168 @@ public:
    //get rid of override virtual function warning
    using FlexLexer::yylex;
 
+   int yylex( cshanty::Parser::semantic_type * const lval){
+	if (myTapped){ return tapLex(lval); }
+	return nextToken(lval);
+   }
+
+   int nextToken( cshanty::Parser::semantic_type * const lval){
+	if (myReplay != nullptr){ return replayLex(lval); }
+	if (myFast){ return fastLex(lval); }
+	return flexLex(lval);
+   }
+
    // YY_DECL defined in the flex cshanty.l
-   virtual int yylex( cshanty::Parser::semantic_type * const lval);
+   int flexLex( cshanty::Parser::semantic_type * const lval);
+   // Hand-written backend, defined in fastlex.cpp
+   int fastLex( cshanty::Parser::semantic_type * const lval);
+   // Token stream backend, defined in scanner.cpp
+   int replayLex( cshanty::Parser::semantic_type * const lval);
 
    int makeBareToken(int tagIn){
 	size_t len = static_cast<size_t>(yyleng);
-	Position * pos = new Position(
-	  this->lineNum, this->colNum,
-	  this->lineNum, this->colNum+len);
-        this->yylval->lexeme = new Token(pos, tagIn);
+        this->yylval->lexeme = myArena.make<Token>(tokenPos(), tagIn);
         colNum += len;
         return tagIn;
    }
 
    void errIllegal(size_t l, size_t c, std::string match){
-	cshanty::Report::fatal(l, c, "Illegal character "
+	lexError(DiagId::IllegalChar, l, c, "Illegal character "
 		+ match);
    }
 
    void errStrEsc(size_t l, size_t c){
-	cshanty::Report::fatal(l, c, "String literal with bad"
+	lexError(DiagId::BadEscape, l, c, "String literal with bad"
 	" escape sequence ignored");
    }
 
    void errStrUnterm(size_t l, size_t c){
-	cshanty::Report::fatal(l, c, "Unterminated string"
+	lexError(DiagId::UntermString, l, c, "Unterminated string"
 	" literal ignored");
    }
 
    void errStrEscAndUnterm(size_t l, size_t c){
-	cshanty::Report::fatal(l, c, "Unterminated string literal"
+	lexError(DiagId::UntermBadEscape, l, c, "Unterminated string literal"
 	" with bad escape sequence ignored");
    }
 
    void errIntOverflow(size_t l, size_t c){
-	cshanty::Report::fatal(l, c, "Integer literal too large;"
+	lexError(DiagId::IntOverflow, l, c, "Integer literal too large;"
 	" using max value");
    }
 
+   /** Give up on the input after a fatal lexical error. This
+       unwinds out of the parser rather than exiting, so the other
+       files of a batch still compile; tapped writers are flushed as
+       the unwinding destroys them **/
+   void bail(){
+	throw new FatalError("Fatal lexical error");
+   }
+
    void warn(int lineNumIn, int colNumIn, std::string msg){
-	std::cerr << lineNumIn << ":" << colNumIn 
-		<< " ***WARNING*** " << msg << std::endl;
+	Report::report(Diagnostic(Severity::Warning, DiagId::Unspecified,
+		tokenPos(), static_cast<size_t>(lineNumIn),
+		static_cast<size_t>(colNumIn), msg));
    }
 
    void error(int lineNumIn, int colNumIn, std::string msg){
-	std::cerr << lineNumIn << ":" << colNumIn 
-		<< " ***ERROR*** " << msg << std::endl;
+	Report::report(Diagnostic(Severity::Error, DiagId::Unspecified,
+		tokenPos(), static_cast<size_t>(lineNumIn),
+		static_cast<size_t>(colNumIn), msg));
    }
 
-   static std::string tokenKindString(int tokenKind);
+   /** Copy every token handed out from now on to text (the -t
+       listing) and/or binary (a -b token stream); either may be
+       null. The writers are finished when END is reached. If timed
+       is set, time spent lexing and writing tokens is added up for
+       scanTime **/
+   void tap(TokenWriter * text, TokenStreamWriter * binary, bool timed);
+   /** Scan the rest of the input, so that tapped writers see every
+       token even if the parser stopped early **/
+   void drain();
+   /** Seconds spent in yylex since tap was called with timed set **/
+   double scanTime() const { return myScanTime; }
+
+   Arena& arena(){ return myArena; }
+   /** Id of the SourceFile this scanner registered **/
+   uint32_t file() const { return myFile; }
+   /** Number of lexical diagnostics reported so far **/
+   size_t reported() const { return myReported; }
+   /** The text being scanned is the length bytes at offset base of
+       file host's current text (see Document): report positions as
+       places in host **/
+   void embed(uint32_t host, uint32_t base, uint32_t length){
+	mySource->embed(host, base, length);
+	SourceFile::get(host).lineCol(base, lineNum, colNum);
+   }
+   /** Called by the parser for each syntax error it reports. The
+       parser recovers from them and still returns success, so this
+       count is what marks the program as rejected **/
+   void syntaxError(){ mySyntaxErrors++; }
+   size_t syntaxErrors() const { return mySyntaxErrors; }
+
+   /** Span of the match currently in yytext **/
+   Position tokenPos() const {
+	return Position(myFile, myTokBegin, myNextOffset);
+   }
+
+   /** Text of the current match. When scanning a SourceBuffer this
+       points into the buffer; otherwise it is only valid until the
+       next match (tokens keep the interned Symbol, not the view) **/
+   StrView lexeme() const {
+	size_t len = static_cast<size_t>(yyleng);
+	if (myBuffer != nullptr){
+		return StrView(myBuffer->data() + myTokBegin, len);
+	}
+	return StrView(yytext, len);
+   }
 
-   void outputTokens(std::ostream& outstream);
+protected:
+   int LexerInput(char * buf, int max_size) override;
 
 private:
+   void init(const std::string& name){
+	lineNum = 1;
+	colNum = 1;
+	myFile = SourceFile::add(name);
+	mySource = &SourceFile::get(myFile);
+	myTokBegin = 0;
+	myNextOffset = 0;
+	myFed = 0;
+	myReported = 0;
+	mySyntaxErrors = 0;
+   }
+
+   void lexError(DiagId id, size_t l, size_t c, const std::string& msg){
+	myReported++;
+	Report::report(Diagnostic(Severity::Fatal, id, tokenPos(), l, c,
+		msg));
+   }
+
+   int fastBare(const char * at, size_t len, int tag);
+   int tapLex( cshanty::Parser::semantic_type * const lval);
+   int copyToken(int kind, cshanty::Parser::semantic_type * const lval);
+
+   Arena& myArena;
+   const SourceBuffer * myBuffer;
+   bool myFast;
+   const TokenStream * myReplay;
+   bool myTapped = false;
+   TokenWriter * myWriter = nullptr;
+   TokenStreamWriter * myStreamWriter = nullptr;
+   bool myTimed = false;
+   double myScanTime = 0;
+   bool myAtEnd = false;
+   size_t myFed;
    cshanty::Parser::semantic_type *yylval = nullptr;
    size_t lineNum;
    size_t colNum;
+   uint32_t myFile;
+   SourceFile * mySource;
+   uint32_t myTokBegin;
+   uint32_t myNextOffset;
+   size_t myReported;
+   size_t mySyntaxErrors;
 };
 
 } /* end namespace */
@@ -0,0 +1,93 @@
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "errors.hpp"
+#include "source.hpp"
+
+namespace cshanty{
+
+static void failRead(const char * path){
+	std::string msg = "Bad input stream ";
+	msg += path;
+	throw new InternalError(msg.c_str());
+}
+
+static void failSize(const char * path){
+	std::string msg = "Bad input stream ";
+	msg += path;
+	msg += " (4 GiB or more)";
+	throw new InternalError(msg.c_str());
+}
+
+void checkSourceSize(const char * path){
+	//A pipe or device has no size to check up front
+	struct stat info;
+	if (stat(path, &info) == 0 && S_ISREG(info.st_mode)
+	  && static_cast<uint64_t>(info.st_size) >= MAX_SOURCE_SIZE){
+		failSize(path);
+	}
+}
+
+SourceBuffer * SourceBuffer::map(const char * path){
+	int fd = open(path, O_RDONLY);
+	if (fd < 0){ failRead(path); }
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)){
+		close(fd);
+		failRead(path);
+	}
+	if (static_cast<uint64_t>(info.st_size) >= MAX_SOURCE_SIZE){
+		close(fd);
+		failSize(path);
+	}
+	size_t size = static_cast<size_t>(info.st_size);
+	if (size == 0){
+		close(fd);
+		return new SourceBuffer("", 0, false);
+	}
+
+	void * mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapping != MAP_FAILED){
+		close(fd);
+		madvise(mapping, size, MADV_SEQUENTIAL);
+		return new SourceBuffer(static_cast<const char *>(mapping),
+			size, true);
+	}
+
+	//Not mappable (e.g. some special filesystems): fall back
+	// to one read into the heap
+	char * copy = new char[size];
+	size_t got = 0;
+	while (got < size){
+		ssize_t n = read(fd, copy + got, size - got);
+		if (n <= 0){
+			delete[] copy;
+			close(fd);
+			failRead(path);
+		}
+		got += static_cast<size_t>(n);
+	}
+	close(fd);
+	return new SourceBuffer(copy, size, false);
+}
+
+SourceBuffer * SourceBuffer::copy(const char * data, size_t size){
+	if (size == 0){ return new SourceBuffer("", 0, false); }
+	char * mem = new char[size];
+	memcpy(mem, data, size);
+	return new SourceBuffer(mem, size, false);
+}
+
+SourceBuffer::~SourceBuffer(){
+	if (myMapped){
+		munmap(const_cast<char *>(myData), mySize);
+	} else if (mySize > 0){
+		delete[] myData;
+	}
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef CSHANTY_SOURCE_H
+#define CSHANTY_SOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cshanty{
+
+/** Inputs must be smaller than this, so that every byte offset in
+    one fits the 32 bits of a Position **/
+static const uint64_t MAX_SOURCE_SIZE = uint64_t(1) << 32;
+
+/** Throw InternalError if the file at path is MAX_SOURCE_SIZE bytes
+    or more. For inputs not read through SourceBuffer::map, which
+    checks for itself **/
+void checkSourceSize(const char * path);
+
+/**
+* \class SourceBuffer
+* The full text of an input file, memory-mapped read-only when the
+* platform allows it (and read into the heap otherwise). Lexemes of
+* tokens scanned from a SourceBuffer are views into it, so the buffer
+* must outlive every token built from it.
+**/
+class SourceBuffer{
+public:
+	/** Map the file at path; throws InternalError if it can't be read
+	    or is MAX_SOURCE_SIZE bytes or more **/
+	static SourceBuffer * map(const char * path);
+	/** A buffer holding its own copy of size bytes of data **/
+	static SourceBuffer * copy(const char * data, size_t size);
+	~SourceBuffer();
+	SourceBuffer(const SourceBuffer&) = delete;
+	SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+	const char * data() const { return myData; }
+	size_t size() const { return mySize; }
+private:
+	SourceBuffer(const char * data, size_t size, bool mapped)
+	: myData(data), mySize(size), myMapped(mapped){ }
+	const char * myData;
+	size_t mySize;
+	bool myMapped;
+};
+
+}
+
+#endif
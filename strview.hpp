@@ -0,0 +1,45 @@
+#ifndef CSHANTY_STRVIEW_H
+#define CSHANTY_STRVIEW_H
+
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace cshanty{
+
+/**
+* \class StrView
+* Non-owning view of a run of characters, used for lexemes so that
+* tokens can point straight into the source text instead of holding
+* their own std::string copies. Whoever builds a StrView is
+* responsible for keeping the characters alive (the mapped source
+* file or the compilation's arena).
+**/
+class StrView{
+public:
+	StrView() : myData(nullptr), myLen(0){ }
+	StrView(const char * data, size_t len) : myData(data), myLen(len){ }
+
+	const char * data() const { return myData; }
+	size_t size() const { return myLen; }
+	std::string str() const { return std::string(myData, myLen); }
+
+	bool operator==(const StrView& other) const{
+		return myLen == other.myLen
+		&& (myLen == 0 || std::memcmp(myData, other.myData, myLen) == 0);
+	}
+	bool operator!=(const StrView& other) const{
+		return !(*this == other);
+	}
+private:
+	const char * myData;
+	size_t myLen;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const StrView& view){
+	return out.write(view.data(), static_cast<std::streamsize>(view.size()));
+}
+
+}
+
+#endif
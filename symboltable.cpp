@@ -0,0 +1,85 @@
+#include "errors.hpp"
+#include "symboltable.hpp"
+
+namespace cshanty{
+
+SymbolTable::SymbolTable()
+: mySlots(64), myNames(0){
+	for (Slot& slot : mySlots){ slot.binding = NONE; }
+}
+
+void SymbolTable::enterScope(){
+	myMarks.push_back(static_cast<uint32_t>(myBindings.size()));
+}
+
+void SymbolTable::leaveScope(){
+	if (myMarks.empty()){
+		throw new InternalError("Left a scope that was never entered");
+	}
+	size_t mark = myMarks.back();
+	myMarks.pop_back();
+	while (myBindings.size() > mark){
+		const Binding& binding = myBindings.back();
+		Slot& slot = mySlots[find(binding.name, hash(binding.name))];
+		slot.binding = binding.shadowed;
+		myBindings.pop_back();
+	}
+}
+
+size_t SymbolTable::find(Symbol name, uint32_t hash) const{
+	size_t mask = mySlots.size() - 1;
+	size_t at = hash & mask;
+	while (mySlots[at].name.valid() && mySlots[at].name != name){
+		at = (at + 1) & mask;
+	}
+	return at;
+}
+
+void SymbolTable::grow(){
+	std::vector<Slot> bigger(mySlots.size() * 2);
+	size_t mask = bigger.size() - 1;
+	for (Slot& slot : bigger){ slot.binding = NONE; }
+	for (const Slot& slot : mySlots){
+		if (!slot.name.valid()){ continue; }
+		size_t at = slot.hash & mask;
+		while (bigger[at].name.valid()){ at = (at + 1) & mask; }
+		bigger[at] = slot;
+	}
+	mySlots.swap(bigger);
+}
+
+bool SymbolTable::declare(Symbol name, DeclNode * decl){
+	if (myMarks.empty()){
+		throw new InternalError("Declared a name outside any scope");
+	}
+	if (2 * (myNames + 1) > mySlots.size()){ grow(); }
+	uint32_t code = hash(name);
+	Slot& slot = mySlots[find(name, code)];
+	if (!slot.name.valid()){
+		slot.name = name;
+		slot.hash = code;
+		myNames++;
+	}
+	uint32_t depth = static_cast<uint32_t>(myMarks.size());
+	if (slot.binding != NONE && myBindings[slot.binding].depth == depth){
+		return false;
+	}
+	Binding binding = { decl, name, depth, slot.binding };
+	slot.binding = static_cast<uint32_t>(myBindings.size());
+	myBindings.push_back(binding);
+	return true;
+}
+
+DeclNode * SymbolTable::lookup(Symbol name) const{
+	const Slot& slot = mySlots[find(name, hash(name))];
+	return slot.binding == NONE ? nullptr : myBindings[slot.binding].decl;
+}
+
+DeclNode * SymbolTable::lookupHere(Symbol name) const{
+	const Slot& slot = mySlots[find(name, hash(name))];
+	if (slot.binding == NONE){ return nullptr; }
+	const Binding& binding = myBindings[slot.binding];
+	return binding.depth == myMarks.size() ? binding.decl : nullptr;
+}
+
+}
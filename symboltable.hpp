@@ -0,0 +1,82 @@
+#ifndef CSHANTY_SYMBOLTABLE_H
+#define CSHANTY_SYMBOLTABLE_H
+
+#include <cstdint>
+#include <vector>
+#include "intern.hpp"
+
+namespace cshanty{
+
+class DeclNode;
+
+/**
+* \class SymbolTable
+* The names in scope during name analysis, each bound to the
+* declaration that introduced it. Scopes nest; a name declared in an
+* inner scope shadows the outer one until that scope is left.
+*
+* Rather than a hash table per scope, which costs a probe per
+* enclosing scope to find a global from deep inside nested blocks,
+* there is one open-addressing table (linear probing, kept at most
+* half full) keyed by interned name. Its slot for a name holds the
+* innermost binding, and each binding links to the one it shadows.
+* The bindings form a stack that doubles as an undo log: entering a
+* scope records the stack's height, and leaving it pops the bindings
+* above that height, restoring what each shadowed. So lookup costs
+* one probe at any depth, and entering or leaving a scope costs O(1)
+* plus O(1) per name it declared.
+**/
+class SymbolTable{
+public:
+	SymbolTable();
+
+	void enterScope();
+	/** Drop every binding made since the matching enterScope **/
+	void leaveScope();
+	/** Number of scopes entered and not yet left **/
+	size_t depth() const { return myMarks.size(); }
+
+	/** Bind name to decl in the innermost scope. Returns false, and
+	    binds nothing, if name is already bound in that scope **/
+	bool declare(Symbol name, DeclNode * decl);
+	/** The innermost declaration of name, or null if there is none
+	    in scope **/
+	DeclNode * lookup(Symbol name) const;
+	/** The declaration of name in the innermost scope, or null **/
+	DeclNode * lookupHere(Symbol name) const;
+private:
+	static const uint32_t NONE = 0xffffffff;
+
+	struct Slot{
+		Symbol name;
+		//Index in myBindings of the innermost binding, or NONE. A
+		// name's slot stays once it is taken, so there are no
+		// tombstones and probing never has to skip any
+		uint32_t binding;
+		uint32_t hash;
+	};
+	struct Binding{
+		DeclNode * decl;
+		Symbol name;
+		uint32_t depth;
+		uint32_t shadowed;
+	};
+
+	static uint32_t hash(Symbol name){
+		//Ids are dense, so spread them over the table (Fibonacci
+		// hashing)
+		return name.id() * 0x9e3779b9u;
+	}
+	size_t find(Symbol name, uint32_t hash) const;
+	void grow();
+
+	std::vector<Slot> mySlots;
+	size_t myNames;
+	std::vector<Binding> myBindings;
+	//Height of myBindings when each open scope was entered
+	std::vector<uint32_t> myMarks;
+};
+
+}
+
+#endif
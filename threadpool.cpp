@@ -0,0 +1,98 @@
+#include "threadpool.hpp"
+
+namespace cshanty{
+
+/* Index of the pool worker running on this thread, if any */
+static thread_local const ThreadPool * currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+
+ThreadPool::ThreadPool(size_t threads)
+: myQueued(0), myPending(0), myNext(0), mySteals(0), myStopping(false){
+	if (threads == 0){ threads = std::thread::hardware_concurrency(); }
+	if (threads == 0){ threads = 1; }
+	for (size_t i = 0; i < threads; i++){
+		myWorkers.emplace_back(new Worker());
+	}
+	for (size_t i = 0; i < threads; i++){
+		myThreads.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool(){
+	wait();
+	{
+		std::lock_guard<std::mutex> guard(myLock);
+		myStopping = true;
+	}
+	myWake.notify_all();
+	for (std::thread& thread : myThreads){ thread.join(); }
+}
+
+void ThreadPool::submit(Job job){
+	size_t target;
+	//Count the job before it can be taken: a thief that ran it first
+	// would otherwise take the counts below zero, and wait() could
+	// return while the job that submitted it is still running
+	{
+		std::lock_guard<std::mutex> guard(myLock);
+		target = currentPool == this
+			? currentWorker : myNext++ % myWorkers.size();
+		myQueued++;
+		myPending++;
+	}
+	{
+		Worker& worker = *myWorkers[target];
+		std::lock_guard<std::mutex> guard(worker.lock);
+		worker.jobs.push_back(std::move(job));
+	}
+	myWake.notify_one();
+}
+
+void ThreadPool::wait(){
+	std::unique_lock<std::mutex> guard(myLock);
+	myIdle.wait(guard, [this]{ return myPending == 0; });
+}
+
+bool ThreadPool::take(size_t self, Job& job){
+	size_t count = myWorkers.size();
+	for (size_t i = 0; i < count; i++){
+		size_t victim = (self + i) % count;
+		Worker& worker = *myWorkers[victim];
+		std::lock_guard<std::mutex> guard(worker.lock);
+		if (worker.jobs.empty()){ continue; }
+		//Own jobs newest first, for locality; stolen ones oldest
+		// first, since those tend to be the biggest
+		if (victim == self){
+			job = std::move(worker.jobs.back());
+			worker.jobs.pop_back();
+		} else {
+			job = std::move(worker.jobs.front());
+			worker.jobs.pop_front();
+		}
+		std::lock_guard<std::mutex> counts(myLock);
+		myQueued--;
+		if (victim != self){ mySteals++; }
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::work(size_t self){
+	currentPool = this;
+	currentWorker = self;
+	Job job;
+	while (true){
+		if (take(self, job)){
+			job();
+			job = nullptr;
+			std::lock_guard<std::mutex> guard(myLock);
+			if (--myPending == 0){ myIdle.notify_all(); }
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(myLock);
+		myWake.wait(guard, [this]{ return myStopping || myQueued > 0; });
+		if (myStopping && myQueued == 0){ return; }
+	}
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef CSHANTY_THREADPOOL_H
+#define CSHANTY_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cshanty{
+
+/**
+* \class ThreadPool
+* Fixed set of worker threads, each with its own deque of jobs. A
+* worker runs the newest job from its own deque and, once that is
+* empty, steals the oldest job from another worker's, so a few slow
+* jobs don't leave the other threads idle. Jobs submitted from
+* outside the pool are dealt out round robin; a job submitted by a
+* running job goes on its own worker's deque. Jobs must not throw.
+**/
+class ThreadPool{
+public:
+	typedef std::function<void()> Job;
+
+	/** Start threads workers; 0 means one per hardware thread **/
+	ThreadPool(size_t threads = 0);
+	/** Finish every submitted job, then stop the workers **/
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void submit(Job job);
+	/** Block until every job submitted so far has finished **/
+	void wait();
+
+	size_t size() const { return myThreads.size(); }
+	/** Jobs a worker took from another worker's deque **/
+	size_t steals() const { return mySteals; }
+private:
+	struct Worker{
+		std::mutex lock;
+		std::deque<Job> jobs;
+	};
+
+	void work(size_t self);
+	bool take(size_t self, Job& job);
+
+	std::vector<std::unique_ptr<Worker>> myWorkers;
+	std::vector<std::thread> myThreads;
+	//Guards the counts below and the two condition variables
+	std::mutex myLock;
+	std::condition_variable myWake;
+	std::condition_variable myIdle;
+	size_t myQueued;
+	size_t myPending;
+	size_t myNext;
+	size_t mySteals;
+	bool myStopping;
+};
+
+}
+
+#endif
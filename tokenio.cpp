@@ -0,0 +1,235 @@
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include "bytes.hpp"
+#include "errors.hpp"
+#include "grammar.hh"
+#include "source.hpp"
+#include "tokenio.hpp"
+
+namespace cshanty{
+
+using TokenKind = cshanty::Parser::token;
+
+static const char MAGIC[4] = {'C', 'S', 'T', 'K'};
+
+TokenWriter::TokenWriter(std::ostream& out)
+: myOut(out), myBuf(new char[CAPACITY]), myLen(0),
+  myFileId(0), myFile(nullptr), myLine(0){
+}
+
+TokenWriter::~TokenWriter(){
+	flush();
+	delete [] myBuf;
+}
+
+void TokenWriter::flush(){
+	myOut.write(myBuf, static_cast<std::streamsize>(myLen));
+	myOut.flush();
+	myLen = 0;
+}
+
+void TokenWriter::put(const char * text, size_t len){
+	if (myLen + len > CAPACITY){
+		myOut.write(myBuf, static_cast<std::streamsize>(myLen));
+		myLen = 0;
+		if (len > CAPACITY){
+			myOut.write(text, static_cast<std::streamsize>(len));
+			return;
+		}
+	}
+	std::memcpy(myBuf + myLen, text, len);
+	myLen += len;
+}
+
+void TokenWriter::put(const char * text){
+	put(text, std::strlen(text));
+}
+
+void TokenWriter::putNum(uint64_t num){
+	char digits[20];
+	size_t count = 0;
+	do {
+		digits[sizeof(digits) - ++count] = static_cast<char>('0' + num % 10);
+		num /= 10;
+	} while (num != 0);
+	put(digits + sizeof(digits) - count, count);
+}
+
+void TokenWriter::putLineCol(size_t line, size_t col){
+	put(" [", 2);
+	putNum(line);
+	put(",", 1);
+	putNum(col);
+	put("]\n", 2);
+}
+
+void TokenWriter::write(const Token * tok){
+	put(tokenKindString(tok->kind()));
+	switch (tok->kind()){
+	case TokenKind::ID: {
+		StrView name = static_cast<const IDToken *>(tok)->value().view();
+		put(":", 1);
+		put(name.data(), name.size());
+		break;
+	}
+	case TokenKind::STRLITERAL: {
+		StrView text = static_cast<const StrToken *>(tok)->str().view();
+		put(":", 1);
+		put(text.data(), text.size());
+		break;
+	}
+	case TokenKind::INTLITERAL:
+		put(":", 1);
+		putNum(static_cast<uint64_t>(
+			static_cast<const IntLitToken *>(tok)->num()));
+		break;
+	default:
+		break;
+	}
+
+	const Position& pos = tok->pos();
+	if (pos.file() == 0){
+		putLineCol(0, 0);
+		return;
+	}
+	if (pos.file() != myFileId){
+		myFileId = pos.file();
+		myFile = &SourceFile::get(myFileId);
+		myLine = 0;
+	}
+	uint32_t offset = pos.beginOffset();
+	if (offset < myFile->lineStart(myLine)){ myLine = 0; }
+	while (myLine + 1 < myFile->lineCount()
+	  && myFile->lineStart(myLine + 1) <= offset){
+		myLine++;
+	}
+	putLineCol(myLine + 1, offset - myFile->lineStart(myLine) + 1);
+}
+
+void TokenWriter::writeEOF(size_t line, size_t col){
+	put("EOF", 3);
+	putLineCol(line, col);
+}
+
+TokenStreamWriter::TokenStreamWriter(std::ostream& out)
+: myOut(out){
+}
+
+void TokenStreamWriter::add(const Token * tok){
+	TokenRecord rec;
+	rec.kind = static_cast<uint32_t>(tok->kind());
+	rec.begin = tok->pos().beginOffset();
+	rec.end = tok->pos().endOffset();
+	rec.payload = 0;
+
+	Symbol text;
+	if (tok->kind() == TokenKind::ID){
+		text = static_cast<const IDToken *>(tok)->value();
+	} else if (tok->kind() == TokenKind::STRLITERAL){
+		text = static_cast<const StrToken *>(tok)->str();
+	} else if (tok->kind() == TokenKind::INTLITERAL){
+		rec.payload = static_cast<uint32_t>(
+			static_cast<const IntLitToken *>(tok)->num());
+	}
+	if (text.valid()){
+		auto found = myStringIndex.find(text);
+		if (found == myStringIndex.end()){
+			rec.payload = static_cast<uint32_t>(myStrings.size());
+			myStringIndex.emplace(text, rec.payload);
+			myStrings.push_back(text);
+		} else {
+			rec.payload = found->second;
+		}
+	}
+	myTokens.push_back(rec);
+}
+
+void TokenStreamWriter::finish(uint32_t file, uint32_t endOffset){
+	const SourceFile& source = SourceFile::get(file);
+	ByteWriter out(myOut);
+	out.raw(MAGIC, sizeof(MAGIC));
+	out.u32(VERSION);
+	out.bytes(source.name().data(), source.name().size());
+	out.u32(static_cast<uint32_t>(source.lineCount()));
+	for (size_t i = 0; i < source.lineCount(); i++){
+		out.u32(source.lineStart(i));
+	}
+	out.u32(endOffset);
+	out.u32(static_cast<uint32_t>(myStrings.size()));
+	for (Symbol text : myStrings){
+		StrView view = text.view();
+		out.bytes(view.data(), view.size());
+	}
+	out.u32(static_cast<uint32_t>(myTokens.size()));
+	for (const TokenRecord& rec : myTokens){
+		out.u32(rec.kind);
+		out.u32(rec.begin);
+		out.u32(rec.end);
+		out.u32(rec.payload);
+	}
+	myOut.flush();
+}
+
+bool TokenStream::sniff(const char * path){
+	std::ifstream in(path, std::ios::binary);
+	char head[sizeof(MAGIC)];
+	if (!in.read(head, sizeof(head))){ return false; }
+	return std::memcmp(head, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+TokenStream * TokenStream::load(const char * path){
+	std::unique_ptr<SourceBuffer> buf(SourceBuffer::map(path));
+	ByteReader in(buf->data(), buf->size(),
+		std::string("token stream ") + path);
+	in.skip(sizeof(MAGIC));
+	if (in.u32() != TokenStreamWriter::VERSION){
+		std::string msg = "Unsupported token stream version in ";
+		msg += path;
+		throw new InternalError(msg.c_str());
+	}
+
+	std::unique_ptr<TokenStream> stream(new TokenStream());
+	stream->myName = in.bytes().str();
+
+	uint32_t lineCount = in.u32();
+	in.fits(lineCount, 4);
+	in.check(lineCount != 0);
+	stream->myLines.reserve(lineCount);
+	for (uint32_t i = 0; i < lineCount; i++){
+		uint32_t start = in.u32();
+		uint32_t prev = i == 0 ? 0 : stream->myLines.back();
+		in.check(start >= prev);
+		stream->myLines.push_back(start);
+	}
+	in.check(stream->myLines.front() == 0);
+	stream->myEndOffset = in.u32();
+
+	uint32_t stringCount = in.u32();
+	in.fits(stringCount, 4);
+	stream->myStrings.reserve(stringCount);
+	for (uint32_t i = 0; i < stringCount; i++){
+		stream->myStrings.push_back(Symbol::intern(in.bytes()));
+	}
+
+	uint32_t tokenCount = in.u32();
+	in.fits(tokenCount, sizeof(TokenRecord));
+	stream->myTokens.reserve(tokenCount);
+	for (uint32_t i = 0; i < tokenCount; i++){
+		TokenRecord rec;
+		rec.kind = in.u32();
+		rec.begin = in.u32();
+		rec.end = in.u32();
+		rec.payload = in.u32();
+		int kind = static_cast<int>(rec.kind);
+		bool hasString = kind == TokenKind::ID
+			|| kind == TokenKind::STRLITERAL;
+		in.check(!hasString || rec.payload < stringCount);
+		in.check(kind != TokenKind::END);
+		in.check(rec.begin <= rec.end && rec.end <= stream->myEndOffset);
+		stream->myTokens.push_back(rec);
+	}
+	return stream.release();
+}
+
+}
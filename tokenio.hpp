@@ -0,0 +1,122 @@
+#ifndef CSHANTY_TOKENIO_H
+#define CSHANTY_TOKENIO_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "intern.hpp"
+#include "position.hpp"
+#include "tokens.hpp"
+
+namespace cshanty{
+
+/**
+* \class TokenWriter
+* Buffered writer for the -t text format. Each line is formatted
+* directly into a fixed buffer, without building strings per token,
+* and the buffer goes to the stream in large blocks instead of being
+* flushed after every line. Tokens must arrive in source order: the
+* writer walks the file's line table forward instead of searching it
+* for every token.
+**/
+class TokenWriter{
+public:
+	TokenWriter(std::ostream& out);
+	~TokenWriter();
+	TokenWriter(const TokenWriter&) = delete;
+	TokenWriter& operator=(const TokenWriter&) = delete;
+
+	void write(const Token * tok);
+	void writeEOF(size_t line, size_t col);
+	/** Hand everything buffered so far to the stream and flush it **/
+	void flush();
+private:
+	static const size_t CAPACITY = 1 << 16;
+	void put(const char * text, size_t len);
+	void put(const char * text);
+	void putNum(uint64_t num);
+	void putLineCol(size_t line, size_t col);
+
+	std::ostream& myOut;
+	char * myBuf;
+	size_t myLen;
+	uint32_t myFileId;
+	const SourceFile * myFile;
+	size_t myLine;
+};
+
+/** One token of a binary token stream **/
+struct TokenRecord{
+	uint32_t kind;
+	uint32_t begin;
+	uint32_t end;
+	//ID/STRLITERAL: index into the string table; INTLITERAL: value
+	uint32_t payload;
+};
+
+/**
+* \class TokenStreamWriter
+* Writes a fully scanned input in the compact binary format that
+* TokenStream loads (-b). Layout, all integers 32-bit little-endian:
+*   "CSTK" version
+*   nameLen name-bytes
+*   lineCount lineStart*
+*   endOffset
+*   stringCount (len bytes)*
+*   tokenCount (kind begin end payload)*
+* Identifier and string payloads are interned, so each distinct
+* spelling is stored once however often it occurs. Kinds are the
+* parser's token numbers; changing the token set in cshanty.yy
+* requires bumping VERSION.
+**/
+class TokenStreamWriter{
+public:
+	static const uint32_t VERSION = 1;
+
+	TokenStreamWriter(std::ostream& out);
+	void add(const Token * tok);
+	/** Write the stream for file, whose text was endOffset bytes long **/
+	void finish(uint32_t file, uint32_t endOffset);
+private:
+	std::ostream& myOut;
+	std::vector<TokenRecord> myTokens;
+	std::vector<Symbol> myStrings;
+	std::unordered_map<Symbol, uint32_t> myStringIndex;
+};
+
+/**
+* \class TokenStream
+* A token stream read back from disk. Scanning one (see the Scanner
+* constructor taking a TokenStream) replays the saved tokens with
+* their original spans, so later phases can't tell that the input
+* was never lexed. Lexical diagnostics were reported when the stream
+* was written and are not repeated.
+**/
+class TokenStream{
+public:
+	/** Does the file at path start with the token stream magic? **/
+	static bool sniff(const char * path);
+	/** Load the stream at path; throws InternalError if malformed **/
+	static TokenStream * load(const char * path);
+
+	const std::string& name() const { return myName; }
+	const std::vector<uint32_t>& lineStarts() const { return myLines; }
+	uint32_t endOffset() const { return myEndOffset; }
+	size_t size() const { return myTokens.size(); }
+	const TokenRecord& at(size_t index) const { return myTokens[index]; }
+	/** Payload of an ID or STRLITERAL record **/
+	Symbol string(uint32_t index) const { return myStrings.at(index); }
+private:
+	TokenStream(){ }
+	std::string myName;
+	std::vector<uint32_t> myLines;
+	uint32_t myEndOffset;
+	std::vector<Symbol> myStrings;
+	std::vector<TokenRecord> myTokens;
+};
+
+}
+
+#endif
@@ -6,7 +6,7 @@ namespace cshanty{
 using TokenKind = cshanty::Parser::token;
 using Lexeme = cshanty::Parser::semantic_type;
 
-static std::string tokenKindString(int tokKind){
+const char * tokenKindString(int tokKind){
 	switch(tokKind){
 		case TokenKind::END: return "EOF";
 		case TokenKind::AND: return "AND";
@@ -54,56 +54,64 @@ static std::string tokenKindString(int tokKind){
 	
 }
 
-Token::Token(Position * posIn, int kindIn)
+Token::Token(const Position& posIn, int kindIn)
   : myPos(posIn), myKind(kindIn){
 }
 
 std::string Token::toString(){
-	return tokenKindString(kind())
-	+ " " + myPos->begin();
+	return std::string(tokenKindString(kind()))
+	+ " " + myPos.begin();
+}
+
+size_t Token::line() const {
+	return myPos.line();
+}
+
+size_t Token::col() const {
+	return myPos.col();
 }
 
 int Token::kind() const { 
 	return this->myKind; 
 }
 
-Position * Token::pos() const {
+const Position& Token::pos() const {
 	return myPos;
 }
 
-IDToken::IDToken(Position * posIn, std::string vIn)
+IDToken::IDToken(const Position& posIn, Symbol vIn)
   : Token(posIn, TokenKind::ID), myValue(vIn){ 
 }
 
 std::string IDToken::toString(){
-	return tokenKindString(kind()) + ":"
-	+ myValue + " " + myPos->begin();
+	return std::string(tokenKindString(kind())) + ":"
+	+ myValue.str() + " " + myPos.begin();
 }
 
-const std::string IDToken::value() const { 
+Symbol IDToken::value() const { 
 	return this->myValue; 
 }
 
-StrToken::StrToken(Position * posIn, std::string sIn)
+StrToken::StrToken(const Position& posIn, Symbol sIn)
   : Token(posIn, TokenKind::STRLITERAL), myStr(sIn){
 }
 
 std::string StrToken::toString(){
-	return tokenKindString(kind()) + ":"
-	+ this->myStr + " " + myPos->begin();
+	return std::string(tokenKindString(kind())) + ":"
+	+ this->myStr.str() + " " + myPos.begin();
 }
 
-const std::string StrToken::str() const {
+Symbol StrToken::str() const {
 	return this->myStr;
 }
 
-IntLitToken::IntLitToken(Position * pos, int numIn)
+IntLitToken::IntLitToken(const Position& pos, int numIn)
   : Token(pos, TokenKind::INTLITERAL), myNum(numIn){}
 
 std::string IntLitToken::toString(){
-	return tokenKindString(kind()) + ":"
+	return std::string(tokenKindString(kind())) + ":"
 	+ std::to_string(this->myNum) + " "
-	+ myPos->begin();
+	+ myPos.begin();
 }
 
 int IntLitToken::num() const {
@@ -3,45 +3,49 @@
 
 #include <string>
 #include "position.hpp"
+#include "intern.hpp"
 
 namespace cshanty{
 
+/** Name of a token kind as it appears in -t output **/
+const char * tokenKindString(int tokKind);
+
 class Token{
 public:
-	Token(Position * pos, int kindIn);
+	Token(const Position& pos, int kindIn);
 	virtual std::string toString();
 	size_t line() const;
 	size_t col() const;
 	int kind() const;
-	Position * pos() const;
+	const Position& pos() const;
 protected:
-	Position * myPos;
+	Position myPos;
 private:
 	const int myKind;
 };
 
 class IDToken : public Token{
 public:
-	IDToken(Position * posIn, std::string valIn);
-	const std::string value() const;
+	IDToken(const Position& posIn, Symbol valIn);
+	Symbol value() const;
 	virtual std::string toString() override;
 private:
-	const std::string myValue;
+	const Symbol myValue;
 	
 };
 
 class StrToken : public Token{
 public:
-	StrToken(Position * posIn, std::string valIn);
+	StrToken(const Position& posIn, Symbol valIn);
 	virtual std::string toString() override;
-	const std::string str() const;
+	Symbol str() const;
 private:
-	const std::string myStr;
+	const Symbol myStr;
 };
 
 class IntLitToken : public Token{
 public:
-	IntLitToken(Position * posIn, int numIn);
+	IntLitToken(const Position& posIn, int numIn);
 	virtual std::string toString() override;
 	int num() const;
 private:
@@ -0,0 +1,337 @@
+#include "ast.hpp"
+#include "errors.hpp"
+#include "types.hpp"
+
+namespace cshanty{
+
+/*
+Type analysis runs after name analysis has resolved every name, and
+visits each node once, in order. Every expression keeps its type (see
+ExpNode::type); a declaration's type is made when the walk reaches
+it, which is before any use of it. An expression that is wrong gets
+Type::error(), and nothing more is reported about the expressions
+built on it, so each mistake is reported once. An expression nested
+more than MAX_EXP_DEPTH deep stops the analysis altogether.
+*/
+
+static const char * const ARITHMETIC =
+	"Arithmetic operator applied to invalid operand";
+static const char * const RELATIONAL =
+	"Relational operator applied to non-numeric operand";
+static const char * const LOGICAL =
+	"Logical operator applied to non-bool operand";
+
+/* Whether operand, already analyzed, has type want; if not, report
+   msg at it unless it was already wrong */
+static bool operandIs(TypeAnalysis& ta, ExpNode * operand, Type want,
+	const char * msg){
+	Type got = operand->type();
+	if (got == want){ return true; }
+	if (!got.isError()){
+		ta.error(operand->pos(), DiagId::BadOperand, msg);
+	}
+	return false;
+}
+
+/* Whether a value of type can be compared or assigned: not a
+   function, a record or a record's name, nor void */
+static bool isScalar(Type type){
+	return type.isInt() || type.isBool() || type.isString();
+}
+
+/* The shared rule for == and =: both sides scalar and the same */
+static bool sameScalars(TypeAnalysis& ta, const Position& pos,
+	ExpNode * left, ExpNode * right, const char * msg){
+	bool ok = true;
+	ExpNode * sides[] = { left, right };
+	for (ExpNode * side : sides){
+		if (!isScalar(side->type())){
+			if (!side->type().isError()){
+				ta.error(side->pos(), DiagId::BadOperand, msg);
+			}
+			ok = false;
+		}
+	}
+	if (ok && left->type() != right->type()){
+		ta.error(pos, DiagId::TypeMismatch, "Type mismatch");
+		return false;
+	}
+	return ok;
+}
+
+static void analyzeAll(NodeSpan<StmtNode> stmts, TypeAnalysis& ta){
+	for (StmtNode * stmt : stmts){ stmt->typeAnalysis(ta); }
+}
+
+static void checkCondition(TypeAnalysis& ta, ExpNode * cond,
+	const char * msg){
+	Type type = cond->typeAnalysis(ta);
+	if (!type.isBool() && !type.isError()){
+		ta.error(cond->pos(), DiagId::BadCondition, msg);
+	}
+}
+
+void ProgramNode::typeAnalysis(TypeAnalysis& ta){
+	for (DeclNode * global : myGlobals){ global->typeAnalysis(ta); }
+}
+
+void VarDeclNode::typeAnalysis(TypeAnalysis& ta){
+	myId->typeAnalysis(ta);
+}
+
+Type VarDeclNode::declType() const{ return myType->asType(); }
+
+void RecordTypeDeclNode::typeAnalysis(TypeAnalysis& ta){
+	myRecordType = ta.types().record(this);
+	for (VarDeclNode * field : variables){ field->typeAnalysis(ta); }
+	myId->typeAnalysis(ta);
+}
+
+Type RecordTypeDeclNode::declType() const{
+	return TypeTable::recordName(myRecordType);
+}
+
+void FnDeclNode::typeAnalysis(TypeAnalysis& ta){
+	std::vector<Type> formals;
+	formals.reserve(parameters.size());
+	for (FormalDeclNode * formal : parameters){
+		formals.push_back(formal->declType());
+	}
+	//Made before the body is checked, so the function can call itself
+	myFnType = ta.types().fn(myType->asType(), formals);
+	myId->typeAnalysis(ta);
+	for (FormalDeclNode * formal : parameters){ formal->typeAnalysis(ta); }
+	ta.enterFn(myFnType);
+	analyzeAll(functionBody, ta);
+}
+
+Type FnDeclNode::declType() const{ return myFnType; }
+
+Type IntTypeNode::asType() const{ return Type::intType(); }
+
+Type BoolTypeNode::asType() const{ return Type::boolType(); }
+
+Type VoidTypeNode::asType() const{ return Type::voidType(); }
+
+Type StringTypeNode::asType() const{ return Type::stringType(); }
+
+Type RecordTypeNode::asType() const{
+	//Name analysis only lets a record's name resolve here
+	RecordTypeDeclNode * decl = static_cast<RecordTypeDeclNode *>(
+		myId->decl());
+	return decl == nullptr ? Type::error() : decl->recordType();
+}
+
+Type TrueNode::computeType(TypeAnalysis&){ return Type::boolType(); }
+
+Type FalseNode::computeType(TypeAnalysis&){ return Type::boolType(); }
+
+Type StrLitNode::computeType(TypeAnalysis&){ return Type::stringType(); }
+
+Type IntLitNode::computeType(TypeAnalysis&){ return Type::intType(); }
+
+Type IDNode::computeType(TypeAnalysis&){
+	return myDecl == nullptr ? Type::error() : myDecl->declType();
+}
+
+Type IndexNode::computeType(TypeAnalysis& ta){
+	//Name analysis resolved the field to its declaration in the record
+	Id_being_accessed->typeAnalysis(ta);
+	return field_Name_being_accessed->typeAnalysis(ta);
+}
+
+Type NegNode::computeType(TypeAnalysis& ta){
+	expression->typeAnalysis(ta);
+	return operandIs(ta, expression, Type::intType(), ARITHMETIC)
+		? Type::intType() : Type::error();
+}
+
+Type NotNode::computeType(TypeAnalysis& ta){
+	expression->typeAnalysis(ta);
+	return operandIs(ta, expression, Type::boolType(), LOGICAL)
+		? Type::boolType() : Type::error();
+}
+
+Type BinaryExpNode::arithmeticType(TypeAnalysis& ta){
+	leftNode->typeAnalysis(ta);
+	rightNode->typeAnalysis(ta);
+	bool ok = operandIs(ta, leftNode, Type::intType(), ARITHMETIC);
+	ok = operandIs(ta, rightNode, Type::intType(), ARITHMETIC) && ok;
+	return ok ? Type::intType() : Type::error();
+}
+
+Type BinaryExpNode::relationalType(TypeAnalysis& ta){
+	leftNode->typeAnalysis(ta);
+	rightNode->typeAnalysis(ta);
+	bool ok = operandIs(ta, leftNode, Type::intType(), RELATIONAL);
+	ok = operandIs(ta, rightNode, Type::intType(), RELATIONAL) && ok;
+	return ok ? Type::boolType() : Type::error();
+}
+
+Type BinaryExpNode::logicalType(TypeAnalysis& ta){
+	leftNode->typeAnalysis(ta);
+	rightNode->typeAnalysis(ta);
+	bool ok = operandIs(ta, leftNode, Type::boolType(), LOGICAL);
+	ok = operandIs(ta, rightNode, Type::boolType(), LOGICAL) && ok;
+	return ok ? Type::boolType() : Type::error();
+}
+
+Type BinaryExpNode::equalityType(TypeAnalysis& ta){
+	leftNode->typeAnalysis(ta);
+	rightNode->typeAnalysis(ta);
+	return sameScalars(ta, pos(), leftNode, rightNode,
+		"Invalid equality operand") ? Type::boolType() : Type::error();
+}
+
+Type PlusNode::computeType(TypeAnalysis& ta){ return arithmeticType(ta); }
+
+Type MinusNode::computeType(TypeAnalysis& ta){ return arithmeticType(ta); }
+
+Type TimesNode::computeType(TypeAnalysis& ta){ return arithmeticType(ta); }
+
+Type DivideNode::computeType(TypeAnalysis& ta){ return arithmeticType(ta); }
+
+Type LessNode::computeType(TypeAnalysis& ta){ return relationalType(ta); }
+
+Type LessEqNode::computeType(TypeAnalysis& ta){ return relationalType(ta); }
+
+Type GreaterNode::computeType(TypeAnalysis& ta){
+	return relationalType(ta);
+}
+
+Type GreaterEqNode::computeType(TypeAnalysis& ta){
+	return relationalType(ta);
+}
+
+Type AndNode::computeType(TypeAnalysis& ta){ return logicalType(ta); }
+
+Type OrNode::computeType(TypeAnalysis& ta){ return logicalType(ta); }
+
+Type EqualsNode::computeType(TypeAnalysis& ta){ return equalityType(ta); }
+
+Type NotEqualsNode::computeType(TypeAnalysis& ta){
+	return equalityType(ta);
+}
+
+Type AssignExpNode::computeType(TypeAnalysis& ta){
+	Type dst = variable->typeAnalysis(ta);
+	expression->typeAnalysis(ta);
+	return sameScalars(ta, pos(), variable, expression,
+		"Invalid assignment operand") ? dst : Type::error();
+}
+
+Type CallExpNode::computeType(TypeAnalysis& ta){
+	Type callee = nameFunc->typeAnalysis(ta);
+	for (ExpNode * arg : arguments){ arg->typeAnalysis(ta); }
+	if (!callee.isFn()){
+		if (!callee.isError()){
+			ta.error(nameFunc->pos(), DiagId::BadCall,
+				"Attempt to call a non-function");
+		}
+		return Type::error();
+	}
+	const TypeTable& types = ta.types();
+	if (arguments.size() != types.arity(callee)){
+		ta.error(nameFunc->pos(), DiagId::BadArgCount,
+			"Function call with wrong number of args");
+	} else {
+		for (size_t i = 0; i < arguments.size(); i++){
+			Type actual = arguments[i]->type();
+			if (actual != types.formal(callee, i) && !actual.isError()){
+				ta.error(arguments[i]->pos(), DiagId::BadArg,
+					"Type of actual does not match type of formal");
+			}
+		}
+	}
+	//The call has its result type even if its arguments are wrong
+	return types.returns(callee);
+}
+
+void AssignStmtNode::typeAnalysis(TypeAnalysis& ta){
+	assignment->typeAnalysis(ta);
+}
+
+void CallStmtNode::typeAnalysis(TypeAnalysis& ta){
+	Function->typeAnalysis(ta);
+}
+
+void PostDecStmtNode::typeAnalysis(TypeAnalysis& ta){
+	variable->typeAnalysis(ta);
+	operandIs(ta, variable, Type::intType(), ARITHMETIC);
+}
+
+void PostIncStmtNode::typeAnalysis(TypeAnalysis& ta){
+	variable->typeAnalysis(ta);
+	operandIs(ta, variable, Type::intType(), ARITHMETIC);
+}
+
+void ReceiveStmtNode::typeAnalysis(TypeAnalysis& ta){
+	Type type = variable->typeAnalysis(ta);
+	const char * msg = nullptr;
+	if (type.isFn()){
+		msg = "Attempt to assign user input to function";
+	} else if (type.isRecordName()){
+		msg = "Attempt to assign user input to record name";
+	} else if (type.isRecord()){
+		msg = "Attempt to assign user input to record variable";
+	}
+	if (msg != nullptr){
+		ta.error(variable->pos(), DiagId::BadReceive, msg);
+	}
+}
+
+void ReportStmtNode::typeAnalysis(TypeAnalysis& ta){
+	Type type = expression->typeAnalysis(ta);
+	const char * msg = nullptr;
+	if (type.isFn()){
+		msg = "Attempt to output a function";
+	} else if (type.isRecordName()){
+		msg = "Attempt to output a record name";
+	} else if (type.isRecord()){
+		msg = "Attempt to output a record variable";
+	} else if (type.isVoid()){
+		msg = "Attempt to output void";
+	}
+	if (msg != nullptr){
+		ta.error(expression->pos(), DiagId::BadReport, msg);
+	}
+}
+
+void ReturnStmtNode::typeAnalysis(TypeAnalysis& ta){
+	Type ret = ta.types().returns(ta.fn());
+	if (expression == nullptr){
+		if (!ret.isVoid()){
+			ta.error(pos(), DiagId::BadReturn, "Missing return value");
+		}
+		return;
+	}
+	Type type = expression->typeAnalysis(ta);
+	if (ret.isVoid()){
+		ta.error(expression->pos(), DiagId::BadReturn,
+			"Return with a value in void function");
+	} else if (type != ret && !type.isError()){
+		ta.error(expression->pos(), DiagId::BadReturn,
+			"Bad return value");
+	}
+}
+
+void WhileStmtNode::typeAnalysis(TypeAnalysis& ta){
+	checkCondition(ta, condition,
+		"Non-bool expression used as a while condition");
+	analyzeAll(WhileBody, ta);
+}
+
+void IfStmtNode::typeAnalysis(TypeAnalysis& ta){
+	checkCondition(ta, condition,
+		"Non-bool expression used as an if condition");
+	analyzeAll(IfBody, ta);
+}
+
+void IfElseStmtNode::typeAnalysis(TypeAnalysis& ta){
+	checkCondition(ta, condition,
+		"Non-bool expression used as an if condition");
+	analyzeAll(IfTrueBody, ta);
+	analyzeAll(IfFalseBody, ta);
+}
+
+}
@@ -0,0 +1,80 @@
+#include <utility>
+#include "ast.hpp"
+#include "errors.hpp"
+#include "types.hpp"
+
+namespace cshanty{
+
+Type TypeTable::record(RecordTypeDeclNode * decl){
+	Type type(Type::Kind::Record, static_cast<uint32_t>(myRecords.size()));
+	myRecords.push_back(decl);
+	return type;
+}
+
+size_t TypeTable::SigHash::operator()(
+	const std::vector<uint32_t>& codes) const{
+	size_t hash = 0;
+	for (uint32_t code : codes){
+		hash = (hash ^ code) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+Type TypeTable::fn(Type ret, const std::vector<Type>& formals){
+	std::vector<uint32_t> key;
+	key.reserve(formals.size() + 1);
+	key.push_back(ret.code());
+	for (Type formal : formals){ key.push_back(formal.code()); }
+	auto found = myIndex.find(key);
+	if (found != myIndex.end()){
+		return Type(Type::Kind::Fn, found->second);
+	}
+	uint32_t index = static_cast<uint32_t>(mySigs.size());
+	Sig sig = { ret, static_cast<uint32_t>(myFormals.size()),
+		static_cast<uint32_t>(formals.size()) };
+	mySigs.push_back(sig);
+	myFormals.insert(myFormals.end(), formals.begin(), formals.end());
+	myIndex.emplace(std::move(key), index);
+	return Type(Type::Kind::Fn, index);
+}
+
+void TypeTable::print(std::ostream& out, Type type) const{
+	switch (type.kind()){
+	case Type::Kind::Basic: {
+		static const char * const NAMES[] = {
+			"ERROR", "void", "int", "bool", "string"
+		};
+		out << NAMES[type.index()];
+		return;
+	}
+	case Type::Kind::Record:
+		out << recordDecl(type)->id()->getName();
+		return;
+	case Type::Kind::RecordName:
+		out << "record " << myRecords[type.index()]->id()->getName();
+		return;
+	case Type::Kind::Fn:
+		out << "(";
+		for (size_t i = 0; i < arity(type); i++){
+			if (i > 0){ out << ","; }
+			print(out, formal(type, i));
+		}
+		out << ")->";
+		print(out, returns(type));
+		return;
+	}
+}
+
+void TypeAnalysis::error(const Position& pos, DiagId id, const char * msg){
+	myOk = false;
+	Report::report(Diagnostic(Severity::Fatal, id, pos, 0, 0, msg));
+}
+
+void TypeAnalysis::tooDeep(const Position& pos){
+	static const char * const msg = "Expression nested too deeply";
+	Report::report(Diagnostic(Severity::Fatal, DiagId::TooDeep, pos, 0, 0,
+		msg));
+	throw new FatalError(msg);
+}
+
+}
@@ -0,0 +1,166 @@
+#ifndef CSHANTY_TYPES_H
+#define CSHANTY_TYPES_H
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "diagnostics.hpp"
+
+namespace cshanty{
+
+class RecordTypeDeclNode;
+
+/**
+* \class Type
+* A handle to the type of an expression or declaration: one 32-bit
+* word, its kind in the top bits and an index below. The basic types
+* are fixed handles; each record and each distinct function signature
+* gets one from the TypeTable of its compilation, which hands out a
+* single handle per type, so two types are the same exactly when
+* their handles are equal.
+**/
+class Type{
+public:
+	enum class Kind : uint32_t{ Basic, Record, RecordName, Fn };
+
+	Type() : myCode(0){ }
+	/** The type of an expression that is already known to be wrong;
+	    nothing more is reported about an expression of this type **/
+	static Type error(){ return Type(Kind::Basic, 0); }
+	static Type voidType(){ return Type(Kind::Basic, 1); }
+	static Type intType(){ return Type(Kind::Basic, 2); }
+	static Type boolType(){ return Type(Kind::Basic, 3); }
+	static Type stringType(){ return Type(Kind::Basic, 4); }
+
+	Kind kind() const { return static_cast<Kind>(myCode >> INDEX_BITS); }
+	uint32_t index() const { return myCode & INDEX_MASK; }
+	uint32_t code() const { return myCode; }
+
+	bool isError() const { return myCode == 0; }
+	bool isVoid() const { return *this == voidType(); }
+	bool isInt() const { return *this == intType(); }
+	bool isBool() const { return *this == boolType(); }
+	bool isString() const { return *this == stringType(); }
+	/** The type of a variable of some record type **/
+	bool isRecord() const { return kind() == Kind::Record; }
+	/** The type of a record's own name, used as an expression **/
+	bool isRecordName() const { return kind() == Kind::RecordName; }
+	bool isFn() const { return kind() == Kind::Fn; }
+
+	bool operator==(const Type& other) const{
+		return myCode == other.myCode;
+	}
+	bool operator!=(const Type& other) const{
+		return myCode != other.myCode;
+	}
+private:
+	static const uint32_t INDEX_BITS = 30;
+	static const uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+	Type(Kind kind, uint32_t index)
+	: myCode(static_cast<uint32_t>(kind) << INDEX_BITS | index){ }
+
+	uint32_t myCode;
+
+	friend class TypeTable;
+};
+
+/**
+* \class TypeTable
+* The record and function types of one compilation. A record type is
+* made once, when type analysis reaches its declaration; a function
+* type is interned by signature, so functions taking and returning
+* the same types share one.
+**/
+class TypeTable{
+public:
+	/** A new record type for decl, with the matching record name
+	    type at the same index (see recordName) **/
+	Type record(RecordTypeDeclNode * decl);
+	/** The type of the name of the record whose variables have type
+	    record **/
+	static Type recordName(Type record){
+		return Type(Type::Kind::RecordName, record.index());
+	}
+	RecordTypeDeclNode * recordDecl(Type record) const{
+		return myRecords[record.index()];
+	}
+	/** The type of functions taking formals and returning ret **/
+	Type fn(Type ret, const std::vector<Type>& formals);
+	Type returns(Type fn) const{ return mySigs[fn.index()].ret; }
+	size_t arity(Type fn) const{ return mySigs[fn.index()].arity; }
+	/** The type of fn's index'th formal **/
+	Type formal(Type fn, size_t index) const{
+		return myFormals[mySigs[fn.index()].first + index];
+	}
+
+	/** Write type as it is spelled in the source: int, R (for a
+	    variable of record type R), (int,bool)->void **/
+	void print(std::ostream& out, Type type) const;
+private:
+	struct Sig{
+		Type ret;
+		uint32_t first;
+		uint32_t arity;
+	};
+	struct SigHash{
+		size_t operator()(const std::vector<uint32_t>& codes) const;
+	};
+
+	std::vector<RecordTypeDeclNode *> myRecords;
+	std::vector<Sig> mySigs;
+	//The formals of every signature, end to end
+	std::vector<Type> myFormals;
+	//Return type then formals, as codes, to signature index
+	std::unordered_map<std::vector<uint32_t>, uint32_t, SigHash> myIndex;
+};
+
+/** How deeply expressions may nest. Type analysis and every pass
+    after it recurse on the C++ stack at each level, so type analysis
+    gives up on a program that nests deeper (see TypeAnalysis::enterExp)
+    rather than let one of them run out of stack **/
+static const size_t MAX_EXP_DEPTH = 10000;
+
+/**
+* \class TypeAnalysis
+* What the type analysis of one program (see typeanalysis.cpp) keeps
+* between nodes: the types made so far, the function being checked,
+* how deeply nested the expression being checked is, and whether any
+* error was reported.
+**/
+class TypeAnalysis{
+public:
+	TypeAnalysis(TypeTable& types)
+	: myTypes(types), myFn(Type::error()), myDepth(0), myOk(true){ }
+
+	TypeTable& types(){ return myTypes; }
+	/** The type of the function whose body is being checked **/
+	Type fn() const { return myFn; }
+	void enterFn(Type fn){ myFn = fn; }
+	/** Go into the expression at pos. Past MAX_EXP_DEPTH, reports it
+	    as too deep and throws FatalError (see tooDeep) **/
+	void enterExp(const Position& pos){
+		if (++myDepth > MAX_EXP_DEPTH){
+			myOk = false;
+			tooDeep(pos);
+		}
+	}
+	void leaveExp(){ myDepth--; }
+
+	void error(const Position& pos, DiagId id, const char * msg);
+	bool ok() const { return myOk; }
+
+	/** Report that the expression at pos nests deeper than
+	    MAX_EXP_DEPTH, and throw FatalError **/
+	[[noreturn]] static void tooDeep(const Position& pos);
+private:
+	TypeTable& myTypes;
+	Type myFn;
+	size_t myDepth;
+	bool myOk;
+};
+
+}
+
+#endif
@@ -27,7 +27,7 @@ void ProgramNode::unparse(std::ostream& out, int indent){
 	   The loop iterates over each element in a collection
 	   without that gross i++ nonsense. 
 	 */
-	for (auto global : *myGlobals){
+	for (auto global : myGlobals){
 		/* The auto keyword tells the compiler
 		   to (try to) figure out what the
 		   type of a variable should be from 
@@ -58,8 +58,30 @@ void FormalDeclNode::unparse(std::ostream& out, int indent){
 void IDNode::unparse(std::ostream& out, int indent){
 	doIndent(out, indent);
 	out << this->name;
+	if (myDecl != nullptr){ myDecl->annotate(out); }
 }
 
+void VarDeclNode::annotate(std::ostream& out){
+	out << "{";
+	myType->unparse(out, 0);
+	out << "}";
+}
+
+void FnDeclNode::annotate(std::ostream& out){
+	out << "{";
+	const char * sep = "";
+	for (FormalDeclNode * formal : parameters){
+		out << sep;
+		formal->type()->unparse(out, 0);
+		sep = ",";
+	}
+	out << "->";
+	myType->unparse(out, 0);
+	out << "}";
+}
+
+void RecordTypeDeclNode::annotate(std::ostream&){ }
+
 void IntTypeNode::unparse(std::ostream& out, int indent){
 	doIndent(out, indent);
 	out << "int";
@@ -82,17 +104,21 @@ void StringTypeNode::unparse(std::ostream& out, int indent){
 
 void RecordTypeNode::unparse(std::ostream& out, int indent){
 	doIndent(out, indent);
-	out << this->myId;
+	this->myId->unparse(out, 0);
 }
 
 void NotNode::unparse(std::ostream& out, int indent){
 	doIndent(out, indent);
-	out << "not";
+	out << "(!";
+	this->expression->unparse(out, 0);
+	out << ")";
 }
 
 void NegNode::unparse(std::ostream& out, int indent){
 	doIndent(out, indent);
-	out << "neg";
+	out << "(-";
+	this->expression->unparse(out, 0);
+	out << ")";
 }
 
 void TrueNode::unparse(std::ostream& out, int indent){
@@ -225,10 +251,15 @@ void AndNode::unparse(std::ostream& out, int indent){
 
 void AssignExpNode::unparse(std::ostream& out, int indent){
 	doIndent(out, indent);
+	out << "(";
+	unparseAssign(out);
+	out << ")";
+}
+
+void AssignExpNode::unparseAssign(std::ostream& out){
 	this->variable->unparse(out, 0);
 	out << " = ";
 	this->expression->unparse(out, 0);
-	out << "; \n";
 }
 
 void IndexNode::unparse(std::ostream& out, int indent){
@@ -242,12 +273,13 @@ void IndexNode::unparse(std::ostream& out, int indent){
 void CallStmtNode::unparse(std::ostream& out, int indent){
 	doIndent(out, indent);
 	this->Function->unparse(out, 0);
+	out << "; \n";
 }
 
 void AssignStmtNode::unparse(std::ostream& out, int indent){
 	doIndent(out, indent);
-	this->assignment->unparse(out, 0);
-	
+	this->assignment->unparseAssign(out);
+	out << "; \n";
 }
 
 void PostDecStmtNode::unparse(std::ostream& out, int indent){
@@ -278,8 +310,11 @@ void ReportStmtNode::unparse(std::ostream& out, int indent){
 
 void ReturnStmtNode::unparse(std::ostream& out, int indent){
 	doIndent(out, indent);
-	out << "return ";
-	this->expression->unparse(out, 0);
+	out << "return";
+	if (this->expression != nullptr){
+		out << " ";
+		this->expression->unparse(out, 0);
+	}
 	out << "; \n";
 }
 
@@ -288,7 +323,7 @@ void RecordTypeDeclNode::unparse(std::ostream& out, int indent) {
 	out << "record ";
 	this->myId->unparse(out, 0);
 	out << "{\n";
-	for (auto varDeclNode: *variables) {
+	for (auto varDeclNode: variables) {
 		varDeclNode->unparse(out, indent + 1);
 	}
 	out << "\n}\n";
@@ -301,19 +336,16 @@ void FnDeclNode::unparse(std::ostream& out, int indent) {
 	this->myId->unparse(out, 0);
 	out << "(";
 	
-	if (parameters != nullptr)
+	std::string comma = "";
+	for (auto param: parameters)
 	{
-		std::string comma = "";
-		for (auto param: *parameters)
-		{
-			out << comma;
-			param->unparse(out, 0);
-			comma = ", ";
-		}
+		out << comma;
+		param->unparse(out, 0);
+		comma = ", ";
 	}
 	
 	out << ") {\n";
-	for (auto stmt: *functionBody)
+	for (auto stmt: functionBody)
 	{
 		stmt->unparse(out, indent + 1);
 	}
@@ -325,7 +357,7 @@ void IfStmtNode::unparse(std::ostream& out, int indent) {
 	out << "if (";
 	this->condition->unparse(out, 0); 
 	out << ") {\n";
-	for (auto stmt: *IfBody)
+	for (auto stmt: IfBody)
 	{
 		stmt->unparse(out, indent);
 	}
@@ -337,12 +369,12 @@ void IfElseStmtNode::unparse(std::ostream& out, int indent) {
 	out << "if (";
 	this->condition->unparse(out, 0); 
 	out << ") {\n";
-	for (auto stmt: *IfTrueBody)
+	for (auto stmt: IfTrueBody)
 	{
 		stmt->unparse(out, indent + 1);
 	}
 	out << "\n}\n else {\n";
-	for (auto stmt: *IfFalseBody)
+	for (auto stmt: IfFalseBody)
 	{
 		stmt->unparse(out, indent + 1);
 	}
@@ -354,7 +386,7 @@ void WhileStmtNode::unparse(std::ostream& out, int indent) {
 	out << "while ("; 
 	this->condition->unparse(out, 0); 
 	out << ") {\n";
-	for (auto stmt: *WhileBody)
+	for (auto stmt: WhileBody)
 	{
 		stmt->unparse(out, indent + 1);
 	}
@@ -365,13 +397,13 @@ void CallExpNode::unparse(std::ostream& out, int indent) {
 	doIndent(out, indent);
 	this->nameFunc->unparse(out, 0); 
 	out << "(";
-	if (!(arguments == nullptr))
-	{
-		for (auto args: *arguments) {
-			args->unparse(out, 0);
-		}
+	std::string comma = "";
+	for (auto args: arguments) {
+		out << comma;
+		args->unparse(out, 0);
+		comma = ", ";
 	}
-	out << ");\n";
+	out << ")";
 }
 
 } // End namespace cshanty
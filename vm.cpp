@@ -0,0 +1,297 @@
+#include <algorithm>
+#include "arith.hpp"
+#include "errors.hpp"
+#include "interp.hpp"
+#include "vm.hpp"
+
+namespace cshanty{
+
+/*
+The VM keeps the running function's registers in R, a window onto one
+big stack, and its next instruction in pc. Where the compiler supports
+it (GCC and Clang), each instruction ends by jumping straight to the
+code for the next through a table of label addresses, so every
+instruction has its own indirect branch for the CPU to predict;
+elsewhere one switch does the dispatch.
+
+A call checks for stack overflow exactly as the interpreter does: it
+counts the calls in progress and the slots of their frames' locals
+against the interpreter's limits, so a program that runs out of stack
+stops at the same call either way. The VM's own frames, which also
+hold temporaries, come from a stack large enough that those limits
+are reached first.
+*/
+
+#if defined(__GNUC__)
+#define CSHANTY_THREADED 1
+#else
+#define CSHANTY_THREADED 0
+#endif
+
+//The interpreter's limit on the slots in use, and the VM's stack
+static const size_t FRAME_SLOTS = 1 << 20;
+static const size_t STACK_SLOTS = 1 << 22;
+
+VM::VM(const Bytecode& code, std::istream& in, std::ostream& out)
+: myCode(code), myIn(in), myOut(out), myGlobals(code.globals()),
+  //Left uninitialized: only the pages a program reaches are touched
+  myStack(new Slot[STACK_SLOTS]){
+	myReturns.reserve(MAX_CALL_DEPTH);
+}
+
+static int32_t asInt(const Slot& slot){
+	return static_cast<int32_t>(slot.i);
+}
+
+void VM::receive(Op op, Slot& slot, const Position& pos){
+	Type type = op == Op::READS ? Type::stringType()
+		: op == Op::READB ? Type::boolType() : Type::intType();
+	Value value;
+	myOut.flush();
+	const char * msg = Value::read(myIn, type, value);
+	if (msg != nullptr){ fail(pos, msg); }
+	slot.i = 0;
+	if (op == Op::READS){ slot.s = value.s; }
+	else if (op == Op::READB){ slot.i = value.b ? 1 : 0; }
+	else { slot.i = value.i; }
+}
+
+void VM::fail(const Position& pos, const char * msg){
+	myOut.flush();
+	Report::report(Diagnostic(Severity::Fatal, DiagId::RuntimeError, pos,
+		0, 0, msg));
+	throw new FatalError(msg);
+}
+
+#if CSHANTY_THREADED
+//Labels as values are a GNU extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+void VM::run(){
+	const std::vector<VMFunction>& fns = myCode.functions();
+	const Slot * K = myCode.constants().data();
+	Slot * G = myGlobals.data();
+	Slot * limit = myStack.get() + STACK_SLOTS;
+	const VMFunction * fn = &fns[myCode.main()];
+	const Instr * code = fn->code().data();
+	const Instr * pc = code;
+	Slot * R = myStack.get();
+	//The slots the interpreter would have in use
+	size_t used = fn->locals();
+	Slot result;
+	myReturns.clear();
+
+#if CSHANTY_THREADED
+	static void * const LABELS[] = {
+		&&op_LOADK, &&op_MOVE, &&op_GET, &&op_SET, &&op_ADDR, &&op_GADDR,
+		&&op_COPY, &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_ADDK,
+		&&op_SUBK, &&op_MULK, &&op_DIVK, &&op_NEG, &&op_NOT, &&op_INC,
+		&&op_DEC, &&op_LT, &&op_LE, &&op_GT, &&op_GE, &&op_EQ, &&op_NE,
+		&&op_JMP, &&op_JMPF, &&op_JMPT, &&op_JLT, &&op_JLE, &&op_JGT,
+		&&op_JGE, &&op_JEQ, &&op_JNE, &&op_JLTK, &&op_JLEK, &&op_JGTK,
+		&&op_JGEK, &&op_JEQK, &&op_JNEK, &&op_RESERVE,
+		&&op_CALL, &&op_CALLR, &&op_RET, &&op_RETV, &&op_NORET,
+		&&op_PRINTI, &&op_PRINTB, &&op_PRINTS, &&op_READI, &&op_READB,
+		&&op_READS
+	};
+	static_assert(sizeof(LABELS) / sizeof(LABELS[0]) == NUM_OPS,
+		"Every op needs a label");
+#define NEXT goto *LABELS[static_cast<size_t>(pc->op)]
+#define CASE(name) op_##name
+	NEXT;
+#else
+#define NEXT goto dispatch
+#define CASE(name) case Op::name
+dispatch:
+	switch (pc->op){
+#endif
+
+	CASE(LOADK): R[pc->a] = K[pc->k()]; pc++; NEXT;
+	CASE(MOVE): R[pc->a] = R[pc->b()]; pc++; NEXT;
+	CASE(GET): R[pc->a] = G[pc->k()]; pc++; NEXT;
+	CASE(SET): G[pc->k()] = R[pc->a]; pc++; NEXT;
+	CASE(ADDR): R[pc->a].p = R + pc->b(); pc++; NEXT;
+	CASE(GADDR): R[pc->a].p = G + pc->k(); pc++; NEXT;
+	CASE(COPY):
+		std::copy(R[pc->b()].p, R[pc->b()].p + pc->c(), R + pc->a);
+		pc++;
+		NEXT;
+
+	CASE(ADD):
+		R[pc->a].i = satAdd(asInt(R[pc->b()]), asInt(R[pc->c()]));
+		pc++;
+		NEXT;
+	CASE(SUB):
+		R[pc->a].i = satSub(asInt(R[pc->b()]), asInt(R[pc->c()]));
+		pc++;
+		NEXT;
+	CASE(MUL):
+		R[pc->a].i = satMul(asInt(R[pc->b()]), asInt(R[pc->c()]));
+		pc++;
+		NEXT;
+	CASE(DIV):
+		if (R[pc->c()].i == 0){
+			fail(fn->where()[static_cast<size_t>(pc - code)],
+				"Division by zero");
+		}
+		R[pc->a].i = satDiv(asInt(R[pc->b()]), asInt(R[pc->c()]));
+		pc++;
+		NEXT;
+	CASE(ADDK):
+		R[pc->a].i = satAdd(asInt(R[pc->b()]), asInt(K[pc->c()]));
+		pc++;
+		NEXT;
+	CASE(SUBK):
+		R[pc->a].i = satSub(asInt(R[pc->b()]), asInt(K[pc->c()]));
+		pc++;
+		NEXT;
+	CASE(MULK):
+		R[pc->a].i = satMul(asInt(R[pc->b()]), asInt(K[pc->c()]));
+		pc++;
+		NEXT;
+	CASE(DIVK):
+		if (K[pc->c()].i == 0){
+			fail(fn->where()[static_cast<size_t>(pc - code)],
+				"Division by zero");
+		}
+		R[pc->a].i = satDiv(asInt(R[pc->b()]), asInt(K[pc->c()]));
+		pc++;
+		NEXT;
+	CASE(NEG): R[pc->a].i = satNeg(asInt(R[pc->b()])); pc++; NEXT;
+	CASE(NOT): R[pc->a].i = R[pc->b()].i == 0; pc++; NEXT;
+	CASE(INC): R[pc->a].i = satAdd(asInt(R[pc->a]), 1); pc++; NEXT;
+	CASE(DEC): R[pc->a].i = satSub(asInt(R[pc->a]), 1); pc++; NEXT;
+
+	CASE(LT): R[pc->a].i = R[pc->b()].i < R[pc->c()].i; pc++; NEXT;
+	CASE(LE): R[pc->a].i = R[pc->b()].i <= R[pc->c()].i; pc++; NEXT;
+	CASE(GT): R[pc->a].i = R[pc->b()].i > R[pc->c()].i; pc++; NEXT;
+	CASE(GE): R[pc->a].i = R[pc->b()].i >= R[pc->c()].i; pc++; NEXT;
+	CASE(EQ): R[pc->a].i = R[pc->b()].i == R[pc->c()].i; pc++; NEXT;
+	CASE(NE): R[pc->a].i = R[pc->b()].i != R[pc->c()].i; pc++; NEXT;
+
+	CASE(JMP): pc = code + pc->k(); NEXT;
+	CASE(JMPF): pc = R[pc->a].i == 0 ? code + pc->k() : pc + 1; NEXT;
+	CASE(JMPT): pc = R[pc->a].i != 0 ? code + pc->k() : pc + 1; NEXT;
+	CASE(JLT):
+		pc = R[pc->a].i < R[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+	CASE(JLE):
+		pc = R[pc->a].i <= R[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+	CASE(JGT):
+		pc = R[pc->a].i > R[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+	CASE(JGE):
+		pc = R[pc->a].i >= R[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+	CASE(JEQ):
+		pc = R[pc->a].i == R[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+	CASE(JNE):
+		pc = R[pc->a].i != R[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+
+	CASE(JLTK):
+		pc = R[pc->a].i < K[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+	CASE(JLEK):
+		pc = R[pc->a].i <= K[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+	CASE(JGTK):
+		pc = R[pc->a].i > K[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+	CASE(JGEK):
+		pc = R[pc->a].i >= K[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+	CASE(JEQK):
+		pc = R[pc->a].i == K[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+	CASE(JNEK):
+		pc = R[pc->a].i != K[pc->b()].i ? code + pc->c() : pc + 1;
+		NEXT;
+
+	CASE(RESERVE):
+	CASE(CALL):
+		{
+			//The checks Interpreter::reserve makes
+			uint32_t locals = fns[pc->b()].locals();
+			if (FRAME_SLOTS - used < locals
+			  || myReturns.size() + 1 == MAX_CALL_DEPTH){
+				fail(fn->where()[static_cast<size_t>(pc - code)],
+					"Stack overflow");
+			}
+			used += locals;
+			if (pc->op == Op::RESERVE){
+				pc++;
+				NEXT;
+			}
+		}
+		//Fall through
+	CASE(CALLR):
+		{
+			const VMFunction * callee = &fns[pc->b()];
+			Slot * frame = R + pc->a;
+			if (static_cast<size_t>(limit - frame) < callee->registers()){
+				fail(fn->where()[static_cast<size_t>(pc - code)],
+					"Stack overflow");
+			}
+			Return back = { pc + 1, R, fn, pc->c() };
+			myReturns.push_back(back);
+			R = frame;
+			fn = callee;
+			code = fn->code().data();
+			pc = code;
+			NEXT;
+		}
+	CASE(RET):
+		result = R[pc->a];
+		goto leave;
+	CASE(RETV):
+		result.i = 0;
+		goto leave;
+	CASE(NORET):
+		fail(fn->where()[static_cast<size_t>(pc - code)],
+			"Missing return value");
+
+	CASE(PRINTI): myOut << asInt(R[pc->a]); pc++; NEXT;
+	CASE(PRINTB): myOut << (R[pc->a].i ? "true" : "false"); pc++; NEXT;
+	CASE(PRINTS): myOut << R[pc->a].s; pc++; NEXT;
+	CASE(READI):
+	CASE(READB):
+	CASE(READS):
+		receive(pc->op, R[pc->a],
+			fn->where()[static_cast<size_t>(pc - code)]);
+		pc++;
+		NEXT;
+
+#if !CSHANTY_THREADED
+	}
+#endif
+
+leave:
+	used -= fn->locals();
+	if (myReturns.empty()){
+		myOut.flush();
+		return;
+	}
+	{
+		const Return& back = myReturns.back();
+		R = back.frame;
+		fn = back.fn;
+		code = fn->code().data();
+		pc = back.pc;
+		if (back.dst != NO_REG){ R[back.dst] = result; }
+	}
+	myReturns.pop_back();
+	NEXT;
+#undef NEXT
+#undef CASE
+}
+
+#if CSHANTY_THREADED
+#pragma GCC diagnostic pop
+#endif
+
+}
@@ -0,0 +1,51 @@
+#ifndef CSHANTY_VM_H
+#define CSHANTY_VM_H
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "bytecode.hpp"
+
+namespace cshanty{
+
+/**
+* \class VM
+* Runs a program compiled to bytecode (see vm.cpp). It does what the
+* Interpreter does, with the same output and the same runtime errors
+* at the same positions, but dispatches on one flat array of
+* instructions per function instead of walking the tree. Frames are
+* windows onto one stack allocated up front, so a call is a pointer
+* bump and never allocates.
+**/
+class VM{
+public:
+	VM(const Bytecode& code, std::istream& in, std::ostream& out);
+
+	/** Call main. Throws FatalError, having reported it, if the
+	    program fails **/
+	void run();
+private:
+	/* Where to go back to when the running function returns */
+	struct Return{
+		const Instr * pc;
+		Slot * frame;
+		const VMFunction * fn;
+		uint16_t dst;
+	};
+
+	/* Read a word of input for READI, READB or READS into slot */
+	void receive(Op op, Slot& slot, const Position& pos);
+	[[noreturn]] void fail(const Position& pos, const char * msg);
+
+	const Bytecode& myCode;
+	std::istream& myIn;
+	std::ostream& myOut;
+	std::vector<Slot> myGlobals;
+	std::unique_ptr<Slot[]> myStack;
+	std::vector<Return> myReturns;
+};
+
+}
+
+#endif
@@ -0,0 +1,1126 @@
+#include <algorithm>
+#include "ast.hpp"
+#include "diagnostics.hpp"
+#include "errors.hpp"
+#include "interp.hpp"
+#include "x86.hpp"
+
+namespace cshanty{
+
+/*
+Each IR function becomes one assembly function, called as the System V
+ABI calls a C function: its arguments in rdi, rsi, rdx, rcx, r8 and r9
+and then on the stack, its result in rax. A function that returns a
+record takes the address to copy it to as a first argument before the
+others, as the IR's call passes it, keeps it in its frame and returns
+it.
+
+Values live where LinearScan puts them. rax, rcx, rdx and r11 are
+never handed out: the code for one instruction works in them, and the
+moves on the way into a block, a call or a function break their cycles
+through rax. The registers a call clobbers go to values that don't
+live across one, and those it leaves alone to values that do, which
+the function saves on the way in. Some values get no location at
+all: constants and the addresses of globals, of strings and of the
+frame are made again wherever they are used, a compare that just
+decides the branch after it only sets the flags, and a value nothing
+uses is dropped once made.
+
+The frame, from rsp up: the stack arguments of the calls it makes,
+the spill slots, the address a record result goes to, and the IR's
+frame for records; then the saved registers and the return address.
+Every slot is 8 bytes; an int or bool is the low 32 bits of its slot
+or register.
+
+The program runs on a stack of its own, big enough for the deepest
+nest of calls the interpreter allows, and counts the slots the
+interpreter's frames would take, so it runs out of stack exactly where
+the interpreter would. Runtime errors print the interpreter's message
+and exit with 1.
+*/
+
+static const uint32_t RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4,
+	RBP = 5, RSI = 6, RDI = 7, R8 = 8, R9 = 9, R10 = 10, R11 = 11,
+	R12 = 12, R13 = 13, R14 = 14, R15 = 15;
+
+static const char * const REGS64[] = {
+	"%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+	"%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"
+};
+
+static const char * const REGS32[] = {
+	"%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi",
+	"%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d"
+};
+
+static const uint32_t ARGS[] = { RDI, RSI, RDX, RCX, R8, R9 };
+static const size_t REG_ARGS = 6;
+
+//As the interpreter: the slots every frame in use may take, and the
+// calls that may be in progress, at most
+static const uint64_t FRAME_SLOTS = 1 << 20;
+
+static const char * reg64(uint32_t reg){ return REGS64[reg]; }
+static const char * reg32(uint32_t reg){ return REGS32[reg]; }
+
+static std::string rsp(uint32_t offset){
+	return std::to_string(offset) + "(%rsp)";
+}
+
+static bool wide(IRType type){
+	return type == IRType::String || type == IRType::Addr;
+}
+
+static bool isCompare(IROp op){
+	return op >= IROp::Lt && op <= IROp::Ne;
+}
+
+static const char * condition(IROp op){
+	switch (op){
+	case IROp::Lt: return "l";
+	case IROp::Le: return "le";
+	case IROp::Gt: return "g";
+	case IROp::Ge: return "ge";
+	case IROp::Eq: return "e";
+	case IROp::Ne: return "ne";
+	default: break;
+	}
+	throw new InternalError("Not a compare");
+}
+
+static const char * invert(const char * cc){
+	static const char * const PAIRS[][2] = {
+		{"l", "ge"}, {"le", "g"}, {"g", "le"}, {"ge", "l"},
+		{"e", "ne"}, {"ne", "e"}
+	};
+	for (const auto& pair : PAIRS){
+		if (std::string(pair[0]) == cc){ return pair[1]; }
+	}
+	throw new InternalError("Bad condition");
+}
+
+/* The runtime report, receive and failures call, written as if it
+   were C: its functions keep rbx, rbp and r12-r15, and those that fail
+   don't return */
+static const char * const RUNTIME = R"(
+cs_report_int:
+	subq $8, %rsp
+	movl %edi, %esi
+	leaq .Lfmt_int(%rip), %rdi
+	xorl %eax, %eax
+	call printf@PLT
+	addq $8, %rsp
+	ret
+
+cs_report_bool:
+	leaq .Lfalse(%rip), %rax
+	leaq .Ltrue(%rip), %rcx
+	testl %edi, %edi
+	cmovne %rcx, %rax
+	movq %rax, %rdi
+cs_report_string:
+	subq $8, %rsp
+	movq stdout@GOTPCREL(%rip), %rax
+	movq (%rax), %rsi
+	call fputs@PLT
+	addq $8, %rsp
+	ret
+
+# Whether the strings at rdi and rsi are equal
+cs_streq:
+	movl $1, %eax
+	cmpq %rsi, %rdi
+	je 1f
+	subq $8, %rsp
+	call strcmp@PLT
+	addq $8, %rsp
+	testl %eax, %eax
+	sete %al
+	movzbl %al, %eax
+1:	ret
+
+# Write the position rdi and then the message rsi to stderr, as the
+# interpreter reports a runtime error, and exit with 1
+cs_fail:
+	pushq %rbx
+	pushq %r12
+	subq $8, %rsp
+	movq %rdi, %rbx
+	movq %rsi, %r12
+	movq stdout@GOTPCREL(%rip), %rax
+	movq (%rax), %rdi
+	call fflush@PLT
+	movq stderr@GOTPCREL(%rip), %rax
+	movq (%rax), %rsi
+	movq %rbx, %rdi
+	call fputs@PLT
+	movq stderr@GOTPCREL(%rip), %rax
+	movq (%rax), %rsi
+	movq %r12, %rdi
+	call fputs@PLT
+	movq stderr@GOTPCREL(%rip), %rax
+	movq (%rax), %rsi
+	movl $10, %edi
+	call fputc@PLT
+	movl $1, %edi
+	call exit@PLT
+
+# The next word of input, failing at the position rdi if there is none
+cs_read_word:
+	pushq %rbx
+	subq $16, %rsp
+	movq %rdi, %rbx
+	movq stdout@GOTPCREL(%rip), %rax
+	movq (%rax), %rdi
+	call fflush@PLT
+	leaq .Lfmt_word(%rip), %rdi
+	movq %rsp, %rsi
+	xorl %eax, %eax
+	call __isoc99_scanf@PLT
+	cmpl $1, %eax
+	jne 1f
+	movq (%rsp), %rax
+	addq $16, %rsp
+	popq %rbx
+	ret
+1:	movq %rbx, %rdi
+	leaq .Lmsg_no_input(%rip), %rsi
+	call cs_fail
+
+# An int of input, clamped to the range of an int
+cs_receive_int:
+	pushq %rbx
+	pushq %r12
+	subq $8, %rsp
+	movq %rdi, %r12
+	call cs_read_word
+	movq %rax, %rbx
+	movq %rax, %rcx
+	xorl %r8d, %r8d
+	cmpb $45, (%rcx)
+	jne 1f
+	movl $1, %r8d
+	incq %rcx
+1:	cmpb $0, (%rcx)
+	je 4f
+	xorl %eax, %eax
+	movl $2147483648, %r9d
+2:	movzbl (%rcx), %edx
+	testl %edx, %edx
+	je 3f
+	subl $48, %edx
+	cmpl $9, %edx
+	ja 4f
+	imulq $10, %rax
+	addq %rdx, %rax
+	cmpq %r9, %rax
+	cmova %r9, %rax
+	incq %rcx
+	jmp 2b
+3:	testl %r8d, %r8d
+	je 5f
+	negq %rax
+	jmp 6f
+5:	movl $2147483647, %edx
+	cmpq %rdx, %rax
+	cmova %rdx, %rax
+6:	movq %rax, %r12
+	movq %rbx, %rdi
+	call free@PLT
+	movl %r12d, %eax
+	addq $8, %rsp
+	popq %r12
+	popq %rbx
+	ret
+4:	movq %r12, %rdi
+	leaq .Lmsg_not_int(%rip), %rsi
+	call cs_fail
+
+# A bool of input: true, aye or 1, or false, nay or 0
+cs_receive_bool:
+	pushq %rbx
+	pushq %r12
+	pushq %r13
+	movq %rdi, %r12
+	call cs_read_word
+	movq %rax, %rbx
+	leaq .Lbools(%rip), %r13
+1:	movq (%r13), %rsi
+	testq %rsi, %rsi
+	je 2f
+	movq %rbx, %rdi
+	call strcmp@PLT
+	addq $16, %r13
+	testl %eax, %eax
+	jne 1b
+	movq %rbx, %rdi
+	call free@PLT
+	movl -8(%r13), %eax
+	popq %r13
+	popq %r12
+	popq %rbx
+	ret
+2:	movq %r12, %rdi
+	leaq .Lmsg_not_bool(%rip), %rsi
+	call cs_fail
+)";
+
+static const char * const RUNTIME_DATA = R"(.Lfmt_int:
+	.string "%d"
+.Lfmt_word:
+	.string " %ms"
+.Ltrue:
+	.string "true"
+.Lfalse:
+	.string "false"
+.Laye:
+	.string "aye"
+.Lnay:
+	.string "nay"
+.Lone:
+	.string "1"
+.Lzero:
+	.string "0"
+cs_empty:
+	.string ""
+.Lmsg_div:
+	.string "Division by zero"
+.Lmsg_overflow:
+	.string "Stack overflow"
+.Lmsg_no_return:
+	.string "Missing return value"
+.Lmsg_no_input:
+	.string "No input left to receive"
+.Lmsg_not_int:
+	.string "Input is not an int"
+.Lmsg_not_bool:
+	.string "Input is not a bool"
+
+	.section .data.rel.ro.local,"aw"
+	.p2align 3
+.Lbools:
+	.quad .Ltrue, 1, .Laye, 1, .Lone, 1
+	.quad .Lfalse, 0, .Lnay, 0, .Lzero, 0
+	.quad 0, 0
+
+	.bss
+	.p2align 3
+cs_used:
+	.zero 8
+cs_depth:
+	.zero 8
+)";
+
+/* text as the operand of .string */
+static void quote(std::ostream& out, const std::string& text){
+	static const char * const DIGITS = "01234567";
+	out << '"';
+	for (char c : text){
+		unsigned char byte = static_cast<unsigned char>(c);
+		if (c == '"' || c == '\\'){
+			out << '\\' << c;
+		} else if (byte < 0x20 || byte >= 0x7f){
+			out << '\\' << DIGITS[byte >> 6] << DIGITS[(byte >> 3) & 7]
+				<< DIGITS[byte & 7];
+		} else {
+			out << c;
+		}
+	}
+	out << '"';
+}
+
+/* The arguments a call passes, leaving out the reserve that took its
+   frame, if there is one */
+static uint32_t arguments(const IRFunction& fn, ValueId call){
+	uint32_t count = fn.instr(call).count;
+	if (count > 0 && fn.instr(fn.operand(call, count - 1)).op
+	  == IROp::Reserve){
+		return count - 1;
+	}
+	return count;
+}
+
+static bool reserved(const IRFunction& fn, ValueId call){
+	return arguments(fn, call) != fn.instr(call).count;
+}
+
+/* Whether fn returns a record, through an address it is passed */
+static bool returnsRecord(const IRFunction& fn){
+	return fn.decl()->retType()->asType().isRecord();
+}
+
+std::string X86Writer::Place::text() const{
+	switch (kind){
+	case Kind::Reg: return reg64(reg);
+	case Kind::Imm: return "$" + std::to_string(disp);
+	case Kind::Mem: case Kind::Lea:
+		if (sym.empty()){ return std::to_string(disp) + "(%rsp)"; }
+		if (disp == 0){ return sym + "(%rip)"; }
+		return sym + (disp < 0 ? "" : "+") + std::to_string(disp) + "(%rip)";
+	}
+	throw new InternalError("Bad place");
+}
+
+bool X86Writer::Place::operator==(const Place& other) const{
+	if (kind != other.kind){ return false; }
+	if (kind == Kind::Reg){ return reg == other.reg; }
+	return sym == other.sym && disp == other.disp;
+}
+
+X86Writer::X86Writer(const IRProgram& program, std::ostream& out)
+: myProgram(program), myOut(out), myAt(&out), myFn(nullptr), myIndex(0),
+  mySpillBase(0), myDestSlot(0), myFrameBase(0), myFrameBytes(0),
+  myLabels(0), myMaxFrame(0){
+}
+
+std::string X86Writer::label(BlockId block) const{
+	return ".LF" + std::to_string(myIndex) + "_" + std::to_string(block);
+}
+
+std::string X86Writer::newLabel(){
+	return ".LF" + std::to_string(myIndex) + "_L" + std::to_string(myLabels++);
+}
+
+std::string X86Writer::prefix(const Position& pos){
+	//What the interpreter writes before its message, as Report would
+	// write it
+	std::ostringstream text;
+	Diagnostic(Severity::Fatal, DiagId::RuntimeError, pos, 0, 0, "")
+		.writeText(text);
+	std::string line = text.str();
+	line.pop_back();
+	auto found = myPrefixes.find(line);
+	if (found != myPrefixes.end()){ return found->second; }
+	std::string name = ".Lpos" + std::to_string(myPrefixes.size());
+	myPrefixes[line] = name;
+	myPrefixOrder.push_back(std::make_pair(name, line));
+	return name;
+}
+
+std::string X86Writer::fail(const Position& pos, const char * msg){
+	std::string name = newLabel();
+	myTail << name << ":\n"
+		<< "\tleaq " << prefix(pos) << "(%rip), %rdi\n"
+		<< "\tleaq " << msg << "(%rip), %rsi\n"
+		<< "\tcall cs_fail\n";
+	return name;
+}
+
+std::string X86Writer::string(int32_t index){
+	size_t at = static_cast<size_t>(index);
+	if (myStrings.size() <= at){ myStrings.resize(at + 1, false); }
+	myStrings[at] = true;
+	return ".Lstr" + std::to_string(index);
+}
+
+X86Writer::Place X86Writer::place(ValueId v){
+	const IRInstr& instr = myFn->instr(v);
+	Place p;
+	p.reg = 0;
+	p.disp = 0;
+	if (myRemat[v]){
+		p.kind = Place::Kind::Lea;
+		switch (instr.op){
+		case IROp::Const:
+			if (instr.type == IRType::String){
+				p.sym = string(instr.imm);
+			} else {
+				p.kind = Place::Kind::Imm;
+				p.disp = instr.imm;
+			}
+			return p;
+		case IROp::GAddr:
+			p.sym = "cs_globals";
+			p.disp = 8 * static_cast<int64_t>(instr.imm);
+			return p;
+		case IROp::Addr:
+			p.disp = myFrameBase + 8 * static_cast<int64_t>(instr.imm);
+			return p;
+		case IROp::Offset:
+			p = place(myFn->operand(v, 0));
+			p.disp += 8 * static_cast<int64_t>(instr.imm);
+			return p;
+		default:
+			throw new InternalError("Can't make this value again");
+		}
+	}
+	const Location& at = myAlloc->where(v);
+	switch (at.kind){
+	case Location::Kind::Reg:
+		p.kind = Place::Kind::Reg;
+		p.reg = at.index;
+		return p;
+	case Location::Kind::Spill:
+		p.kind = Place::Kind::Mem;
+		p.disp = mySpillBase + 8 * static_cast<int64_t>(at.index);
+		return p;
+	case Location::Kind::None:
+		break;
+	}
+	throw new InternalError("Value used but not kept");
+}
+
+uint32_t X86Writer::target(ValueId v){
+	const Location& at = myAlloc->where(v);
+	return at.kind == Location::Kind::Reg ? at.index : RAX;
+}
+
+void X86Writer::keep(ValueId v, uint32_t reg){
+	const Location& at = myAlloc->where(v);
+	if (at.kind == Location::Kind::None){ return; }
+	Place from;
+	from.kind = Place::Kind::Reg;
+	from.reg = reg;
+	from.disp = 0;
+	move(place(v), from);
+}
+
+void X86Writer::get(ValueId v, uint32_t reg){
+	Place to;
+	to.kind = Place::Kind::Reg;
+	to.reg = reg;
+	to.disp = 0;
+	move(to, place(v));
+}
+
+std::string X86Writer::src32(ValueId v){
+	Place p = place(v);
+	if (p.kind == Place::Kind::Reg){ return reg32(p.reg); }
+	return p.text();
+}
+
+std::string X86Writer::address(ValueId v, int32_t slots){
+	Place p = place(v);
+	switch (p.kind){
+	case Place::Kind::Lea:
+		p.disp += 8 * static_cast<int64_t>(slots);
+		return p.text();
+	case Place::Kind::Reg:
+		return std::to_string(8 * static_cast<int64_t>(slots)) + "("
+			+ reg64(p.reg) + ")";
+	case Place::Kind::Mem:
+		out() << "\tmovq " << p.text() << ", %r11\n";
+		return std::to_string(8 * static_cast<int64_t>(slots)) + "(%r11)";
+	case Place::Kind::Imm:
+		break;
+	}
+	throw new InternalError("Not an address");
+}
+
+void X86Writer::move(const Place& to, const Place& from){
+	if (to == from){ return; }
+	if (to.kind == Place::Kind::Reg){
+		switch (from.kind){
+		case Place::Kind::Imm:
+			out() << "\tmovl " << from.text() << ", " << reg32(to.reg) << "\n";
+			return;
+		case Place::Kind::Lea:
+			out() << "\tleaq " << from.text() << ", " << to.text() << "\n";
+			return;
+		default:
+			out() << "\tmovq " << from.text() << ", " << to.text() << "\n";
+			return;
+		}
+	}
+	switch (from.kind){
+	case Place::Kind::Reg: case Place::Kind::Imm:
+		out() << "\tmovq " << from.text() << ", " << to.text() << "\n";
+		return;
+	case Place::Kind::Lea:
+		out() << "\tleaq " << from.text() << ", %r11\n";
+		break;
+	case Place::Kind::Mem:
+		out() << "\tmovq " << from.text() << ", %r11\n";
+		break;
+	}
+	out() << "\tmovq %r11, " << to.text() << "\n";
+}
+
+void X86Writer::parallel(std::vector<Move> moves){
+	moves.erase(std::remove_if(moves.begin(), moves.end(),
+		[](const Move& m){ return m.to == m.from; }), moves.end());
+	while (!moves.empty()){
+		//A move whose destination no other move still has to read
+		bool moved = false;
+		for (size_t i = 0; i < moves.size() && !moved; i++){
+			bool read = false;
+			for (size_t j = 0; j < moves.size(); j++){
+				if (j != i && moves[j].from == moves[i].to){ read = true; }
+			}
+			if (!read){
+				move(moves[i].to, moves[i].from);
+				moves.erase(moves.begin() + static_cast<std::ptrdiff_t>(i));
+				moved = true;
+			}
+		}
+		if (moved){ continue; }
+		//Every destination is read: the moves left are cycles. Save one
+		// destination in rax and read it from there
+		Place save;
+		save.kind = Place::Kind::Reg;
+		save.reg = RAX;
+		save.disp = 0;
+		move(save, moves[0].to);
+		Place was = moves[0].to;
+		for (Move& m : moves){
+			if (m.from == was){ m.from = save; }
+		}
+	}
+}
+
+
+void X86Writer::function(size_t index){
+	const IRFunction& fn = myProgram.functions()[index];
+	myFn = &fn;
+	myIndex = index;
+	myLabels = 0;
+	size_t count = fn.instrs().size();
+
+	std::vector<uint32_t> uses(count, 0);
+	for (ValueId v = 0; v < count; v++){
+		for (uint32_t i = 0; i < fn.instr(v).count; i++){
+			uses[fn.operand(v, i)]++;
+		}
+	}
+	//A value comes after the values it uses, but for phis, which are
+	// never made again
+	myRemat.assign(count, false);
+	for (ValueId v = 0; v < count; v++){
+		IROp op = fn.instr(v).op;
+		myRemat[v] = op == IROp::Const || op == IROp::GAddr
+			|| op == IROp::Addr
+			|| (op == IROp::Offset && myRemat[fn.operand(v, 0)]);
+	}
+	myFused.assign(count, false);
+	for (const IRBlock& block : fn.blocks()){
+		for (size_t i = 0; i + 1 < block.code.size(); i++){
+			ValueId v = block.code[i];
+			ValueId next = block.code[i + 1];
+			const IRInstr& instr = fn.instr(v);
+			myFused[v] = isCompare(instr.op)
+				&& fn.instr(fn.operand(v, 0)).type != IRType::String
+				&& uses[v] == 1 && fn.instr(next).op == IROp::Branch
+				&& fn.operand(next, 0) == v;
+		}
+	}
+	std::vector<bool> wanted(count, false);
+	std::vector<bool> calls(count, false);
+	uint32_t stackArgs = 0;
+	for (ValueId v = 0; v < count; v++){
+		const IRInstr& instr = fn.instr(v);
+		wanted[v] = instr.type != IRType::None && !myRemat[v] && !myFused[v]
+			&& uses[v] > 0;
+		calls[v] = instr.op == IROp::Call || instr.op == IROp::Report
+			|| instr.op == IROp::Receive
+			|| ((instr.op == IROp::Eq || instr.op == IROp::Ne)
+				&& fn.instr(fn.operand(v, 0)).type == IRType::String);
+		if (instr.op == IROp::Call && arguments(fn, v) > REG_ARGS){
+			stackArgs = std::max(stackArgs,
+				static_cast<uint32_t>(arguments(fn, v) - REG_ARGS));
+		}
+	}
+	Registers regs;
+	regs.clobbered = { RSI, RDI, R8, R9, R10 };
+	regs.preserved = { RBX, R12, R13, R14, R15, RBP };
+	myAlloc.reset(new LinearScan(fn, regs, wanted, calls));
+
+	const std::vector<uint32_t>& saved = myAlloc->saved();
+	uint32_t pushed = 8 * static_cast<uint32_t>(saved.size());
+	mySpillBase = 8 * stackArgs;
+	myDestSlot = mySpillBase + 8 * myAlloc->spillSlots();
+	myFrameBase = myDestSlot + (returnsRecord(fn) ? 8 : 0);
+	myFrameBytes = myFrameBase + 8 * fn.frameSlots();
+	//Calls are made with rsp on a 16-byte boundary
+	if ((myFrameBytes + pushed + 8) % 16 != 0){ myFrameBytes += 8; }
+	myMaxFrame = std::max(myMaxFrame, myFrameBytes + pushed + 8);
+
+	myOut << "\ncs_f_" << fn.name().str() << ":\n";
+	for (uint32_t reg : saved){ myOut << "\tpushq " << reg64(reg) << "\n"; }
+	if (myFrameBytes > 0){
+		myOut << "\tsubq $" << myFrameBytes << ", %rsp\n";
+	}
+	std::vector<Move> params;
+	uint32_t first = 0;
+	if (returnsRecord(fn)){
+		myOut << "\tmovq %rdi, " << rsp(myDestSlot) << "\n";
+		first = 1;
+	}
+	for (ValueId v : fn.blocks()[0].code){
+		const IRInstr& instr = fn.instr(v);
+		if (instr.op != IROp::Param || !wanted[v]){ continue; }
+		size_t arg = first + static_cast<size_t>(instr.imm);
+		Move m;
+		m.to = place(v);
+		m.from.reg = 0;
+		m.from.disp = 0;
+		if (arg < REG_ARGS){
+			m.from.kind = Place::Kind::Reg;
+			m.from.reg = ARGS[arg];
+		} else {
+			m.from.kind = Place::Kind::Mem;
+			m.from.disp = myFrameBytes + pushed + 8
+				+ 8 * static_cast<int64_t>(arg - REG_ARGS);
+		}
+		params.push_back(m);
+	}
+	parallel(params);
+
+	myTail.str("");
+	for (BlockId b = 0; b < fn.blocks().size(); b++){
+		myOut << label(b) << ":\n";
+		for (ValueId v : fn.blocks()[b].code){ instr(v, b); }
+	}
+	myOut << myTail.str();
+}
+
+void X86Writer::instr(ValueId v, BlockId block){
+	const IRInstr& instr = myFn->instr(v);
+	switch (instr.op){
+	case IROp::Const: case IROp::Param: case IROp::Phi:
+	case IROp::Addr: case IROp::GAddr:
+		//Made where they are used, on the way in, or on the way
+		// into the block
+		return;
+	case IROp::Add: case IROp::Sub: case IROp::Mul: case IROp::Neg:
+	case IROp::Not:
+		arith(v);
+		return;
+	case IROp::Div:
+		divide(v);
+		return;
+	case IROp::Lt: case IROp::Le: case IROp::Gt: case IROp::Ge:
+	case IROp::Eq: case IROp::Ne:
+		if (!myFused[v]){ compare(v); }
+		return;
+	case IROp::Offset:{
+		if (myRemat[v] || myAlloc->where(v).kind == Location::Kind::None){
+			return;
+		}
+		std::string at = address(myFn->operand(v, 0), instr.imm);
+		uint32_t reg = target(v);
+		out() << "\tleaq " << at << ", " << reg64(reg) << "\n";
+		keep(v, reg);
+		return;
+	}
+	case IROp::Load:{
+		if (myAlloc->where(v).kind == Location::Kind::None){ return; }
+		std::string at = address(myFn->operand(v, 0), instr.imm);
+		uint32_t reg = target(v);
+		if (wide(instr.type)){
+			out() << "\tmovq " << at << ", " << reg64(reg) << "\n";
+		} else {
+			out() << "\tmovl " << at << ", " << reg32(reg) << "\n";
+		}
+		keep(v, reg);
+		return;
+	}
+	case IROp::Store:{
+		ValueId value = myFn->operand(v, 1);
+		Place from = place(value);
+		bool wideValue = wide(myFn->instr(value).type);
+		std::string what;
+		if (from.kind == Place::Kind::Reg || from.kind == Place::Kind::Imm){
+			what = from.kind == Place::Kind::Imm ? from.text()
+				: wideValue ? reg64(from.reg) : reg32(from.reg);
+		} else {
+			get(value, RAX);
+			what = wideValue ? "%rax" : "%eax";
+		}
+		std::string at = address(myFn->operand(v, 0), instr.imm);
+		out() << (wideValue ? "\tmovq " : "\tmovl ") << what << ", " << at
+			<< "\n";
+		return;
+	}
+	case IROp::Copy:
+		get(myFn->operand(v, 0), RDX);
+		get(myFn->operand(v, 1), RCX);
+		copy(static_cast<uint32_t>(instr.imm));
+		return;
+	case IROp::Reserve:
+		reserve(myProgram.functions()[static_cast<size_t>(instr.imm)]
+			.decl()->frameSize(), myFn->where(v));
+		return;
+	case IROp::Call:
+		call(v);
+		return;
+	case IROp::Report:{
+		ValueId value = myFn->operand(v, 0);
+		switch (myFn->instr(value).type){
+		case IRType::Int:
+			get(value, RDI);
+			out() << "\tcall cs_report_int\n";
+			return;
+		case IRType::Bool:
+			get(value, RDI);
+			out() << "\tcall cs_report_bool\n";
+			return;
+		default:
+			get(value, RDI);
+			out() << "\tcall cs_report_string\n";
+			return;
+		}
+	}
+	case IROp::Receive:
+		out() << "\tleaq " << prefix(myFn->where(v)) << "(%rip), %rdi\n"
+			<< "\tcall " << (instr.type == IRType::Int ? "cs_receive_int"
+				: instr.type == IRType::Bool ? "cs_receive_bool"
+				: "cs_read_word") << "\n";
+		keep(v, RAX);
+		return;
+	case IROp::Jump:
+		goTo(block, 0);
+		return;
+	case IROp::Branch:
+		branch(v, block);
+		return;
+	case IROp::Return:
+		ret(v);
+		return;
+	case IROp::NoReturn:
+		out() << "\tleaq " << prefix(myFn->where(v)) << "(%rip), %rdi\n"
+			<< "\tleaq .Lmsg_no_return(%rip), %rsi\n"
+			<< "\tcall cs_fail\n";
+		return;
+	}
+	throw new InternalError("Bad IR op");
+}
+
+void X86Writer::arith(ValueId v){
+	const IRInstr& instr = myFn->instr(v);
+	//Worked out in v's register, which none of its operands is in
+	uint32_t reg = target(v);
+	const char * r = reg32(reg);
+	ValueId a = myFn->operand(v, 0);
+	out() << "\tmovl " << src32(a) << ", " << r << "\n";
+	switch (instr.op){
+	case IROp::Not:
+		out() << "\txorl $1, " << r << "\n";
+		break;
+	case IROp::Neg:
+		out() << "\tnegl " << r << "\n"
+			<< "\tjno 1f\n"
+			<< "\tmovl $2147483647, " << r << "\n"
+			<< "1:\n";
+		break;
+	case IROp::Add: case IROp::Sub:{
+		//On overflow the sign of what is left is wrong: saturate
+		// towards the other one
+		out() << (instr.op == IROp::Add ? "\taddl " : "\tsubl ")
+			<< src32(myFn->operand(v, 1)) << ", " << r << "\n"
+			<< "\tjno 1f\n"
+			<< "\tsarl $31, " << r << "\n"
+			<< "\txorl $0x80000000, " << r << "\n"
+			<< "1:\n";
+		break;
+	}
+	case IROp::Mul:{
+		//On overflow, saturate towards the sign of the product
+		std::string b = src32(myFn->operand(v, 1));
+		out() << "\timull " << b << ", " << r << "\n"
+			<< "\tjno 1f\n"
+			<< "\tmovl " << src32(a) << ", " << r << "\n"
+			<< "\txorl " << b << ", " << r << "\n"
+			<< "\tsarl $31, " << r << "\n"
+			<< "\txorl $0x7fffffff, " << r << "\n"
+			<< "1:\n";
+		break;
+	}
+	default:
+		throw new InternalError("Not arithmetic");
+	}
+	keep(v, reg);
+}
+
+void X86Writer::divide(ValueId v){
+	ValueId b = myFn->operand(v, 1);
+	std::string zero = fail(myFn->where(v), ".Lmsg_div");
+	Place divisor = place(b);
+	if (divisor.kind == Place::Kind::Imm && divisor.disp == 0){
+		out() << "\tjmp " << zero << "\n";
+		return;
+	}
+	out() << "\tmovl " << src32(b) << ", %ecx\n";
+	if (divisor.kind != Place::Kind::Imm){
+		out() << "\ttestl %ecx, %ecx\n"
+			<< "\tje " << zero << "\n";
+	}
+	out() << "\tmovl " << src32(myFn->operand(v, 0)) << ", %eax\n";
+	//idiv traps on INT_MIN / -1, which saturates; any other x / -1
+	// is -x
+	bool minusOne = divisor.kind == Place::Kind::Imm && divisor.disp == -1;
+	if (divisor.kind != Place::Kind::Imm){
+		out() << "\tcmpl $-1, %ecx\n"
+			<< "\tjne 1f\n";
+	}
+	if (divisor.kind != Place::Kind::Imm || minusOne){
+		out() << "\tnegl %eax\n"
+			<< "\tjno 2f\n"
+			<< "\tmovl $2147483647, %eax\n"
+			<< "\tjmp 2f\n";
+	}
+	if (!minusOne){
+		out() << "1:\n"
+			<< "\tcltd\n"
+			<< "\tidivl %ecx\n";
+	}
+	out() << "2:\n";
+	keep(v, RAX);
+}
+
+const char * X86Writer::flags(ValueId v){
+	const IRInstr& instr = myFn->instr(v);
+	Place a = place(myFn->operand(v, 0));
+	std::string left;
+	if (a.kind == Place::Kind::Reg){
+		left = reg32(a.reg);
+	} else {
+		out() << "\tmovl " << src32(myFn->operand(v, 0)) << ", %eax\n";
+		left = "%eax";
+	}
+	out() << "\tcmpl " << src32(myFn->operand(v, 1)) << ", " << left << "\n";
+	return condition(instr.op);
+}
+
+void X86Writer::compare(ValueId v){
+	const IRInstr& instr = myFn->instr(v);
+	ValueId a = myFn->operand(v, 0);
+	if (myFn->instr(a).type == IRType::String){
+		std::vector<Move> moves(2);
+		moves[0].to.kind = moves[1].to.kind = Place::Kind::Reg;
+		moves[0].to.reg = RDI;
+		moves[1].to.reg = RSI;
+		moves[0].to.disp = moves[1].to.disp = 0;
+		moves[0].from = place(a);
+		moves[1].from = place(myFn->operand(v, 1));
+		parallel(moves);
+		out() << "\tcall cs_streq\n";
+		if (instr.op == IROp::Ne){ out() << "\txorl $1, %eax\n"; }
+		keep(v, RAX);
+		return;
+	}
+	const char * cc = flags(v);
+	uint32_t reg = target(v);
+	out() << "\tset" << cc << " %al\n"
+		<< "\tmovzbl %al, " << reg32(reg) << "\n";
+	keep(v, reg);
+}
+
+void X86Writer::reserve(uint32_t slots, const Position& pos){
+	//The checks Interpreter::reserve makes
+	std::string overflow = fail(pos, ".Lmsg_overflow");
+	out() << "\tmovq cs_used(%rip), %rax\n"
+		<< "\taddq $" << slots << ", %rax\n"
+		<< "\tcmpq $" << FRAME_SLOTS << ", %rax\n"
+		<< "\tja " << overflow << "\n"
+		<< "\tcmpl $" << MAX_CALL_DEPTH << ", cs_depth(%rip)\n"
+		<< "\tje " << overflow << "\n"
+		<< "\tmovq %rax, cs_used(%rip)\n";
+}
+
+void X86Writer::call(ValueId v){
+	const IRInstr& instr = myFn->instr(v);
+	const IRFunction& callee
+		= myProgram.functions()[static_cast<size_t>(instr.imm)];
+	uint32_t slots = callee.decl()->frameSize();
+	if (!reserved(*myFn, v)){ reserve(slots, myFn->where(v)); }
+	std::vector<Move> moves;
+	for (uint32_t i = 0; i < arguments(*myFn, v); i++){
+		Move m;
+		m.from = place(myFn->operand(v, i));
+		m.to.reg = 0;
+		m.to.disp = 0;
+		if (i < REG_ARGS){
+			m.to.kind = Place::Kind::Reg;
+			m.to.reg = ARGS[i];
+		} else {
+			m.to.kind = Place::Kind::Mem;
+			m.to.disp = 8 * static_cast<int64_t>(i - REG_ARGS);
+		}
+		moves.push_back(m);
+	}
+	parallel(moves);
+	out() << "\tincl cs_depth(%rip)\n"
+		<< "\tcall cs_f_" << callee.name().str() << "\n"
+		<< "\tdecl cs_depth(%rip)\n"
+		<< "\tsubq $" << slots << ", cs_used(%rip)\n";
+	keep(v, RAX);
+}
+
+void X86Writer::copy(uint32_t slots){
+	//From the slots at rcx to those at rdx
+	if (slots <= 8){
+		for (uint32_t i = 0; i < slots; i++){
+			out() << "\tmovq " << 8 * i << "(%rcx), %r11\n"
+				<< "\tmovq %r11, " << 8 * i << "(%rdx)\n";
+		}
+		return;
+	}
+	out() << "\tmovl $" << slots << ", %eax\n"
+		<< "1:\n"
+		<< "\tmovq -8(%rcx,%rax,8), %r11\n"
+		<< "\tmovq %r11, -8(%rdx,%rax,8)\n"
+		<< "\tdecq %rax\n"
+		<< "\tjnz 1b\n";
+}
+
+void X86Writer::edge(BlockId block, size_t succ){
+	const IRBlock& from = myFn->blocks()[block];
+	BlockId to = from.succs[succ];
+	const IRBlock& into = myFn->blocks()[to];
+	size_t pred = static_cast<size_t>(std::find(into.preds.begin(),
+		into.preds.end(), block) - into.preds.begin());
+	std::vector<Move> moves;
+	for (ValueId phi : into.phis){
+		if (myAlloc->where(phi).kind == Location::Kind::None){ continue; }
+		Move m;
+		m.to = place(phi);
+		m.from = place(myFn->operand(phi, pred));
+		moves.push_back(m);
+	}
+	parallel(moves);
+}
+
+void X86Writer::goTo(BlockId block, size_t succ){
+	edge(block, succ);
+	BlockId to = myFn->blocks()[block].succs[succ];
+	if (to != block + 1){ out() << "\tjmp " << label(to) << "\n"; }
+}
+
+void X86Writer::branch(ValueId v, BlockId block){
+	const IRBlock& here = myFn->blocks()[block];
+	ValueId cond = myFn->operand(v, 0);
+	const char * cc;
+	if (myFused[cond]){
+		cc = flags(cond);
+	} else {
+		Place p = place(cond);
+		if (p.kind == Place::Kind::Imm){
+			goTo(block, p.disp != 0 ? 0 : 1);
+			return;
+		}
+		if (p.kind == Place::Kind::Reg){
+			out() << "\ttestl " << reg32(p.reg) << ", " << reg32(p.reg) << "\n";
+		} else {
+			out() << "\tcmpl $0, " << p.text() << "\n";
+		}
+		cc = "ne";
+	}
+	//Jump on cc to one successor and go on to the other, the next
+	// block if either is
+	size_t jump = 0;
+	if (here.succs[0] == block + 1 && here.succs[1] != block + 1){
+		jump = 1;
+		cc = invert(cc);
+	}
+	BlockId to = here.succs[jump];
+	if (myFn->blocks()[to].phis.empty()){
+		out() << "\tj" << cc << " " << label(to) << "\n";
+	} else {
+		//The moves onto that edge go in a stub of their own
+		std::string stub = newLabel();
+		out() << "\tj" << cc << " " << stub << "\n";
+		myAt = &myTail;
+		out() << stub << ":\n";
+		edge(block, jump);
+		out() << "\tjmp " << label(to) << "\n";
+		myAt = &myOut;
+	}
+	goTo(block, 1 - jump);
+}
+
+void X86Writer::ret(ValueId v){
+	const IRInstr& instr = myFn->instr(v);
+	if (instr.count > 0){
+		ValueId value = myFn->operand(v, 0);
+		if (returnsRecord(*myFn)){
+			get(value, RCX);
+			out() << "\tmovq " << rsp(myDestSlot) << ", %rdx\n";
+			copy(FrameLayout::slotsFor(myFn->decl()->retType()));
+			out() << "\tmovq %rdx, %rax\n";
+		} else {
+			get(value, RAX);
+		}
+	}
+	if (myFrameBytes > 0){
+		out() << "\taddq $" << myFrameBytes << ", %rsp\n";
+	}
+	const std::vector<uint32_t>& saved = myAlloc->saved();
+	for (size_t i = saved.size(); i-- > 0;){
+		out() << "\tpopq " << reg64(saved[i]) << "\n";
+	}
+	out() << "\tret\n";
+}
+
+void X86Writer::entry(FnDeclNode * main){
+	//A stack for the program, as deep as the interpreter lets calls
+	// go, and room for the runtime's calls below the deepest
+	uint64_t stack = MAX_CALL_DEPTH * static_cast<uint64_t>(myMaxFrame)
+		+ (1 << 20);
+	std::string pos = prefix(main->pos());
+	myOut << "\n\t.globl main\n"
+		<< "main:\n"
+		<< "\tpushq %rbx\n";
+	if (main->frameSize() > FRAME_SLOTS){
+		myOut << "\tjmp 1f\n";
+	}
+	myOut << "\txorl %edi, %edi\n"
+		<< "\tmovabsq $" << stack << ", %rsi\n"
+		<< "\tmovl $3, %edx\n"                  // PROT_READ | PROT_WRITE
+		<< "\tmovl $0x4022, %ecx\n"             // MAP_PRIVATE | MAP_ANONYMOUS
+		<< "\tmovl $-1, %r8d\n"                 //  | MAP_NORESERVE
+		<< "\txorl %r9d, %r9d\n"
+		<< "\tcall mmap@PLT\n"
+		<< "\tcmpq $-1, %rax\n"
+		<< "\tje 1f\n"
+		<< "\tmovabsq $" << stack << ", %rcx\n"
+		<< "\tleaq (%rax,%rcx), %rsp\n"
+		<< "\tmovq $" << main->frameSize() << ", cs_used(%rip)\n"
+		<< "\tmovl $1, cs_depth(%rip)\n"
+		<< "\tcall cs_f_" << main->id()->getName().str() << "\n"
+		<< "\txorl %edi, %edi\n"
+		<< "\tcall exit@PLT\n"
+		<< "1:\n"
+		<< "\tleaq " << pos << "(%rip), %rdi\n"
+		<< "\tleaq .Lmsg_overflow(%rip), %rsi\n"
+		<< "\tcall cs_fail\n";
+}
+
+void X86Writer::write(FnDeclNode * main){
+	myOut << "\t.text\n";
+	for (size_t i = 0; i < myProgram.functions().size(); i++){
+		function(i);
+	}
+	entry(main);
+	myOut << RUNTIME;
+
+	myOut << "\n\t.section .rodata\n";
+	for (size_t i = 0; i < myStrings.size(); i++){
+		if (!myStrings[i]){ continue; }
+		myOut << ".Lstr" << i << ":\n\t.string ";
+		quote(myOut, myProgram.string(static_cast<int32_t>(i)).str());
+		myOut << "\n";
+	}
+	for (const auto& pos : myPrefixOrder){
+		myOut << pos.first << ":\n\t.string ";
+		quote(myOut, pos.second);
+		myOut << "\n";
+	}
+	myOut << RUNTIME_DATA;
+
+	//The globals, each slot as the interpreter starts it: 0, false or
+	// the empty string
+	std::vector<bool> strings(myProgram.globalSlots(), false);
+	for (VarDeclNode * global : myProgram.globals()){
+		FrameLayout::eachScalar(global->type(), global->slot(),
+			[&](uint32_t slot, Type kind){ strings[slot] = kind.isString(); });
+	}
+	myOut << "\n\t.section .data.rel.local,\"aw\"\n\t.p2align 3\ncs_globals:\n";
+	for (bool isString : strings){
+		myOut << (isString ? "\t.quad cs_empty\n" : "\t.quad 0\n");
+	}
+	myOut << "\t.quad 0\n";
+	myOut << "\n\t.section .note.GNU-stack,\"\",@progbits\n";
+	myOut.flush();
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef CSHANTY_X86_H
+#define CSHANTY_X86_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ir.hpp"
+#include "regalloc.hpp"
+
+namespace cshanty{
+
+class FnDeclNode;
+
+/**
+* \class X86Writer
+* Compiles an IRProgram to x86-64 assembly for the GNU assembler, one
+* function at a time, its values in the registers LinearScan gives
+* them (see x86.cpp). What it writes is a whole program: the globals,
+* the strings, a small runtime that report and receive call, and a
+* main that runs the program's, to be linked with cc. The program
+* runs as the interpreter would run it, down to where and how it
+* fails.
+**/
+class X86Writer{
+public:
+	X86Writer(const IRProgram& program, std::ostream& out);
+
+	/** Write the program, main being the function it runs **/
+	void write(FnDeclNode * main);
+private:
+	/** Where a value is, or how to make it where it isn't kept **/
+	struct Place{
+		enum class Kind : uint8_t{ Reg, Mem, Imm, Lea };
+		Kind kind;
+		uint32_t reg;
+		//Mem and Lea: disp(%rsp), or sym+disp(%rip) if sym is set;
+		// Imm: $disp
+		std::string sym;
+		int64_t disp;
+
+		std::string text() const;
+		bool operator==(const Place& other) const;
+	};
+	struct Move{
+		Place to;
+		Place from;
+	};
+
+	void function(size_t index);
+	void instr(ValueId v, BlockId block);
+	void arith(ValueId v);
+	void divide(ValueId v);
+	void compare(ValueId v);
+	/** Set the flags for compare v; returns the condition that holds
+	    if it is true **/
+	const char * flags(ValueId v);
+	void call(ValueId v);
+	void branch(ValueId v, BlockId block);
+	void ret(ValueId v);
+	/** The moves onto succs[succ] of block, then the jump there if
+	    it isn't next **/
+	void goTo(BlockId block, size_t succ);
+	void edge(BlockId block, size_t succ);
+	void reserve(uint32_t slots, const Position& pos);
+	void copy(uint32_t slots);
+	void entry(FnDeclNode * main);
+
+	Place place(ValueId v);
+	/** The register v is made in: its own, else rax **/
+	uint32_t target(ValueId v);
+	/** Keep what v was made in reg wherever v is kept **/
+	void keep(ValueId v, uint32_t reg);
+	/** v in reg **/
+	void get(ValueId v, uint32_t reg);
+	/** v as a 32-bit source operand **/
+	std::string src32(ValueId v);
+	/** The address slots slots past address v, as an operand **/
+	std::string address(ValueId v, int32_t slots);
+	void move(const Place& to, const Place& from);
+	void parallel(std::vector<Move> moves);
+
+	std::string label(BlockId block) const;
+	std::string newLabel();
+	/** A stub at the end of the function that fails at pos **/
+	std::string fail(const Position& pos, const char * msg);
+	std::string prefix(const Position& pos);
+	std::string string(int32_t index);
+	std::ostream& out(){ return *myAt; }
+
+	const IRProgram& myProgram;
+	std::ostream& myOut;
+	//Where instructions go: the function's text, or its tail of stubs
+	std::ostream * myAt;
+	std::ostringstream myTail;
+
+	//The function being written
+	const IRFunction * myFn;
+	size_t myIndex;
+	std::unique_ptr<LinearScan> myAlloc;
+	std::vector<bool> myRemat;
+	std::vector<bool> myFused;
+	uint32_t mySpillBase;
+	uint32_t myDestSlot;
+	uint32_t myFrameBase;
+	uint32_t myFrameBytes;
+	uint32_t myLabels;
+
+	//What every function shares: the biggest frame, the texts of
+	// the failure prefixes and the strings used
+	uint32_t myMaxFrame;
+	std::unordered_map<std::string, std::string> myPrefixes;
+	std::vector<std::pair<std::string, std::string>> myPrefixOrder;
+	std::vector<bool> myStrings;
+};
+
+}
+
+#endif